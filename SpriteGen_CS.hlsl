@@ -1,5 +1,12 @@
 #define THREAD_GROUP_SIZE 1024
 #define CULL_OFFSET 0
+#define SPRITE_MESH_VERTEX_COUNT 8
+#define SPRITE_INDEX_COUNT ((SPRITE_MESH_VERTEX_COUNT - 2) * 3)
+#define TEXTURE_ID_MESH_SHIFT 12
+#define TEXTURE_ID_INDEX_MASK ((1u << TEXTURE_ID_MESH_SHIFT) - 1)
+// Same order as ni::FrameGpuCounter.
+#define FRAME_GPU_COUNTER_SPRITES_DRAWN 0
+#define FRAME_GPU_COUNTER_SPRITES_CULLED 1
 
 struct DrawCommand {
     float4 image;
@@ -16,7 +23,11 @@ struct SpriteVertex {
 };
 
 struct SpriteQuad {
-    SpriteVertex vertices[6];
+    SpriteVertex vertices[SPRITE_MESH_VERTEX_COUNT];
+};
+
+struct SpriteMesh {
+    float2 vertices[SPRITE_MESH_VERTEX_COUNT];
 };
 
 cbuffer ConstantData : register(b0) {
@@ -26,9 +37,10 @@ cbuffer ConstantData : register(b0) {
 };
 
 struct Draw {
-    uint vertexCountPerInstance;
+    uint indexCountPerInstance;
     uint instanceCount;
-    uint startVertexLocation;
+    uint startIndexLocation;
+    int baseVertexLocation;
     uint startInstanceLocation;
 };
 
@@ -39,6 +51,8 @@ struct IndirectCommand {
 RWStructuredBuffer<DrawCommand> drawCommands : register(u0);
 RWStructuredBuffer<SpriteQuad> spriteVertices : register(u1);
 RWStructuredBuffer<IndirectCommand> indirectCommands : register(u2);
+RWStructuredBuffer<SpriteMesh> spriteMeshes : register(u5);
+RWStructuredBuffer<uint> frameCounters : register(u6);
 
 float2 transform(float2 position, DrawCommand cmd) {
     float2 v = position;
@@ -64,24 +78,40 @@ bool isQuadVisible(float2 v0, float2 v1, float2 v2, float2 v3) {
 [numthreads(THREAD_GROUP_SIZE, 1, 1)]
 void main(uint3 dispatchThreadId : SV_DispatchThreadID) {
     uint drawCmdIndex = dispatchThreadId.x;
+    // The views span the whole buffers, past the end are stale commands of earlier frames.
+    if (drawCmdIndex >= totalDrawCmds) {
+        return;
+    }
     DrawCommand cmd = drawCommands[drawCmdIndex];
     float4 image = cmd.image;
     float2 v0 = transform(image.xy, cmd);
     float2 v1 = transform(float2(image.x, image.y + image.w), cmd);
     float2 v2 = transform(float2(image.x + image.z, image.y + image.w), cmd);
     float2 v3 = transform(float2(image.x + image.z, image.y), cmd);
-    float visible = float(isQuadVisible(v0, v1, v2, v3));
-    SpriteVertex sv0 = { v0 * visible, float2(0, 0), cmd.color, cmd.textureId };
-    SpriteVertex sv1 = { v1 * visible, float2(0, 1), cmd.color, cmd.textureId };
-    SpriteVertex sv2 = { v2 * visible, float2(1, 1), cmd.color, cmd.textureId };
-    SpriteVertex sv3 = { v3 * visible, float2(1, 0), cmd.color, cmd.textureId };
+    bool isVisible = isQuadVisible(v0, v1, v2, v3);
+    float visible = float(isVisible);
+    // One atomic per wave instead of one per sprite.
+    uint drawnNum = WaveActiveCountBits(isVisible);
+    uint culledNum = WaveActiveCountBits(!isVisible);
+    if (WaveIsFirstLane()) {
+        InterlockedAdd(frameCounters[FRAME_GPU_COUNTER_SPRITES_DRAWN], drawnNum);
+        InterlockedAdd(frameCounters[FRAME_GPU_COUNTER_SPRITES_CULLED], culledNum);
+    }
+    // Emit the alpha trimmed mesh of the image instead of the full quad. The index buffer
+    // triangulates it as a fan from the first vertex.
+    SpriteMesh mesh = spriteMeshes[cmd.textureId >> TEXTURE_ID_MESH_SHIFT];
     SpriteQuad quad;
-    quad.vertices[0] = sv0;
-    quad.vertices[1] = sv1;
-    quad.vertices[2] = sv2;
-    quad.vertices[3] = sv0;
-    quad.vertices[4] = sv2;
-    quad.vertices[5] = sv3;
+    [unroll]
+    for (uint index = 0; index < SPRITE_MESH_VERTEX_COUNT; ++index) {
+        float2 texCoord = mesh.vertices[index];
+        float2 position = transform(image.xy + texCoord * image.zw, cmd);
+        SpriteVertex vertex = { position * visible, texCoord, cmd.color, cmd.textureId & TEXTURE_ID_INDEX_MASK };
+        quad.vertices[index] = vertex;
+    }
     spriteVertices[drawCmdIndex] = quad;
-    InterlockedAdd(indirectCommands[0].draw.vertexCountPerInstance, 6);
+    // One instance of the SPRITE_INDEX_COUNT index fan per sprite, the count comes preset in the arguments.
+    uint spriteNum = WaveActiveCountBits(true);
+    if (WaveIsFirstLane()) {
+        InterlockedAdd(indirectCommands[0].draw.instanceCount, spriteNum);
+    }
 }
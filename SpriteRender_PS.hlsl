@@ -1,5 +1,5 @@
 Texture2D<float4> mainTexture[] : register(t0);
-SamplerState samplerPoint  : register(s0);
+SamplerState samplerLinear : register(s0);
 
 struct PixelVertex {
 	float4 position : SV_POSITION;
@@ -19,7 +19,7 @@ PixelOutput main(PixelVertex vtx) {
 		discard;
 		return output;
 	}
-	float4 color = mainTexture[textureId & 0xfff].SampleLevel(samplerPoint, vtx.texCoord, 0);
+	float4 color = mainTexture[textureId & 0xfff].Sample(samplerLinear, vtx.texCoord);
 	if (color.a == 0.0) {
 		discard;
 		return output;
@@ -1,11 +1,20 @@
-const float2 resolution : register(b0);
+#define SPRITE_MESH_VERTEX_COUNT 8
+
+cbuffer ConstantData : register(b0) {
+	float2 resolution;
+};
 
 struct SpriteVertex {
-	float2 position : POSITION0;
-	float2 texCoord : TEXCOORD0;
-	nointerpolation float4 color : COLOR0;
-	nointerpolation uint textureId : TEXCOORD1;
+	float2 position;
+	float2 texCoord;
+	uint color;
+	uint textureId;
 };
+
+struct SpriteQuad {
+	SpriteVertex vertices[SPRITE_MESH_VERTEX_COUNT];
+};
+
 struct PixelVertex {
 	float4 position : SV_POSITION;
 	float2 texCoord : TEXCOORD0;
@@ -13,12 +22,16 @@ struct PixelVertex {
 	nointerpolation uint textureId : TEXCOORD1;
 };
 
-PixelVertex main(SpriteVertex vtx) {
+// Written by SpriteGen. One instance per sprite, the index buffer is a single fan over its vertices.
+StructuredBuffer<SpriteQuad> spriteVertices : register(t0, space1);
+
+PixelVertex main(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID) {
+	SpriteVertex vtx = spriteVertices[instanceId].vertices[vertexId];
 	PixelVertex vtxOut;
 	vtxOut.position = float4((vtx.position * resolution) * 2.0 - 1, 0, 1);
 	vtxOut.position.y = -vtxOut.position.y;
 	vtxOut.texCoord = vtx.texCoord;
-	vtxOut.color = vtx.color;
+	vtxOut.color = float4(vtx.color & 0xff, (vtx.color >> 8) & 0xff, (vtx.color >> 16) & 0xff, vtx.color >> 24) / 255.0;
 	vtxOut.textureId = vtx.textureId;
 	return vtxOut;
-}
\ No newline at end of file
+}
@@ -0,0 +1,101 @@
+#include "asset_pack.h"
+#include "texture_compression.h"
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(ni::AssetPackHeader) == 24, "Asset pack header layout changed, bump NI_ASSET_PACK_VERSION");
+static_assert(sizeof(ni::AssetPackTexture) == 104, "Asset pack texture layout changed, bump NI_ASSET_PACK_VERSION");
+
+ni::AssetPack::AssetPack(const char* path) : file(path) {
+    if (!file.isValid()) {
+        NI_LOG("Failed to open asset pack %s", path);
+        return;
+    }
+    const AssetPackHeader* packHeader = (const AssetPackHeader*)*file;
+    if (file.getSize() < sizeof(AssetPackHeader) || packHeader->magic != NI_ASSET_PACK_MAGIC || packHeader->version != NI_ASSET_PACK_VERSION) {
+        NI_LOG("Asset pack %s is invalid or was built by a different AssetPacker version", path);
+        return;
+    }
+    if (packHeader->fileSize != file.getSize() || sizeof(AssetPackHeader) + packHeader->textureNum * sizeof(AssetPackTexture) > file.getSize()) {
+        NI_LOG("Asset pack %s is truncated", path);
+        return;
+    }
+    textures = (const AssetPackTexture*)offsetPtr((void*)packHeader, sizeof(AssetPackHeader));
+    // Entries come from a file, so nothing in them is trusted. The range check is written so it can't overflow,
+    // and names are used as C strings, so they have to end within their field.
+    for (uint32_t index = 0; index < packHeader->textureNum; ++index) {
+        const AssetPackTexture& texture = textures[index];
+        if (texture.dataOffset > file.getSize() || texture.dataSize > file.getSize() - texture.dataOffset) {
+            NI_LOG("Asset pack %s is truncated", path);
+            textures = nullptr;
+            return;
+        }
+        if (memchr(texture.name, '\0', NI_ASSET_PACK_NAME_MAX) == nullptr) {
+            NI_LOG("Asset pack %s has a texture name without a terminator", path);
+            textures = nullptr;
+            return;
+        }
+    }
+    header = packHeader;
+}
+
+const ni::AssetPackTexture& ni::AssetPack::getTexture(uint32_t index) const {
+    NI_ASSERT(index < header->textureNum, "Index out of bounds");
+    return textures[index];
+}
+
+const ni::AssetPackTexture* ni::AssetPack::findTexture(const char* name) const {
+    for (uint32_t index = 0; index < header->textureNum; ++index) {
+        if (strncmp(textures[index].name, name, NI_ASSET_PACK_NAME_MAX) == 0) {
+            return &textures[index];
+        }
+    }
+    return nullptr;
+}
+
+const void* ni::AssetPack::getTextureData(const AssetPackTexture& texture) const {
+    return offsetPtr((void*)*file, (intptr_t)texture.dataOffset);
+}
+
+ni::Texture* ni::AssetPack::createTexture(const wchar_t* name, const AssetPackTexture& texture) const {
+    Texture* result = createTextureFromFootprints(name, texture.width, texture.height, texture.mipLevels, (DXGI_FORMAT)texture.format, getTextureData(texture), (size_t)texture.dataSize);
+    result->assetName = texture.name;
+    return result;
+}
+
+ni::Texture* ni::AssetPack::streamTexture(const wchar_t* name, const AssetPackTexture& texture) const {
+    Texture* result = ni::streamTexture(name, texture.width, texture.height, texture.mipLevels, (DXGI_FORMAT)texture.format, getTextureData(texture), (size_t)texture.dataSize);
+    result->assetName = texture.name;
+    return result;
+}
+
+void* ni::AssetPack::decodeTexture(const AssetPackTexture& texture) const {
+    DXGI_FORMAT format = (DXGI_FORMAT)texture.format;
+    NI_ASSERT(format == DXGI_FORMAT_R8G8B8A8_UNORM || isBlockCompressed(format), "Can't decode %s, format %u", texture.name, texture.format);
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+    uint32_t numRows[D3D12_REQ_MIP_LEVELS] = {};
+    uint64_t rowSizeInBytes[D3D12_REQ_MIP_LEVELS] = {};
+    getTextureFootprints(texture.width, texture.height, texture.mipLevels, format, layouts, numRows, rowSizeInBytes);
+    uint8_t* mipChain = (uint8_t*)malloc(getMipChainSize(texture.width, texture.height, texture.mipLevels, DXGI_FORMAT_R8G8B8A8_UNORM));
+    // Blocks of one level with the pitch padding removed.
+    uint8_t* blocks = isBlockCompressed(format) ? (uint8_t*)malloc((size_t)rowSizeInBytes[0] * numRows[0]) : nullptr;
+    const uint8_t* data = (const uint8_t*)getTextureData(texture);
+    uint8_t* dst = mipChain;
+    uint32_t mipWidth = texture.width;
+    uint32_t mipHeight = texture.height;
+    for (uint32_t mip = 0; mip < texture.mipLevels; ++mip) {
+        const uint8_t* src = data + layouts[mip].Offset;
+        uint8_t* rows = blocks != nullptr ? blocks : dst;
+        for (uint32_t row = 0; row < numRows[mip]; ++row) {
+            memcpy(rows + (size_t)row * rowSizeInBytes[mip], src + (size_t)row * layouts[mip].Footprint.RowPitch, (size_t)rowSizeInBytes[mip]);
+        }
+        if (blocks != nullptr) {
+            decompressTexture(blocks, mipWidth, mipHeight, format, dst);
+        }
+        dst += (size_t)mipWidth * mipHeight * 4;
+        mipWidth = mipWidth > 1 ? mipWidth >> 1 : 1;
+        mipHeight = mipHeight > 1 ? mipHeight >> 1 : 1;
+    }
+    free(blocks);
+    return mipChain;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ni.h"
+#include "sprite_mesh.h"
+
+// Binary sprite pack written by AssetPacker. Layout:
+//   AssetPackHeader
+//   AssetPackTexture[textureNum]
+//   texture blobs, each aligned to D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+// Blobs are stored exactly as GetCopyableFootprints lays them out in an upload buffer (rows padded to
+// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT), so loading is a single memcpy from the mapped file.
+#define NI_ASSET_PACK_MAGIC 0x4b50494e // 'NIPK'
+// 2: bounds are padded by the filter footprint, see SPRITE_MESH_MAX_FILTER_MIP.
+#define NI_ASSET_PACK_VERSION 2
+#define NI_ASSET_PACK_NAME_MAX 32
+
+namespace ni {
+
+	struct AssetPackHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t textureNum;
+		uint32_t reserved;
+		uint64_t fileSize;
+	};
+
+	struct AssetPackTexture {
+		char name[NI_ASSET_PACK_NAME_MAX];
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		uint32_t format;
+		uint64_t dataOffset;
+		uint64_t dataSize;
+		// Opaque bounds of the unpadded source image, used to build the sprite mesh.
+		SpriteBounds bounds;
+		uint32_t reserved;
+	};
+
+	struct AssetPackSource {
+		const char* name;
+		const void* pixels;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	struct AssetPack {
+		AssetPack(const char* path);
+		~AssetPack() {}
+
+		bool isValid() const { return header != nullptr; }
+		uint32_t getTextureNum() const { return header->textureNum; }
+		const AssetPackTexture& getTexture(uint32_t index) const;
+		const AssetPackTexture* findTexture(const char* name) const;
+		const void* getTextureData(const AssetPackTexture& texture) const;
+		Texture* createTexture(const wchar_t* name, const AssetPackTexture& texture) const;
+		// Uploads in the background. The pack has to outlive the upload.
+		Texture* streamTexture(const wchar_t* name, const AssetPackTexture& texture) const;
+		// Decodes the texels into a tightly packed 8 bit RGBA mip chain, the layout SoftwareRasterizer samples.
+		// The caller frees it.
+		void* decodeTexture(const AssetPackTexture& texture) const;
+
+	private:
+		MappedFile file;
+		const AssetPackHeader* header = nullptr;
+		const AssetPackTexture* textures = nullptr;
+	};
+
+	// Encodes the 8 bit RGBA sources into format and writes the pack. Used by AssetPacker.
+	bool writeAssetPack(const char* path, const AssetPackSource* sources, uint32_t sourceNum, DXGI_FORMAT format, bool generateMips);
+}
@@ -0,0 +1,67 @@
+#include "asset_pack.h"
+#include "texture_compression.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Kept apart from the loader in asset_pack.cpp, so AssetPacker builds without the renderer.
+
+bool ni::writeAssetPack(const char* path, const AssetPackSource* sources, uint32_t sourceNum, DXGI_FORMAT format, bool generateMips) {
+    AssetPackTexture* textures = (AssetPackTexture*)calloc(sourceNum, sizeof(AssetPackTexture));
+    CompressedMipChain* mipChains = (CompressedMipChain*)calloc(sourceNum, sizeof(CompressedMipChain));
+    NI_ASSERT(textures != nullptr && mipChains != nullptr, "Failed to allocate asset pack entries");
+
+    uint64_t fileSize = sizeof(AssetPackHeader) + sourceNum * sizeof(AssetPackTexture);
+    for (uint32_t index = 0; index < sourceNum; ++index) {
+        const AssetPackSource& source = sources[index];
+        NI_ASSERT(strlen(source.name) < NI_ASSET_PACK_NAME_MAX, "Asset name %s is too long", source.name);
+        mipChains[index] = compressMipChain(source.pixels, source.width, source.height, format, generateMips);
+        AssetPackTexture& texture = textures[index];
+        strncpy(texture.name, source.name, NI_ASSET_PACK_NAME_MAX - 1);
+        texture.width = mipChains[index].width;
+        texture.height = mipChains[index].height;
+        texture.mipLevels = mipChains[index].mipLevels;
+        texture.format = (uint32_t)format;
+        texture.dataOffset = alignSize(fileSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+        texture.dataSize = getTextureFootprints(texture.width, texture.height, texture.mipLevels, format, nullptr, nullptr, nullptr);
+        texture.bounds = computeSpriteBounds(source.pixels, source.width, source.height);
+        fileSize = texture.dataOffset + texture.dataSize;
+    }
+
+    uint8_t* buffer = (uint8_t*)calloc((size_t)fileSize, 1);
+    NI_ASSERT(buffer != nullptr, "Failed to allocate asset pack");
+    AssetPackHeader* header = (AssetPackHeader*)buffer;
+    header->magic = NI_ASSET_PACK_MAGIC;
+    header->version = NI_ASSET_PACK_VERSION;
+    header->textureNum = sourceNum;
+    header->fileSize = fileSize;
+    memcpy(buffer + sizeof(AssetPackHeader), textures, sourceNum * sizeof(AssetPackTexture));
+
+    // Pitch every level the way the upload buffer expects it.
+    for (uint32_t index = 0; index < sourceNum; ++index) {
+        const AssetPackTexture& texture = textures[index];
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+        uint32_t numRows[D3D12_REQ_MIP_LEVELS] = {};
+        uint64_t rowSizeInBytes[D3D12_REQ_MIP_LEVELS] = {};
+        getTextureFootprints(texture.width, texture.height, texture.mipLevels, format, layouts, numRows, rowSizeInBytes);
+        const uint8_t* srcMip = (const uint8_t*)mipChains[index].data;
+        for (uint32_t mip = 0; mip < texture.mipLevels; ++mip) {
+            uint8_t* dstMip = buffer + texture.dataOffset + layouts[mip].Offset;
+            for (uint32_t row = 0; row < numRows[mip]; ++row) {
+                memcpy(dstMip + (size_t)row * layouts[mip].Footprint.RowPitch, srcMip + (size_t)row * rowSizeInBytes[mip], (size_t)rowSizeInBytes[mip]);
+            }
+            srcMip += (size_t)rowSizeInBytes[mip] * numRows[mip];
+        }
+        free(mipChains[index].data);
+    }
+
+    bool success = writeFile(path, buffer, (size_t)fileSize);
+    if (success) {
+        NI_LOG("Wrote %u textures to %s (%.2f MB)", sourceNum, path, (double)fileSize / (1024.0 * 1024.0));
+    } else {
+        NI_LOG("Failed to write asset pack %s", path);
+    }
+    free(buffer);
+    free(mipChains);
+    free(textures);
+    return success;
+}
@@ -0,0 +1,59 @@
+
+#include "ni.h"
+#include "images.h"
+#include "asset_pack.h"
+#include "texture_compression.h"
+#include "async_loader.h"
+#include <string.h>
+
+// Offline tool that cooks the images.h sprites into sprites.pack. Runs as a post build step.
+// Usage: AssetPacker [output path] [--format rgba8|bc1|bc3|bc7] [--no-mips] [--bench-bc]
+
+static DXGI_FORMAT parseFormat(const char* name) {
+    if (strcmp(name, "rgba8") == 0) return DXGI_FORMAT_R8G8B8A8_UNORM;
+    if (strcmp(name, "bc1") == 0) return DXGI_FORMAT_BC1_UNORM;
+    if (strcmp(name, "bc3") == 0) return DXGI_FORMAT_BC3_UNORM;
+    if (strcmp(name, "bc7") == 0) return DXGI_FORMAT_BC7_UNORM;
+    NI_PANIC("Unknown texture format %s", name);
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+int main(int argc, char** argv) {
+    const ni::AssetPackSource sources[] = {
+        { "image1", image_img1, image_img1_width, image_img1_height },
+        { "image2", image_img2, image_img2_width, image_img2_height },
+        { "image3", image_img3, image_img3_width, image_img3_height },
+        { "image4", image_img4, image_img4_width, image_img4_height }
+    };
+    const uint32_t sourceNum = sizeof(sources) / sizeof(sources[0]);
+
+    const char* outputPath = "sprites.pack";
+    DXGI_FORMAT format = DXGI_FORMAT_BC7_UNORM;
+    bool generateMips = true;
+    // compressTexture splits the block rows over the loader threads.
+    ni::initLoaderThreads(0);
+    for (int index = 1; index < argc; ++index) {
+        if (strcmp(argv[index], "--bench-bc") == 0) {
+            for (uint32_t source = 0; source < sourceNum; ++source) {
+                ni::benchmarkTextureCompression(sources[source].name, sources[source].pixels, sources[source].width, sources[source].height);
+            }
+            ni::destroyLoaderThreads();
+            return 0;
+        } else if (strcmp(argv[index], "--format") == 0 && index + 1 < argc) {
+            format = parseFormat(argv[++index]);
+        } else if (strcmp(argv[index], "--no-mips") == 0) {
+            generateMips = false;
+        } else {
+            outputPath = argv[index];
+        }
+    }
+
+    for (uint32_t source = 0; source < sourceNum; ++source) {
+        logSpriteMeshReport(sources[source].name, sources[source].pixels, sources[source].width, sources[source].height);
+    }
+    double startTime = ni::getSeconds();
+    bool success = ni::writeAssetPack(outputPath, sources, sourceNum, format, generateMips);
+    NI_LOG("Packing took %.2lf ms", (ni::getSeconds() - startTime) * 1000.0);
+    ni::destroyLoaderThreads();
+    return success ? 0 : 1;
+}
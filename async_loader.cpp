@@ -0,0 +1,228 @@
+#include "async_loader.h"
+#include "cpu_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define NI_ASYNC_BENCH_PERMUTATIONS 48
+#define NI_ASYNC_BENCH_FILE_SIZE (256 << 10)
+// Hash passes over the shader per permutation, about a millisecond of work like a small pipeline compile.
+#define NI_ASYNC_BENCH_COMPILE_ROUNDS 24
+#define NI_ASYNC_BENCH_PATH "async_loading_bench.tmp"
+
+struct LoaderJob {
+    ni::JobFunction function;
+    void* userData;
+    ni::JobCounter* counter;
+};
+
+static std::mutex loaderMutex;
+static std::condition_variable loaderSignal;
+static ni::Array<LoaderJob, uint32_t> loaderJobs;
+// Jobs before this index were taken, the array is reset once all of them are.
+static uint32_t loaderJobFirst = 0;
+static std::thread* loaderThreads = nullptr;
+static uint32_t loaderThreadNum = 0;
+static bool loaderRunning = false;
+
+// Needs loaderMutex.
+static bool popJob(LoaderJob& outJob) {
+    if (loaderJobFirst == loaderJobs.getNum()) return false;
+    outJob = loaderJobs.getData()[loaderJobFirst++];
+    if (loaderJobFirst == loaderJobs.getNum()) {
+        loaderJobs.reset();
+        loaderJobFirst = 0;
+    }
+    return true;
+}
+
+static void runJob(const LoaderJob& job) {
+    NI_TRACE_SCOPE("Job");
+    job.function(job.userData);
+    job.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void loaderMain() {
+    NI_TRACE_THREAD_NAME("Loader");
+    std::unique_lock<std::mutex> lock(loaderMutex);
+    while (true) {
+        LoaderJob job = {};
+        loaderSignal.wait(lock, [&] { return !loaderRunning || loaderJobFirst < loaderJobs.getNum(); });
+        // Queued jobs still run after destroy was called, someone may be waiting for them.
+        if (!popJob(job)) break;
+        lock.unlock();
+        runJob(job);
+        lock.lock();
+    }
+}
+
+void ni::initLoaderThreads(uint32_t threadNum) {
+    if (threadNum == 0) {
+        uint32_t coreNum = std::thread::hardware_concurrency();
+        threadNum = coreNum > 1 ? coreNum - 1 : 1;
+    }
+    loaderRunning = true;
+    loaderThreadNum = threadNum;
+    loaderThreads = new std::thread[threadNum];
+    for (uint32_t index = 0; index < threadNum; ++index) {
+        loaderThreads[index] = std::thread(loaderMain);
+    }
+}
+
+void ni::destroyLoaderThreads() {
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        loaderRunning = false;
+    }
+    loaderSignal.notify_all();
+    for (uint32_t index = 0; index < loaderThreadNum; ++index) {
+        loaderThreads[index].join();
+    }
+    delete[] loaderThreads;
+    loaderThreads = nullptr;
+    loaderThreadNum = 0;
+    loaderJobs.destroy();
+    loaderJobFirst = 0;
+}
+
+uint32_t ni::getLoaderThreadNum() {
+    return loaderThreadNum;
+}
+
+void ni::submitJob(JobFunction function, void* userData, JobCounter& counter) {
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+    LoaderJob job = { function, userData, &counter };
+    if (loaderThreadNum == 0) {
+        runJob(job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        loaderJobs.add(job);
+    }
+    loaderSignal.notify_one();
+}
+
+void ni::waitJobs(JobCounter& counter) {
+    while (counter.pending.load(std::memory_order_acquire) > 0) {
+        LoaderJob job = {};
+        bool popped = false;
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            popped = popJob(job);
+        }
+        if (popped) {
+            runJob(job);
+        } else {
+            // The remaining jobs are running on other threads.
+            std::this_thread::yield();
+        }
+    }
+}
+
+ni::AsyncFile::AsyncFile() : path(nullptr), data(nullptr), size(0) {}
+
+ni::AsyncFile::~AsyncFile() {
+    waitJobs(counter);
+    free(data);
+}
+
+void ni::AsyncFile::read(const char* filePath) {
+    waitJobs(counter);
+    free(data);
+    path = filePath;
+    data = nullptr;
+    size = 0;
+    submitJob(readJob, this, counter);
+}
+
+void ni::AsyncFile::readJob(void* userData) {
+    AsyncFile* file = (AsyncFile*)userData;
+    file->size = getFileSize(file->path);
+    file->data = file->size > 0 ? allocReadFile(file->path) : nullptr;
+}
+
+const void* ni::AsyncFile::getData() {
+    waitJobs(counter);
+    return data;
+}
+
+size_t ni::AsyncFile::getSize() {
+    waitJobs(counter);
+    return size;
+}
+
+struct BenchPermutation {
+    ni::AsyncFile* shader;
+    uint32_t index;
+    uint64_t result;
+};
+
+static uint64_t compilePermutation(const void* data, size_t size, uint32_t index) {
+    uint64_t hash = index;
+    for (uint32_t round = 0; round < NI_ASYNC_BENCH_COMPILE_ROUNDS; ++round) {
+        hash = ni::murmurHash(data, size, hash);
+    }
+    return hash;
+}
+
+static void compilePermutationJob(void* userData) {
+    BenchPermutation* permutation = (BenchPermutation*)userData;
+    permutation->result = compilePermutation(permutation->shader->getData(), permutation->shader->getSize(), permutation->index);
+}
+
+uint32_t ni::benchmarkAsyncLoading() {
+    uint8_t* source = (uint8_t*)malloc(NI_ASYNC_BENCH_FILE_SIZE);
+    for (uint32_t index = 0; index < NI_ASYNC_BENCH_FILE_SIZE; ++index) {
+        source[index] = (uint8_t)randomUint();
+    }
+    bool written = writeFile(NI_ASYNC_BENCH_PATH, source, NI_ASYNC_BENCH_FILE_SIZE);
+    free(source);
+    if (!written) {
+        NI_LOG("Async loading: failed to write %s", NI_ASYNC_BENCH_PATH);
+        return 1;
+    }
+
+    // Every permutation reads its own copy of the shader, like material permutations with separate files.
+    uint64_t serialResults[NI_ASYNC_BENCH_PERMUTATIONS];
+    double serialStart = getSeconds();
+    for (uint32_t index = 0; index < NI_ASYNC_BENCH_PERMUTATIONS; ++index) {
+        FileReader shader(NI_ASYNC_BENCH_PATH);
+        serialResults[index] = compilePermutation(*shader, shader.getSize(), index);
+    }
+    double serialTime = getSeconds() - serialStart;
+
+    initLoaderThreads(0);
+    AsyncFile* shaders = new AsyncFile[NI_ASYNC_BENCH_PERMUTATIONS];
+    BenchPermutation permutations[NI_ASYNC_BENCH_PERMUTATIONS];
+    JobCounter counter;
+    double parallelStart = getSeconds();
+    for (uint32_t index = 0; index < NI_ASYNC_BENCH_PERMUTATIONS; ++index) {
+        shaders[index].read(NI_ASYNC_BENCH_PATH);
+    }
+    // Submitted behind all reads, each compile waits for its own read.
+    for (uint32_t index = 0; index < NI_ASYNC_BENCH_PERMUTATIONS; ++index) {
+        permutations[index] = { &shaders[index], index, 0 };
+        submitJob(compilePermutationJob, &permutations[index], counter);
+    }
+    waitJobs(counter);
+    double parallelTime = getSeconds() - parallelStart;
+    uint32_t threadNum = getLoaderThreadNum();
+    delete[] shaders;
+    destroyLoaderThreads();
+    remove(NI_ASYNC_BENCH_PATH);
+
+    uint32_t errorNum = 0;
+    for (uint32_t index = 0; index < NI_ASYNC_BENCH_PERMUTATIONS; ++index) {
+        if (permutations[index].result != serialResults[index]) {
+            NI_LOG("Async loading: permutation %u differs from the serial load", index);
+            errorNum++;
+        }
+    }
+    NI_LOG("Async loading: %u permutations, serial %.2f ms, %u loader threads %.2f ms (%.1fx), %u error(s)",
+        NI_ASYNC_BENCH_PERMUTATIONS, serialTime * 1000.0, threadNum, parallelTime * 1000.0, serialTime / parallelTime, errorNum);
+    return errorNum;
+}
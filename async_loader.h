@@ -0,0 +1,48 @@
+#pragma once
+
+#include "ni_core.h"
+
+namespace ni {
+
+	typedef void(*JobFunction)(void* userData);
+
+	// Number of submitted jobs that haven't finished yet.
+	struct JobCounter {
+		std::atomic<uint32_t> pending{ 0 };
+	};
+
+	// Started by ni::init, threadNum 0 uses one thread per core besides the render thread. Destroy finishes
+	// the queued jobs first.
+	void initLoaderThreads(uint32_t threadNum);
+	void destroyLoaderThreads();
+	uint32_t getLoaderThreadNum();
+	// Jobs run in submission order. Without loader threads they run right away on the calling thread.
+	void submitJob(JobFunction function, void* userData, JobCounter& counter);
+	// Runs queued jobs while waiting, so a job can wait for the jobs it depends on.
+	void waitJobs(JobCounter& counter);
+
+	// Whole file read on a loader thread. The path has to stay valid until the read is done.
+	struct AsyncFile {
+		AsyncFile();
+		~AsyncFile();
+
+		void read(const char* path);
+		// These wait for the read. The data is null when the file couldn't be read.
+		const void* getData();
+		size_t getSize();
+		const char* getPath() const { return path; }
+
+	private:
+		static void readJob(void* userData);
+
+		const char* path;
+		void* data;
+		size_t size;
+		JobCounter counter;
+	};
+
+	// Loads synthetic pipeline permutations serially and on the loader threads, logs the speedup and checks that
+	// both produce the same results, including jobs that wait for other jobs. Doesn't need a device. Returns the
+	// error count.
+	uint32_t benchmarkAsyncLoading();
+}
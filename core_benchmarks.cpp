@@ -0,0 +1,87 @@
+#include "ni_core.h"
+#include "async_loader.h"
+#include "cpu_trace.h"
+#include "golden_images.h"
+#include "heap_allocator.h"
+#include "texture_streaming.h"
+#include <string.h>
+
+// The benchmarks of main.cpp that only need the portable core, built by CMakeLists.txt so they also run where
+// there's no D3D12. Runs every benchmark, or the ones named on the command line, and exits with 1 if any of
+// them reports an error. --golden-check and --golden-update run the golden images like main.cpp does.
+// Usage: CoreBenchmarks [--list] [--golden-check <dir>] [--golden-update <dir>] [benchmark name...]
+
+#define GOLDEN_CSV_PATH "golden_results.csv"
+#define GOLDEN_JSON_PATH "golden_results.json"
+#define STREAMING_BENCH_TEXTURE_COUNT 512
+
+struct CoreBenchmark {
+    const char* name;
+    uint32_t(*run)();
+};
+
+static uint32_t benchmarkTextureStreaming() {
+    return ni::benchmarkTextureStreaming(STREAMING_BENCH_TEXTURE_COUNT);
+}
+
+static const CoreBenchmark coreBenchmarks[] = {
+    { "async-loading", ni::benchmarkAsyncLoading },
+    { "cpu-trace", ni::benchmarkCpuTrace },
+    { "heap", ni::benchmarkHeapAllocator },
+    { "streaming", benchmarkTextureStreaming },
+};
+static const uint32_t coreBenchmarkNum = sizeof(coreBenchmarks) / sizeof(coreBenchmarks[0]);
+
+static const CoreBenchmark* findCoreBenchmark(const char* name) {
+    for (uint32_t index = 0; index < coreBenchmarkNum; ++index) {
+        if (strcmp(coreBenchmarks[index].name, name) == 0) return &coreBenchmarks[index];
+    }
+    return nullptr;
+}
+
+static uint32_t runCoreBenchmark(const CoreBenchmark& benchmark) {
+    NI_LOG("[%s]", benchmark.name);
+    uint32_t errorNum = benchmark.run();
+    NI_LOG("[%s] %s", benchmark.name, errorNum == 0 ? "passed" : "FAILED");
+    return errorNum;
+}
+
+int main(int argc, char** argv) {
+    uint32_t failedNum = 0;
+    uint32_t runNum = 0;
+    for (int index = 1; index < argc; ++index) {
+        if (strcmp(argv[index], "--list") == 0) {
+            for (uint32_t benchmark = 0; benchmark < coreBenchmarkNum; ++benchmark) {
+                NI_LOG("%s", coreBenchmarks[benchmark].name);
+            }
+            return 0;
+        }
+        if (strcmp(argv[index], "--golden-check") == 0 || strcmp(argv[index], "--golden-update") == 0) {
+            bool update = strcmp(argv[index], "--golden-update") == 0;
+            if (index + 1 >= argc) {
+                NI_PANIC("Missing operand for %s", argv[index]);
+            }
+            const char* goldenDir = argv[++index];
+            ni::initLoaderThreads(0);
+            uint32_t goldenFailedNum = ni::runGoldenImages(goldenDir, update, GOLDEN_CSV_PATH, GOLDEN_JSON_PATH);
+            ni::destroyLoaderThreads();
+            failedNum += goldenFailedNum > 0 ? 1 : 0;
+            runNum++;
+            continue;
+        }
+        const CoreBenchmark* benchmark = findCoreBenchmark(argv[index]);
+        if (benchmark == nullptr) {
+            NI_PANIC("Unknown benchmark %s, --list shows them", argv[index]);
+        }
+        failedNum += runCoreBenchmark(*benchmark) > 0 ? 1 : 0;
+        runNum++;
+    }
+    if (runNum == 0) {
+        for (uint32_t benchmark = 0; benchmark < coreBenchmarkNum; ++benchmark) {
+            failedNum += runCoreBenchmark(coreBenchmarks[benchmark]) > 0 ? 1 : 0;
+            runNum++;
+        }
+    }
+    NI_LOG("%u of %u benchmarks failed", failedNum, runNum);
+    return failedNum == 0 ? 0 : 1;
+}
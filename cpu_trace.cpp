@@ -0,0 +1,298 @@
+#include "cpu_trace.h"
+#include "ni_core.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#if _MSC_VER
+#include <intrin.h>
+#define NI_CPU_TRACE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define NI_CPU_TRACE_RDTSC 1
+#else
+#define NI_CPU_TRACE_RDTSC 0
+#endif
+
+// The rdtsc rate is measured against the steady clock over at least this long.
+#define NI_CPU_TRACE_CALIBRATION_US 10000.0
+#define NI_CPU_TRACE_BENCH_THREADS 4
+#define NI_CPU_TRACE_BENCH_SCOPES 100000
+#define NI_CPU_TRACE_BENCH_PATH "cpu_trace_bench.json"
+
+struct TraceOpenScope {
+    const char* name;
+    uint64_t beginTicks;
+};
+
+struct TraceThread {
+    ni::TraceEvent events[NI_CPU_TRACE_EVENTS_PER_THREAD];
+    TraceOpenScope openScopes[NI_CPU_TRACE_MAX_DEPTH];
+    // Events written so far, the ring holds the last NI_CPU_TRACE_EVENTS_PER_THREAD of them.
+    std::atomic<uint64_t> writeIndex;
+    std::atomic<const char*> name;
+    uint32_t depth;
+    uint32_t id;
+    TraceThread* next;
+};
+
+// Threads are pushed to the front and never removed, events of finished threads stay exportable.
+static std::atomic<TraceThread*> traceThreads{ nullptr };
+static std::atomic<uint32_t> traceThreadNum{ 0 };
+static thread_local TraceThread* currentTraceThread = nullptr;
+static const uint64_t traceStartTicks = ni::getTraceTicks();
+static const std::chrono::steady_clock::time_point traceStartTime = std::chrono::steady_clock::now();
+
+uint64_t ni::getTraceTicks() {
+#if NI_CPU_TRACE_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+static TraceThread* registerTraceThread() {
+    TraceThread* thread = new TraceThread();
+    thread->writeIndex = 0;
+    thread->name = nullptr;
+    thread->depth = 0;
+    thread->id = traceThreadNum.fetch_add(1, std::memory_order_relaxed);
+    thread->next = traceThreads.load(std::memory_order_relaxed);
+    while (!traceThreads.compare_exchange_weak(thread->next, thread, std::memory_order_release, std::memory_order_relaxed)) {}
+    currentTraceThread = thread;
+    return thread;
+}
+
+static TraceThread* findTraceThread(uint32_t id) {
+    for (TraceThread* thread = traceThreads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next) {
+        if (thread->id == id) return thread;
+    }
+    return nullptr;
+}
+
+void ni::beginTraceEvent(const char* name) {
+    TraceThread* thread = currentTraceThread != nullptr ? currentTraceThread : registerTraceThread();
+    // Scopes nested deeper than the stack are counted but not recorded.
+    if (thread->depth < NI_CPU_TRACE_MAX_DEPTH) {
+        thread->openScopes[thread->depth] = { name, getTraceTicks() };
+    }
+    thread->depth++;
+}
+
+void ni::endTraceEvent() {
+    uint64_t endTicks = getTraceTicks();
+    TraceThread* thread = currentTraceThread;
+    NI_ASSERT(thread != nullptr && thread->depth > 0, "Trace event ended without a begin");
+    uint32_t depth = --thread->depth;
+    if (depth >= NI_CPU_TRACE_MAX_DEPTH) return;
+    const TraceOpenScope& scope = thread->openScopes[depth];
+    uint64_t index = thread->writeIndex.load(std::memory_order_relaxed);
+    thread->events[index & (NI_CPU_TRACE_EVENTS_PER_THREAD - 1)] = { scope.name, scope.beginTicks, endTicks, depth };
+    thread->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void ni::setTraceThreadName(const char* name) {
+    TraceThread* thread = currentTraceThread != nullptr ? currentTraceThread : registerTraceThread();
+    thread->name.store(name, std::memory_order_release);
+}
+
+uint32_t ni::getTraceThreadNum() {
+    return traceThreadNum.load(std::memory_order_acquire);
+}
+
+static uint64_t countTraceEvents(const TraceThread* thread) {
+    uint64_t writeIndex = thread->writeIndex.load(std::memory_order_acquire);
+    return writeIndex < NI_CPU_TRACE_EVENTS_PER_THREAD ? writeIndex : NI_CPU_TRACE_EVENTS_PER_THREAD;
+}
+
+static ni::TraceEvent readTraceEvent(const TraceThread* thread, uint64_t index) {
+    uint64_t writeIndex = thread->writeIndex.load(std::memory_order_acquire);
+    uint64_t first = writeIndex > NI_CPU_TRACE_EVENTS_PER_THREAD ? writeIndex - NI_CPU_TRACE_EVENTS_PER_THREAD : 0;
+    return thread->events[(first + index) & (NI_CPU_TRACE_EVENTS_PER_THREAD - 1)];
+}
+
+uint64_t ni::getTraceEventNum(uint32_t threadId) {
+    TraceThread* thread = findTraceThread(threadId);
+    return thread != nullptr ? countTraceEvents(thread) : 0;
+}
+
+ni::TraceEvent ni::getTraceEvent(uint32_t threadId, uint64_t index) {
+    TraceThread* thread = findTraceThread(threadId);
+    NI_ASSERT(thread != nullptr, "Unknown trace thread %u", threadId);
+    return readTraceEvent(thread, index);
+}
+
+static double getTraceTicksPerMicrosecond() {
+#if NI_CPU_TRACE_RDTSC
+    // Measured from startup to now, waiting a little if the process only just started.
+    double elapsedUs = 0.0;
+    uint64_t ticks = 0;
+    do {
+        ticks = ni::getTraceTicks();
+        elapsedUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - traceStartTime).count();
+    } while (elapsedUs < NI_CPU_TRACE_CALIBRATION_US);
+    return (double)(ticks - traceStartTicks) / elapsedUs;
+#else
+    return (double)std::chrono::steady_clock::period::den / ((double)std::chrono::steady_clock::period::num * 1e6);
+#endif
+}
+
+struct TraceText {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+static void appendText(TraceText& text, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list sizeArgs;
+    va_copy(sizeArgs, args);
+    int length = vsnprintf(nullptr, 0, fmt, sizeArgs);
+    va_end(sizeArgs);
+    if (text.size + length + 1 > text.capacity) {
+        size_t capacity = text.capacity > 0 ? text.capacity * 2 : (1 << 20);
+        while (capacity < text.size + length + 1) capacity *= 2;
+        text.data = (char*)realloc(text.data, capacity);
+        NI_ASSERT(text.data != nullptr, "Failed to grow the trace export buffer");
+        text.capacity = capacity;
+    }
+    vsnprintf(text.data + text.size, length + 1, fmt, args);
+    text.size += length;
+    va_end(args);
+}
+
+// Names are meant to be literals, but quotes and control characters would still break the JSON.
+static void appendName(TraceText& text, const char* name) {
+    name = name != nullptr ? name : "?";
+    bool plain = true;
+    for (const char* character = name; *character != 0 && plain; ++character) {
+        plain = *character != '"' && *character != '\\' && (unsigned char)*character >= 0x20;
+    }
+    if (plain) {
+        appendText(text, "\"%s\"", name);
+        return;
+    }
+    appendText(text, "\"");
+    for (const char* character = name; *character != 0; ++character) {
+        if (*character == '"' || *character == '\\') {
+            appendText(text, "\\%c", *character);
+        } else if ((unsigned char)*character < 0x20) {
+            appendText(text, "\\u%04x", (unsigned char)*character);
+        } else {
+            appendText(text, "%c", *character);
+        }
+    }
+    appendText(text, "\"");
+}
+
+bool ni::exportCpuTrace(const char* path) {
+    double ticksPerUs = getTraceTicksPerMicrosecond();
+    TraceText text = {};
+    appendText(text, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (TraceThread* thread = traceThreads.load(std::memory_order_acquire); thread != nullptr; thread = thread->next) {
+        const char* name = thread->name.load(std::memory_order_acquire);
+        if (name != nullptr) {
+            appendText(text, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->id);
+            appendName(text, name);
+            appendText(text, "}}");
+            first = false;
+        }
+        uint64_t eventNum = countTraceEvents(thread);
+        for (uint64_t index = 0; index < eventNum; ++index) {
+            TraceEvent event = readTraceEvent(thread, index);
+            appendText(text, "%s{\"name\":", first ? "" : ",\n");
+            appendName(text, event.name);
+            appendText(text, ",\"cat\":\"ni\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", thread->id,
+                (double)(event.beginTicks - traceStartTicks) / ticksPerUs, (double)(event.endTicks - event.beginTicks) / ticksPerUs);
+            first = false;
+        }
+    }
+    appendText(text, "\n]}\n");
+    bool written = writeFile(path, text.data, text.size);
+    free(text.data);
+    return written;
+}
+
+static void traceBenchThread(uint32_t index, double* outSeconds) {
+    static const char* names[NI_CPU_TRACE_BENCH_THREADS] = { "Bench 0", "Bench 1", "Bench 2", "Bench 3" };
+    ni::setTraceThreadName(names[index]);
+    double startTime = ni::getSeconds();
+    // Called directly instead of through the macros so the bench also runs with NI_USE_CPU_TRACE off.
+    for (uint32_t scope = 0; scope < NI_CPU_TRACE_BENCH_SCOPES / 4; ++scope) {
+        ni::TraceScope outer("Outer");
+        for (uint32_t inner = 0; inner < 3; ++inner) {
+            ni::TraceScope innerScope("Inner \"quoted\"");
+        }
+    }
+    *outSeconds = ni::getSeconds() - startTime;
+}
+
+uint32_t ni::benchmarkCpuTrace() {
+    setTraceThreadName("Main");
+    uint32_t firstBenchThread = getTraceThreadNum();
+    std::thread threads[NI_CPU_TRACE_BENCH_THREADS];
+    double seconds[NI_CPU_TRACE_BENCH_THREADS] = {};
+    for (uint32_t index = 0; index < NI_CPU_TRACE_BENCH_THREADS; ++index) {
+        threads[index] = std::thread(traceBenchThread, index, &seconds[index]);
+    }
+    for (uint32_t index = 0; index < NI_CPU_TRACE_BENCH_THREADS; ++index) {
+        threads[index].join();
+    }
+
+    // Every thread wrapped around its ring. Events end in order, inner scopes sit inside the outer one after them.
+    uint32_t errorNum = 0;
+    double slowestSeconds = 0.0;
+    for (uint32_t index = 0; index < NI_CPU_TRACE_BENCH_THREADS; ++index) {
+        uint32_t thread = firstBenchThread + index;
+        uint64_t eventNum = getTraceEventNum(thread);
+        if (eventNum != NI_CPU_TRACE_EVENTS_PER_THREAD) {
+            NI_LOG("CPU trace: thread %u kept %llu events instead of %u", thread, eventNum, NI_CPU_TRACE_EVENTS_PER_THREAD);
+            errorNum++;
+        }
+        TraceEvent previous = {};
+        // Begin of the first inner scope since the last outer one, they have to start inside the next outer.
+        uint64_t innerBegin = UINT64_MAX;
+        for (uint64_t event = 0; event < eventNum; ++event) {
+            TraceEvent current = getTraceEvent(thread, event);
+            bool ordered = current.beginTicks <= current.endTicks && (event == 0 || previous.endTicks <= current.endTicks);
+            bool nested = current.depth <= 1;
+            if (current.depth == 1 && innerBegin == UINT64_MAX) {
+                innerBegin = current.beginTicks;
+            } else if (current.depth == 0) {
+                nested = innerBegin == UINT64_MAX || innerBegin >= current.beginTicks;
+                innerBegin = UINT64_MAX;
+            }
+            if (!ordered || !nested) {
+                NI_LOG("CPU trace: thread %u event %llu (%s, depth %u) is out of order", thread, event, current.name, current.depth);
+                errorNum++;
+                break;
+            }
+            previous = current;
+        }
+        slowestSeconds = seconds[index] > slowestSeconds ? seconds[index] : slowestSeconds;
+    }
+
+    // Cost of an empty scope on one thread, without the other threads competing for the cores.
+    double startTime = getSeconds();
+    for (uint32_t scope = 0; scope < NI_CPU_TRACE_BENCH_SCOPES; ++scope) {
+        TraceScope emptyScope("Empty");
+    }
+    double scopeNs = (getSeconds() - startTime) * 1e9 / NI_CPU_TRACE_BENCH_SCOPES;
+
+    double exportStart = getSeconds();
+    if (!exportCpuTrace(NI_CPU_TRACE_BENCH_PATH) || getFileSize(NI_CPU_TRACE_BENCH_PATH) == 0) {
+        NI_LOG("CPU trace: failed to export %s", NI_CPU_TRACE_BENCH_PATH);
+        errorNum++;
+    }
+    double exportMs = (getSeconds() - exportStart) * 1000.0;
+    NI_LOG("CPU trace: %.1f ns per scope, %u threads x %u scopes in %.2f ms, exported %u threads to %s in %.1f ms, %u error(s)",
+        scopeNs, NI_CPU_TRACE_BENCH_THREADS, NI_CPU_TRACE_BENCH_SCOPES, slowestSeconds * 1000.0, getTraceThreadNum(), NI_CPU_TRACE_BENCH_PATH, exportMs, errorNum);
+    return errorNum;
+}
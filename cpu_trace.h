@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scoped CPU events in per thread rings. The NI_TRACE macros compile to nothing when disabled. Doesn't depend on
+// the rest of ni, so any module can trace.
+#ifndef NI_USE_CPU_TRACE
+#define NI_USE_CPU_TRACE 1
+#endif
+// Events kept per thread, older ones are overwritten. Power of two.
+#define NI_CPU_TRACE_EVENTS_PER_THREAD (1 << 16)
+// Deepest nesting of open scopes on one thread.
+#define NI_CPU_TRACE_MAX_DEPTH 64
+
+#if NI_USE_CPU_TRACE
+#define NI_TRACE_CONCAT_INNER(a, b) a##b
+#define NI_TRACE_CONCAT(a, b) NI_TRACE_CONCAT_INNER(a, b)
+// The name has to outlive the trace, string literals are the intended use.
+#define NI_TRACE_SCOPE(name) ni::TraceScope NI_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define NI_TRACE_BEGIN(name) ni::beginTraceEvent(name)
+#define NI_TRACE_END() ni::endTraceEvent()
+#define NI_TRACE_THREAD_NAME(name) ni::setTraceThreadName(name)
+#else
+#define NI_TRACE_SCOPE(name)
+#define NI_TRACE_BEGIN(name)
+#define NI_TRACE_END()
+#define NI_TRACE_THREAD_NAME(name)
+#endif
+
+namespace ni {
+
+	struct TraceEvent {
+		const char* name;
+		uint64_t beginTicks;
+		uint64_t endTicks;
+		uint32_t depth;
+	};
+
+	// Each thread writes to its own ring, registered on its first event. Recording doesn't lock or allocate
+	// after that, the exporter reads the rings concurrently and may see torn events from threads that are
+	// still tracing, so export once they are quiet.
+	void beginTraceEvent(const char* name);
+	void endTraceEvent();
+	void setTraceThreadName(const char* name);
+	// rdtsc where available, steady clock ticks otherwise. Converted to time when exporting.
+	uint64_t getTraceTicks();
+	// Chrome trace event JSON, open it in chrome://tracing or Perfetto.
+	bool exportCpuTrace(const char* path);
+	// Number of events each registered thread holds, in registration order.
+	uint32_t getTraceThreadNum();
+	uint64_t getTraceEventNum(uint32_t thread);
+	// Oldest first, index below getTraceEventNum.
+	TraceEvent getTraceEvent(uint32_t thread, uint64_t index);
+
+	struct TraceScope {
+		TraceScope(const char* name) { beginTraceEvent(name); }
+		~TraceScope() { endTraceEvent(); }
+	};
+
+	// Records nested scopes on several threads, logs the cost of a scope and checks the rings and the export.
+	// Returns the error count.
+	uint32_t benchmarkCpuTrace();
+}
@@ -0,0 +1,261 @@
+#include "draw_capture.h"
+#include "frame_timing.h"
+#include <stdlib.h>
+#include <string.h>
+
+static_assert(sizeof(ni::DrawCaptureHeader) == 40, "Draw capture header layout changed, bump NI_DRAW_CAPTURE_VERSION");
+static_assert(sizeof(ni::DrawCaptureFrame) == 40, "Draw capture frame layout changed, bump NI_DRAW_CAPTURE_VERSION");
+static_assert(sizeof(ni::DrawCaptureImage) == 72, "Draw capture image layout changed, bump NI_DRAW_CAPTURE_VERSION");
+static_assert(sizeof(ni::DrawCaptureTexture) == 48, "Draw capture texture layout changed, bump NI_DRAW_CAPTURE_VERSION");
+static_assert(sizeof(DrawCommand) == 40, "DrawCommand layout changed, bump NI_DRAW_CAPTURE_VERSION");
+
+ni::DrawCaptureWriter::DrawCaptureWriter() : file(nullptr), path(nullptr), offset(0), failed(false), camera{}, textureIndices(nullptr) {}
+
+ni::DrawCaptureWriter::~DrawCaptureWriter() {
+    if (file != nullptr) {
+        close();
+    }
+}
+
+bool ni::DrawCaptureWriter::open(const char* capturePath) {
+    NI_ASSERT(file == nullptr, "Draw capture %s is already open", path);
+    file = fopen(capturePath, "wb");
+    if (file == nullptr) {
+        NI_LOG("Failed to create draw capture %s", capturePath);
+        return false;
+    }
+    path = capturePath;
+    offset = 0;
+    failed = false;
+    frames.reset();
+    textures.reset();
+    textureIndices = (uint32_t*)calloc(NI_MAX_DESCRIPTORS, sizeof(uint32_t));
+    // Rewritten with the table offsets once they are known.
+    DrawCaptureHeader header = {};
+    write(&header, sizeof(header));
+    return true;
+}
+
+void ni::DrawCaptureWriter::write(const void* data, size_t size) {
+    if (size == 0 || failed) return;
+    failed = fwrite(data, 1, size, file) != size;
+    offset += size;
+}
+
+void ni::DrawCaptureWriter::pad() {
+    static const uint8_t zeros[NI_DRAW_CAPTURE_ALIGNMENT] = {};
+    write(zeros, alignSize((size_t)offset, NI_DRAW_CAPTURE_ALIGNMENT) - (size_t)offset);
+}
+
+uint32_t ni::DrawCaptureWriter::findTexture(const Texture* texture) {
+    uint32_t heapIndex = texture->shaderResourceView.heapIndex;
+    NI_ASSERT(heapIndex < NI_MAX_DESCRIPTORS, "Texture %u isn't in the persistent region", heapIndex);
+    DrawCaptureTexture entry = { texture->width, texture->height, texture->mipLevels, (uint32_t)texture->format };
+    if (texture->assetName != nullptr) {
+        strncpy(entry.assetName, texture->assetName, NI_ASSET_PACK_NAME_MAX - 1);
+    }
+    uint32_t index = textureIndices[heapIndex];
+    if (index > 0 && memcmp(&textures.getData()[index - 1], &entry, sizeof(entry)) == 0) {
+        return index - 1;
+    }
+    textures.add(entry);
+    textureIndices[heapIndex] = textures.getNum();
+    return textures.getNum() - 1;
+}
+
+void ni::DrawCaptureWriter::writeFrame(const DrawCommand* drawCommands, uint32_t drawCommandNum, Texture* const* images, const SpriteMesh* meshes, uint32_t imageNum) {
+    if (file == nullptr) return;
+    frameImages.reset();
+    for (uint32_t index = 0; index < imageNum; ++index) {
+        DrawCaptureImage image = {};
+        image.textureIndex = findTexture(images[index]);
+        image.mesh = meshes[index];
+        frameImages.add(image);
+    }
+    pad();
+    DrawCaptureFrame frame = {};
+    frame.dataOffset = offset;
+    frame.drawCommandNum = drawCommandNum;
+    frame.imageNum = imageNum;
+    frame.viewWidth = getViewWidth();
+    frame.viewHeight = getViewHeight();
+    frame.camera = camera;
+    frames.add(frame);
+    write(frameImages.getData(), imageNum * sizeof(DrawCaptureImage));
+    pad();
+    write(drawCommands, drawCommandNum * sizeof(DrawCommand));
+}
+
+bool ni::DrawCaptureWriter::close() {
+    if (file == nullptr) return false;
+    DrawCaptureHeader header = {};
+    header.magic = NI_DRAW_CAPTURE_MAGIC;
+    header.version = NI_DRAW_CAPTURE_VERSION;
+    header.frameNum = frames.getNum();
+    header.textureNum = textures.getNum();
+    pad();
+    header.textureTableOffset = offset;
+    write(textures.getData(), textures.getNum() * sizeof(DrawCaptureTexture));
+    pad();
+    header.frameTableOffset = offset;
+    write(frames.getData(), frames.getNum() * sizeof(DrawCaptureFrame));
+    header.fileSize = offset;
+    if (!failed) {
+        failed = fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, 1, sizeof(header), file) != sizeof(header);
+    }
+    failed = fclose(file) != 0 || failed;
+    file = nullptr;
+    if (failed) {
+        NI_LOG("Failed to write draw capture %s", path);
+    } else {
+        NI_LOG("Wrote %u frames and %u textures to %s (%.2f MB)", header.frameNum, header.textureNum, path, (double)header.fileSize / (1024.0 * 1024.0));
+    }
+    free(textureIndices);
+    textureIndices = nullptr;
+    frames.destroy();
+    textures.destroy();
+    frameImages.destroy();
+    return !failed;
+}
+
+ni::DrawCapture::DrawCapture(const char* path) : file(path) {
+    if (!file.isValid()) {
+        NI_LOG("Failed to open draw capture %s", path);
+        return;
+    }
+    const DrawCaptureHeader* captureHeader = (const DrawCaptureHeader*)*file;
+    if (file.getSize() < sizeof(DrawCaptureHeader) || captureHeader->magic != NI_DRAW_CAPTURE_MAGIC || captureHeader->version != NI_DRAW_CAPTURE_VERSION) {
+        NI_LOG("Draw capture %s is invalid or was written by a different version", path);
+        return;
+    }
+    if (captureHeader->fileSize != file.getSize() || captureHeader->textureTableOffset + captureHeader->textureNum * sizeof(DrawCaptureTexture) > file.getSize() ||
+        captureHeader->frameTableOffset + captureHeader->frameNum * sizeof(DrawCaptureFrame) > file.getSize()) {
+        NI_LOG("Draw capture %s is truncated", path);
+        return;
+    }
+    textures = (const DrawCaptureTexture*)offsetPtr((void*)captureHeader, (intptr_t)captureHeader->textureTableOffset);
+    frames = (const DrawCaptureFrame*)offsetPtr((void*)captureHeader, (intptr_t)captureHeader->frameTableOffset);
+    for (uint32_t index = 0; index < captureHeader->frameNum; ++index) {
+        const DrawCaptureFrame& frame = frames[index];
+        uint64_t commandOffset = alignSize((size_t)(frame.dataOffset + frame.imageNum * sizeof(DrawCaptureImage)), NI_DRAW_CAPTURE_ALIGNMENT);
+        if (commandOffset + frame.drawCommandNum * sizeof(DrawCommand) > file.getSize() || frame.imageNum > NI_MAX_DESCRIPTORS || frame.drawCommandNum > MAX_DRAW_COMMANDS) {
+            NI_LOG("Draw capture %s is truncated", path);
+            frames = nullptr;
+            return;
+        }
+        const DrawCaptureImage* images = (const DrawCaptureImage*)offsetPtr((void*)captureHeader, (intptr_t)frame.dataOffset);
+        for (uint32_t image = 0; image < frame.imageNum; ++image) {
+            if (images[image].textureIndex >= captureHeader->textureNum) {
+                NI_LOG("Draw capture %s references texture %u of %u", path, images[image].textureIndex, captureHeader->textureNum);
+                frames = nullptr;
+                return;
+            }
+        }
+    }
+    header = captureHeader;
+}
+
+const ni::DrawCaptureTexture& ni::DrawCapture::getTexture(uint32_t index) const {
+    NI_ASSERT(index < header->textureNum, "Index out of bounds");
+    return textures[index];
+}
+
+const ni::DrawCaptureFrame& ni::DrawCapture::getFrame(uint32_t index) const {
+    NI_ASSERT(index < header->frameNum, "Index out of bounds");
+    return frames[index];
+}
+
+const ni::DrawCaptureImage* ni::DrawCapture::getFrameImages(const DrawCaptureFrame& frame) const {
+    return (const DrawCaptureImage*)offsetPtr((void*)header, (intptr_t)frame.dataOffset);
+}
+
+const DrawCommand* ni::DrawCapture::getFrameDrawCommands(const DrawCaptureFrame& frame) const {
+    size_t commandOffset = alignSize((size_t)(frame.dataOffset + frame.imageNum * sizeof(DrawCaptureImage)), NI_DRAW_CAPTURE_ALIGNMENT);
+    return (const DrawCommand*)offsetPtr((void*)header, (intptr_t)commandOffset);
+}
+
+const ni::AssetPackTexture* ni::findCapturedTexture(const AssetPack* pack, const DrawCaptureTexture& texture) {
+    if (pack == nullptr || texture.assetName[0] == '\0') return nullptr;
+    char assetName[NI_ASSET_PACK_NAME_MAX] = {};
+    strncpy(assetName, texture.assetName, NI_ASSET_PACK_NAME_MAX - 1);
+    const AssetPackTexture* packTexture = pack->findTexture(assetName);
+    if (packTexture == nullptr || packTexture->width != texture.width || packTexture->height != texture.height ||
+        packTexture->mipLevels != texture.mipLevels || packTexture->format != texture.format) {
+        NI_LOG("Draw capture texture %s isn't in the pack or changed since the capture", assetName);
+        return nullptr;
+    }
+    return packTexture;
+}
+
+void ni::replayDrawCapture(SpriteRenderer* spriteRenderer, const char* path, uint32_t loopNum, const AssetPack* pack) {
+    DrawCapture capture(path);
+    if (!capture.isValid() || capture.getFrameNum() == 0) {
+        NI_LOG("Nothing to replay in %s", path);
+        return;
+    }
+    // Missing textures become opaque white ones of the captured size, format and mip count. They cost about the
+    // same to sample and blend as the real ones, zero alpha would be discarded. Everything is created directly,
+    // so it's resident by the first flush that draws it.
+    Texture** textures = (Texture**)malloc(capture.getTextureNum() * sizeof(Texture*));
+    uint32_t placeholderNum = 0;
+    for (uint32_t index = 0; index < capture.getTextureNum(); ++index) {
+        const DrawCaptureTexture& texture = capture.getTexture(index);
+        const AssetPackTexture* packTexture = findCapturedTexture(pack, texture);
+        if (packTexture != nullptr) {
+            textures[index] = pack->createTexture(L"DrawCapture::texture", *packTexture);
+            continue;
+        }
+        placeholderNum++;
+        size_t mipChainSize = getMipChainSize(texture.width, texture.height, texture.mipLevels, (DXGI_FORMAT)texture.format);
+        void* mipChain = malloc(mipChainSize);
+        memset(mipChain, 0xff, mipChainSize);
+        textures[index] = createTextureFromMipChain(L"DrawCapture::texture", texture.width, texture.height, texture.mipLevels, mipChain, (DXGI_FORMAT)texture.format);
+        free(mipChain);
+    }
+    if (placeholderNum > 0) {
+        NI_LOG("Replaying %s with %u of %u textures as placeholders", path, placeholderNum, capture.getTextureNum());
+    }
+    const DrawCaptureFrame& firstFrame = capture.getFrame(0);
+    if (firstFrame.viewWidth != getViewWidth() || firstFrame.viewHeight != getViewHeight()) {
+        NI_LOG("Draw capture %s was taken at %.0fx%.0f, culling will differ at %.0fx%.0f", path, firstFrame.viewWidth, firstFrame.viewHeight, getViewWidth(), getViewHeight());
+    }
+
+    Texture** frameImages = (Texture**)malloc(NI_MAX_DESCRIPTORS * sizeof(Texture*));
+    SpriteMesh* frameMeshes = (SpriteMesh*)malloc(NI_MAX_DESCRIPTORS * sizeof(SpriteMesh));
+    getFrameTiming()->reset();
+    uint64_t replayedFrameNum = 0;
+    uint64_t replayedCommandNum = 0;
+    double startTime = getSeconds();
+    for (uint32_t loop = 0; loop < loopNum && !shouldQuit(); ++loop) {
+        for (uint32_t frameIndex = 0; frameIndex < capture.getFrameNum() && !shouldQuit(); ++frameIndex) {
+            pollEvents();
+            const DrawCaptureFrame& frame = capture.getFrame(frameIndex);
+            const DrawCaptureImage* images = capture.getFrameImages(frame);
+            for (uint32_t image = 0; image < frame.imageNum; ++image) {
+                frameImages[image] = textures[images[image].textureIndex];
+                frameMeshes[image] = images[image].mesh;
+            }
+            spriteRenderer->replayFrame(capture.getFrameDrawCommands(frame), frame.drawCommandNum, frameImages, frameMeshes, frame.imageNum);
+            FrameData& frameData = beginFrame();
+            spriteRenderer->flushCommands(frameData);
+            endFrame();
+            present(false);
+            waitForCurrentFrame();
+            replayedFrameNum++;
+            replayedCommandNum += frame.drawCommandNum;
+        }
+    }
+    waitForAllFrames();
+    double elapsed = getSeconds() - startTime;
+    NI_LOG("Replayed %llu frames of %s in %.2f s: %.1f frames/s, %.1f M sprites/s", replayedFrameNum, path, elapsed,
+        (double)replayedFrameNum / elapsed, (double)replayedCommandNum / elapsed / 1000000.0);
+    getFrameTiming()->log();
+
+    spriteRenderer->reset();
+    for (uint32_t index = 0; index < capture.getTextureNum(); ++index) {
+        destroyTexture(textures[index]);
+    }
+    free(frameMeshes);
+    free(frameImages);
+    free(textures);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ni.h"
+#include "asset_pack.h"
+#include "sprite_renderer.h"
+#include <stdio.h>
+
+// Binary capture of what SpriteRenderer::flushCommands was fed. Layout:
+//   DrawCaptureHeader
+//   per frame, aligned to NI_DRAW_CAPTURE_ALIGNMENT: DrawCaptureImage[imageNum], DrawCommand[drawCommandNum]
+//   DrawCaptureTexture[textureNum]
+//   DrawCaptureFrame[frameNum]
+// Draw commands are stored as they were uploaded. The texture id's high bits index the frame's images, its
+// bindless bits are stale and get replaced on replay. Everything is read straight out of the mapping.
+#define NI_DRAW_CAPTURE_MAGIC 0x4344494e // 'NIDC'
+#define NI_DRAW_CAPTURE_VERSION 2
+#define NI_DRAW_CAPTURE_ALIGNMENT 16
+
+namespace ni {
+
+	struct DrawCaptureHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t frameNum;
+		uint32_t textureNum;
+		uint64_t textureTableOffset;
+		uint64_t frameTableOffset;
+		uint64_t fileSize;
+	};
+
+	// The texels aren't captured. Textures from an asset pack keep their entry name so the replay can load them
+	// again, the rest are recreated with the same size and format so they cost the same to sample.
+	struct DrawCaptureTexture {
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+		uint32_t format;
+		// Empty when the texture didn't come from a pack.
+		char assetName[NI_ASSET_PACK_NAME_MAX];
+	};
+
+	struct DrawCaptureFrame {
+		uint64_t dataOffset;
+		uint32_t drawCommandNum;
+		uint32_t imageNum;
+		float viewWidth;
+		float viewHeight;
+		Transform camera;
+	};
+
+	// One per image bound in the frame, in the order of the draw commands' mesh slots.
+	struct DrawCaptureImage {
+		uint32_t textureIndex;
+		uint32_t reserved;
+		SpriteMesh mesh;
+	};
+
+	// Streams frames to disk as they are flushed. The tables are written by close.
+	struct DrawCaptureWriter {
+		DrawCaptureWriter();
+		~DrawCaptureWriter();
+
+		bool open(const char* path);
+		bool close();
+		bool isOpen() const { return file != nullptr; }
+		// Stored with the frames flushed after it, only informational on replay.
+		void setCamera(const Transform& frameCamera) { camera = frameCamera; }
+		void writeFrame(const DrawCommand* drawCommands, uint32_t drawCommandNum, Texture* const* images, const SpriteMesh* meshes, uint32_t imageNum);
+		uint32_t getFrameNum() const { return frames.getNum(); }
+
+	private:
+		void write(const void* data, size_t size);
+		void pad();
+		uint32_t findTexture(const Texture* texture);
+
+		FILE* file;
+		const char* path;
+		uint64_t offset;
+		bool failed;
+		Transform camera;
+		Array<DrawCaptureFrame, uint32_t> frames;
+		Array<DrawCaptureTexture, uint32_t> textures;
+		// Capture texture index + 1 by bindless index, 0 when the texture wasn't seen yet. Bindless indices are
+		// reused, so the entry is checked against the texture before it's taken.
+		uint32_t* textureIndices;
+		Array<DrawCaptureImage, uint32_t> frameImages;
+	};
+
+	struct DrawCapture {
+		DrawCapture(const char* path);
+		~DrawCapture() {}
+
+		bool isValid() const { return header != nullptr; }
+		uint32_t getFrameNum() const { return header->frameNum; }
+		uint32_t getTextureNum() const { return header->textureNum; }
+		const DrawCaptureTexture& getTexture(uint32_t index) const;
+		const DrawCaptureFrame& getFrame(uint32_t index) const;
+		const DrawCaptureImage* getFrameImages(const DrawCaptureFrame& frame) const;
+		const DrawCommand* getFrameDrawCommands(const DrawCaptureFrame& frame) const;
+
+	private:
+		MappedFile file;
+		const DrawCaptureHeader* header = nullptr;
+		const DrawCaptureTexture* textures = nullptr;
+		const DrawCaptureFrame* frames = nullptr;
+	};
+
+	// Pack entry a captured texture came from. Null without a pack, for textures that didn't come from one and
+	// when the entry is gone or no longer matches the captured size and format, which would throw off the mesh
+	// slots and the cost.
+	const AssetPackTexture* findCapturedTexture(const AssetPack* pack, const DrawCaptureTexture& texture);
+	// Loads the captured textures from pack, or recreates the ones it doesn't have as opaque white textures of
+	// the same size, and feeds every frame through flushCommands as fast as the GPU takes them, loopNum times.
+	// pack can be null. Logs the throughput and the frame time percentiles of the replay.
+	void replayDrawCapture(SpriteRenderer* spriteRenderer, const char* path, uint32_t loopNum, const AssetPack* pack);
+}
@@ -0,0 +1,215 @@
+#include "frame_timing.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if _MSC_VER
+#include <intrin.h>
+static inline uint32_t findLastSet(uint64_t value) { unsigned long index; _BitScanReverse64(&index, value); return (uint32_t)index; }
+#else
+static inline uint32_t findLastSet(uint64_t value) { return 63 - (uint32_t)__builtin_clzll(value); }
+#endif
+
+#define NI_HISTOGRAM_SUB_BUCKET_NUM (1 << NI_HISTOGRAM_SUB_BUCKET_BITS)
+#define NI_HISTOGRAM_HALF_SUB_BUCKET_NUM (1 << (NI_HISTOGRAM_SUB_BUCKET_BITS - 1))
+#define NI_FRAME_TIMING_EXPORT_SIZE 4096
+#define NI_FRAME_TIMING_VALIDATION_CSV "frame_timing_validation.csv"
+#define NI_FRAME_TIMING_VALIDATION_JSON "frame_timing_validation.json"
+
+static const char* metricNames[ni::FRAME_TIMING_METRIC_COUNT] = { "cpu_frame", "gpu_frame", "present_wait" };
+
+// Values below NI_HISTOGRAM_SUB_BUCKET_NUM map to themselves. Above that every power of two gets
+// NI_HISTOGRAM_HALF_SUB_BUCKET_NUM buckets, indexed by the bits below the highest one.
+static uint32_t getBucketIndex(uint64_t value) {
+    if (value < NI_HISTOGRAM_SUB_BUCKET_NUM) return (uint32_t)value;
+    uint32_t shift = findLastSet(value) - (NI_HISTOGRAM_SUB_BUCKET_BITS - 1);
+    uint32_t subBucket = (uint32_t)(value >> shift) - NI_HISTOGRAM_HALF_SUB_BUCKET_NUM;
+    return NI_HISTOGRAM_SUB_BUCKET_NUM + (shift - 1) * NI_HISTOGRAM_HALF_SUB_BUCKET_NUM + subBucket;
+}
+
+static uint64_t getBucketHighestValue(uint32_t index) {
+    if (index < NI_HISTOGRAM_SUB_BUCKET_NUM) return index;
+    uint32_t offset = index - NI_HISTOGRAM_SUB_BUCKET_NUM;
+    uint32_t shift = offset / NI_HISTOGRAM_HALF_SUB_BUCKET_NUM + 1;
+    uint64_t subBucket = offset % NI_HISTOGRAM_HALF_SUB_BUCKET_NUM + NI_HISTOGRAM_HALF_SUB_BUCKET_NUM;
+    return (subBucket << shift) + (1ull << shift) - 1;
+}
+
+ni::Histogram::Histogram() {
+    reset();
+}
+
+void ni::Histogram::reset() {
+    memset(counts, 0, sizeof(counts));
+    sampleNum = 0;
+    valueSum = 0;
+    minValue = ~0ull;
+    maxValue = 0;
+}
+
+void ni::Histogram::record(uint64_t value) {
+    const uint64_t largestValue = (1ull << NI_HISTOGRAM_MAX_VALUE_BITS) - 1;
+    value = value < largestValue ? value : largestValue;
+    counts[getBucketIndex(value)]++;
+    sampleNum++;
+    valueSum += value;
+    minValue = value < minValue ? value : minValue;
+    maxValue = value > maxValue ? value : maxValue;
+}
+
+uint64_t ni::Histogram::getPercentile(double percentile) const {
+    if (sampleNum == 0) return 0;
+    percentile = percentile < 0.0 ? 0.0 : (percentile > 100.0 ? 100.0 : percentile);
+    uint64_t rank = (uint64_t)ceil(percentile * 0.01 * (double)sampleNum);
+    rank = rank > 0 ? rank : 1;
+    uint64_t counted = 0;
+    for (uint32_t index = 0; index < NI_HISTOGRAM_BUCKET_NUM; ++index) {
+        counted += counts[index];
+        if (counted >= rank) {
+            // The top bucket is wider than the values that actually landed in it.
+            uint64_t value = getBucketHighestValue(index);
+            return value < maxValue ? value : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+void ni::FrameTiming::reset() {
+    for (uint32_t metric = 0; metric < FRAME_TIMING_METRIC_COUNT; ++metric) {
+        histograms[metric].reset();
+    }
+}
+
+void ni::FrameTiming::record(FrameTimingMetric metric, double milliseconds) {
+    histograms[metric].record(milliseconds > 0.0 ? (uint64_t)(milliseconds * 1000.0 + 0.5) : 0);
+}
+
+ni::FrameTimingSummary ni::FrameTiming::getSummary(FrameTimingMetric metric) const {
+    const Histogram& histogram = histograms[metric];
+    FrameTimingSummary summary = {};
+    summary.sampleNum = histogram.getSampleNum();
+    summary.meanMs = histogram.getMean() * 0.001;
+    summary.p50Ms = (double)histogram.getPercentile(50.0) * 0.001;
+    summary.p95Ms = (double)histogram.getPercentile(95.0) * 0.001;
+    summary.p99Ms = (double)histogram.getPercentile(99.0) * 0.001;
+    summary.maxMs = (double)histogram.getMax() * 0.001;
+    return summary;
+}
+
+void ni::FrameTiming::log() const {
+    for (uint32_t metric = 0; metric < FRAME_TIMING_METRIC_COUNT; ++metric) {
+        FrameTimingSummary summary = getSummary((FrameTimingMetric)metric);
+        if (summary.sampleNum == 0) continue;
+        NI_LOG("  %-12s p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms over %llu frames", metricNames[metric],
+            summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs, summary.sampleNum);
+    }
+}
+
+bool ni::FrameTiming::exportCsv(const char* path) const {
+    char text[NI_FRAME_TIMING_EXPORT_SIZE];
+    int size = snprintf(text, sizeof(text), "metric,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+    for (uint32_t metric = 0; metric < FRAME_TIMING_METRIC_COUNT; ++metric) {
+        FrameTimingSummary summary = getSummary((FrameTimingMetric)metric);
+        size += snprintf(text + size, sizeof(text) - size, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", metricNames[metric],
+            summary.sampleNum, summary.meanMs, summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs);
+    }
+    return writeFile(path, text, size);
+}
+
+bool ni::FrameTiming::exportJson(const char* path) const {
+    char text[NI_FRAME_TIMING_EXPORT_SIZE];
+    int size = snprintf(text, sizeof(text), "{\n");
+    for (uint32_t metric = 0; metric < FRAME_TIMING_METRIC_COUNT; ++metric) {
+        FrameTimingSummary summary = getSummary((FrameTimingMetric)metric);
+        size += snprintf(text + size, sizeof(text) - size, "  \"%s\": {\"samples\": %llu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}%s\n",
+            metricNames[metric], summary.sampleNum, summary.meanMs, summary.p50Ms, summary.p95Ms, summary.p99Ms, summary.maxMs,
+            metric + 1 < FRAME_TIMING_METRIC_COUNT ? "," : "");
+    }
+    size += snprintf(text + size, sizeof(text) - size, "}\n");
+    return writeFile(path, text, size);
+}
+
+const char* ni::getFrameTimingMetricName(FrameTimingMetric metric) {
+    return metricNames[metric];
+}
+
+// The reported value has to be the exact one or above it by less than the bucket precision.
+static bool withinPrecision(uint64_t reported, uint64_t exact) {
+    return reported >= exact && reported - exact <= exact / NI_HISTOGRAM_HALF_SUB_BUCKET_NUM;
+}
+
+uint32_t ni::validateFrameTiming() {
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+
+    // Every value from 1 us to 100 ms once, in scrambled order. The exact percentile is its rank.
+    const uint64_t valueNum = 100000;
+    Histogram* histogram = new Histogram();
+    for (uint64_t index = 0; index < valueNum; ++index) {
+        histogram->record((index * 7919) % valueNum + 1);
+    }
+    const double percentiles[] = { 0.0, 1.0, 25.0, 50.0, 90.0, 95.0, 99.0, 99.9, 100.0 };
+    for (uint32_t index = 0; index < sizeof(percentiles) / sizeof(percentiles[0]); ++index) {
+        uint64_t exact = (uint64_t)ceil(percentiles[index] * 0.01 * (double)valueNum);
+        exact = exact > 0 ? exact : 1;
+        uint64_t reported = histogram->getPercentile(percentiles[index]);
+        checkNum++;
+        if (!withinPrecision(reported, exact)) {
+            NI_LOG("Frame timing: p%.1f is %llu instead of %llu", percentiles[index], reported, exact);
+            errorNum++;
+        }
+    }
+    checkNum++;
+    if (histogram->getMin() != 1 || histogram->getMax() != valueNum || histogram->getSampleNum() != valueNum || fabs(histogram->getMean() - (double)(valueNum + 1) * 0.5) > 1e-6) {
+        NI_LOG("Frame timing: min %llu, max %llu, mean %.3f over %llu values", histogram->getMin(), histogram->getMax(), histogram->getMean(), histogram->getSampleNum());
+        errorNum++;
+    }
+    // Values past the range are clamped instead of indexing out of the buckets.
+    histogram->reset();
+    histogram->record(~0ull);
+    checkNum++;
+    if (histogram->getMax() != (1ull << NI_HISTOGRAM_MAX_VALUE_BITS) - 1 || histogram->getPercentile(50.0) != histogram->getMax()) {
+        NI_LOG("Frame timing: a huge value was recorded as %llu", histogram->getMax());
+        errorNum++;
+    }
+    delete histogram;
+
+    // 60 Hz frames with one 50 ms hitch every 200 frames. The average barely moves, the tail shows it.
+    FrameTiming* timing = new FrameTiming();
+    const uint32_t frameNum = 20000;
+    for (uint32_t frame = 0; frame < frameNum; ++frame) {
+        bool hitch = frame % 200 == 199;
+        timing->record(FRAME_TIMING_CPU_FRAME, hitch ? 50.0 : 4.0);
+        timing->record(FRAME_TIMING_GPU_FRAME, 12.5);
+        timing->record(FRAME_TIMING_PRESENT_WAIT, hitch ? 0.0 : 16.667 - 4.0);
+    }
+    FrameTimingSummary cpu = timing->getSummary(FRAME_TIMING_CPU_FRAME);
+    FrameTimingSummary gpu = timing->getSummary(FRAME_TIMING_GPU_FRAME);
+    FrameTimingSummary presentWait = timing->getSummary(FRAME_TIMING_PRESENT_WAIT);
+    checkNum++;
+    if (!withinPrecision((uint64_t)(cpu.p50Ms * 1000.0 + 0.5), 4000) || !withinPrecision((uint64_t)(cpu.p99Ms * 1000.0 + 0.5), 4000) ||
+        cpu.maxMs != 50.0 || cpu.sampleNum != frameNum || fabs(cpu.meanMs - (4.0 * 199.0 + 50.0) / 200.0) > 1e-6) {
+        NI_LOG("Frame timing: CPU frame p50 %.3f, p99 %.3f, max %.3f, mean %.3f ms", cpu.p50Ms, cpu.p99Ms, cpu.maxMs, cpu.meanMs);
+        errorNum++;
+    }
+    checkNum++;
+    if (!withinPrecision(timing->getHistogram(FRAME_TIMING_CPU_FRAME).getPercentile(99.9), 50000) ||
+        !withinPrecision((uint64_t)(gpu.p95Ms * 1000.0 + 0.5), 12500) || !withinPrecision((uint64_t)(presentWait.p50Ms * 1000.0 + 0.5), 12667) || presentWait.p95Ms < presentWait.p50Ms) {
+        NI_LOG("Frame timing: CPU frame p99.9 %llu us, GPU frame p95 %.3f ms, present wait p50 %.3f ms", timing->getHistogram(FRAME_TIMING_CPU_FRAME).getPercentile(99.9), gpu.p95Ms, presentWait.p50Ms);
+        errorNum++;
+    }
+
+    checkNum++;
+    bool csvWritten = timing->exportCsv(NI_FRAME_TIMING_VALIDATION_CSV);
+    bool jsonWritten = timing->exportJson(NI_FRAME_TIMING_VALIDATION_JSON);
+    if (!csvWritten || !jsonWritten || getFileSize(NI_FRAME_TIMING_VALIDATION_CSV) == 0 || getFileSize(NI_FRAME_TIMING_VALIDATION_JSON) == 0) {
+        NI_LOG("Frame timing: failed to export %s and %s", NI_FRAME_TIMING_VALIDATION_CSV, NI_FRAME_TIMING_VALIDATION_JSON);
+        errorNum++;
+    }
+    remove(NI_FRAME_TIMING_VALIDATION_CSV);
+    remove(NI_FRAME_TIMING_VALIDATION_JSON);
+    timing->log();
+    delete timing;
+    NI_LOG("Frame timing: %u checks, %u error(s)", checkNum, errorNum);
+    return errorNum;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "ni_core.h"
+
+// Values below 2^NI_HISTOGRAM_SUB_BUCKET_BITS are counted exactly, larger ones in buckets that keep this many
+// significant bits, so every value is within 1 / 2^(NI_HISTOGRAM_SUB_BUCKET_BITS - 1) of the one reported.
+#define NI_HISTOGRAM_SUB_BUCKET_BITS 8
+// Values are clamped to 2^NI_HISTOGRAM_MAX_VALUE_BITS - 1, in microseconds that's about 19 hours.
+#define NI_HISTOGRAM_MAX_VALUE_BITS 36
+#define NI_HISTOGRAM_BUCKET_NUM ((1 << NI_HISTOGRAM_SUB_BUCKET_BITS) + (NI_HISTOGRAM_MAX_VALUE_BITS - NI_HISTOGRAM_SUB_BUCKET_BITS) * (1 << (NI_HISTOGRAM_SUB_BUCKET_BITS - 1)))
+
+namespace ni {
+
+	// HDR histogram style: log2 buckets split into linear sub-buckets, so tail percentiles keep the same
+	// relative precision as the median. Recording is a few shifts and an increment, nothing is allocated.
+	struct Histogram {
+		Histogram();
+
+		void reset();
+		void record(uint64_t value);
+		// Highest value that falls into the same bucket as the one at the percentile, 0 when empty.
+		uint64_t getPercentile(double percentile) const;
+		uint64_t getMax() const { return maxValue; }
+		uint64_t getMin() const { return sampleNum > 0 ? minValue : 0; }
+		double getMean() const { return sampleNum > 0 ? (double)valueSum / (double)sampleNum : 0.0; }
+		uint64_t getSampleNum() const { return sampleNum; }
+
+	private:
+		uint64_t counts[NI_HISTOGRAM_BUCKET_NUM];
+		uint64_t sampleNum;
+		uint64_t valueSum;
+		uint64_t minValue;
+		uint64_t maxValue;
+	};
+
+	enum FrameTimingMetric {
+		// CPU time of a frame between presents, without the time it was blocked in present and frame waits.
+		FRAME_TIMING_CPU_FRAME,
+		// Direct queue time of a frame, from the GPU profiler's frame scope.
+		FRAME_TIMING_GPU_FRAME,
+		// Time the CPU was blocked in present and waiting for frames to retire.
+		FRAME_TIMING_PRESENT_WAIT,
+		FRAME_TIMING_METRIC_COUNT
+	};
+
+	struct FrameTimingSummary {
+		uint64_t sampleNum;
+		double meanMs;
+		double p50Ms;
+		double p95Ms;
+		double p99Ms;
+		double maxMs;
+	};
+
+	// Durations are recorded with microsecond resolution.
+	struct FrameTiming {
+		void reset();
+		void record(FrameTimingMetric metric, double milliseconds);
+		FrameTimingSummary getSummary(FrameTimingMetric metric) const;
+		const Histogram& getHistogram(FrameTimingMetric metric) const { return histograms[metric]; }
+		void log() const;
+		// One row per metric: metric,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms.
+		bool exportCsv(const char* path) const;
+		// One object per metric with the same fields as the CSV.
+		bool exportJson(const char* path) const;
+
+	private:
+		Histogram histograms[FRAME_TIMING_METRIC_COUNT];
+	};
+
+	const char* getFrameTimingMetricName(FrameTimingMetric metric);
+	// Records known distributions and checks the percentiles against the exact ones, then exports both formats.
+	uint32_t validateFrameTiming();
+}
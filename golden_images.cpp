@@ -0,0 +1,439 @@
+#include "golden_images.h"
+#include "async_loader.h"
+#include "cpu_trace.h"
+#include "image_codec.h"
+#include "software_rasterizer.h"
+#include "sprite_mesh.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_GOLDEN_MAX_SPRITES 20000
+#define NI_GOLDEN_MAX_PATH 512
+#define NI_GOLDEN_EXPORT_SIZE (16 * 1024)
+#define NI_GOLDEN_TIMINGS_FILE "timings.csv"
+#define NI_GOLDEN_TEXTURE_SIZE 64
+
+// Each texture is its own mesh slot, see goldenTextureId.
+enum GoldenTexture : uint32_t {
+    // Opaque checker with a full mip chain, shows filtering and mip selection.
+    GOLDEN_TEXTURE_CHECKER,
+    // Soft disc with transparent corners and a trimmed octagon mesh.
+    GOLDEN_TEXTURE_DISC,
+    // Alpha ramp from 0 on the left, the first column is discarded.
+    GOLDEN_TEXTURE_RAMP,
+    GOLDEN_TEXTURE_COUNT
+};
+
+struct GoldenScene {
+    const char* name;
+    uint32_t (*build)(DrawCommand* commands);
+};
+
+// Scenes have to be the same on every run and machine, so they don't share ni::randomUint's state.
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static float nextRandomFloat(uint32_t& state) {
+    return (float)(nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static inline uint32_t goldenTextureId(GoldenTexture texture) {
+    return (uint32_t)texture | ((uint32_t)texture << TEXTURE_ID_MESH_SHIFT);
+}
+
+static inline void addSprite(DrawCommand* commands, uint32_t& commandNum, float x, float y, float size, float rotation, uint32_t color, GoldenTexture texture) {
+    commands[commandNum++] = { { -size * 0.5f, -size * 0.5f, size, size }, { x, y, 1.0f, rotation }, color, goldenTextureId(texture) };
+}
+
+// Argument evaluation order differs between compilers, so every draw from the generator is its own statement.
+static uint32_t randomColor(uint32_t& state) {
+    uint32_t r = 64 + nextRandom(state) % 192;
+    uint32_t g = 64 + nextRandom(state) % 192;
+    uint32_t b = 64 + nextRandom(state) % 192;
+    return NI_COLOR_RGBA_UINT(r, g, b, 0xff);
+}
+
+// Axis aligned opaque sprites at whole and half pixel sizes, with and without tint.
+static uint32_t buildOpaqueGrid(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0x1b873593u;
+    for (uint32_t y = 0; y < 9; ++y) {
+        for (uint32_t x = 0; x < 16; ++x) {
+            uint32_t color = (x + y) % 3 == 0 ? NI_COLOR_UINT(0xffffffff) : randomColor(state);
+            addSprite(commands, commandNum, 15.0f + x * 30.0f, 15.0f + y * 30.0f, 20.0f + (float)(x % 4) * 2.5f, 0.0f, color, GOLDEN_TEXTURE_CHECKER);
+        }
+    }
+    return commandNum;
+}
+
+// Translucent discs over each other, the result depends on the blending order.
+static uint32_t buildAlphaStack(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0xcc9e2d51u;
+    for (uint32_t index = 0; index < 200; ++index) {
+        uint32_t color = randomColor(state) & 0x00ffffffu;
+        color |= (uint32_t)(96 + nextRandom(state) % 128) << 24;
+        float x = 140.0f + nextRandomFloat(state) * 200.0f;
+        float y = 60.0f + nextRandomFloat(state) * 150.0f;
+        float size = 24.0f + nextRandomFloat(state) * 80.0f;
+        addSprite(commands, commandNum, x, y, size, 0.0f, color, GOLDEN_TEXTURE_DISC);
+    }
+    return commandNum;
+}
+
+// Subpixel positions and arbitrary rotations, where coverage rules and snapping show.
+static uint32_t buildRotatedSubpixel(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0xe6546b64u;
+    for (uint32_t index = 0; index < 300; ++index) {
+        GoldenTexture texture = index % 3 == 0 ? GOLDEN_TEXTURE_RAMP : GOLDEN_TEXTURE_CHECKER;
+        float x = nextRandomFloat(state) * NI_GOLDEN_WIDTH;
+        float y = nextRandomFloat(state) * NI_GOLDEN_HEIGHT;
+        float size = 8.0f + nextRandomFloat(state) * 40.0f;
+        float rotation = nextRandomFloat(state) * 6.2831853f;
+        addSprite(commands, commandNum, x, y, size, rotation, NI_COLOR_UINT(0xffffffff), texture);
+    }
+    return commandNum;
+}
+
+// Sprites from a few pixels down to below one, every level of the chain gets sampled.
+static uint32_t buildMinifiedMips(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0x85ebca6bu;
+    for (uint32_t index = 0; index < 2000; ++index) {
+        float x = nextRandomFloat(state) * NI_GOLDEN_WIDTH;
+        float y = nextRandomFloat(state) * NI_GOLDEN_HEIGHT;
+        float size = 0.5f + nextRandomFloat(state) * 12.0f;
+        float rotation = nextRandomFloat(state) * 6.2831853f;
+        addSprite(commands, commandNum, x, y, size, rotation, NI_COLOR_UINT(0xffffffff), GOLDEN_TEXTURE_CHECKER);
+    }
+    return commandNum;
+}
+
+// Most sprites outside the view and some across its edges, SpriteGen's culling decides what's left.
+static uint32_t buildCulling(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0xc2b2ae35u;
+    for (uint32_t index = 0; index < NI_GOLDEN_MAX_SPRITES; ++index) {
+        float x = nextRandomFloat(state) * NI_GOLDEN_WIDTH * 5.0f - NI_GOLDEN_WIDTH * 2.0f;
+        float y = nextRandomFloat(state) * NI_GOLDEN_HEIGHT * 5.0f - NI_GOLDEN_HEIGHT * 2.0f;
+        float size = 16.0f + nextRandomFloat(state) * 32.0f;
+        float rotation = nextRandomFloat(state) * 6.2831853f;
+        addSprite(commands, commandNum, x, y, size, rotation, randomColor(state), GOLDEN_TEXTURE_DISC);
+    }
+    return commandNum;
+}
+
+// Many small blended sprites, the one the timing gate watches most.
+static uint32_t buildDenseSmall(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    uint32_t state = 0x27d4eb2fu;
+    for (uint32_t index = 0; index < NI_GOLDEN_MAX_SPRITES; ++index) {
+        GoldenTexture texture = (GoldenTexture)(index % GOLDEN_TEXTURE_COUNT);
+        float x = nextRandomFloat(state) * NI_GOLDEN_WIDTH;
+        float y = nextRandomFloat(state) * NI_GOLDEN_HEIGHT;
+        float size = 2.0f + nextRandomFloat(state) * 10.0f;
+        float rotation = nextRandomFloat(state) * 6.2831853f;
+        addSprite(commands, commandNum, x, y, size, rotation, randomColor(state), texture);
+    }
+    return commandNum;
+}
+
+// Tints whose channels add up to exactly 1 are ignored by SpriteRender_PS, the others multiply.
+static uint32_t buildTintQuirk(DrawCommand* commands) {
+    uint32_t commandNum = 0;
+    const uint32_t colors[] = {
+        NI_COLOR_RGBA_UINT(0xff, 0, 0, 0), NI_COLOR_RGBA_UINT(0, 0, 0, 0xff), NI_COLOR_RGBA_UINT(0x80, 0x7f, 0, 0),
+        NI_COLOR_RGBA_UINT(0xff, 0, 0, 0xff), NI_COLOR_RGBA_UINT(0, 0xff, 0, 0x80), NI_COLOR_RGBA_UINT(0x40, 0x40, 0xff, 0xff),
+    };
+    for (uint32_t index = 0; index < sizeof(colors) / sizeof(colors[0]); ++index) {
+        addSprite(commands, commandNum, 40.0f + index * 80.0f, 70.0f, 64.0f, 0.0f, colors[index], GOLDEN_TEXTURE_CHECKER);
+        addSprite(commands, commandNum, 40.0f + index * 80.0f, 190.0f, 64.0f, 0.0f, colors[index], GOLDEN_TEXTURE_DISC);
+    }
+    return commandNum;
+}
+
+static const GoldenScene goldenScenes[] = {
+    { "opaque_grid", buildOpaqueGrid },
+    { "alpha_stack", buildAlphaStack },
+    { "rotated_subpixel", buildRotatedSubpixel },
+    { "minified_mips", buildMinifiedMips },
+    { "culling", buildCulling },
+    { "dense_small", buildDenseSmall },
+    { "tint_quirk", buildTintQuirk },
+};
+static const uint32_t goldenSceneNum = sizeof(goldenScenes) / sizeof(goldenScenes[0]);
+
+static void buildTexturePixels(GoldenTexture texture, uint8_t* pixels) {
+    const float center = (NI_GOLDEN_TEXTURE_SIZE - 1) * 0.5f;
+    for (uint32_t y = 0; y < NI_GOLDEN_TEXTURE_SIZE; ++y) {
+        for (uint32_t x = 0; x < NI_GOLDEN_TEXTURE_SIZE; ++x) {
+            uint8_t* pixel = &pixels[(y * NI_GOLDEN_TEXTURE_SIZE + x) * 4];
+            if (texture == GOLDEN_TEXTURE_CHECKER) {
+                bool dark = ((x / 8) + (y / 8)) % 2 != 0;
+                pixel[0] = dark ? 40 : 230;
+                pixel[1] = dark ? 60 : 210;
+                pixel[2] = dark ? 90 : 160;
+                pixel[3] = 0xff;
+            } else if (texture == GOLDEN_TEXTURE_DISC) {
+                float distance = sqrtf(((float)x - center) * ((float)x - center) + ((float)y - center) * ((float)y - center)) / (center + 0.5f);
+                float alpha = std::clamp((1.0f - distance) * 3.0f, 0.0f, 1.0f);
+                pixel[0] = 0xff;
+                pixel[1] = (uint8_t)(255.0f - distance * 120.0f);
+                pixel[2] = (uint8_t)(255.0f - distance * 200.0f);
+                pixel[3] = (uint8_t)(alpha * 255.0f);
+            } else {
+                pixel[0] = (uint8_t)(y * 4);
+                pixel[1] = 0xff;
+                pixel[2] = (uint8_t)(255 - y * 4);
+                pixel[3] = (uint8_t)(x * 255 / (NI_GOLDEN_TEXTURE_SIZE - 1));
+            }
+        }
+    }
+}
+
+static void* readWholeFile(const char* path, size_t& outSize) {
+    outSize = ni::getFileSize(path);
+    return outSize > 0 ? ni::allocReadFile(path) : nullptr;
+}
+
+// Recorded total time of a scene, negative when it's missing or was recorded with another thread count.
+static double findBaseline(const char* timings, const char* scene, uint32_t threadNum) {
+    if (timings == nullptr) return -1.0;
+    for (const char* line = timings; *line != '\0';) {
+        char name[64];
+        uint32_t recordedThreadNum = 0;
+        double totalMs = 0.0;
+        if (sscanf(line, "%63[^,],%u,%lf", name, &recordedThreadNum, &totalMs) == 3 && strcmp(name, scene) == 0) {
+            return recordedThreadNum == threadNum ? totalMs : -1.0;
+        }
+        const char* next = strchr(line, '\n');
+        if (next == nullptr) break;
+        line = next + 1;
+    }
+    return -1.0;
+}
+
+static bool writeQoi(const char* path, const uint32_t* pixels, uint32_t width, uint32_t height) {
+    size_t size = 0;
+    void* data = ni::encodeQoi(pixels, width, height, width * 4, false, size);
+    bool written = ni::writeFile(path, data, size);
+    free(data);
+    return written;
+}
+
+// Mismatches in red over a dimmed copy of the golden image.
+static void compareImages(const uint32_t* pixels, const uint32_t* golden, uint32_t pixelNum, ni::GoldenSceneResult& result, uint32_t* outDiff) {
+    for (uint32_t index = 0; index < pixelNum; ++index) {
+        uint32_t difference = 0;
+        for (uint32_t channel = 0; channel < 3; ++channel) {
+            int32_t channelDifference = (int32_t)((pixels[index] >> (channel * 8)) & 0xff) - (int32_t)((golden[index] >> (channel * 8)) & 0xff);
+            difference = std::max(difference, (uint32_t)abs(channelDifference));
+        }
+        result.maxChannelDifference = std::max(result.maxChannelDifference, difference);
+        bool mismatch = difference > NI_GOLDEN_CHANNEL_TOLERANCE;
+        result.mismatchNum += mismatch ? 1 : 0;
+        uint32_t dimmed = ((golden[index] & 0xff) + ((golden[index] >> 8) & 0xff) + ((golden[index] >> 16) & 0xff)) / 12;
+        outDiff[index] = mismatch ? NI_COLOR_RGB_UINT(0xff, 0, 0) : NI_COLOR_RGB_UINT(dimmed, dimmed, dimmed);
+    }
+}
+
+static const char* getTimeStatusName(ni::GoldenTimeStatus status) {
+    switch (status) {
+    case ni::GOLDEN_TIME_PASSED: return "passed";
+    case ni::GOLDEN_TIME_SLOWER: return "slower";
+    case ni::GOLDEN_TIME_NO_BASELINE: return "no_baseline";
+    }
+    return "unknown";
+}
+
+static void logResult(const ni::GoldenSceneResult& result, bool update) {
+    if (update) {
+        NI_LOG(" %-18s %6u sprites, generate %7.3f ms, draw %7.3f ms, recorded", result.name, result.spriteNum, result.generateMs, result.drawMs);
+        return;
+    }
+    char baseline[32] = "no baseline";
+    if (result.baselineMs >= 0.0) {
+        snprintf(baseline, sizeof(baseline), "baseline %7.3f ms", result.baselineMs);
+    }
+    NI_LOG(" %-18s %6u sprites, generate %7.3f ms, draw %7.3f ms, %s %s, image %s (%u mismatches, max difference %u)",
+        result.name, result.spriteNum, result.generateMs, result.drawMs, baseline,
+        result.timeStatus == ni::GOLDEN_TIME_PASSED ? "ok" : result.timeStatus == ni::GOLDEN_TIME_SLOWER ? "SLOWER" : "UNGATED",
+        !result.hasGolden ? "MISSING" : result.imagePassed ? "ok" : "DIFFERS", result.mismatchNum, result.maxChannelDifference);
+}
+
+static bool exportResults(const ni::GoldenSceneResult* results, uint32_t resultNum, const char* csvPath, const char* jsonPath) {
+    char* text = (char*)malloc(NI_GOLDEN_EXPORT_SIZE);
+    int size = snprintf(text, NI_GOLDEN_EXPORT_SIZE, "scene,sprites,has_golden,image_passed,mismatches,max_difference,generate_ms,draw_ms,baseline_ms,time_status\n");
+    for (uint32_t index = 0; index < resultNum; ++index) {
+        const ni::GoldenSceneResult& result = results[index];
+        size += snprintf(text + size, NI_GOLDEN_EXPORT_SIZE - size, "%s,%u,%d,%d,%u,%u,%.4f,%.4f,%.4f,%s\n", result.name, result.spriteNum,
+            result.hasGolden, result.imagePassed, result.mismatchNum, result.maxChannelDifference, result.generateMs, result.drawMs, result.baselineMs,
+            getTimeStatusName(result.timeStatus));
+    }
+    bool written = ni::writeFile(csvPath, text, size);
+
+    size = snprintf(text, NI_GOLDEN_EXPORT_SIZE, "[\n");
+    for (uint32_t index = 0; index < resultNum; ++index) {
+        const ni::GoldenSceneResult& result = results[index];
+        size += snprintf(text + size, NI_GOLDEN_EXPORT_SIZE - size,
+            "%s  {\"scene\": \"%s\", \"sprites\": %u, \"has_golden\": %s, \"image_passed\": %s, \"mismatches\": %u, \"max_difference\": %u, "
+            "\"generate_ms\": %.4f, \"draw_ms\": %.4f, \"baseline_ms\": %.4f, \"time_status\": \"%s\"}",
+            index > 0 ? ",\n" : "", result.name, result.spriteNum, result.hasGolden ? "true" : "false", result.imagePassed ? "true" : "false",
+            result.mismatchNum, result.maxChannelDifference, result.generateMs, result.drawMs, result.baselineMs, getTimeStatusName(result.timeStatus));
+    }
+    size += snprintf(text + size, NI_GOLDEN_EXPORT_SIZE - size, "\n]\n");
+    written &= ni::writeFile(jsonPath, text, size);
+    free(text);
+    if (written) {
+        NI_LOG("Golden image results written to %s and %s", csvPath, jsonPath);
+    } else {
+        NI_LOG("Failed to write golden image results %s and %s", csvPath, jsonPath);
+    }
+    return written;
+}
+
+uint32_t ni::runGoldenImages(const char* goldenDir, bool update, const char* csvPath, const char* jsonPath) {
+    const uint32_t width = NI_GOLDEN_WIDTH;
+    const uint32_t height = NI_GOLDEN_HEIGHT;
+    const uint32_t threadNum = getLoaderThreadNum();
+    NI_LOG("Golden images %s %s at %ux%u, %u loader threads:", update ? "recorded to" : "checked against", goldenDir, width, height, threadNum);
+
+    SoftwareRasterizer rasterizer;
+    rasterizer.init(width, height);
+    const uint32_t mipLevels = getMipLevelCount(NI_GOLDEN_TEXTURE_SIZE, NI_GOLDEN_TEXTURE_SIZE);
+    uint8_t* pixels = (uint8_t*)malloc(NI_GOLDEN_TEXTURE_SIZE * NI_GOLDEN_TEXTURE_SIZE * 4);
+    void* mipChains[GOLDEN_TEXTURE_COUNT];
+    SpriteMesh meshes[GOLDEN_TEXTURE_COUNT];
+    for (uint32_t texture = 0; texture < GOLDEN_TEXTURE_COUNT; ++texture) {
+        buildTexturePixels((GoldenTexture)texture, pixels);
+        mipChains[texture] = malloc(getMipChainSizeRGBA8(NI_GOLDEN_TEXTURE_SIZE, NI_GOLDEN_TEXTURE_SIZE, mipLevels));
+        generateMipChainRGBA8(pixels, NI_GOLDEN_TEXTURE_SIZE, NI_GOLDEN_TEXTURE_SIZE, mipLevels, mipChains[texture]);
+        meshes[texture] = buildSpriteMesh(pixels, NI_GOLDEN_TEXTURE_SIZE, NI_GOLDEN_TEXTURE_SIZE);
+        rasterizer.setTexture(texture, { (const uint8_t*)mipChains[texture], NI_GOLDEN_TEXTURE_SIZE, NI_GOLDEN_TEXTURE_SIZE, mipLevels });
+    }
+    free(pixels);
+
+    char path[NI_GOLDEN_MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", goldenDir, NI_GOLDEN_TIMINGS_FILE);
+    size_t timingsSize = 0;
+    char* timings = nullptr;
+    if (!update) {
+        void* timingsFile = readWholeFile(path, timingsSize);
+        if (timingsFile != nullptr) {
+            timings = (char*)malloc(timingsSize + 1);
+            memcpy(timings, timingsFile, timingsSize);
+            timings[timingsSize] = '\0';
+            free(timingsFile);
+        }
+    }
+    char* recorded = (char*)malloc(NI_GOLDEN_EXPORT_SIZE);
+    int recordedSize = snprintf(recorded, NI_GOLDEN_EXPORT_SIZE, "scene,loader_threads,total_ms\n");
+
+    DrawCommand* commands = (DrawCommand*)malloc(NI_GOLDEN_MAX_SPRITES * sizeof(DrawCommand));
+    SpriteQuad* quads = (SpriteQuad*)malloc(NI_GOLDEN_MAX_SPRITES * sizeof(SpriteQuad));
+    uint32_t* diff = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+    GoldenSceneResult results[goldenSceneNum];
+    uint32_t failedNum = 0;
+    uint32_t noBaselineNum = 0;
+    for (uint32_t sceneIndex = 0; sceneIndex < goldenSceneNum; ++sceneIndex) {
+        NI_TRACE_SCOPE("Golden scene");
+        const GoldenScene& scene = goldenScenes[sceneIndex];
+        GoldenSceneResult& result = results[sceneIndex];
+        result = {};
+        result.name = scene.name;
+        result.spriteNum = scene.build(commands);
+        result.baselineMs = -1.0;
+        // The fastest run is the one least disturbed by the rest of the machine.
+        double bestMs = 0.0;
+        for (uint32_t run = 0; run < NI_GOLDEN_TIMING_RUNS; ++run) {
+            rasterizer.clear(NI_COLOR_RGBA_UINT(0, 0, 0, 0xff));
+            double startTime = getSeconds();
+            generateSpritesCpu(commands, result.spriteNum, meshes, (float)width, (float)height, quads);
+            double generateTime = getSeconds();
+            rasterizer.drawSprites(quads, result.spriteNum);
+            double drawTime = getSeconds();
+            double runMs = (drawTime - startTime) * 1000.0;
+            if (run == 0 || runMs < bestMs) {
+                bestMs = runMs;
+                result.generateMs = (generateTime - startTime) * 1000.0;
+                result.drawMs = (drawTime - generateTime) * 1000.0;
+            }
+        }
+        recordedSize += snprintf(recorded + recordedSize, NI_GOLDEN_EXPORT_SIZE - recordedSize, "%s,%u,%.4f\n", scene.name, threadNum, bestMs);
+
+        snprintf(path, sizeof(path), "%s/%s.qoi", goldenDir, scene.name);
+        if (update) {
+            result.hasGolden = writeQoi(path, rasterizer.getPixels(), width, height);
+            result.imagePassed = result.hasGolden;
+            result.timeStatus = GOLDEN_TIME_PASSED;
+            if (!result.hasGolden) {
+                NI_LOG("Failed to write golden image %s", path);
+                failedNum++;
+            }
+            logResult(result, update);
+            continue;
+        }
+
+        size_t goldenSize = 0;
+        void* goldenFile = readWholeFile(path, goldenSize);
+        uint32_t goldenWidth = 0;
+        uint32_t goldenHeight = 0;
+        uint32_t* golden = goldenFile != nullptr ? (uint32_t*)decodeQoi(goldenFile, goldenSize, goldenWidth, goldenHeight) : nullptr;
+        free(goldenFile);
+        result.hasGolden = golden != nullptr && goldenWidth == width && goldenHeight == height;
+        if (result.hasGolden) {
+            compareImages(rasterizer.getPixels(), golden, width * height, result, diff);
+            result.imagePassed = result.mismatchNum <= (uint32_t)(width * height * NI_GOLDEN_MISMATCH_FRACTION);
+        }
+        free(golden);
+        result.baselineMs = findBaseline(timings, scene.name, threadNum);
+        if (result.baselineMs < 0.0) {
+            result.timeStatus = GOLDEN_TIME_NO_BASELINE;
+            noBaselineNum++;
+        } else {
+            result.timeStatus = bestMs <= result.baselineMs * NI_GOLDEN_TIME_RATIO + NI_GOLDEN_TIME_SLACK_MS ? GOLDEN_TIME_PASSED : GOLDEN_TIME_SLOWER;
+        }
+        if (!result.hasGolden || !result.imagePassed) {
+            snprintf(path, sizeof(path), "%s/%s_actual.qoi", goldenDir, scene.name);
+            writeQoi(path, rasterizer.getPixels(), width, height);
+            if (result.hasGolden) {
+                snprintf(path, sizeof(path), "%s/%s_diff.qoi", goldenDir, scene.name);
+                writeQoi(path, diff, width, height);
+            }
+        }
+        failedNum += !result.hasGolden || !result.imagePassed || result.timeStatus == GOLDEN_TIME_SLOWER ? 1 : 0;
+        logResult(result, update);
+    }
+    if (update) {
+        snprintf(path, sizeof(path), "%s/%s", goldenDir, NI_GOLDEN_TIMINGS_FILE);
+        if (!writeFile(path, recorded, recordedSize)) {
+            NI_LOG("Failed to write %s", path);
+            failedNum++;
+        }
+    }
+    NI_LOG("Golden images: %u of %u scenes %s", goldenSceneNum - failedNum, goldenSceneNum, update ? "recorded" : "passed");
+    if (noBaselineNum > 0) {
+        NI_LOG("Golden images: %u scenes have no timing baseline for %u threads, their times weren't gated. --golden-update records them",
+            noBaselineNum, threadNum);
+    }
+    exportResults(results, goldenSceneNum, csvPath, jsonPath);
+
+    free(diff);
+    free(quads);
+    free(commands);
+    free(recorded);
+    free(timings);
+    for (uint32_t texture = 0; texture < GOLDEN_TEXTURE_COUNT; ++texture) {
+        free(mipChains[texture]);
+    }
+    rasterizer.destroy();
+    return failedNum;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ni_core.h"
+
+// Canonical scenes are drawn at this size, small enough that the whole set runs in a few seconds.
+#define NI_GOLDEN_WIDTH 480
+#define NI_GOLDEN_HEIGHT 270
+// A pixel matches when no channel is further than this from the golden one, room for sinf/cosf and float
+// rounding differences between compilers.
+#define NI_GOLDEN_CHANNEL_TOLERANCE 2
+// Share of the pixels allowed to miss it, edges exactly through pixel centers can flip with the last bit.
+#define NI_GOLDEN_MISMATCH_FRACTION 0.001
+// A scene fails the timing gate when it's this much slower than its recorded time plus the slack, the
+// slack keeps scenes that take a fraction of a millisecond from failing on timer noise.
+#define NI_GOLDEN_TIME_RATIO 1.5
+#define NI_GOLDEN_TIME_SLACK_MS 0.5
+#define NI_GOLDEN_TIMING_RUNS 5
+
+namespace ni {
+
+	enum GoldenTimeStatus {
+		GOLDEN_TIME_PASSED,
+		GOLDEN_TIME_SLOWER,
+		// timings.csv is recorded per machine and isn't checked in, a fresh checkout has no baseline. The scene
+		// isn't failed for it but reported apart, --golden-update records one.
+		GOLDEN_TIME_NO_BASELINE,
+	};
+
+	struct GoldenSceneResult {
+		const char* name;
+		uint32_t spriteNum;
+		// False when there was no golden image to compare with, the scene fails then.
+		bool hasGolden;
+		bool imagePassed;
+		// Pixels beyond NI_GOLDEN_CHANNEL_TOLERANCE and the largest channel difference of the image.
+		uint32_t mismatchNum;
+		uint32_t maxChannelDifference;
+		// Fastest of NI_GOLDEN_TIMING_RUNS, generateMs is generateSpritesCpu, drawMs the rasterizer.
+		double generateMs;
+		double drawMs;
+		// Recorded total, negative when there is none or it was taken with another loader thread count.
+		double baselineMs;
+		GoldenTimeStatus timeStatus;
+	};
+
+	// Draws the canonical scenes through the CPU emulation of the sprite pipeline, generateSpritesCpu and
+	// SoftwareRasterizer, and compares them with <goldenDir>/<scene>.qoi and the times in
+	// <goldenDir>/timings.csv. Failing scenes leave <scene>_actual.qoi and <scene>_diff.qoi next to the
+	// goldens. With update the images and times are recorded instead. Results go to csvPath and jsonPath.
+	// Returns the number of failed scenes. Runs on the loader threads, call initLoaderThreads first when
+	// there's no renderer.
+	uint32_t runGoldenImages(const char* goldenDir, bool update, const char* csvPath, const char* jsonPath);
+}
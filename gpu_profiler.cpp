@@ -0,0 +1,284 @@
+#include "gpu_profiler.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_GPU_PROFILER_SLOT_SIZE (GPU_PROFILER_QUEUE_COUNT * NI_GPU_PROFILER_MAX_QUERIES * sizeof(uint64_t))
+#define NI_GPU_PROFILER_VALIDATION_FRAMES 100
+
+static const char* queueNames[ni::GPU_PROFILER_QUEUE_COUNT] = { "direct", "compute", "copy" };
+
+ni::GpuProfiler::GpuProfiler() : slots{}, readbackBuffer{}, headlessTimestamps(nullptr), frequencies{}, queueEnabled{}, currentSlot(0), droppedScopeNum(0), collectedFrameNum(0) {}
+
+void ni::GpuProfiler::init(ID3D12CommandQueue* const queues[GPU_PROFILER_QUEUE_COUNT]) {
+    ID3D12Device* device = getDevice();
+    D3D12_FEATURE_DATA_D3D12_OPTIONS3 options = {};
+    bool copyTimestamps = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS3, &options, sizeof(options)) == S_OK && options.CopyQueueTimestampQueriesSupported;
+    for (uint32_t queue = 0; queue < GPU_PROFILER_QUEUE_COUNT; ++queue) {
+        queueEnabled[queue] = queues[queue] != nullptr && (queue != GPU_PROFILER_QUEUE_COPY || copyTimestamps);
+        if (!queueEnabled[queue]) continue;
+        NI_D3D_ASSERT(queues[queue]->GetTimestampFrequency(&frequencies[queue]), "Failed to get timestamp frequency");
+        for (uint32_t slot = 0; slot < NI_FRAME_COUNT; ++slot) {
+            D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+            queryHeapDesc.Type = queue == GPU_PROFILER_QUEUE_COPY ? D3D12_QUERY_HEAP_TYPE_COPY_QUEUE_TIMESTAMP : D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+            queryHeapDesc.Count = NI_GPU_PROFILER_MAX_QUERIES;
+            queryHeapDesc.NodeMask = 0;
+            NI_D3D_ASSERT(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&slots[slot].queryHeaps[queue])), "Failed to create timestamp query heap");
+            slots[slot].queryHeaps[queue]->SetName(L"GpuProfiler::queryHeap");
+        }
+    }
+    readbackBuffer = createBuffer(L"GpuProfiler::readbackBuffer", NI_FRAME_COUNT * NI_GPU_PROFILER_SLOT_SIZE, READBACK_BUFFER);
+}
+
+void ni::GpuProfiler::initHeadless(const uint64_t queueFrequencies[GPU_PROFILER_QUEUE_COUNT]) {
+    for (uint32_t queue = 0; queue < GPU_PROFILER_QUEUE_COUNT; ++queue) {
+        frequencies[queue] = queueFrequencies[queue];
+        queueEnabled[queue] = queueFrequencies[queue] > 0;
+    }
+    headlessTimestamps = (uint64_t*)calloc(1, NI_FRAME_COUNT * NI_GPU_PROFILER_SLOT_SIZE);
+}
+
+void ni::GpuProfiler::destroy() {
+    for (uint32_t slot = 0; slot < NI_FRAME_COUNT; ++slot) {
+        for (uint32_t queue = 0; queue < GPU_PROFILER_QUEUE_COUNT; ++queue) {
+            NI_D3D_RELEASE(slots[slot].queryHeaps[queue]);
+        }
+        slots[slot].scopes.destroy();
+    }
+    if (readbackBuffer.resource != nullptr) {
+        destroyBuffer(readbackBuffer);
+    }
+    free(headlessTimestamps);
+    headlessTimestamps = nullptr;
+    scopeStats.destroy();
+}
+
+uint64_t* ni::GpuProfiler::getSlotTimestamps(uint32_t slot, GpuProfilerQueue queue) {
+    return &headlessTimestamps[(slot * GPU_PROFILER_QUEUE_COUNT + queue) * NI_GPU_PROFILER_MAX_QUERIES];
+}
+
+void ni::GpuProfiler::beginFrame(uint64_t frameNumber) {
+    currentSlot = (uint32_t)(frameNumber % NI_FRAME_COUNT);
+    FrameSlot& frameSlot = slots[currentSlot];
+    if (frameSlot.pending) {
+        collectSlot(frameSlot, currentSlot);
+    }
+    frameSlot.scopes.reset();
+    memset(frameSlot.queryNums, 0, sizeof(frameSlot.queryNums));
+}
+
+uint32_t ni::GpuProfiler::beginScope(ID3D12GraphicsCommandList* commandList, GpuProfilerQueue queue, const char* name) {
+    if (!queueEnabled[queue]) return NI_GPU_PROFILER_INVALID_SCOPE;
+    FrameSlot& frameSlot = slots[currentSlot];
+    if (frameSlot.queryNums[queue] + 2 > NI_GPU_PROFILER_MAX_QUERIES) {
+        droppedScopeNum++;
+        return NI_GPU_PROFILER_INVALID_SCOPE;
+    }
+    // Both timestamps are reserved up front so nested scopes can't run out in between.
+    Scope scope = { name, queue, frameSlot.queryNums[queue], true };
+    frameSlot.queryNums[queue] += 2;
+    if (commandList != nullptr) {
+        commandList->EndQuery(frameSlot.queryHeaps[queue], D3D12_QUERY_TYPE_TIMESTAMP, scope.beginQuery);
+    }
+    frameSlot.scopes.add(scope);
+    return frameSlot.scopes.getNum() - 1;
+}
+
+void ni::GpuProfiler::endScope(ID3D12GraphicsCommandList* commandList, uint32_t scopeIndex) {
+    if (scopeIndex == NI_GPU_PROFILER_INVALID_SCOPE) return;
+    FrameSlot& frameSlot = slots[currentSlot];
+    Scope& scope = frameSlot.scopes.getData()[scopeIndex];
+    NI_ASSERT(scope.open, "GPU scope %s ended twice", scope.name);
+    scope.open = false;
+    if (commandList != nullptr) {
+        commandList->EndQuery(frameSlot.queryHeaps[scope.queue], D3D12_QUERY_TYPE_TIMESTAMP, scope.beginQuery + 1);
+    }
+}
+
+void ni::GpuProfiler::endFrame(ID3D12GraphicsCommandList* const commandLists[GPU_PROFILER_QUEUE_COUNT]) {
+    FrameSlot& frameSlot = slots[currentSlot];
+    for (uint32_t index = 0; index < frameSlot.scopes.getNum(); ++index) {
+        NI_ASSERT(!frameSlot.scopes.getData()[index].open, "GPU scope %s was never ended", frameSlot.scopes.getData()[index].name);
+    }
+    if (headlessTimestamps == nullptr) {
+        for (uint32_t queue = 0; queue < GPU_PROFILER_QUEUE_COUNT; ++queue) {
+            if (frameSlot.queryNums[queue] == 0) continue;
+            NI_ASSERT(commandLists[queue] != nullptr, "GPU scopes on the %s queue but no list to resolve them on", queueNames[queue]);
+            uint64_t offset = currentSlot * NI_GPU_PROFILER_SLOT_SIZE + queue * NI_GPU_PROFILER_MAX_QUERIES * sizeof(uint64_t);
+            commandLists[queue]->ResolveQueryData(frameSlot.queryHeaps[queue], D3D12_QUERY_TYPE_TIMESTAMP, 0, frameSlot.queryNums[queue], readbackBuffer.resource, offset);
+        }
+    }
+    frameSlot.pending = frameSlot.scopes.getNum() > 0;
+}
+
+void ni::GpuProfiler::setSyntheticTimestamps(uint32_t scopeIndex, uint64_t begin, uint64_t end) {
+    NI_ASSERT(headlessTimestamps != nullptr, "Synthetic timestamps are only taken when headless");
+    if (scopeIndex == NI_GPU_PROFILER_INVALID_SCOPE) return;
+    const Scope& scope = slots[currentSlot].scopes.getData()[scopeIndex];
+    uint64_t* timestamps = getSlotTimestamps(currentSlot, scope.queue);
+    timestamps[scope.beginQuery] = begin;
+    timestamps[scope.beginQuery + 1] = end;
+}
+
+void ni::GpuProfiler::collectSlot(FrameSlot& frameSlot, uint32_t slot) {
+    const uint64_t* slotTimestamps = nullptr;
+    if (headlessTimestamps != nullptr) {
+        slotTimestamps = getSlotTimestamps(slot, GPU_PROFILER_QUEUE_DIRECT);
+    } else {
+        slotTimestamps = (const uint64_t*)mapReadbackBuffer(readbackBuffer, slot * NI_GPU_PROFILER_SLOT_SIZE, NI_GPU_PROFILER_SLOT_SIZE);
+    }
+    for (uint32_t index = 0; index < frameSlot.scopes.getNum(); ++index) {
+        const Scope& scope = frameSlot.scopes.getData()[index];
+        const uint64_t* timestamps = &slotTimestamps[scope.queue * NI_GPU_PROFILER_MAX_QUERIES];
+        uint64_t begin = timestamps[scope.beginQuery];
+        uint64_t end = timestamps[scope.beginQuery + 1];
+        // Some drivers report zeros for lists that were never executed.
+        if (end < begin) continue;
+        addSample(scope.name, scope.queue, (double)(end - begin) * 1000.0 / (double)frequencies[scope.queue]);
+    }
+    if (headlessTimestamps == nullptr) {
+        unmapReadbackBuffer(readbackBuffer);
+    }
+    frameSlot.pending = false;
+    collectedFrameNum++;
+}
+
+void ni::GpuProfiler::addSample(const char* name, GpuProfilerQueue queue, double milliseconds) {
+    GpuScopeStats* stats = (GpuScopeStats*)findScope(name, queue);
+    if (stats == nullptr) {
+        GpuScopeStats newStats = {};
+        newStats.name = name;
+        newStats.queue = queue;
+        scopeStats.add(newStats);
+        stats = &scopeStats.getData()[scopeStats.getNum() - 1];
+    }
+    stats->samples[stats->sampleNum % NI_GPU_PROFILER_AVERAGE_FRAMES] = milliseconds;
+    stats->sampleNum++;
+    stats->lastMs = milliseconds;
+    uint64_t windowNum = stats->sampleNum < NI_GPU_PROFILER_AVERAGE_FRAMES ? stats->sampleNum : NI_GPU_PROFILER_AVERAGE_FRAMES;
+    double sum = 0.0;
+    stats->maxMs = 0.0;
+    for (uint64_t index = 0; index < windowNum; ++index) {
+        sum += stats->samples[index];
+        stats->maxMs = stats->samples[index] > stats->maxMs ? stats->samples[index] : stats->maxMs;
+    }
+    stats->averageMs = sum / (double)windowNum;
+}
+
+const ni::GpuScopeStats* ni::GpuProfiler::findScope(const char* name, GpuProfilerQueue queue) const {
+    for (uint32_t index = 0; index < scopeStats.getNum(); ++index) {
+        const GpuScopeStats& stats = scopeStats.getData()[index];
+        if (stats.queue == queue && strcmp(stats.name, name) == 0) return &stats;
+    }
+    return nullptr;
+}
+
+void ni::GpuProfiler::log() const {
+    for (uint32_t index = 0; index < scopeStats.getNum(); ++index) {
+        const GpuScopeStats& stats = scopeStats.getData()[index];
+        NI_LOG("  GPU %-7s %-20s %.3f ms avg, %.3f ms max", queueNames[stats.queue], stats.name, stats.averageMs, stats.maxMs);
+    }
+    if (droppedScopeNum > 0) {
+        NI_LOG("  GPU scopes dropped: %u, raise NI_GPU_PROFILER_MAX_QUERIES", droppedScopeNum);
+    }
+}
+
+static bool nearlyEqual(double a, double b) {
+    return fabs(a - b) < 1e-6;
+}
+
+uint32_t ni::validateGpuProfiler() {
+    // Direct and compute tick in microseconds, copy in 100 ns like most copy engines.
+    const uint64_t frequencies[GPU_PROFILER_QUEUE_COUNT] = { 1000000, 1000000, 10000000 };
+    GpuProfiler profiler;
+    profiler.initHeadless(frequencies);
+    ID3D12GraphicsCommandList* lists[GPU_PROFILER_QUEUE_COUNT] = {};
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+    // Every frame renders 1 us longer than the one before, so a sample read from the wrong slot shows up.
+    for (uint64_t frame = 0; frame < NI_GPU_PROFILER_VALIDATION_FRAMES; ++frame) {
+        profiler.beginFrame(frame);
+        if (frame >= NI_FRAME_COUNT) {
+            const GpuScopeStats* render = profiler.findScope("SpriteRender", GPU_PROFILER_QUEUE_DIRECT);
+            double expected = 2.0 + (double)(frame - NI_FRAME_COUNT) * 0.001;
+            checkNum++;
+            if (render == nullptr || !nearlyEqual(render->lastMs, expected)) {
+                NI_LOG("GPU profiler: frame %llu collected %.4f ms instead of %.4f ms", frame, render != nullptr ? render->lastMs : -1.0, expected);
+                errorNum++;
+            }
+        }
+        uint64_t base = frame * 20000;
+        uint32_t upload = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_COPY, "Upload");
+        profiler.endScope(nullptr, upload);
+        profiler.setSyntheticTimestamps(upload, base * 10, base * 10 + 5000);
+        uint32_t spriteGen = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_COMPUTE, "SpriteGen");
+        profiler.endScope(nullptr, spriteGen);
+        profiler.setSyntheticTimestamps(spriteGen, base, base + 1000 + (frame % 2) * 200);
+        // Same name on another queue is a separate scope. Nested inside the frame scope.
+        uint32_t frameScope = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_DIRECT, "Frame");
+        uint32_t render = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_DIRECT, "SpriteRender");
+        uint32_t directGen = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_DIRECT, "SpriteGen");
+        profiler.endScope(nullptr, directGen);
+        profiler.endScope(nullptr, render);
+        profiler.endScope(nullptr, frameScope);
+        profiler.setSyntheticTimestamps(frameScope, base, base + 3000);
+        profiler.setSyntheticTimestamps(render, base + 500, base + 2500 + frame);
+        profiler.setSyntheticTimestamps(directGen, base + 100, base + 400);
+        profiler.endFrame(lists);
+    }
+
+    struct Expected {
+        const char* name;
+        GpuProfilerQueue queue;
+        double averageMs;
+        double maxMs;
+    };
+    // The window holds an even number of frames, SpriteGen alternates between 1.0 and 1.2 ms.
+    uint64_t lastFrame = NI_GPU_PROFILER_VALIDATION_FRAMES - NI_FRAME_COUNT - 1;
+    double renderAverage = 2.0 + (double)(lastFrame * 2 - NI_GPU_PROFILER_AVERAGE_FRAMES + 1) * 0.5 * 0.001;
+    const Expected expected[] = {
+        { "Upload", GPU_PROFILER_QUEUE_COPY, 0.5, 0.5 },
+        { "SpriteGen", GPU_PROFILER_QUEUE_COMPUTE, 1.1, 1.2 },
+        { "SpriteGen", GPU_PROFILER_QUEUE_DIRECT, 0.3, 0.3 },
+        { "Frame", GPU_PROFILER_QUEUE_DIRECT, 3.0, 3.0 },
+        { "SpriteRender", GPU_PROFILER_QUEUE_DIRECT, renderAverage, 2.0 + (double)lastFrame * 0.001 },
+    };
+    for (uint32_t index = 0; index < sizeof(expected) / sizeof(expected[0]); ++index) {
+        const GpuScopeStats* stats = profiler.findScope(expected[index].name, expected[index].queue);
+        checkNum++;
+        if (stats == nullptr || !nearlyEqual(stats->averageMs, expected[index].averageMs) || !nearlyEqual(stats->maxMs, expected[index].maxMs)) {
+            NI_LOG("GPU profiler: %s on the %s queue averaged %.4f ms (max %.4f) instead of %.4f ms (max %.4f)", expected[index].name, queueNames[expected[index].queue],
+                stats != nullptr ? stats->averageMs : -1.0, stats != nullptr ? stats->maxMs : -1.0, expected[index].averageMs, expected[index].maxMs);
+            errorNum++;
+        }
+    }
+    checkNum++;
+    if (profiler.getScopeNum() != sizeof(expected) / sizeof(expected[0]) || profiler.getCollectedFrameNum() != NI_GPU_PROFILER_VALIDATION_FRAMES - NI_FRAME_COUNT) {
+        NI_LOG("GPU profiler: %u scopes over %llu frames", profiler.getScopeNum(), profiler.getCollectedFrameNum());
+        errorNum++;
+    }
+
+    // More scopes than queries, the ones that don't fit are dropped and the rest still resolve.
+    const uint32_t overflowNum = 5;
+    profiler.beginFrame(NI_GPU_PROFILER_VALIDATION_FRAMES);
+    for (uint32_t index = 0; index < NI_GPU_PROFILER_MAX_QUERIES / 2 + overflowNum; ++index) {
+        uint32_t scope = profiler.beginScope(nullptr, GPU_PROFILER_QUEUE_DIRECT, "Overflow");
+        profiler.endScope(nullptr, scope);
+        profiler.setSyntheticTimestamps(scope, 0, 1000);
+    }
+    profiler.endFrame(lists);
+    for (uint64_t frame = 1; frame <= NI_FRAME_COUNT; ++frame) {
+        profiler.beginFrame(NI_GPU_PROFILER_VALIDATION_FRAMES + frame);
+        profiler.endFrame(lists);
+    }
+    const GpuScopeStats* overflow = profiler.findScope("Overflow", GPU_PROFILER_QUEUE_DIRECT);
+    checkNum++;
+    if (profiler.getDroppedScopeNum() != overflowNum || overflow == nullptr || overflow->sampleNum != NI_GPU_PROFILER_MAX_QUERIES / 2) {
+        NI_LOG("GPU profiler: dropped %u scopes instead of %u, kept %llu", profiler.getDroppedScopeNum(), overflowNum, overflow != nullptr ? overflow->sampleNum : 0ull);
+        errorNum++;
+    }
+    profiler.log();
+    profiler.destroy();
+    NI_LOG("GPU profiler: %u checks, %u error(s)", checkNum, errorNum);
+    return errorNum;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "ni.h"
+
+// Timestamps per queue and frame, every scope takes two.
+#define NI_GPU_PROFILER_MAX_QUERIES 256
+// Scope averages cover this many of the frames the scope ran in.
+#define NI_GPU_PROFILER_AVERAGE_FRAMES 64
+#define NI_GPU_PROFILER_INVALID_SCOPE 0xffffffffu
+
+namespace ni {
+
+	enum GpuProfilerQueue {
+		GPU_PROFILER_QUEUE_DIRECT,
+		GPU_PROFILER_QUEUE_COMPUTE,
+		GPU_PROFILER_QUEUE_COPY,
+		GPU_PROFILER_QUEUE_COUNT
+	};
+
+	// Aggregated by name and queue over all frames.
+	struct GpuScopeStats {
+		const char* name;
+		GpuProfilerQueue queue;
+		double lastMs;
+		double averageMs;
+		double maxMs;
+		uint64_t sampleNum;
+		double samples[NI_GPU_PROFILER_AVERAGE_FRAMES];
+	};
+
+	// Named timestamp scopes on the direct, compute and copy queues. Every frame slot has its own query heaps
+	// and its own range of a readback buffer the queries are resolved into at the end of the frame. The slot
+	// is read back the next time it's used, its frame has completed by then. Scopes only measure time on
+	// their own queue, the queues don't share a clock.
+	struct GpuProfiler {
+		GpuProfiler();
+
+		// The copy queue is left out when the device can't take timestamps on it.
+		void init(ID3D12CommandQueue* const queues[GPU_PROFILER_QUEUE_COUNT]);
+		// No queries are recorded, the timestamps come from setSyntheticTimestamps instead.
+		void initHeadless(const uint64_t frequencies[GPU_PROFILER_QUEUE_COUNT]);
+		void destroy();
+		// Collects the scopes of the frame that used this slot before.
+		void beginFrame(uint64_t frameNumber);
+		// Returns NI_GPU_PROFILER_INVALID_SCOPE when the queue doesn't support timestamps or its queries ran out.
+		// The list is only used for the query, pass null when headless.
+		uint32_t beginScope(ID3D12GraphicsCommandList* commandList, GpuProfilerQueue queue, const char* name);
+		void endScope(ID3D12GraphicsCommandList* commandList, uint32_t scope);
+		// Resolves the queries of every queue into the readback buffer, before the lists are closed. Lists can be
+		// null for queues that aren't used this frame.
+		void endFrame(ID3D12GraphicsCommandList* const commandLists[GPU_PROFILER_QUEUE_COUNT]);
+		// Headless only, writes the timestamps a scope of the current frame would have resolved to.
+		void setSyntheticTimestamps(uint32_t scope, uint64_t begin, uint64_t end);
+		const GpuScopeStats* findScope(const char* name, GpuProfilerQueue queue) const;
+		const GpuScopeStats* getScopes() const { return scopeStats.getData(); }
+		uint32_t getScopeNum() const { return scopeStats.getNum(); }
+		uint32_t getDroppedScopeNum() const { return droppedScopeNum; }
+		uint64_t getCollectedFrameNum() const { return collectedFrameNum; }
+		void log() const;
+
+	private:
+		struct Scope {
+			const char* name;
+			GpuProfilerQueue queue;
+			// The end timestamp goes to the query after it.
+			uint32_t beginQuery;
+			bool open;
+		};
+
+		struct FrameSlot {
+			ID3D12QueryHeap* queryHeaps[GPU_PROFILER_QUEUE_COUNT];
+			Array<Scope, uint32_t> scopes;
+			uint32_t queryNums[GPU_PROFILER_QUEUE_COUNT];
+			bool pending;
+		};
+
+		uint64_t* getSlotTimestamps(uint32_t slot, GpuProfilerQueue queue);
+		void collectSlot(FrameSlot& frameSlot, uint32_t slot);
+		void addSample(const char* name, GpuProfilerQueue queue, double milliseconds);
+
+		FrameSlot slots[NI_FRAME_COUNT];
+		Array<GpuScopeStats, uint32_t> scopeStats;
+		// One NI_GPU_PROFILER_MAX_QUERIES range per slot and queue, the same memory is malloced when headless.
+		Resource readbackBuffer;
+		uint64_t* headlessTimestamps;
+		uint64_t frequencies[GPU_PROFILER_QUEUE_COUNT];
+		bool queueEnabled[GPU_PROFILER_QUEUE_COUNT];
+		uint32_t currentSlot;
+		uint32_t droppedScopeNum;
+		uint64_t collectedFrameNum;
+	};
+
+	// Feeds synthetic frames with known durations through the profiler and checks the averages, the slot reuse
+	// and the query overflow.
+	uint32_t validateGpuProfiler();
+}
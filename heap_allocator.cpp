@@ -0,0 +1,304 @@
+#include "heap_allocator.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if _MSC_VER
+#include <intrin.h>
+static inline uint32_t findLastSet(uint64_t value) { unsigned long index; _BitScanReverse64(&index, value); return (uint32_t)index; }
+static inline uint32_t findFirstSet(uint64_t value) { unsigned long index; _BitScanForward64(&index, value); return (uint32_t)index; }
+#else
+static inline uint32_t findLastSet(uint64_t value) { return 63 - (uint32_t)__builtin_clzll(value); }
+static inline uint32_t findFirstSet(uint64_t value) { return (uint32_t)__builtin_ctzll(value); }
+#endif
+
+// Sizes are in granules. Anything below NI_TLSF_SL_COUNT lands in the first level linearly.
+static inline void mapSize(uint64_t size, uint32_t& outFirstLevel, uint32_t& outSecondLevel) {
+    if (size < NI_TLSF_SL_COUNT) {
+        outFirstLevel = 0;
+        outSecondLevel = (uint32_t)size;
+        return;
+    }
+    uint32_t lastSet = findLastSet(size);
+    outFirstLevel = lastSet - NI_TLSF_SL_BITS + 1;
+    outSecondLevel = (uint32_t)(size >> (lastSet - NI_TLSF_SL_BITS)) ^ NI_TLSF_SL_COUNT;
+}
+
+void ni::TLSFAllocator::init(uint64_t heapSize, uint64_t heapGranularity) {
+    NI_ASSERT(heapGranularity > 0 && (heapGranularity & (heapGranularity - 1)) == 0, "Granularity has to be a power of two");
+    size = heapSize / heapGranularity * heapGranularity;
+    granularity = heapGranularity;
+    freeSize = 0;
+    allocationNum = 0;
+    firstLevelBitmap = 0;
+    memset(secondLevelBitmaps, 0, sizeof(secondLevelBitmaps));
+    memset(freeLists, 0xff, sizeof(freeLists));
+    blocks.reset();
+    unusedBlocks.reset();
+    uint32_t node = createBlock(0, size / granularity);
+    insertFreeBlock(node);
+}
+
+void ni::TLSFAllocator::destroy() {
+    blocks.destroy();
+    unusedBlocks.destroy();
+}
+
+uint32_t ni::TLSFAllocator::createBlock(uint64_t offset, uint64_t blockSize) {
+    Block block = { offset, blockSize, NI_TLSF_INVALID_NODE, NI_TLSF_INVALID_NODE, NI_TLSF_INVALID_NODE, NI_TLSF_INVALID_NODE, false };
+    uint32_t unusedNum = unusedBlocks.getNum();
+    if (unusedNum > 0) {
+        uint32_t node = unusedBlocks.getData()[unusedNum - 1];
+        unusedBlocks.remove(unusedNum - 1);
+        blocks.getData()[node] = block;
+        return node;
+    }
+    blocks.add(block);
+    return blocks.getNum() - 1;
+}
+
+void ni::TLSFAllocator::insertFreeBlock(uint32_t node) {
+    Block& block = blocks.getData()[node];
+    uint32_t firstLevel, secondLevel;
+    mapSize(block.size, firstLevel, secondLevel);
+    uint32_t head = freeLists[firstLevel][secondLevel];
+    block.isFree = true;
+    block.prevFree = NI_TLSF_INVALID_NODE;
+    block.nextFree = head;
+    if (head != NI_TLSF_INVALID_NODE) {
+        blocks.getData()[head].prevFree = node;
+    }
+    freeLists[firstLevel][secondLevel] = node;
+    firstLevelBitmap |= 1ull << firstLevel;
+    secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+    freeSize += block.size * granularity;
+}
+
+void ni::TLSFAllocator::removeFreeBlock(uint32_t node) {
+    Block& block = blocks.getData()[node];
+    uint32_t firstLevel, secondLevel;
+    mapSize(block.size, firstLevel, secondLevel);
+    if (block.prevFree != NI_TLSF_INVALID_NODE) {
+        blocks.getData()[block.prevFree].nextFree = block.nextFree;
+    } else {
+        freeLists[firstLevel][secondLevel] = block.nextFree;
+        if (block.nextFree == NI_TLSF_INVALID_NODE) {
+            secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (secondLevelBitmaps[firstLevel] == 0) {
+                firstLevelBitmap &= ~(1ull << firstLevel);
+            }
+        }
+    }
+    if (block.nextFree != NI_TLSF_INVALID_NODE) {
+        blocks.getData()[block.nextFree].prevFree = block.prevFree;
+    }
+    block.isFree = false;
+    freeSize -= block.size * granularity;
+}
+
+uint32_t ni::TLSFAllocator::findFreeBlock(uint64_t blockSize) {
+    // Round up to the next second level range so any block in the list found is large enough.
+    if (blockSize >= NI_TLSF_SL_COUNT) {
+        blockSize += (1ull << (findLastSet(blockSize) - NI_TLSF_SL_BITS)) - 1;
+    }
+    uint32_t firstLevel, secondLevel;
+    mapSize(blockSize, firstLevel, secondLevel);
+    if (firstLevel >= NI_TLSF_FL_COUNT) return NI_TLSF_INVALID_NODE;
+    uint32_t secondLevelMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (secondLevelMap == 0) {
+        uint64_t firstLevelMap = firstLevel + 1 < 64 ? firstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+        if (firstLevelMap == 0) return NI_TLSF_INVALID_NODE;
+        firstLevel = findFirstSet(firstLevelMap);
+        secondLevelMap = secondLevelBitmaps[firstLevel];
+    }
+    secondLevel = findFirstSet(secondLevelMap);
+    return freeLists[firstLevel][secondLevel];
+}
+
+uint32_t ni::TLSFAllocator::splitBlock(uint32_t node, uint64_t headSize) {
+    const Block& block = blocks.getData()[node];
+    uint32_t tail = createBlock(block.offset + headSize, block.size - headSize);
+    Block& head = blocks.getData()[node];
+    Block& tailBlock = blocks.getData()[tail];
+    tailBlock.prevPhysical = node;
+    tailBlock.nextPhysical = head.nextPhysical;
+    if (head.nextPhysical != NI_TLSF_INVALID_NODE) {
+        blocks.getData()[head.nextPhysical].prevPhysical = tail;
+    }
+    head.nextPhysical = tail;
+    head.size = headSize;
+    return tail;
+}
+
+bool ni::TLSFAllocator::allocate(uint64_t allocationSize, uint64_t alignment, HeapRange& outRange) {
+    NI_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0, "Alignment has to be a power of two");
+    uint64_t blockSize = (allocationSize + granularity - 1) / granularity;
+    blockSize = blockSize > 0 ? blockSize : 1;
+    // Alignments above the granularity search for enough room to skip to the next aligned offset.
+    uint64_t alignmentBlocks = alignment > granularity ? alignment / granularity : 1;
+    uint32_t node = findFreeBlock(blockSize + alignmentBlocks - 1);
+    if (node == NI_TLSF_INVALID_NODE) return false;
+    removeFreeBlock(node);
+
+    uint64_t padding = (alignmentBlocks - blocks.getData()[node].offset % alignmentBlocks) % alignmentBlocks;
+    if (padding > 0) {
+        uint32_t aligned = splitBlock(node, padding);
+        insertFreeBlock(node);
+        node = aligned;
+    }
+    if (blocks.getData()[node].size > blockSize) {
+        insertFreeBlock(splitBlock(node, blockSize));
+    }
+
+    const Block& block = blocks.getData()[node];
+    outRange = { block.offset * granularity, block.size * granularity, node };
+    allocationNum++;
+    return true;
+}
+
+void ni::TLSFAllocator::free(uint32_t node) {
+    NI_ASSERT(node < blocks.getNum() && !blocks.getData()[node].isFree, "Invalid or double free");
+    allocationNum--;
+    // Merge with the free neighbours so free space stays in as few blocks as possible.
+    uint32_t next = blocks.getData()[node].nextPhysical;
+    if (next != NI_TLSF_INVALID_NODE && blocks.getData()[next].isFree) {
+        removeFreeBlock(next);
+        Block& block = blocks.getData()[node];
+        const Block& nextBlock = blocks.getData()[next];
+        block.size += nextBlock.size;
+        block.nextPhysical = nextBlock.nextPhysical;
+        if (nextBlock.nextPhysical != NI_TLSF_INVALID_NODE) {
+            blocks.getData()[nextBlock.nextPhysical].prevPhysical = node;
+        }
+        unusedBlocks.add(next);
+    }
+    uint32_t prev = blocks.getData()[node].prevPhysical;
+    if (prev != NI_TLSF_INVALID_NODE && blocks.getData()[prev].isFree) {
+        removeFreeBlock(prev);
+        Block& prevBlock = blocks.getData()[prev];
+        const Block& block = blocks.getData()[node];
+        prevBlock.size += block.size;
+        prevBlock.nextPhysical = block.nextPhysical;
+        if (block.nextPhysical != NI_TLSF_INVALID_NODE) {
+            blocks.getData()[block.nextPhysical].prevPhysical = prev;
+        }
+        unusedBlocks.add(node);
+        node = prev;
+    }
+    insertFreeBlock(node);
+}
+
+uint64_t ni::TLSFAllocator::getLargestFreeBlock() const {
+    if (firstLevelBitmap == 0) return 0;
+    uint32_t firstLevel = findLastSet(firstLevelBitmap);
+    uint32_t secondLevel = findLastSet(secondLevelBitmaps[firstLevel]);
+    uint64_t largest = 0;
+    for (uint32_t node = freeLists[firstLevel][secondLevel]; node != NI_TLSF_INVALID_NODE; node = blocks.getData()[node].nextFree) {
+        largest = blocks.getData()[node].size > largest ? blocks.getData()[node].size : largest;
+    }
+    return largest * granularity;
+}
+
+// D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT and D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, spelled out so the
+// benchmark runs without the D3D12 headers.
+#define NI_HEAP_BENCH_SMALL_ALIGNMENT (4ull << 10)
+#define NI_HEAP_BENCH_DEFAULT_ALIGNMENT (64ull << 10)
+#define NI_HEAP_BENCH_SIZE (1ull << 30)
+#define NI_HEAP_BENCH_GRANULARITY NI_HEAP_BENCH_SMALL_ALIGNMENT
+#define NI_HEAP_BENCH_SLOTS 4096
+#define NI_HEAP_BENCH_OPERATIONS 2000000
+// Live bytes are kept under this, so a failed allocation is down to fragmentation and not a full heap.
+#define NI_HEAP_BENCH_BUDGET (NI_HEAP_BENCH_SIZE / 2)
+
+uint32_t ni::benchmarkHeapAllocator() {
+    TLSFAllocator allocator;
+    allocator.init(NI_HEAP_BENCH_SIZE, NI_HEAP_BENCH_GRANULARITY);
+    HeapRange* slots = (HeapRange*)malloc(NI_HEAP_BENCH_SLOTS * sizeof(HeapRange));
+    bool* live = (bool*)calloc(NI_HEAP_BENCH_SLOTS, sizeof(bool));
+    uint64_t* requestedSizes = (uint64_t*)malloc(NI_HEAP_BENCH_SLOTS * sizeof(uint64_t));
+    uint64_t requestedSize = 0;
+    uint64_t allocatedSize = 0;
+    uint64_t peakAllocatedSize = 0;
+    uint32_t failedNum = 0;
+    uint32_t overBudgetNum = 0;
+    double worstFragmentation = 0.0;
+    bool valid = true;
+
+    double startTime = getSeconds();
+    for (uint32_t operation = 0; operation < NI_HEAP_BENCH_OPERATIONS; ++operation) {
+        uint32_t slot = randomUint() % NI_HEAP_BENCH_SLOTS;
+        if (live[slot]) {
+            allocator.free(slots[slot].node);
+            requestedSize -= requestedSizes[slot];
+            allocatedSize -= slots[slot].size;
+            live[slot] = false;
+            continue;
+        }
+        // Mostly small buffers and sprite sized textures, now and then a large render target sized one.
+        uint64_t size = 256ull << (randomUint() % 12);
+        if (randomUint() % 128 == 0) size = (16ull << 20) + (randomUint() % 16) * (1ull << 20);
+        // Same rule as small placed textures, anything under 64 KB only needs 4 KB alignment.
+        uint64_t alignment = size < NI_HEAP_BENCH_DEFAULT_ALIGNMENT ? NI_HEAP_BENCH_SMALL_ALIGNMENT : NI_HEAP_BENCH_DEFAULT_ALIGNMENT;
+        if (allocatedSize + alignSize(size, alignment) > NI_HEAP_BENCH_BUDGET) {
+            overBudgetNum++;
+            continue;
+        }
+        if (!allocator.allocate(size, alignment, slots[slot])) {
+            failedNum++;
+            uint64_t freeSize = allocator.getFreeSize();
+            double fragmentation = freeSize > 0 ? 1.0 - (double)allocator.getLargestFreeBlock() / (double)freeSize : 0.0;
+            worstFragmentation = fragmentation > worstFragmentation ? fragmentation : worstFragmentation;
+            continue;
+        }
+        valid &= slots[slot].offset % alignment == 0;
+        requestedSizes[slot] = size;
+        requestedSize += size;
+        allocatedSize += slots[slot].size;
+        peakAllocatedSize = allocatedSize > peakAllocatedSize ? allocatedSize : peakAllocatedSize;
+        live[slot] = true;
+    }
+    double elapsed = getSeconds() - startTime;
+    uint64_t endFreeSize = allocator.getFreeSize();
+    double endFragmentation = endFreeSize > 0 ? 1.0 - (double)allocator.getLargestFreeBlock() / (double)endFreeSize : 0.0;
+    double utilization = allocatedSize > 0 ? (double)requestedSize / (double)allocatedSize : 1.0;
+
+    // Live ranges sorted by offset must not overlap.
+    uint64_t* offsets = (uint64_t*)malloc(NI_HEAP_BENCH_SLOTS * 2 * sizeof(uint64_t));
+    uint32_t liveNum = 0;
+    for (uint32_t slot = 0; slot < NI_HEAP_BENCH_SLOTS; ++slot) {
+        if (!live[slot]) continue;
+        offsets[liveNum * 2] = slots[slot].offset;
+        offsets[liveNum * 2 + 1] = slots[slot].offset + slots[slot].size;
+        liveNum++;
+        valid &= slots[slot].offset + slots[slot].size <= NI_HEAP_BENCH_SIZE;
+    }
+    qsort(offsets, liveNum, sizeof(uint64_t) * 2, [](const void* a, const void* b) {
+        uint64_t left = *(const uint64_t*)a;
+        uint64_t right = *(const uint64_t*)b;
+        return left < right ? -1 : (left > right ? 1 : 0);
+    });
+    for (uint32_t index = 1; index < liveNum; ++index) {
+        valid &= offsets[(index - 1) * 2 + 1] <= offsets[index * 2];
+    }
+    valid &= liveNum == allocator.getAllocationNum();
+    for (uint32_t slot = 0; slot < NI_HEAP_BENCH_SLOTS; ++slot) {
+        if (live[slot]) allocator.free(slots[slot].node);
+    }
+    // Everything merged back into a single block.
+    valid &= allocator.getFreeSize() == allocator.getSize() && allocator.getLargestFreeBlock() == allocator.getSize();
+
+    NI_LOG("TLSF heap: %u operations in %.2f ms (%.1f ns each), peak %.1f of %.1f MB in use, %.1f%% of allocated bytes requested",
+        NI_HEAP_BENCH_OPERATIONS, elapsed * 1000.0, elapsed * 1e9 / NI_HEAP_BENCH_OPERATIONS,
+        (double)peakAllocatedSize / (1024.0 * 1024.0), (double)NI_HEAP_BENCH_SIZE / (1024.0 * 1024.0), utilization * 100.0);
+    NI_LOG("TLSF heap: fragmentation %.1f%% at the end, %u requests skipped over the %.1f MB budget, %s",
+        endFragmentation * 100.0, overBudgetNum, (double)NI_HEAP_BENCH_BUDGET / (1024.0 * 1024.0), valid ? "ranges valid" : "RANGES OVERLAP");
+    if (failedNum > 0) {
+        NI_LOG("TLSF heap: FAILED %u allocations under budget (worst fragmentation on failure %.1f%%)", failedNum, worstFragmentation * 100.0);
+    }
+
+    free(offsets);
+    free(requestedSizes);
+    free(live);
+    free(slots);
+    allocator.destroy();
+    return failedNum + (valid ? 0 : 1);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ni_core.h"
+
+// Two level segregated fit: the first level splits free blocks by power of two, the second level splits each
+// of those into NI_TLSF_SL_COUNT linear ranges. Allocation and free are O(1), every fit is good enough.
+#define NI_TLSF_SL_BITS 4
+#define NI_TLSF_SL_COUNT (1 << NI_TLSF_SL_BITS)
+#define NI_TLSF_FL_COUNT 40
+#define NI_TLSF_INVALID_NODE 0xffffffffu
+
+namespace ni {
+
+	struct HeapRange {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t node;
+	};
+
+	// Hands out ranges of [0, size) without touching any memory, so the same allocator backs ID3D12Heaps,
+	// shared upload buffers and the CPU benchmark. Offsets and sizes are multiples of the granularity.
+	struct TLSFAllocator {
+		void init(uint64_t heapSize, uint64_t heapGranularity);
+		void destroy();
+		// Returns false when no free block is large enough.
+		bool allocate(uint64_t size, uint64_t alignment, HeapRange& outRange);
+		void free(uint32_t node);
+		uint64_t getSize() const { return size; }
+		uint64_t getFreeSize() const { return freeSize; }
+		uint64_t getLargestFreeBlock() const;
+		uint32_t getAllocationNum() const { return allocationNum; }
+
+	private:
+		struct Block {
+			uint64_t offset;
+			uint64_t size;
+			uint32_t prevPhysical;
+			uint32_t nextPhysical;
+			uint32_t prevFree;
+			uint32_t nextFree;
+			bool isFree;
+		};
+
+		uint32_t createBlock(uint64_t offset, uint64_t blockSize);
+		// Shrinks node to headSize and returns a new block for the rest, neither is in a free list.
+		uint32_t splitBlock(uint32_t node, uint64_t headSize);
+		void insertFreeBlock(uint32_t node);
+		void removeFreeBlock(uint32_t node);
+		uint32_t findFreeBlock(uint64_t blockSize);
+
+		Array<Block, uint32_t> blocks;
+		Array<uint32_t, uint32_t> unusedBlocks;
+		uint32_t freeLists[NI_TLSF_FL_COUNT][NI_TLSF_SL_COUNT];
+		uint32_t secondLevelBitmaps[NI_TLSF_FL_COUNT];
+		uint64_t firstLevelBitmap;
+		uint64_t size;
+		uint64_t granularity;
+		uint64_t freeSize;
+		uint32_t allocationNum;
+	};
+
+	// Random allocate/free workload with resource sized requests. Logs speed and fragmentation and
+	// checks that no two live ranges overlap. Live bytes stay within half the heap, so every failed
+	// allocation is counted as an error along with overlapping ranges. Returns the error count.
+	uint32_t benchmarkHeapAllocator();
+}
@@ -0,0 +1,409 @@
+#include "image_codec.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_QOI_OP_INDEX 0x00
+#define NI_QOI_OP_DIFF 0x40
+#define NI_QOI_OP_LUMA 0x80
+#define NI_QOI_OP_RUN 0xc0
+#define NI_QOI_OP_RGB 0xfe
+#define NI_QOI_OP_RGBA 0xff
+#define NI_QOI_MASK 0xc0
+#define NI_QOI_HEADER_SIZE 14
+#define NI_QOI_END_SIZE 8
+#define NI_QOI_MAX_RUN 62
+// Limits decoded images to 400 MP, like the reference decoder.
+#define NI_QOI_MAX_PIXELS 400000000u
+// Largest stored deflate block.
+#define NI_PNG_STORED_BLOCK_SIZE 65535u
+
+static const uint8_t qoiEnd[NI_QOI_END_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+union QoiPixel {
+    struct {
+        uint8_t r, g, b, a;
+    } rgba;
+    uint32_t value;
+};
+
+static inline uint32_t qoiHash(QoiPixel pixel) {
+    return (pixel.rgba.r * 3 + pixel.rgba.g * 5 + pixel.rgba.b * 7 + pixel.rgba.a * 11) % 64;
+}
+
+static inline uint8_t* writeBigEndian(uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+    return out + 4;
+}
+
+static inline uint32_t readBigEndian(const uint8_t* in) {
+    return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | (uint32_t)in[3];
+}
+
+void* ni::encodeQoi(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, bool alpha, size_t& outSize) {
+    const uint32_t channels = alpha ? 4 : 3;
+    // Every pixel takes at most a tag and its channels.
+    size_t capacity = NI_QOI_HEADER_SIZE + (size_t)width * height * (channels + 1) + NI_QOI_END_SIZE;
+    uint8_t* data = (uint8_t*)malloc(capacity);
+    uint8_t* out = data;
+    memcpy(out, "qoif", 4);
+    out = writeBigEndian(out + 4, width);
+    out = writeBigEndian(out, height);
+    *out++ = (uint8_t)channels;
+    *out++ = 0;
+
+    QoiPixel index[64] = {};
+    QoiPixel previous = {};
+    previous.rgba.a = 255;
+    uint32_t run = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = (const uint8_t*)pixels + (size_t)y * rowPitch;
+        for (uint32_t x = 0; x < width; ++x) {
+            QoiPixel pixel;
+            memcpy(&pixel, row + x * 4, 4);
+            if (!alpha) pixel.rgba.a = 255;
+            if (pixel.value == previous.value) {
+                if (++run == NI_QOI_MAX_RUN) {
+                    *out++ = (uint8_t)(NI_QOI_OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                *out++ = (uint8_t)(NI_QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            uint32_t hash = qoiHash(pixel);
+            if (index[hash].value == pixel.value) {
+                *out++ = (uint8_t)(NI_QOI_OP_INDEX | hash);
+            } else {
+                index[hash] = pixel;
+                if (pixel.rgba.a == previous.rgba.a) {
+                    int8_t dr = (int8_t)(pixel.rgba.r - previous.rgba.r);
+                    int8_t dg = (int8_t)(pixel.rgba.g - previous.rgba.g);
+                    int8_t db = (int8_t)(pixel.rgba.b - previous.rgba.b);
+                    int8_t drg = (int8_t)(dr - dg);
+                    int8_t dbg = (int8_t)(db - dg);
+                    if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                        *out++ = (uint8_t)(NI_QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                    } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                        *out++ = (uint8_t)(NI_QOI_OP_LUMA | (dg + 32));
+                        *out++ = (uint8_t)(((drg + 8) << 4) | (dbg + 8));
+                    } else {
+                        *out++ = NI_QOI_OP_RGB;
+                        *out++ = pixel.rgba.r;
+                        *out++ = pixel.rgba.g;
+                        *out++ = pixel.rgba.b;
+                    }
+                } else {
+                    *out++ = NI_QOI_OP_RGBA;
+                    memcpy(out, &pixel, 4);
+                    out += 4;
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if (run > 0) {
+        *out++ = (uint8_t)(NI_QOI_OP_RUN | (run - 1));
+    }
+    memcpy(out, qoiEnd, NI_QOI_END_SIZE);
+    out += NI_QOI_END_SIZE;
+    outSize = out - data;
+    return data;
+}
+
+void* ni::decodeQoi(const void* data, size_t size, uint32_t& outWidth, uint32_t& outHeight) {
+    const uint8_t* in = (const uint8_t*)data;
+    if (size < NI_QOI_HEADER_SIZE + NI_QOI_END_SIZE || memcmp(in, "qoif", 4) != 0) return nullptr;
+    uint32_t width = readBigEndian(in + 4);
+    uint32_t height = readBigEndian(in + 8);
+    uint32_t channels = in[12];
+    if (width == 0 || height == 0 || (channels != 3 && channels != 4) || height >= NI_QOI_MAX_PIXELS / width) return nullptr;
+
+    uint32_t pixelNum = width * height;
+    QoiPixel* pixels = (QoiPixel*)malloc((size_t)pixelNum * sizeof(QoiPixel));
+    QoiPixel index[64] = {};
+    QoiPixel pixel = {};
+    pixel.rgba.a = 255;
+    size_t position = NI_QOI_HEADER_SIZE;
+    size_t chunksEnd = size - NI_QOI_END_SIZE;
+    uint32_t run = 0;
+    for (uint32_t pixelIndex = 0; pixelIndex < pixelNum; ++pixelIndex) {
+        if (run > 0) {
+            run--;
+        } else if (position < chunksEnd) {
+            uint8_t tag = in[position++];
+            if (tag == NI_QOI_OP_RGB) {
+                if (position + 3 > chunksEnd) break;
+                pixel.rgba.r = in[position++];
+                pixel.rgba.g = in[position++];
+                pixel.rgba.b = in[position++];
+            } else if (tag == NI_QOI_OP_RGBA) {
+                if (position + 4 > chunksEnd) break;
+                memcpy(&pixel, in + position, 4);
+                position += 4;
+            } else if ((tag & NI_QOI_MASK) == NI_QOI_OP_INDEX) {
+                pixel = index[tag];
+            } else if ((tag & NI_QOI_MASK) == NI_QOI_OP_DIFF) {
+                pixel.rgba.r += ((tag >> 4) & 0x03) - 2;
+                pixel.rgba.g += ((tag >> 2) & 0x03) - 2;
+                pixel.rgba.b += (tag & 0x03) - 2;
+            } else if ((tag & NI_QOI_MASK) == NI_QOI_OP_LUMA) {
+                if (position + 1 > chunksEnd) break;
+                uint8_t next = in[position++];
+                int dg = (tag & 0x3f) - 32;
+                pixel.rgba.r += dg - 8 + ((next >> 4) & 0x0f);
+                pixel.rgba.g += dg;
+                pixel.rgba.b += dg - 8 + (next & 0x0f);
+            } else {
+                run = tag & 0x3f;
+            }
+            index[qoiHash(pixel)] = pixel;
+        } else {
+            break;
+        }
+        pixels[pixelIndex] = pixel;
+        if (pixelIndex + 1 == pixelNum) {
+            outWidth = width;
+            outHeight = height;
+            return pixels;
+        }
+    }
+    free(pixels);
+    return nullptr;
+}
+
+static uint32_t crcTable[256];
+
+static void initCrcTable() {
+    if (crcTable[1] != 0) return;
+    for (uint32_t index = 0; index < 256; ++index) {
+        uint32_t crc = index;
+        for (uint32_t bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+        }
+        crcTable[index] = crc;
+    }
+}
+
+static uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+    for (size_t index = 0; index < size; ++index) {
+        crc = crcTable[(crc ^ data[index]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+// Writes the length, type and data of a chunk, then its CRC over the type and data.
+static uint8_t* writePngChunk(uint8_t* out, const char* type, const uint8_t* chunkData, uint32_t chunkSize) {
+    out = writeBigEndian(out, chunkSize);
+    uint8_t* crcStart = out;
+    memcpy(out, type, 4);
+    out += 4;
+    if (chunkSize > 0 && chunkData != out) {
+        memmove(out, chunkData, chunkSize);
+    }
+    out += chunkSize;
+    uint32_t crc = updateCrc(0xffffffffu, crcStart, chunkSize + 4) ^ 0xffffffffu;
+    return writeBigEndian(out, crc);
+}
+
+void* ni::encodePng(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, bool alpha, size_t& outSize) {
+    initCrcTable();
+    const uint32_t channels = alpha ? 4 : 3;
+    // Every scanline starts with its filter type, none here.
+    const size_t scanlineSize = (size_t)width * channels + 1;
+    const size_t rawSize = scanlineSize * height;
+    const size_t blockNum = (rawSize + NI_PNG_STORED_BLOCK_SIZE - 1) / NI_PNG_STORED_BLOCK_SIZE;
+    // zlib header, stored block headers, the raw data and the Adler-32 trailer.
+    const size_t idatSize = 2 + blockNum * 5 + rawSize + 4;
+    NI_ASSERT(idatSize < 0x80000000ull, "Image is too large for one IDAT chunk");
+    size_t capacity = sizeof(pngSignature) + (12 + 13) + (12 + idatSize) + 12;
+    uint8_t* data = (uint8_t*)malloc(capacity);
+    uint8_t* out = data;
+    memcpy(out, pngSignature, sizeof(pngSignature));
+    out += sizeof(pngSignature);
+
+    uint8_t header[13];
+    writeBigEndian(header, width);
+    writeBigEndian(header + 4, height);
+    header[8] = 8;
+    header[9] = alpha ? 6 : 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    out = writePngChunk(out, "IHDR", header, sizeof(header));
+
+    // The IDAT data is built in place, right where writePngChunk expects it.
+    uint8_t* idat = out + 8;
+    uint8_t* idatOut = idat;
+    *idatOut++ = 0x78;
+    *idatOut++ = 0x01;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    size_t rawPosition = 0;
+    size_t blockRemaining = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* row = (const uint8_t*)pixels + (size_t)y * rowPitch;
+        for (size_t column = 0; column < scanlineSize; ++column) {
+            if (blockRemaining == 0) {
+                size_t blockSize = rawSize - rawPosition < NI_PNG_STORED_BLOCK_SIZE ? rawSize - rawPosition : NI_PNG_STORED_BLOCK_SIZE;
+                *idatOut++ = rawPosition + blockSize == rawSize ? 1 : 0;
+                *idatOut++ = (uint8_t)blockSize;
+                *idatOut++ = (uint8_t)(blockSize >> 8);
+                *idatOut++ = (uint8_t)~blockSize;
+                *idatOut++ = (uint8_t)(~blockSize >> 8);
+                blockRemaining = blockSize;
+            }
+            uint8_t value = 0;
+            if (column > 0) {
+                size_t pixel = (column - 1) / channels;
+                value = row[pixel * 4 + (column - 1) % channels];
+            }
+            *idatOut++ = value;
+            adlerA = (adlerA + value) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+            rawPosition++;
+            blockRemaining--;
+        }
+    }
+    idatOut = writeBigEndian(idatOut, (adlerB << 16) | adlerA);
+    NI_ASSERT((size_t)(idatOut - idat) == idatSize, "PNG data size mismatch");
+    out = writePngChunk(out, "IDAT", idat, (uint32_t)idatSize);
+    out = writePngChunk(out, "IEND", nullptr, 0);
+    outSize = out - data;
+    return data;
+}
+
+// Reads back what encodePng writes, stored blocks only. Returns the number of mismatching bytes or checksums.
+static uint32_t checkPng(const uint8_t* data, size_t size, const uint8_t* pixels, uint32_t width, uint32_t height, bool alpha) {
+    uint32_t errorNum = 0;
+    if (size < sizeof(pngSignature) || memcmp(data, pngSignature, sizeof(pngSignature)) != 0) return 1;
+    size_t position = sizeof(pngSignature);
+    const uint8_t* idat = nullptr;
+    uint32_t idatSize = 0;
+    bool ended = false;
+    while (position + 12 <= size && !ended) {
+        uint32_t chunkSize = readBigEndian(data + position);
+        const uint8_t* type = data + position + 4;
+        if (position + 12 + chunkSize > size) return errorNum + 1;
+        uint32_t crc = updateCrc(0xffffffffu, type, chunkSize + 4) ^ 0xffffffffu;
+        errorNum += crc != readBigEndian(type + 4 + chunkSize);
+        if (memcmp(type, "IHDR", 4) == 0) {
+            errorNum += readBigEndian(type + 4) != width || readBigEndian(type + 8) != height || type[12] != 8 || type[13] != (alpha ? 6 : 2);
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            idat = type + 4;
+            idatSize = chunkSize;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            ended = true;
+        }
+        position += 12 + chunkSize;
+    }
+    if (idat == nullptr || !ended || position != size) return errorNum + 1;
+
+    const uint32_t channels = alpha ? 4 : 3;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    size_t in = 2;
+    size_t rawPosition = 0;
+    bool final = false;
+    while (!final && in + 5 <= idatSize) {
+        final = (idat[in] & 1) != 0;
+        uint32_t blockSize = idat[in + 1] | (idat[in + 2] << 8);
+        errorNum += (uint16_t)~blockSize != (idat[in + 3] | (idat[in + 4] << 8));
+        in += 5;
+        if (in + blockSize > idatSize) return errorNum + 1;
+        for (uint32_t index = 0; index < blockSize; ++index, ++rawPosition) {
+            uint8_t value = idat[in + index];
+            size_t column = rawPosition % ((size_t)width * channels + 1);
+            size_t y = rawPosition / ((size_t)width * channels + 1);
+            uint8_t expected = column == 0 ? 0 : pixels[(y * width + (column - 1) / channels) * 4 + (column - 1) % channels];
+            errorNum += value != expected;
+            adlerA = (adlerA + value) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        in += blockSize;
+    }
+    errorNum += !final || rawPosition != ((size_t)width * channels + 1) * height || in + 4 != idatSize;
+    errorNum += in + 4 <= idatSize && readBigEndian(idat + in) != ((adlerB << 16) | adlerA);
+    return errorNum;
+}
+
+uint32_t ni::validateImageCodec() {
+    initCrcTable();
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+    // Gradients exercise the diff and luma ops, flat areas the runs, the noise band the literals and the index.
+    const uint32_t sizes[][2] = { { 1, 1 }, { 7, 3 }, { 64, 64 }, { 333, 127 }, { 1920, 1080 } };
+    uint32_t state = 0x12345678u;
+    for (uint32_t sizeIndex = 0; sizeIndex < sizeof(sizes) / sizeof(sizes[0]); ++sizeIndex) {
+        uint32_t width = sizes[sizeIndex][0];
+        uint32_t height = sizes[sizeIndex][1];
+        uint8_t* pixels = (uint8_t*)malloc((size_t)width * height * 4);
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                uint8_t* pixel = &pixels[((size_t)y * width + x) * 4];
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                bool noise = y % 32 < 4;
+                bool flat = x < width / 4;
+                pixel[0] = noise ? (uint8_t)state : flat ? 40 : (uint8_t)(x * 255 / width);
+                pixel[1] = noise ? (uint8_t)(state >> 8) : flat ? 80 : (uint8_t)(y * 255 / height);
+                pixel[2] = noise ? (uint8_t)(state >> 16) : flat ? 120 : (uint8_t)((x + y) * 3);
+                pixel[3] = noise ? (uint8_t)(state >> 24) : flat ? 255 : (uint8_t)(255 - x % 3);
+            }
+        }
+        for (uint32_t alpha = 0; alpha < 2; ++alpha) {
+            size_t qoiSize = 0;
+            void* qoi = encodeQoi(pixels, width, height, width * 4, alpha != 0, qoiSize);
+            uint32_t decodedWidth = 0;
+            uint32_t decodedHeight = 0;
+            uint8_t* decoded = (uint8_t*)decodeQoi(qoi, qoiSize, decodedWidth, decodedHeight);
+            uint32_t mismatchNum = 0;
+            if (decoded != nullptr && decodedWidth == width && decodedHeight == height) {
+                for (size_t index = 0; index < (size_t)width * height * 4; ++index) {
+                    uint8_t expected = index % 4 == 3 && alpha == 0 ? 255 : pixels[index];
+                    mismatchNum += decoded[index] != expected;
+                }
+            } else {
+                mismatchNum++;
+            }
+            checkNum++;
+            if (mismatchNum > 0) {
+                NI_LOG("Image codec: %ux%u QOI %s round trip has %u mismatches", width, height, alpha ? "RGBA" : "RGB", mismatchNum);
+                errorNum++;
+            }
+            // Truncated files are rejected instead of read past their end.
+            void* truncated = decodeQoi(qoi, qoiSize / 2, decodedWidth, decodedHeight);
+            checkNum++;
+            if (truncated != nullptr && width * height > 1) {
+                NI_LOG("Image codec: truncated %ux%u QOI decoded", width, height);
+                errorNum++;
+            }
+            free(truncated);
+            free(decoded);
+            free(qoi);
+
+            size_t pngSize = 0;
+            uint8_t* png = (uint8_t*)encodePng(pixels, width, height, width * 4, alpha != 0, pngSize);
+            uint32_t pngErrorNum = checkPng(png, pngSize, pixels, width, height, alpha != 0);
+            checkNum++;
+            if (pngErrorNum > 0) {
+                NI_LOG("Image codec: %ux%u PNG %s has %u errors", width, height, alpha ? "RGBA" : "RGB", pngErrorNum);
+                errorNum++;
+            }
+            if (width == 1920 && alpha == 0) {
+                NI_LOG("Image codec: 1920x1080 RGB is %.2f MB raw, %.2f MB QOI, %.2f MB PNG", (double)width * height * 3 / (1024.0 * 1024.0),
+                    (double)qoiSize / (1024.0 * 1024.0), (double)pngSize / (1024.0 * 1024.0));
+            }
+            free(png);
+        }
+        free(pixels);
+    }
+    NI_LOG("Image codec: %u checks, %u error(s)", checkNum, errorNum);
+    return errorNum;
+}
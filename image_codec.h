@@ -0,0 +1,17 @@
+#pragma once
+
+#include "ni_core.h"
+
+namespace ni {
+
+	// Encoders take RGBA8 rows rowPitch bytes apart and return a malloced file the caller frees. Without alpha
+	// only RGB is stored.
+	void* encodeQoi(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, bool alpha, size_t& outSize);
+	// Tightly packed RGBA8, null when the data isn't a valid QOI image. The caller frees the pixels.
+	void* decodeQoi(const void* data, size_t size, uint32_t& outWidth, uint32_t& outHeight);
+	// The image data goes into stored deflate blocks, so the file is a bit larger than the pixels, but it's
+	// written at memcpy speed and every viewer opens it. QOI is the one to use when size matters.
+	void* encodePng(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, bool alpha, size_t& outSize);
+	// Round trips synthetic images through QOI and checks the PNG chunks, checksums and stored scanlines.
+	uint32_t validateImageCodec();
+}
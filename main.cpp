@@ -1,10 +1,25 @@
 
 #include "ni.h"
-#include "images.h"
+#include "asset_pack.h"
+#include "async_loader.h"
+#include "cpu_trace.h"
+#include "draw_capture.h"
+#include "frame_timing.h"
+#include "golden_images.h"
+#include "gpu_profiler.h"
+#include "heap_allocator.h"
+#include "pipeline_cache.h"
+#include "queue_simulator.h"
+#include "readback.h"
+#include "render_batch.h"
+#include "render_graph.h"
+#include "renderer_stats.h"
+#include "resource_state_tracker.h"
+#include "sprite_benchmark.h"
 #include "sprite_renderer.h"
+#include "texture_streaming.h"
 #include <algorithm>
-
-#include <Superluminal/PerformanceAPI.h>
+#include <string.h>
 
 struct Point {
     float x;
@@ -33,19 +48,245 @@ struct Point {
 };
 
 #define SPRITE_COUNT (MAX_DRAW_COMMANDS - 1)
+// Cooked by AssetPacker as a post build step. Pass a different path as the only non option argument to override.
+#define SPRITE_PACK_PATH "sprites.pack"
+#define STREAMING_BENCH_TEXTURE_COUNT 512
+// Sprites drawn under one trace event, a million single draws would flood the trace.
+#define SPRITE_TRACE_BATCH 65536
+#define CPU_TRACE_PATH "cpu_trace.json"
+#define FRAME_TIMING_CSV_PATH "frame_timing.csv"
+#define FRAME_TIMING_JSON_PATH "frame_timing.json"
+#define STATS_LOG_FRAMES 20
+// Times a capture is played back by --replay.
+#define REPLAY_LOOP_COUNT 10
+#define SPRITE_BENCH_CSV_PATH "sprite_bench.csv"
+#define SPRITE_BENCH_JSON_PATH "sprite_bench.json"
+#define GOLDEN_CSV_PATH "golden_results.csv"
+#define GOLDEN_JSON_PATH "golden_results.json"
+#define SCREENSHOT_PATH_SIZE 64
+// Output size of --batch unless --thumbnail-size overrides it.
+#define BATCH_THUMBNAIL_WIDTH 320
+#define BATCH_THUMBNAIL_HEIGHT 180
+#define QUEUE_SIM_FRAME_COUNT 120
+
+// Flags that take an operand panic when it's missing instead of falling through to the pack path.
+static const char* getOperand(int argc, char** argv, int& index) {
+    if (index + 1 >= argc) {
+        NI_PANIC("Missing operand for %s", argv[index]);
+    }
+    return argv[++index];
+}
+
+struct Validation {
+    const char* name;
+    uint32_t(*run)();
+};
+
+static uint32_t simulateFrameQueues() {
+    return ni::simulateFrameQueues(QUEUE_SIM_FRAME_COUNT);
+}
 
-int main() {
+// The device free checks that still need the D3D12 types, SelfTests runs the ones on the portable core.
+static const Validation validations[] = {
+    { "barriers", ni::validateResourceStateTracker },
+    { "queues", simulateFrameQueues },
+    { "pipeline-cache", ni::validatePipelineCache },
+    { "gpu-profiler", ni::validateGpuProfiler },
+    { "renderer-stats", ni::validateRendererStats },
+};
+
+static uint32_t runValidations() {
+    uint32_t failedNum = 0;
+    for (const Validation& validation : validations) {
+        uint32_t errorNum = validation.run();
+        NI_LOG("[%s] %s", validation.name, errorNum == 0 ? "passed" : "FAILED");
+        failedNum += errorNum > 0 ? 1 : 0;
+    }
+    return failedNum;
+}
+
+int main(int argc, char** argv) {
 
     //ShowCursor(0);
 
-	ni::init(1920, 1080);
+    const char* packPath = SPRITE_PACK_PATH;
+    bool packPathSet = false;
+    bool exportTrace = false;
+    bool exportFrameTiming = false;
+    const char* capturePath = nullptr;
+    const char* replayPath = nullptr;
+    bool benchSprites = false;
+    const char* recordPrefix = nullptr;
+    ni::RenderBatchOptions batchOptions = { nullptr, nullptr, ni::READBACK_ENCODING_PNG, 0, 1, nullptr };
+    uint32_t thumbnailWidth = BATCH_THUMBNAIL_WIDTH;
+    uint32_t thumbnailHeight = BATCH_THUMBNAIL_HEIGHT;
+    uint32_t initFlags = 0;
+    bool softwareBatch = false;
+    for (int index = 1; index < argc; ++index) {
+        if (strcmp(argv[index], "--cpu-trace") == 0) {
+            exportTrace = true;
+            continue;
+        }
+        if (strcmp(argv[index], "--frame-timing") == 0) {
+            exportFrameTiming = true;
+            continue;
+        }
+        if (strcmp(argv[index], "--capture") == 0) {
+            capturePath = getOperand(argc, argv, index);
+            continue;
+        }
+        if (strcmp(argv[index], "--replay") == 0) {
+            replayPath = getOperand(argc, argv, index);
+            continue;
+        }
+        if (strcmp(argv[index], "--record") == 0) {
+            recordPrefix = getOperand(argc, argv, index);
+            continue;
+        }
+        if (strcmp(argv[index], "--batch") == 0) {
+            batchOptions.listPath = getOperand(argc, argv, index);
+            batchOptions.outputDir = getOperand(argc, argv, index);
+            continue;
+        }
+        if (strcmp(argv[index], "--shard") == 0) {
+            if (!ni::parseShard(getOperand(argc, argv, index), batchOptions.shardIndex, batchOptions.shardNum)) {
+                NI_PANIC("Expected --shard <index>/<num>, got %s", argv[index]);
+            }
+            continue;
+        }
+        if (strcmp(argv[index], "--thumbnail-size") == 0) {
+            if (sscanf(getOperand(argc, argv, index), "%ux%u", &thumbnailWidth, &thumbnailHeight) != 2 || thumbnailWidth == 0 || thumbnailHeight == 0) {
+                NI_PANIC("Expected --thumbnail-size <width>x<height>, got %s", argv[index]);
+            }
+            continue;
+        }
+        if (strcmp(argv[index], "--qoi") == 0) {
+            batchOptions.encoding = ni::READBACK_ENCODING_QOI;
+            continue;
+        }
+        if (strcmp(argv[index], "--warp") == 0) {
+            initFlags |= ni::INIT_WARP_ADAPTER;
+            continue;
+        }
+        if (strcmp(argv[index], "--software") == 0) {
+            softwareBatch = true;
+            continue;
+        }
+        // Gates a change on both the images and the time of the CPU pipeline, --golden-update records them. The
+        // references are checked in under golden/, the times stay with the machine that recorded them.
+        if (strcmp(argv[index], "--golden-check") == 0 || strcmp(argv[index], "--golden-update") == 0) {
+            bool update = strcmp(argv[index], "--golden-update") == 0;
+            const char* goldenDir = getOperand(argc, argv, index);
+            ni::initLoaderThreads(NI_LOADER_THREAD_NUM);
+            uint32_t failedNum = ni::runGoldenImages(goldenDir, update, GOLDEN_CSV_PATH, GOLDEN_JSON_PATH);
+            ni::destroyLoaderThreads();
+            return failedNum == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--bench-sprites") == 0) {
+            benchSprites = true;
+            continue;
+        }
+        if (strcmp(argv[index], "--bench-sprites-cpu") == 0) {
+            ni::benchmarkSpritesCpu(SPRITE_BENCH_CSV_PATH, SPRITE_BENCH_JSON_PATH);
+            return 0;
+        }
+        if (strcmp(argv[index], "--bench-cpu-trace") == 0) {
+            return ni::benchmarkCpuTrace() == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--bench-streaming") == 0) {
+            return ni::benchmarkTextureStreaming(STREAMING_BENCH_TEXTURE_COUNT) == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--bench-heap") == 0) {
+            return ni::benchmarkHeapAllocator() == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--bench-async-loading") == 0) {
+            return ni::benchmarkAsyncLoading() == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--bench-render-graph") == 0) {
+            return ni::benchmarkRenderGraph() == 0 ? 0 : 1;
+        }
+        if (strcmp(argv[index], "--validate") == 0) {
+            return runValidations() == 0 ? 0 : 1;
+        }
+        if (strncmp(argv[index], "--", 2) == 0) {
+            NI_PANIC("Unknown option %s", argv[index]);
+        }
+        if (packPathSet) {
+            NI_PANIC("Unexpected argument %s, the pack path is already %s", argv[index], packPath);
+        }
+        packPath = argv[index];
+        packPathSet = true;
+    }
+
+    NI_TRACE_THREAD_NAME("Main");
+    // Batch jobs run on servers, nothing is shown. Start one process per shard to use more cores or GPUs.
+    // --software draws on the CPU, for machines without a GPU where even WARP isn't available. Captured images
+    // are drawn with the pack's textures.
+    if (batchOptions.listPath != nullptr && softwareBatch) {
+        ni::initLoaderThreads(NI_LOADER_THREAD_NUM);
+        ni::AssetPack* pack = new ni::AssetPack(packPath);
+        batchOptions.pack = pack->isValid() ? pack : nullptr;
+        ni::RenderBatchStats batchStats = ni::renderBatchSoftware(batchOptions, thumbnailWidth, thumbnailHeight);
+        delete pack;
+        ni::destroyLoaderThreads();
+        return batchStats.skippedNum == 0 && batchStats.failedNum == 0 ? 0 : 1;
+    }
+    if (batchOptions.listPath != nullptr) {
+        ni::init(thumbnailWidth, thumbnailHeight, initFlags | ni::INIT_OFFSCREEN);
+        SpriteRenderer* spriteRenderer = new SpriteRenderer();
+        ni::AssetPack* pack = new ni::AssetPack(packPath);
+        batchOptions.pack = pack->isValid() ? pack : nullptr;
+        ni::RenderBatchStats batchStats = ni::renderBatch(spriteRenderer, batchOptions);
+        delete spriteRenderer;
+        ni::destroy();
+        delete pack;
+        return batchStats.skippedNum == 0 && batchStats.failedNum == 0 ? 0 : 1;
+    }
+    // Replays only measure the renderer, so nothing is shown. Textures missing from the pack get placeholders.
+    if (replayPath != nullptr) {
+        ni::init(1920, 1080, initFlags | ni::INIT_OFFSCREEN);
+        SpriteRenderer* spriteRenderer = new SpriteRenderer();
+        ni::AssetPack* pack = new ni::AssetPack(packPath);
+        ni::replayDrawCapture(spriteRenderer, replayPath, REPLAY_LOOP_COUNT, pack->isValid() ? pack : nullptr);
+        delete spriteRenderer;
+        ni::destroy();
+        delete pack;
+        return 0;
+    }
+	ni::init(1920, 1080, initFlags);
     SpriteRenderer* spriteRenderer = new SpriteRenderer();
+    if (benchSprites) {
+        // Doesn't need the pack, the benchmark creates its own textures.
+        ni::benchmarkSpritesGpu(spriteRenderer, SPRITE_BENCH_CSV_PATH, SPRITE_BENCH_JSON_PATH);
+        delete spriteRenderer;
+        ni::destroy();
+        return 0;
+    }
+    ni::DrawCaptureWriter* drawCapture = nullptr;
+    if (capturePath != nullptr) {
+        drawCapture = new ni::DrawCaptureWriter();
+        if (drawCapture->open(capturePath)) {
+            spriteRenderer->setCapture(drawCapture);
+        }
+    }
 
+    const char* imageNames[4] = { "image1", "image2", "image3", "image4" };
+    const wchar_t* imageDebugNames[4] = { L"image1", L"image2", L"image3", L"image4" };
     ni::Texture* images[4] = {};
-    images[0] = ni::createTexture(L"image1", image_img1_width, image_img1_height, 1, image_img1);
-    images[1] = ni::createTexture(L"image2", image_img2_width, image_img2_height, 1, image_img2);
-    images[2] = ni::createTexture(L"image3", image_img3_width, image_img3_height, 1, image_img3);
-    images[3] = ni::createTexture(L"image4", image_img4_width, image_img4_height, 1, image_img4);
+    SpriteMesh spriteMeshes[4] = {};
+    // Textures stream straight out of the mapping, so the pack stays open until shutdown.
+    ni::AssetPack* pack = new ni::AssetPack(packPath);
+    if (!pack->isValid()) {
+        NI_PANIC("Failed to load the sprite pack. Build the AssetPacker project to cook it.");
+    }
+    for (uint32_t index = 0; index < 4; ++index) {
+        const ni::AssetPackTexture* packTexture = pack->findTexture(imageNames[index]);
+        NI_ASSERT(packTexture != nullptr, "Missing %s in sprite pack", imageNames[index]);
+        images[index] = pack->streamTexture(imageDebugNames[index], *packTexture);
+        // Compressed textures can be padded to whole blocks, so normalize against the texture size.
+        spriteMeshes[index] = buildSpriteMesh(packTexture->bounds, packTexture->width, packTexture->height);
+        images[index]->spriteMesh = &spriteMeshes[index];
+    }
 
     Point* points = new Point[SPRITE_COUNT];
     uint32_t sx = 0;
@@ -72,15 +313,27 @@ int main() {
     float viewVel[2] = { 0, 0 };
     float viewAcl[2] = { 0, 0 };
     float rotation = 0.0f;
-    double deltaAccumulation = 0.0;
-    double accumulationCounter = 0.0;
+    uint32_t frameCounter = 0;
+    bool screenshotKeyDown = false;
+    // QOI keeps up with every frame where PNG wouldn't, the frames are numbered for ffmpeg or a QOI aware viewer.
+    if (recordPrefix != nullptr) {
+        ni::getReadback()->startRecording(recordPrefix, ni::READBACK_ENCODING_QOI);
+    }
 	while (!ni::shouldQuit()) {
-        double startTime = ni::getSeconds();
-
-        PerformanceAPI_BeginEvent("Frame", nullptr, PERFORMANCEAPI_MAKE_COLOR(0xFF, 0xFF, 0x00));
+        NI_TRACE_BEGIN("Frame");
 
 		ni::pollEvents();
 
+        // Copied at the end of this frame and written a few frames later on a loader thread.
+        if (ni::keyDown(ni::F12) && !screenshotKeyDown) {
+            char screenshotPath[SCREENSHOT_PATH_SIZE];
+            snprintf(screenshotPath, sizeof(screenshotPath), "screenshot_%u.png", frameCounter);
+            if (!ni::getReadback()->requestScreenshot(screenshotPath, ni::READBACK_ENCODING_PNG)) {
+                NI_LOG("Screenshot dropped, every readback slot is busy");
+            }
+        }
+        screenshotKeyDown = ni::keyDown(ni::F12);
+
         bool btnDown = ni::mouseDown(ni::MOUSE_BUTTON_LEFT);
 
         if (btnDown && ni::mouseX() > ni::getViewWidth() - 300) {
@@ -108,19 +361,23 @@ int main() {
 
         /* Render Sprites */
         {
-            PerformanceAPI_BeginEvent("SpriteRendering", nullptr, PERFORMANCEAPI_MAKE_COLOR(0xFF, 0x00, 0xFF));
+            NI_TRACE_BEGIN("SpriteRendering");
             spriteRenderer->reset();
             spriteRenderer->pushMatrix();
             spriteRenderer->translate(-viewPos[0], -viewPos[1]);
 
-            for (uint32_t index = 0; index < SPRITE_COUNT; ++index) {
-                spriteRenderer->pushMatrix();
-                spriteRenderer->translate(points[index].x, points[index].y);
-                spriteRenderer->rotate(points[index].rotation);
-                spriteRenderer->scale(0.25f, 0.25f);
-                spriteRenderer->drawImage(-(float)points[index].width * 0.5f, -(float)points[index].height * 0.5f, (float)points[index].width, (float)points[index].height, NI_COLOR_UINT(0xffffffff), points[index].image);
-                spriteRenderer->popMatrix();
-                points[index].rotation -= 1.0f / 60.0f;
+            for (uint32_t batch = 0; batch < SPRITE_COUNT; batch += SPRITE_TRACE_BATCH) {
+                NI_TRACE_SCOPE("drawImage batch");
+                uint32_t batchEnd = std::min(batch + SPRITE_TRACE_BATCH, (uint32_t)SPRITE_COUNT);
+                for (uint32_t index = batch; index < batchEnd; ++index) {
+                    spriteRenderer->pushMatrix();
+                    spriteRenderer->translate(points[index].x, points[index].y);
+                    spriteRenderer->rotate(points[index].rotation);
+                    spriteRenderer->scale(0.25f, 0.25f);
+                    spriteRenderer->drawImage(-(float)points[index].width * 0.5f, -(float)points[index].height * 0.5f, (float)points[index].width, (float)points[index].height, NI_COLOR_UINT(0xffffffff), points[index].image);
+                    spriteRenderer->popMatrix();
+                    points[index].rotation -= 1.0f / 60.0f;
+                }
             }
 
             spriteRenderer->pushMatrix();
@@ -129,37 +386,64 @@ int main() {
             spriteRenderer->drawImage(-(float)images[0]->width * 0.5f, -(float)images[0]->height * 0.5f, (float)images[0]->width, (float)images[0]->height, NI_COLOR_UINT(0xff0000ff), images[0]);
             spriteRenderer->popMatrix();
             spriteRenderer->popMatrix();
-            PerformanceAPI_EndEvent();
+            NI_TRACE_END();
         }
         
         /* Submit to the GPU */
         {
-            PerformanceAPI_BeginEvent("GPU Submit", nullptr, PERFORMANCEAPI_MAKE_COLOR(0x00, 0xFF, 0xFF));
+            NI_TRACE_BEGIN("GPU Submit");
+            if (drawCapture != nullptr) {
+                drawCapture->setCamera({ viewPos[0], viewPos[1], 1.0f, 0.0f });
+            }
             ni::FrameData& frame = ni::beginFrame();
             spriteRenderer->flushCommands(frame);
             ni::endFrame();
-            PerformanceAPI_EndEvent();
+            NI_TRACE_END();
         }
 		ni::present(0);
         ni::waitForCurrentFrame();
 
         rotation += 1.0f / 60.0f;
 
-        PerformanceAPI_EndEvent();
+        NI_TRACE_END();
 
-        double endTime = ni::getSeconds();
-        deltaAccumulation += (endTime - startTime) * 1000.0;
-        accumulationCounter += 1.0f;
-        if (accumulationCounter == 20) {
-            printf("%.4lf ms\n", deltaAccumulation / accumulationCounter);
-            accumulationCounter = 0.0f;
-            deltaAccumulation = 0.0f;
+        // Percentiles over the whole run, an average over the last few frames would hide hitches.
+        if (++frameCounter % STATS_LOG_FRAMES == 0) {
+            const SpriteRenderStats& stats = spriteRenderer->getStats();
+            ni::StreamingStats streamingStats = ni::getStreamingStats();
+            ni::getFrameTiming()->log();
+            printf("texture bandwidth ~%.1f MB/frame (%.1f MB without mips), staging peak %.1f of %.1f MB\n",
+                (double)stats.estimatedTextureBytes / (1024.0 * 1024.0), (double)stats.estimatedTextureBytesWithoutMips / (1024.0 * 1024.0),
+                (double)streamingStats.stagingHighWaterMark / (1024.0 * 1024.0), (double)streamingStats.stagingCapacity / (1024.0 * 1024.0));
+            ni::getGpuProfiler()->log();
+            ni::getRendererStats()->log();
         }
     }
 
+    ni::getReadback()->stopRecording();
     ni::waitForAllFrames();
+    if (exportTrace) {
+        if (ni::exportCpuTrace(CPU_TRACE_PATH)) {
+            NI_LOG("CPU trace written to %s", CPU_TRACE_PATH);
+        } else {
+            NI_LOG("Failed to write CPU trace %s", CPU_TRACE_PATH);
+        }
+    }
+    if (exportFrameTiming) {
+        if (ni::getFrameTiming()->exportCsv(FRAME_TIMING_CSV_PATH) && ni::getFrameTiming()->exportJson(FRAME_TIMING_JSON_PATH)) {
+            NI_LOG("Frame timing written to %s and %s", FRAME_TIMING_CSV_PATH, FRAME_TIMING_JSON_PATH);
+        } else {
+            NI_LOG("Failed to write frame timing %s and %s", FRAME_TIMING_CSV_PATH, FRAME_TIMING_JSON_PATH);
+        }
+    }
+    if (drawCapture != nullptr) {
+        spriteRenderer->setCapture(nullptr);
+        drawCapture->close();
+        delete drawCapture;
+    }
     delete spriteRenderer;
     delete[] points;
 	ni::destroy();
+    delete pack;
     return 0;
 }
\ No newline at end of file
@@ -15,22 +15,195 @@
 #include <string>
 #include <strsafe.h>
 #include <new>
-#include <random>
-#include <chrono>
 
 #include "ni.h"
+#include "texture_compression.h"
+#include "texture_streaming.h"
+#include "heap_allocator.h"
+#include "pipeline_cache.h"
+#include "async_loader.h"
+#include "gpu_profiler.h"
+#include "frame_timing.h"
+#include "renderer_stats.h"
+#include "cpu_trace.h"
+#include "readback.h"
 
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
 #pragma comment(lib, "dxguid.lib")
 #pragma comment(lib, "d3dcompiler.lib")
 
-#define NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE  4096
-#define NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT 4
 
 static bool keysDown[512];
 static bool mouseBtnsDown[3];
 static ni::Renderer renderer = {};
+
+// Placed resource memory. Blocks are created on first use and kept until ni::destroy, streaming keeps reusing them.
+struct GpuHeapBlock {
+    ID3D12Heap* heap;
+    // GPU_HEAP_POOL_SMALL_UPLOAD suballocates a persistently mapped buffer instead of placing resources.
+    ID3D12Resource* buffer;
+    void* mapped;
+    ni::TLSFAllocator allocator;
+};
+
+struct GpuHeapPoolData {
+    GpuHeapBlock blocks[NI_GPU_HEAP_MAX_BLOCKS];
+    uint32_t blockNum;
+    uint32_t allocationNum;
+    uint64_t allocatedBytes;
+};
+
+static GpuHeapPoolData heapPools[ni::GPU_HEAP_POOL_COUNT];
+static uint32_t committedResourceNum;
+
+struct PendingDescriptorFree {
+    uint32_t node;
+    uint64_t frameNumber;
+};
+
+// Persistent region of renderer.descriptorHeap, offsets are in descriptors.
+static ni::TLSFAllocator persistentDescriptors;
+static ni::Array<PendingDescriptorFree, uint32_t> pendingDescriptorFrees;
+
+// Destroyed buffers and textures wait like descriptors do. A placed resource created in the range right away
+// would alias memory the frames in flight still read.
+struct PendingResourceRelease {
+    ni::Resource resource;
+    uint64_t frameNumber;
+};
+
+static ni::Array<PendingResourceRelease, uint32_t> pendingResourceReleases;
+
+static void getHeapPoolDesc(ni::GpuHeapPool pool, D3D12_HEAP_TYPE& outHeapType, D3D12_HEAP_FLAGS& outHeapFlags, uint64_t& outBlockSize, uint64_t& outGranularity) {
+    outBlockSize = NI_GPU_HEAP_BLOCK_SIZE;
+    outGranularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    switch (pool) {
+    case ni::GPU_HEAP_POOL_DEFAULT_BUFFERS:
+        outHeapType = D3D12_HEAP_TYPE_DEFAULT;
+        outHeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS | D3D12_HEAP_FLAG_CREATE_NOT_ZEROED;
+        break;
+    case ni::GPU_HEAP_POOL_UPLOAD_BUFFERS:
+        outHeapType = D3D12_HEAP_TYPE_UPLOAD;
+        outHeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+        break;
+    case ni::GPU_HEAP_POOL_TEXTURES:
+        // Textures below 64 KB can use 4 KB placement alignment.
+        outHeapType = D3D12_HEAP_TYPE_DEFAULT;
+        outHeapFlags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES | D3D12_HEAP_FLAG_CREATE_NOT_ZEROED;
+        outGranularity = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        break;
+    case ni::GPU_HEAP_POOL_SMALL_UPLOAD:
+        outHeapType = D3D12_HEAP_TYPE_UPLOAD;
+        outHeapFlags = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+        outBlockSize = NI_SMALL_UPLOAD_BLOCK_SIZE;
+        outGranularity = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+        break;
+    default:
+        NI_PANIC("Error: Invalid heap pool");
+        break;
+    }
+}
+
+// First fit over the pool's blocks, a new block is created when none of them has room.
+static bool allocateFromHeapPool(ni::GpuHeapPool pool, uint64_t size, uint64_t alignment, ni::HeapAllocation& outAllocation, uint64_t& outOffset) {
+    GpuHeapPoolData& poolData = heapPools[pool];
+    D3D12_HEAP_TYPE heapType;
+    D3D12_HEAP_FLAGS heapFlags;
+    uint64_t blockSize, granularity;
+    getHeapPoolDesc(pool, heapType, heapFlags, blockSize, granularity);
+    if (size > blockSize) return false;
+
+    ni::HeapRange range = {};
+    uint32_t blockIndex = 0;
+    for (; blockIndex < poolData.blockNum; ++blockIndex) {
+        if (poolData.blocks[blockIndex].allocator.allocate(size, alignment, range)) break;
+    }
+    if (blockIndex == poolData.blockNum) {
+        if (poolData.blockNum == NI_GPU_HEAP_MAX_BLOCKS) return false;
+        GpuHeapBlock& block = poolData.blocks[poolData.blockNum];
+        D3D12_HEAP_PROPERTIES heapProps = { heapType, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 0, 0 };
+        block.heap = nullptr;
+        block.buffer = nullptr;
+        block.mapped = nullptr;
+        if (pool == ni::GPU_HEAP_POOL_SMALL_UPLOAD) {
+            D3D12_RESOURCE_DESC bufferDesc = { D3D12_RESOURCE_DIMENSION_BUFFER, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, blockSize, 1, 1, 1, DXGI_FORMAT_UNKNOWN, { 1, 0 }, D3D12_TEXTURE_LAYOUT_ROW_MAJOR, D3D12_RESOURCE_FLAG_NONE };
+            NI_D3D_ASSERT(renderer.device->CreateCommittedResource(&heapProps, heapFlags, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&block.buffer)), "Failed to create small upload buffer block");
+            block.buffer->SetName(L"gfx::smallUploadBlock");
+            D3D12_RANGE readRange = { 0, 0 };
+            NI_D3D_ASSERT(block.buffer->Map(0, &readRange, &block.mapped), "Failed to map small upload buffer block");
+        } else {
+            D3D12_HEAP_DESC heapDesc = { blockSize, heapProps, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, heapFlags };
+            NI_D3D_ASSERT(renderer.device->CreateHeap(&heapDesc, IID_PPV_ARGS(&block.heap)), "Failed to create heap block");
+            block.heap->SetName(L"gfx::heapBlock");
+        }
+        block.allocator.init(blockSize, granularity);
+        poolData.blockNum++;
+        if (!block.allocator.allocate(size, alignment, range)) return false;
+    }
+    outAllocation = { (uint32_t)pool, blockIndex, range.node };
+    outOffset = range.offset;
+    poolData.allocationNum++;
+    poolData.allocatedBytes += range.size;
+    return true;
+}
+
+static void freeFromHeapPool(const ni::HeapAllocation& allocation) {
+    GpuHeapPoolData& poolData = heapPools[allocation.pool];
+    ni::TLSFAllocator& allocator = poolData.blocks[allocation.block].allocator;
+    uint64_t freeSize = allocator.getFreeSize();
+    allocator.free(allocation.node);
+    poolData.allocationNum--;
+    poolData.allocatedBytes -= allocator.getFreeSize() - freeSize;
+}
+
+// Releases the resource and hands its heap range back. Shared small upload buffers are only unreferenced.
+static void releaseResourceNow(ni::Resource& resource) {
+    if (resource.allocation.pool == ni::GPU_HEAP_POOL_SMALL_UPLOAD) {
+        resource.resource = nullptr;
+    } else if (resource.resource != nullptr && resource.allocation.pool == ni::GPU_HEAP_POOL_COMMITTED) {
+        committedResourceNum--;
+    }
+    NI_D3D_RELEASE(resource.resource);
+    if (resource.allocation.pool != ni::GPU_HEAP_POOL_COMMITTED) {
+        freeFromHeapPool(resource.allocation);
+    }
+    resource = {};
+}
+
+// beginFrame does the release once every frame that could reference the resource retired.
+static void releaseResource(ni::Resource& resource) {
+    if (resource.resource != nullptr || resource.allocation.pool != ni::GPU_HEAP_POOL_COMMITTED) {
+        pendingResourceReleases.add({ resource, renderer.frameNumber });
+    }
+    resource = {};
+}
+
+static void retirePendingReleases(uint64_t frameNumber) {
+    for (uint32_t index = 0; index < pendingResourceReleases.getNum();) {
+        PendingResourceRelease& release = pendingResourceReleases.getData()[index];
+        if (release.frameNumber + NI_FRAME_COUNT <= frameNumber) {
+            releaseResourceNow(release.resource);
+            pendingResourceReleases.getData()[index] = pendingResourceReleases.getData()[pendingResourceReleases.getNum() - 1];
+            pendingResourceReleases.remove(pendingResourceReleases.getNum() - 1);
+        } else {
+            index++;
+        }
+    }
+}
+
+// Placed resources still alive keep a reference to their heap, so this doesn't pull memory from under them.
+static void destroyHeapPools() {
+    for (uint32_t pool = 0; pool < ni::GPU_HEAP_POOL_COUNT; ++pool) {
+        GpuHeapPoolData& poolData = heapPools[pool];
+        for (uint32_t block = 0; block < poolData.blockNum; ++block) {
+            NI_D3D_RELEASE(poolData.blocks[block].buffer);
+            NI_D3D_RELEASE(poolData.blocks[block].heap);
+            poolData.blocks[block].allocator.destroy();
+        }
+        poolData.blockNum = 0;
+    }
+}
 static void loadPIX() {
     if (GetModuleHandleA("WinPixGpuCapture.dll") == 0) {
 
@@ -106,7 +279,15 @@ void ni::RootSignatureBuilder::addRootParameterConstant(uint32_t shaderRegister,
     rootParam.ShaderVisibility = shaderVisibility;
     rootParameters.add(rootParam);
 }
-void ni::RootSignatureBuilder::addStaticSampler(D3D12_FILTER filter, D3D12_TEXTURE_ADDRESS_MODE addressModeAll, uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility) {
+void ni::RootSignatureBuilder::addRootParameterShaderResourceView(uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility) {
+    D3D12_ROOT_PARAMETER rootParam = {};
+    rootParam.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    rootParam.Descriptor.ShaderRegister = shaderRegister;
+    rootParam.Descriptor.RegisterSpace = registerSpace;
+    rootParam.ShaderVisibility = shaderVisibility;
+    rootParameters.add(rootParam);
+}
+void ni::RootSignatureBuilder::addStaticSampler(D3D12_FILTER filter, D3D12_TEXTURE_ADDRESS_MODE addressModeAll, uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility, float maxLOD) {
     D3D12_STATIC_SAMPLER_DESC staticSampler = {};
     staticSampler.Filter = filter;
     staticSampler.AddressU = addressModeAll;
@@ -117,7 +298,7 @@ void ni::RootSignatureBuilder::addStaticSampler(D3D12_FILTER filter, D3D12_TEXTU
     staticSampler.ComparisonFunc = D3D12_COMPARISON_FUNC_ALWAYS;
     staticSampler.BorderColor = D3D12_STATIC_BORDER_COLOR_OPAQUE_BLACK;
     staticSampler.MinLOD = 0;
-    staticSampler.MaxLOD = 0;
+    staticSampler.MaxLOD = maxLOD;
     staticSampler.ShaderRegister = shaderRegister;
     staticSampler.RegisterSpace = registerSpace;
     staticSampler.ShaderVisibility = shaderVisibility;
@@ -138,6 +319,8 @@ ID3D12RootSignature* ni::RootSignatureBuilder::build(bool isCompute) {
     }
     ID3D12RootSignature* rootSignature = nullptr;
     NI_D3D_ASSERT(renderer.device->CreateRootSignature(0, rootSignatureBlob->GetBufferPointer(), rootSignatureBlob->GetBufferSize(), IID_PPV_ARGS(&rootSignature)), "Failed to create root signature");
+    registerRootSignature(rootSignature, rootSignatureBlob->GetBufferPointer(), rootSignatureBlob->GetBufferSize());
+    rootSignatureBlob->Release();
     return rootSignature;
 }
 
@@ -146,16 +329,51 @@ void ni::DescriptorAllocator::reset() {
 }
 
 ni::DescriptorTable ni::DescriptorAllocator::allocateDescriptorTable(uint32_t descriptorNum) {
-    NI_ASSERT(descriptorAllocated + descriptorNum <= NI_MAX_DESCRIPTORS, "Can't allocate %u descriptors", descriptorNum);
-    DescriptorTable table = { { gpuBaseHandle.ptr + descriptorAllocated * descriptorHandleSize }, { cpuBaseHandle.ptr + descriptorAllocated * descriptorHandleSize }, descriptorHandleSize, 0, descriptorNum };
+    NI_ASSERT(descriptorAllocated + descriptorNum <= descriptorCapacity, "Can't allocate %u descriptors", descriptorNum);
+    DescriptorTable table = { { gpuBaseHandle.ptr + descriptorAllocated * descriptorHandleSize }, { cpuBaseHandle.ptr + descriptorAllocated * descriptorHandleSize }, descriptorHandleSize, 0, descriptorNum, heapIndex + descriptorAllocated, NI_TLSF_INVALID_NODE };
     descriptorAllocated += descriptorNum;
     return table;
 }
 
-void ni::init(uint32_t width, uint32_t height) {
+ni::DescriptorTable ni::allocatePersistentDescriptors(uint32_t descriptorNum) {
+    HeapRange range = {};
+    if (!persistentDescriptors.allocate(descriptorNum, 1, range)) {
+        NI_PANIC("Out of persistent descriptors, can't allocate %u", descriptorNum);
+    }
+    uint32_t handleSize = renderer.descriptorHandleSize;
+    D3D12_GPU_DESCRIPTOR_HANDLE gpuBaseHandle = renderer.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    D3D12_CPU_DESCRIPTOR_HANDLE cpuBaseHandle = renderer.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    DescriptorTable table = { { gpuBaseHandle.ptr + range.offset * handleSize }, { cpuBaseHandle.ptr + range.offset * handleSize }, handleSize, 0, descriptorNum, (uint32_t)range.offset, range.node };
+    return table;
+}
+
+void ni::freePersistentDescriptors(DescriptorTable& table) {
+    if (table.capacity == 0) return;
+    NI_ASSERT(table.node != NI_TLSF_INVALID_NODE, "Only persistent descriptor tables can be freed");
+    // Frames that are still in flight may reference the descriptors, beginFrame frees them once those retired.
+    pendingDescriptorFrees.add({ table.node, renderer.frameNumber });
+    table = {};
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE ni::getPersistentDescriptorBase() {
+    return renderer.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+}
+
+// Cached pipelines only work on the GPU and driver version that compiled them.
+static uint64_t getDeviceHash() {
+    DXGI_ADAPTER_DESC1 adapterDesc = {};
+    renderer.adapter->GetDesc1(&adapterDesc);
+    LARGE_INTEGER driverVersion = {};
+    renderer.adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+    uint32_t adapterIds[4] = { adapterDesc.VendorId, adapterDesc.DeviceId, adapterDesc.SubSysId, adapterDesc.Revision };
+    return ni::murmurHash(&driverVersion.QuadPart, sizeof(driverVersion.QuadPart), ni::murmurHash(adapterIds, sizeof(adapterIds), 0));
+}
+
+void ni::init(uint32_t width, uint32_t height, uint32_t flags) {
     memset(&renderer, 0, sizeof(renderer));
 	renderer.windowWidth = width;
 	renderer.windowHeight = height;
+    renderer.offscreen = (flags & INIT_OFFSCREEN) > 0;
 
     renderer.imagesToUpload = (Texture**)malloc(NI_MAX_DESCRIPTORS * sizeof(Texture*));
     renderer.imageToUploadNum = 0;
@@ -163,65 +381,66 @@ void ni::init(uint32_t width, uint32_t height) {
     memset(keysDown, 0, sizeof(keysDown));
     memset(mouseBtnsDown, 0, sizeof(mouseBtnsDown));
 
+    // Offscreen frames only exist as textures, there's nothing to show or take input from.
+    if (!renderer.offscreen) {
 #if NI_USE_FULLSCREEN
-    renderer.windowWidth = GetSystemMetrics(SM_CXSCREEN);
-    renderer.windowHeight = GetSystemMetrics(SM_CXSCREEN);
+        renderer.windowWidth = GetSystemMetrics(SM_CXSCREEN);
+        renderer.windowHeight = GetSystemMetrics(SM_CXSCREEN);
 #endif
 
-    /* Create Window */
-    WNDCLASS windowClass = {
-        0,
-        [](HWND windowHandle, UINT message, WPARAM wParam,
-                          LPARAM lParam) -> LRESULT {
-            switch (message) {
-            case WM_SIZE:
-                //windowWidth = LOWORD(lParam);
-                //windowHeight = HIWORD(lParam);
-                break;
-            case WM_CONTEXTMENU:
-                break;
-            case WM_ENTERSIZEMOVE:
-                break;
-            case WM_EXITSIZEMOVE:
-                break;
-            case WM_CLOSE:
-                DestroyWindow(windowHandle);
-                break;
-            case WM_DESTROY:
-                PostQuitMessage(0);
-                break;
-            default:
-                return DefWindowProc(windowHandle, message, wParam, lParam);
-            }
-            return S_OK;
-        },
-        0,
-        0,
-        GetModuleHandle(nullptr),
-        LoadIcon(nullptr, IDI_APPLICATION),
-        LoadCursor(nullptr, IDC_ARROW),
-        (HBRUSH)(COLOR_WINDOW + 1),
-        nullptr,
-        L"WindowClass"
-    };
-    RegisterClass(&windowClass);
-
-    DWORD windowStyle = WS_VISIBLE | WS_SYSMENU | WS_CAPTION | WS_BORDER;
+        /* Create Window */
+        WNDCLASS windowClass = {
+            0,
+            [](HWND windowHandle, UINT message, WPARAM wParam,
+                              LPARAM lParam) -> LRESULT {
+                switch (message) {
+                case WM_SIZE:
+                    //windowWidth = LOWORD(lParam);
+                    //windowHeight = HIWORD(lParam);
+                    break;
+                case WM_CONTEXTMENU:
+                    break;
+                case WM_ENTERSIZEMOVE:
+                    break;
+                case WM_EXITSIZEMOVE:
+                    break;
+                case WM_CLOSE:
+                    DestroyWindow(windowHandle);
+                    break;
+                case WM_DESTROY:
+                    PostQuitMessage(0);
+                    break;
+                default:
+                    return DefWindowProc(windowHandle, message, wParam, lParam);
+                }
+                return S_OK;
+            },
+            0,
+            0,
+            GetModuleHandle(nullptr),
+            LoadIcon(nullptr, IDI_APPLICATION),
+            LoadCursor(nullptr, IDC_ARROW),
+            (HBRUSH)(COLOR_WINDOW + 1),
+            nullptr,
+            L"WindowClass"
+        };
+        RegisterClass(&windowClass);
+
+        DWORD windowStyle = WS_VISIBLE | WS_SYSMENU | WS_CAPTION | WS_BORDER;
 #if NI_USE_FULLSCREEN    
-    windowStyle = WS_POPUP | WS_VISIBLE;
+        windowStyle = WS_POPUP | WS_VISIBLE;
 #endif
 
-    RECT windowRect = { 0, 0, (LONG)renderer.windowWidth, (LONG)renderer.windowHeight };
-    AdjustWindowRect(&windowRect, windowStyle, false);
-    int32_t adjustedWidth = windowRect.right - windowRect.left;
-    int32_t adjustedHeight = windowRect.bottom - windowRect.top;
-
+        RECT windowRect = { 0, 0, (LONG)renderer.windowWidth, (LONG)renderer.windowHeight };
+        AdjustWindowRect(&windowRect, windowStyle, false);
+        int32_t adjustedWidth = windowRect.right - windowRect.left;
+        int32_t adjustedHeight = windowRect.bottom - windowRect.top;
 
-
-    renderer.windowHandle = CreateWindowExA(
-        WS_EX_LEFT, "WindowClass", "GPU Driven Sprites", windowStyle, CW_USEDEFAULT,
-        CW_USEDEFAULT, adjustedWidth, adjustedHeight, nullptr, nullptr,
-        GetModuleHandle(nullptr), nullptr);
+        renderer.windowHandle = CreateWindowExA(
+            WS_EX_LEFT, "WindowClass", "GPU Driven Sprites", windowStyle, CW_USEDEFAULT,
+            CW_USEDEFAULT, adjustedWidth, adjustedHeight, nullptr, nullptr,
+            GetModuleHandle(nullptr), nullptr);
+    }
     loadPIX();
 
 #if _DEBUG
@@ -233,8 +452,17 @@ void ni::init(uint32_t width, uint32_t height) {
     UINT factoryFlag = 0;
 #endif
     NI_D3D_ASSERT(CreateDXGIFactory2(factoryFlag, IID_PPV_ARGS(&renderer.factory)), "Failed to create factory");
-    NI_D3D_ASSERT(renderer.factory->EnumAdapters(0, (IDXGIAdapter**)(&renderer.adapter)), "Failed to aquire adapter");
+    if ((flags & INIT_WARP_ADAPTER) > 0) {
+        IDXGIFactory4* factory4 = nullptr;
+        NI_D3D_ASSERT(renderer.factory->QueryInterface(IID_PPV_ARGS(&factory4)), "Failed to query IDXGIFactory4");
+        NI_D3D_ASSERT(factory4->EnumWarpAdapter(IID_PPV_ARGS(&renderer.adapter)), "Failed to aquire WARP adapter");
+        factory4->Release();
+    } else {
+        NI_D3D_ASSERT(renderer.factory->EnumAdapters(0, (IDXGIAdapter**)(&renderer.adapter)), "Failed to aquire adapter");
+    }
     NI_D3D_ASSERT(D3D12CreateDevice((IUnknown*)renderer.adapter, D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&renderer.device)), "Failed to create device");
+    initPipelineCache(NI_PIPELINE_CACHE_PATH, getDeviceHash());
+    initLoaderThreads(NI_LOADER_THREAD_NUM);
 
     D3D12_COMMAND_QUEUE_DESC commandQueueDesc{};
     commandQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
@@ -244,26 +472,59 @@ void ni::init(uint32_t width, uint32_t height) {
     NI_D3D_ASSERT(renderer.device->CreateCommandQueue(&commandQueueDesc, IID_PPV_ARGS(&renderer.commandQueue)), "Failed to create command queue");
     renderer.commandQueue->SetName(L"gfx::graphicsCommandQueue");
 
+    commandQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    NI_D3D_ASSERT(renderer.device->CreateCommandQueue(&commandQueueDesc, IID_PPV_ARGS(&renderer.copyQueue)), "Failed to create copy queue");
+    renderer.copyQueue->SetName(L"gfx::copyCommandQueue");
+
+#if NI_USE_ASYNC_COMPUTE
+    commandQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    NI_D3D_ASSERT(renderer.device->CreateCommandQueue(&commandQueueDesc, IID_PPV_ARGS(&renderer.computeQueue)), "Failed to create compute queue");
+    renderer.computeQueue->SetName(L"gfx::computeCommandQueue");
+#endif
+
+    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
+    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    descriptorHeapDesc.NumDescriptors = NI_MAX_DESCRIPTORS + NI_FRAME_COUNT * NI_TRANSIENT_DESCRIPTORS;
+    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    descriptorHeapDesc.NodeMask = 0;
+    NI_D3D_ASSERT(renderer.device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&renderer.descriptorHeap)), "Failed to create descriptor heap");
+    renderer.descriptorHeap->SetName(L"gfx::descriptorHeap");
+    renderer.descriptorHandleSize = renderer.device->GetDescriptorHandleIncrementSize(descriptorHeapDesc.Type);
+    persistentDescriptors.init(NI_MAX_DESCRIPTORS, 1);
+    pendingDescriptorFrees.reset();
+    pendingResourceReleases.reset();
+
     for (uint32_t index = 0; index < NI_FRAME_COUNT; ++index) {
         FrameData& frame = renderer.frames[index];
         NI_D3D_ASSERT(renderer.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&frame.commandAllocator)), "Failed to create command allocator");
         NI_D3D_ASSERT(renderer.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, frame.commandAllocator, nullptr, IID_PPV_ARGS(&frame.commandList)), "Failed to create command list");
+        NI_D3D_ASSERT(renderer.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&frame.copyCommandAllocator)), "Failed to create copy command allocator");
+        NI_D3D_ASSERT(renderer.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, frame.copyCommandAllocator, nullptr, IID_PPV_ARGS(&frame.copyCommandList)), "Failed to create copy command list");
         NI_D3D_ASSERT(renderer.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&frame.fence)), "Failed to create fence");
         frame.fenceEvent = CreateEvent(nullptr, false, false, nullptr);
         NI_D3D_ASSERT(frame.commandList->Close(), "Failed to close command list");
+        NI_D3D_ASSERT(frame.copyCommandList->Close(), "Failed to close copy command list");
         frame.commandAllocator->SetName(L"gfx::frame::commandAllocator");
         frame.commandList->SetName(L"gfx::frame::commandList");
+        frame.copyCommandAllocator->SetName(L"gfx::frame::copyCommandAllocator");
+        frame.copyCommandList->SetName(L"gfx::frame::copyCommandList");
+#if NI_USE_ASYNC_COMPUTE
+        NI_D3D_ASSERT(renderer.device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&frame.computeCommandAllocator)), "Failed to create compute command allocator");
+        NI_D3D_ASSERT(renderer.device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, frame.computeCommandAllocator, nullptr, IID_PPV_ARGS(&frame.computeCommandList)), "Failed to create compute command list");
+        NI_D3D_ASSERT(frame.computeCommandList->Close(), "Failed to close compute command list");
+        frame.computeCommandAllocator->SetName(L"gfx::frame::computeCommandAllocator");
+        frame.computeCommandList->SetName(L"gfx::frame::computeCommandList");
+#else
+        frame.computeCommandList = frame.commandList;
+#endif
         frame.fence->SetName(L"gfx::frame::fence");
-        D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
-        descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-        descriptorHeapDesc.NumDescriptors = NI_MAX_DESCRIPTORS;
-        descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-        descriptorHeapDesc.NodeMask = 0;
-        NI_D3D_ASSERT(renderer.device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(&frame.descriptorAllocator.descriptorHeap)), "Failed to create descriptor heap");
-        frame.descriptorAllocator.descriptorHandleSize = renderer.device->GetDescriptorHandleIncrementSize(descriptorHeapDesc.Type);
+        uint32_t transientStart = NI_MAX_DESCRIPTORS + index * NI_TRANSIENT_DESCRIPTORS;
+        frame.descriptorAllocator.descriptorHandleSize = renderer.descriptorHandleSize;
         frame.descriptorAllocator.descriptorAllocated = 0;
-        frame.descriptorAllocator.gpuBaseHandle = frame.descriptorAllocator.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
-        frame.descriptorAllocator.cpuBaseHandle = frame.descriptorAllocator.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+        frame.descriptorAllocator.descriptorCapacity = NI_TRANSIENT_DESCRIPTORS;
+        frame.descriptorAllocator.heapIndex = transientStart;
+        frame.descriptorAllocator.gpuBaseHandle = { renderer.descriptorHeap->GetGPUDescriptorHandleForHeapStart().ptr + transientStart * renderer.descriptorHandleSize };
+        frame.descriptorAllocator.cpuBaseHandle = { renderer.descriptorHeap->GetCPUDescriptorHandleForHeapStart().ptr + transientStart * renderer.descriptorHandleSize };
         frame.frameIndex = index;
     }
 
@@ -272,27 +533,82 @@ void ni::init(uint32_t width, uint32_t height) {
     renderer.presentFenceValue = 0;
     renderer.presentFence->SetName(L"gfx::presentFence");
 
-    DXGI_SWAP_CHAIN_DESC swapChainDesc = {
-         { 
-            renderer.windowWidth,
-            renderer.windowHeight,
-            { 0,  0},
-            DXGI_FORMAT_R8G8B8A8_UNORM,
-            DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED,
-            DXGI_MODE_SCALING_UNSPECIFIED},
-        { 1, 0 },
-        DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_SHADER_INPUT,
-        NI_BACKBUFFER_COUNT,
-        renderer.windowHandle,
-        true,
-        DXGI_SWAP_EFFECT_FLIP_DISCARD,
-        DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH 
-    };
-
-    NI_D3D_ASSERT(renderer.factory->CreateSwapChain((IUnknown*)renderer.commandQueue, &swapChainDesc, (IDXGISwapChain**)&renderer.swapChain), "Failed to create swapchain");
-    for (uint32_t index = 0; index < NI_BACKBUFFER_COUNT; ++index) {
-        renderer.swapChain->GetBuffer(index, IID_PPV_ARGS(&renderer.backbuffers[index]));
-        renderer.backbuffers[index]->SetName(L"gfx::backbuffer");
+    NI_D3D_ASSERT(renderer.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&renderer.copyFence)), "Failed to create fence");
+    renderer.copyFence->SetName(L"gfx::copyFence");
+    renderer.copyFenceValue = 0;
+#if NI_USE_ASYNC_COMPUTE
+    NI_D3D_ASSERT(renderer.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&renderer.computeFence)), "Failed to create fence");
+    renderer.computeFence->SetName(L"gfx::computeFence");
+    renderer.computeFenceValue = 0;
+    NI_D3D_ASSERT(renderer.device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&renderer.directFence)), "Failed to create fence");
+    renderer.directFence->SetName(L"gfx::directFence");
+    renderer.directFenceValue = 0;
+#endif
+    renderer.frameNumber = 0;
+    renderer.streamingStaging = createBuffer(L"gfx::streamingStaging", NI_STREAMING_STAGING_SIZE, UPLOAD_BUFFER, false);
+    // Upload heaps can stay mapped for their whole lifetime.
+    void* stagingMemory = mapBuffer(renderer.streamingStaging);
+    renderer.streamer = new TextureStreamer();
+    renderer.streamer->init(stagingMemory, NI_STREAMING_STAGING_SIZE, NI_STREAMING_FRAME_BUDGET);
+    // Without async compute the compute list is the direct list, its scopes belong to the direct queue.
+    ID3D12CommandQueue* profiledQueues[GPU_PROFILER_QUEUE_COUNT] = { renderer.commandQueue, renderer.computeQueue, renderer.copyQueue };
+    renderer.gpuProfiler = new GpuProfiler();
+    renderer.gpuProfiler->init(profiledQueues);
+    renderer.rendererStats = new RendererStats();
+    renderer.rendererStats->init();
+    renderer.frameTiming = new FrameTiming();
+    renderer.readback = new ReadbackRing();
+    renderer.gpuFrameScope = NI_GPU_PROFILER_INVALID_SCOPE;
+    renderer.gpuFrameSampleNum = 0;
+    renderer.lastPresentSeconds = 0.0;
+    renderer.blockedSeconds = 0.0;
+
+    if (renderer.offscreen) {
+        // Same format and starting state as swapchain buffers, PRESENT is COMMON, so SpriteRenderer and the
+        // readback ring treat both alike.
+        D3D12_HEAP_PROPERTIES heapProperties = {};
+        heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+        D3D12_RESOURCE_DESC backbufferDesc = {};
+        backbufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+        backbufferDesc.Width = renderer.windowWidth;
+        backbufferDesc.Height = renderer.windowHeight;
+        backbufferDesc.DepthOrArraySize = 1;
+        backbufferDesc.MipLevels = 1;
+        backbufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        backbufferDesc.SampleDesc = { 1, 0 };
+        backbufferDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+        backbufferDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+        // SpriteRenderer clears to opaque black.
+        D3D12_CLEAR_VALUE clearValue = { DXGI_FORMAT_R8G8B8A8_UNORM, { 0.0f, 0.0f, 0.0f, 1.0f } };
+        for (uint32_t index = 0; index < NI_BACKBUFFER_COUNT; ++index) {
+            renderer.backbuffers[index] = { nullptr, D3D12_RESOURCE_STATE_PRESENT, 0, {}, D3D12_RESOURCE_DIMENSION_TEXTURE2D };
+            NI_D3D_ASSERT(renderer.device->CreateCommittedResource(&heapProperties, D3D12_HEAP_FLAG_NONE, &backbufferDesc, D3D12_RESOURCE_STATE_PRESENT, &clearValue, IID_PPV_ARGS(&renderer.backbuffers[index].resource)), "Failed to create offscreen backbuffer");
+            renderer.backbuffers[index].resource->SetName(L"gfx::offscreenBackbuffer");
+        }
+    } else {
+        DXGI_SWAP_CHAIN_DESC swapChainDesc = {
+             { 
+                renderer.windowWidth,
+                renderer.windowHeight,
+                { 0,  0},
+                DXGI_FORMAT_R8G8B8A8_UNORM,
+                DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED,
+                DXGI_MODE_SCALING_UNSPECIFIED},
+            { 1, 0 },
+            DXGI_USAGE_RENDER_TARGET_OUTPUT | DXGI_USAGE_SHADER_INPUT,
+            NI_BACKBUFFER_COUNT,
+            renderer.windowHandle,
+            true,
+            DXGI_SWAP_EFFECT_FLIP_DISCARD,
+            DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH 
+        };
+
+        NI_D3D_ASSERT(renderer.factory->CreateSwapChain((IUnknown*)renderer.commandQueue, &swapChainDesc, (IDXGISwapChain**)&renderer.swapChain), "Failed to create swapchain");
+        for (uint32_t index = 0; index < NI_BACKBUFFER_COUNT; ++index) {
+            renderer.backbuffers[index] = { nullptr, D3D12_RESOURCE_STATE_PRESENT, 0, {}, D3D12_RESOURCE_DIMENSION_TEXTURE2D };
+            renderer.swapChain->GetBuffer(index, IID_PPV_ARGS(&renderer.backbuffers[index].resource));
+            renderer.backbuffers[index].resource->SetName(L"gfx::backbuffer");
+        }
     }
 
     D3D12_DESCRIPTOR_HEAP_DESC rtvDescriptorHeapDesc = {};
@@ -316,10 +632,13 @@ void ni::setFrameUserData(uint32_t frame, void* data) {
     renderer.frames[frame].userData = data;
 }
 void ni::waitForCurrentFrame() {
+    NI_TRACE_SCOPE("waitForCurrentFrame");
     FrameData& frame = renderer.frames[renderer.currentFrame];
     if (frame.fence->GetCompletedValue() != frame.frameWaitValue) {
+        double waitStart = getSeconds();
         frame.fence->SetEventOnCompletion(frame.frameWaitValue, frame.fenceEvent);
         WaitForSingleObject(frame.fenceEvent, INFINITE);
+        renderer.blockedSeconds += getSeconds() - waitStart;
     }
 }
 void ni::waitForAllFrames() {
@@ -333,25 +652,59 @@ void ni::waitForAllFrames() {
 }
 void ni::destroy() {
     waitForAllFrames();
+    renderer.streamer->destroy();
+    delete renderer.streamer;
+    renderer.streamer = nullptr;
+    renderer.gpuProfiler->destroy();
+    delete renderer.gpuProfiler;
+    renderer.gpuProfiler = nullptr;
+    renderer.rendererStats->destroy();
+    delete renderer.rendererStats;
+    renderer.rendererStats = nullptr;
+    delete renderer.frameTiming;
+    renderer.frameTiming = nullptr;
+    renderer.readback->destroy();
+    delete renderer.readback;
+    renderer.readback = nullptr;
+    destroyBuffer(renderer.streamingStaging);
+    NI_D3D_RELEASE(renderer.copyFence);
+    NI_D3D_RELEASE(renderer.computeFence);
+    NI_D3D_RELEASE(renderer.directFence);
     for (uint32_t index = 0; index < NI_FRAME_COUNT; ++index) {
         FrameData& frame = renderer.frames[index];
         NI_D3D_RELEASE(frame.commandList);
         NI_D3D_RELEASE(frame.commandAllocator);
+        NI_D3D_RELEASE(frame.copyCommandList);
+        NI_D3D_RELEASE(frame.copyCommandAllocator);
+#if NI_USE_ASYNC_COMPUTE
+        NI_D3D_RELEASE(frame.computeCommandList);
+        NI_D3D_RELEASE(frame.computeCommandAllocator);
+#endif
         NI_D3D_RELEASE(frame.fence);
         CloseHandle(frame.fenceEvent);
-        NI_D3D_RELEASE(frame.descriptorAllocator.descriptorHeap);
     }
     for (uint32_t index = 0; index < NI_BACKBUFFER_COUNT; ++index) {
-        NI_D3D_RELEASE(renderer.backbuffers[index]);
+        NI_D3D_RELEASE(renderer.backbuffers[index].resource);
     }
     if (renderer.presentFence->GetCompletedValue() != renderer.presentFenceValue) {
         renderer.presentFence->SetEventOnCompletion(renderer.presentFenceValue, renderer.presentFenceEvent);
         WaitForSingleObject(renderer.presentFenceEvent, INFINITE);
     }
     CloseHandle(renderer.presentFenceEvent);
+    // Nothing is in flight anymore.
+    retirePendingReleases(UINT64_MAX - NI_FRAME_COUNT);
+    pendingResourceReleases.destroy();
+    destroyHeapPools();
+    destroyLoaderThreads();
+    destroyPipelineCache();
+    persistentDescriptors.destroy();
+    pendingDescriptorFrees.destroy();
+    NI_D3D_RELEASE(renderer.descriptorHeap);
     NI_D3D_RELEASE(renderer.rtvDescriptorHeap);
     NI_D3D_RELEASE(renderer.presentFence);
     NI_D3D_RELEASE(renderer.swapChain);
+    NI_D3D_RELEASE(renderer.computeQueue);
+    NI_D3D_RELEASE(renderer.copyQueue);
     NI_D3D_RELEASE(renderer.commandQueue);
     NI_D3D_RELEASE(renderer.device);
     NI_D3D_RELEASE(renderer.adapter);
@@ -375,6 +728,7 @@ void ni::destroy() {
 }
 
 void ni::pollEvents() {
+    NI_TRACE_SCOPE("pollEvents");
     MSG message;
     while (PeekMessageA(&message, nullptr, 0, 0, PM_REMOVE)) {
         switch (message.message) {
@@ -426,6 +780,10 @@ bool ni::shouldQuit() {
     return renderer.shouldQuit;
 }
 
+bool ni::isOffscreen() {
+    return renderer.offscreen;
+}
+
 ni::FrameData& ni::getFrameData() {
     FrameData& frame = renderer.frames[renderer.currentFrame];
     return frame;
@@ -435,109 +793,255 @@ ID3D12Device* ni::getDevice() {
     return renderer.device;
 }
 
+// Copies data, either tightly packed one mip after the other or already pitched, into staging memory laid out like the upload footprints.
+static void copyTextureToStaging(const ni::Texture* texture, const void* data, bool pitched, void* staging) {
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+    uint32_t numRows[D3D12_REQ_MIP_LEVELS] = {};
+    uint64_t rowSizeInBytes[D3D12_REQ_MIP_LEVELS] = {};
+    uint64_t totalBytes = ni::getTextureFootprints(texture->width, texture->height, texture->mipLevels, texture->format, layouts, numRows, rowSizeInBytes);
+    if (pitched) {
+        memcpy(staging, data, (size_t)totalBytes);
+        return;
+    }
+    // Rows of block compressed formats are rows of 4x4 blocks, which rowSizeInBytes and numRows already account for.
+    const void* srcMip = data;
+    for (uint32_t mip = 0; mip < texture->mipLevels; ++mip) {
+        const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& layout = layouts[mip];
+        size_t srcRowPitch = (size_t)rowSizeInBytes[mip];
+        for (uint32_t row = 0; row < numRows[mip]; ++row) {
+            void* dstAddr = ni::offsetPtr(staging, (intptr_t)(layout.Offset + row * layout.Footprint.RowPitch));
+            const void* srcAddr = ni::offsetPtr((void*)srcMip, (intptr_t)(row * srcRowPitch));
+            memcpy(dstAddr, srcAddr, srcRowPitch);
+        }
+        srcMip = ni::offsetPtr((void*)srcMip, (intptr_t)(srcRowPitch * numRows[mip]));
+    }
+}
+
+// Picks up textures the loader thread staged, within the frame budget, and copies them out of the staging ring.
+// Recorded on the copy list, textures are promoted to COPY_DEST and decay back to COMMON, so there are no barriers.
+static void recordStreamingUploads(ID3D12GraphicsCommandList* copyCommandList) {
+    ni::StreamRequest requests[64];
+    uint32_t requestNum = renderer.streamer->acquireStaged(requests, 64);
+    if (requestNum == 0) return;
+
+    ni::FrameStats& stats = renderer.rendererStats->getCurrentFrame();
+    stats.texturesUploaded += requestNum;
+    for (uint32_t index = 0; index < requestNum; ++index) {
+        const ni::StreamRequest& request = requests[index];
+        ni::Texture* texture = request.texture;
+        NI_ASSERT(texture->texture.state == D3D12_RESOURCE_STATE_COMMON, "Streamed textures have to be in the common state");
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+        stats.uploadBytes += ni::getTextureFootprints(texture->width, texture->height, texture->mipLevels, texture->format, layouts, nullptr, nullptr);
+        for (uint32_t mip = 0; mip < texture->mipLevels; ++mip) {
+            D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
+            srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+            srcLocation.pResource = renderer.streamingStaging.resource;
+            srcLocation.PlacedFootprint = layouts[mip];
+            srcLocation.PlacedFootprint.Offset += request.staging.offset;
+            D3D12_TEXTURE_COPY_LOCATION dstLocation = {};
+            dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+            dstLocation.pResource = texture->texture.resource;
+            dstLocation.SubresourceIndex = mip;
+            copyCommandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
+        }
+    }
+    // Signaled on the copy queue in endFrame once this command list has been submitted.
+    renderer.streamer->submit(requests, requestNum, renderer.copyFenceValue + 1);
+}
+
 ni::FrameData& ni::beginFrame() {
+    NI_TRACE_SCOPE("beginFrame");
     FrameData& frame = renderer.frames[renderer.currentFrame];
     NI_D3D_ASSERT(frame.commandAllocator->Reset(), "Failed to reset command allocator");
     NI_D3D_ASSERT(frame.commandList->Reset(frame.commandAllocator, nullptr), "Failed to reset command list");
+    // The frame fence is signaled after the direct queue waited for this frame's copies, so the copy allocator is free too.
+    NI_D3D_ASSERT(frame.copyCommandAllocator->Reset(), "Failed to reset copy command allocator");
+    NI_D3D_ASSERT(frame.copyCommandList->Reset(frame.copyCommandAllocator, nullptr), "Failed to reset copy command list");
+#if NI_USE_ASYNC_COMPUTE
+    NI_D3D_ASSERT(frame.computeCommandAllocator->Reset(), "Failed to reset compute command allocator");
+    NI_D3D_ASSERT(frame.computeCommandList->Reset(frame.computeCommandAllocator, nullptr), "Failed to reset compute command list");
+#endif
+    frame.frameNumber = renderer.frameNumber;
     frame.descriptorAllocator.reset();
-    // Allocate all descriptors to allow for bindless resources.
-    frame.descriptorTable = frame.descriptorAllocator.allocateDescriptorTable(NI_MAX_DESCRIPTORS);
-    frame.commandList->SetDescriptorHeaps(1, &frame.descriptorAllocator.descriptorHeap);
+    renderer.gpuProfiler->beginFrame(frame.frameNumber);
+    renderer.rendererStats->beginFrame(frame.frameNumber);
+    renderer.readback->poll(frame.frameNumber);
+    // The profiler collected the slot's previous frame just now, a new sample is that frame's GPU time.
+    const GpuScopeStats* gpuFrame = renderer.gpuProfiler->findScope("Frame", GPU_PROFILER_QUEUE_DIRECT);
+    if (gpuFrame != nullptr && gpuFrame->sampleNum != renderer.gpuFrameSampleNum) {
+        renderer.frameTiming->record(FRAME_TIMING_GPU_FRAME, gpuFrame->lastMs);
+        renderer.gpuFrameSampleNum = gpuFrame->sampleNum;
+    }
+    renderer.gpuFrameScope = renderer.gpuProfiler->beginScope(frame.commandList, GPU_PROFILER_QUEUE_DIRECT, "Frame");
+    // Every frame up to frameNumber - NI_FRAME_COUNT has retired, so nothing reads descriptors freed back then.
+    for (uint32_t index = 0; index < pendingDescriptorFrees.getNum();) {
+        if (pendingDescriptorFrees.getData()[index].frameNumber + NI_FRAME_COUNT <= renderer.frameNumber) {
+            persistentDescriptors.free(pendingDescriptorFrees.getData()[index].node);
+            pendingDescriptorFrees.getData()[index] = pendingDescriptorFrees.getData()[pendingDescriptorFrees.getNum() - 1];
+            pendingDescriptorFrees.remove(pendingDescriptorFrees.getNum() - 1);
+        } else {
+            index++;
+        }
+    }
+    retirePendingReleases(renderer.frameNumber);
+    frame.commandList->SetDescriptorHeaps(1, &renderer.descriptorHeap);
+#if NI_USE_ASYNC_COMPUTE
+    frame.computeCommandList->SetDescriptorHeaps(1, &renderer.descriptorHeap);
+#endif
 
-    // Upload texture data
+    // Upload texture data. Everything goes through the staging ring, which is recycled once the copy queue is done with it.
+    renderer.streamer->reclaim(renderer.copyFence->GetCompletedValue());
+    FrameStats& stats = renderer.rendererStats->getCurrentFrame();
+    uint32_t deferredNum = 0;
     for (uint32_t index = 0; index < renderer.imageToUploadNum; ++index) {
         Texture* image = renderer.imagesToUpload[index];
         NI_ASSERT((image->state & NI_IMAGE_STATE_CREATED) > 0, "Invalid image");
         if ((image->state & NI_IMAGE_STATE_UPLOADED) > 0) {
             continue;
         }
+        if ((image->state & NI_IMAGE_STATE_STAGED) == 0) {
+            uint64_t stagingSize = getTextureFootprints(image->width, image->height, image->mipLevels, image->format, nullptr, nullptr, nullptr);
+            if (!renderer.streamer->allocateStaging(stagingSize, image->staging)) {
+                // Still full, try again next frame.
+                renderer.imagesToUpload[deferredNum++] = image;
+                continue;
+            }
+            copyTextureToStaging(image, image->cpuData, (image->state & NI_IMAGE_STATE_PITCHED) > 0, renderer.streamer->getStagingPointer(image->staging));
+            free((void*)image->cpuData);
+            image->cpuData = nullptr;
+            image->state |= NI_IMAGE_STATE_STAGED;
+        }
 
-        ID3D12Resource* texture = image->texture.resource;
-        ID3D12Resource* uploadBuffer = image->upload.resource;
-        D3D12_RESOURCE_DESC desc = image->texture.resource->GetDesc();
-
-        D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout;
-        uint32_t numRows = 0;
-        uint64_t rowSizeInBytes = 0, totalBytes = 0;
-        renderer.device->GetCopyableFootprints(&desc, 0, 1, 0, &layout, &numRows, &rowSizeInBytes, &totalBytes);
-        void* mapped = nullptr;
-        uploadBuffer->Map(0, nullptr, &mapped);
-        size_t pixelSize = ni::getDXGIFormatBytes(desc.Format);
-
-        for (uint32_t index = 0; index < numRows * layout.Footprint.Depth; ++index) {
-            void* dstAddr = offsetPtr(mapped, (intptr_t)(index * layout.Footprint.RowPitch));
-            const void* srcAddr = offsetPtr((void*)image->cpuData, (intptr_t)(index * (desc.Width * pixelSize)));
-            memcpy(dstAddr, srcAddr, (size_t)rowSizeInBytes);
+        // The copy queue can't transition out of shader read states, uploaded textures stay in COMMON.
+        NI_ASSERT(image->texture.state == D3D12_RESOURCE_STATE_COMMON, "Uploaded textures have to be in the common state");
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+        stats.uploadBytes += getTextureFootprints(image->width, image->height, image->mipLevels, image->format, layouts, nullptr, nullptr);
+        stats.texturesUploaded++;
+        for (uint32_t mip = 0; mip < image->mipLevels; ++mip) {
+            D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
+            srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+            srcLocation.pResource = renderer.streamingStaging.resource;
+            srcLocation.PlacedFootprint = layouts[mip];
+            srcLocation.PlacedFootprint.Offset += image->staging.offset;
+            D3D12_TEXTURE_COPY_LOCATION dstLocation = {};
+            dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+            dstLocation.pResource = image->texture.resource;
+            dstLocation.SubresourceIndex = mip;
+            frame.copyCommandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
         }
-        uploadBuffer->Unmap(0, nullptr);
-
-        D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
-        srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
-        srcLocation.pResource = uploadBuffer;
-        srcLocation.PlacedFootprint = layout;
-        D3D12_TEXTURE_COPY_LOCATION dstLocation = {};
-        dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-        dstLocation.pResource = texture;
-        dstLocation.SubresourceIndex = 0;
-
-        D3D12_RESOURCE_BARRIER textureBufferBarrier[1] = {};
-        textureBufferBarrier[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        textureBufferBarrier[0].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-        textureBufferBarrier[0].Transition.Subresource = 0;
-        textureBufferBarrier[0].Transition.pResource = texture;
-        textureBufferBarrier[0].Transition.StateBefore = image->texture.state;
-        textureBufferBarrier[0].Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-
-        frame.commandList->ResourceBarrier(1, textureBufferBarrier);
-        frame.commandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
-
-        textureBufferBarrier[0].Transition.StateAfter = image->texture.state;
-        textureBufferBarrier[0].Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-        frame.commandList->ResourceBarrier(1, textureBufferBarrier);
-
-        free((void*)image->cpuData);
-        image->cpuData = nullptr;
+        renderer.streamer->submitStaging(image->staging, renderer.copyFenceValue + 1);
         image->state |= NI_IMAGE_STATE_UPLOADED;
+        // Anything drawing it from here on waits for this frame's copies.
+        image->residency = TEXTURE_RESIDENCY_RESIDENT;
     }
-    renderer.imageToUploadNum = 0;
+    renderer.imageToUploadNum = deferredNum;
+
+    recordStreamingUploads(frame.copyCommandList);
 
     return frame;
 }
 
 void ni::endFrame() {
+    NI_TRACE_SCOPE("endFrame");
     FrameData& frame = renderer.frames[renderer.currentFrame];
+#if NI_USE_ASYNC_COMPUTE
+    ID3D12GraphicsCommandList* profiledLists[GPU_PROFILER_QUEUE_COUNT] = { frame.commandList, frame.computeCommandList, frame.copyCommandList };
+#else
+    ID3D12GraphicsCommandList* profiledLists[GPU_PROFILER_QUEUE_COUNT] = { frame.commandList, nullptr, frame.copyCommandList };
+#endif
+    // The frame fence is signaled right after this list, with the next wait value.
+    renderer.readback->recordCopies(frame.commandList, getCurrentBackbuffer(), frame.fence, frame.frameWaitValue + 1, frame.frameNumber);
+    renderer.gpuProfiler->endScope(frame.commandList, renderer.gpuFrameScope);
+    renderer.gpuProfiler->endFrame(profiledLists);
+    FrameStats& stats = renderer.rendererStats->getCurrentFrame();
+    stats.transientDescriptors = frame.descriptorAllocator.descriptorAllocated;
+    stats.persistentDescriptors = (uint32_t)(persistentDescriptors.getSize() - persistentDescriptors.getFreeSize());
+    NI_D3D_ASSERT(frame.copyCommandList->Close(), "Failed to close copy command list");
+#if NI_USE_ASYNC_COMPUTE
+    NI_D3D_ASSERT(frame.computeCommandList->Close(), "Failed to close compute command list");
+#endif
     NI_D3D_ASSERT(frame.commandList->Close(), "Failed to close command list");
+    // Copies run while the direct queue is still busy with earlier frames, it only waits right before this frame.
+    ID3D12CommandList* copyCommandLists[] = { frame.copyCommandList };
+    renderer.copyQueue->ExecuteCommandLists(1, copyCommandLists);
+    NI_D3D_ASSERT(renderer.copyQueue->Signal(renderer.copyFence, ++renderer.copyFenceValue), "Failed to signal copy fence");
+#if NI_USE_ASYNC_COMPUTE
+    // Compute needs this frame's copies and has to wait until the direct queue is done reading the buffers it's about to overwrite.
+    // The direct queue waits for compute only, which already waited for the copies.
+    NI_D3D_ASSERT(renderer.computeQueue->Wait(renderer.copyFence, renderer.copyFenceValue), "Failed to wait for copy fence");
+    if (renderer.directFenceValue + 1 > NI_ASYNC_COMPUTE_BUFFER_COUNT) {
+        NI_D3D_ASSERT(renderer.computeQueue->Wait(renderer.directFence, renderer.directFenceValue + 1 - NI_ASYNC_COMPUTE_BUFFER_COUNT), "Failed to wait for direct fence");
+    }
+    ID3D12CommandList* computeCommandLists[] = { frame.computeCommandList };
+    renderer.computeQueue->ExecuteCommandLists(1, computeCommandLists);
+    NI_D3D_ASSERT(renderer.computeQueue->Signal(renderer.computeFence, ++renderer.computeFenceValue), "Failed to signal compute fence");
+    NI_D3D_ASSERT(renderer.commandQueue->Wait(renderer.computeFence, renderer.computeFenceValue), "Failed to wait for compute fence");
+#else
+    NI_D3D_ASSERT(renderer.commandQueue->Wait(renderer.copyFence, renderer.copyFenceValue), "Failed to wait for copy fence");
+#endif
     ID3D12CommandList* commandLists[] = { frame.commandList };
     renderer.commandQueue->ExecuteCommandLists(1, commandLists);
     NI_D3D_ASSERT(renderer.commandQueue->Signal(frame.fence, ++frame.frameWaitValue), "Failed to signal frame fence");
+#if NI_USE_ASYNC_COMPUTE
+    NI_D3D_ASSERT(renderer.commandQueue->Signal(renderer.directFence, ++renderer.directFenceValue), "Failed to signal direct fence");
+#endif
+    renderer.frameNumber++;
     renderer.currentFrame = (renderer.currentFrame + 1) % NI_FRAME_COUNT;
 }
 
-ID3D12Resource* ni::getCurrentBackbuffer() {
-    return renderer.backbuffers[renderer.presentFrame];
+ni::GpuProfiler* ni::getGpuProfiler() {
+    return renderer.gpuProfiler;
+}
+
+ni::RendererStats* ni::getRendererStats() {
+    return renderer.rendererStats;
+}
+
+ni::FrameTiming* ni::getFrameTiming() {
+    return renderer.frameTiming;
+}
+
+ni::ReadbackRing* ni::getReadback() {
+    return renderer.readback;
+}
+
+ni::Resource* ni::getCurrentBackbuffer() {
+    return &renderer.backbuffers[renderer.presentFrame];
 }
 
 void ni::present(bool vsync) {
+    NI_TRACE_SCOPE("present");
+    double presentStart = getSeconds();
     if (renderer.presentFence->GetCompletedValue() != renderer.presentFenceValue) {
         renderer.presentFence->SetEventOnCompletion(renderer.presentFenceValue, renderer.presentFenceEvent);
         WaitForSingleObject(renderer.presentFenceEvent, INFINITE);
     }
 
-    NI_D3D_ASSERT(renderer.swapChain->Present(vsync ? 1 : 0, 0), "Failed to present");
+    if (!renderer.offscreen) {
+        NI_D3D_ASSERT(renderer.swapChain->Present(vsync ? 1 : 0, 0), "Failed to present");
+    }
     NI_D3D_ASSERT(renderer.commandQueue->Signal(renderer.presentFence, ++renderer.presentFenceValue), "Failed to signal present fence");
     renderer.presentFrame = renderer.presentFenceValue % NI_BACKBUFFER_COUNT;
+    double presentEnd = getSeconds();
+    renderer.blockedSeconds += presentEnd - presentStart;
+    // The first present has no frame before it to measure against.
+    if (renderer.lastPresentSeconds > 0.0) {
+        double frameSeconds = presentEnd - renderer.lastPresentSeconds;
+        renderer.frameTiming->record(FRAME_TIMING_CPU_FRAME, (frameSeconds - renderer.blockedSeconds) * 1000.0);
+        renderer.frameTiming->record(FRAME_TIMING_PRESENT_WAIT, renderer.blockedSeconds * 1000.0);
+    }
+    renderer.lastPresentSeconds = presentEnd;
+    renderer.blockedSeconds = 0.0;
 }
 
 ID3D12PipelineState* ni::createGraphicsPipelineState(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc) {
-    ID3D12PipelineState* pso = nullptr;
-    NI_D3D_ASSERT(renderer.device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso)), "Failed to create graphics pipeline state");
+    ID3D12PipelineState* pso = loadGraphicsPipelineState(psoDesc);
     pso->SetName(name);
     return pso;
 }
 
 ID3D12PipelineState* ni::createComputePipelineState(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& psoDesc) {
-    ID3D12PipelineState* pso = nullptr;
-    NI_D3D_ASSERT(renderer.device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&pso)), "Failed to create compute pipeline state");
+    ID3D12PipelineState* pso = loadComputePipelineState(psoDesc);
     pso->SetName(name);
     return pso;
 }
@@ -580,6 +1084,11 @@ ni::Resource ni::createBuffer(const wchar_t* name, size_t bufferSize, BufferType
         flags = D3D12_RESOURCE_FLAG_NONE;
         heapType = D3D12_HEAP_TYPE_DEFAULT;
         break;
+    case READBACK_BUFFER:
+        initialState = D3D12_RESOURCE_STATE_COPY_DEST;
+        flags = D3D12_RESOURCE_FLAG_NONE;
+        heapType = D3D12_HEAP_TYPE_READBACK;
+        break;
     default:
         NI_PANIC("Error: Invalid buffer type"); // Invalid Buffer Type
         break;
@@ -605,6 +1114,44 @@ ni::Resource ni::createBuffer(const wchar_t* name, size_t bufferSize, BufferType
         0
     };
 
+    // Buffers are created in COMMON whatever state is asked for, only upload heap buffers stay in GENERIC_READ.
+    D3D12_RESOURCE_STATES trackedState = heapType == D3D12_HEAP_TYPE_DEFAULT ? D3D12_RESOURCE_STATE_COMMON : initialState;
+
+    // Small upload buffers don't need a resource of their own, they stay in GENERIC_READ and are only copied from.
+    if (type == UPLOAD_BUFFER && resourceDesc.Width < D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT) {
+        Resource buffer = { nullptr, trackedState, 0, {}, D3D12_RESOURCE_DIMENSION_BUFFER };
+        if (allocateFromHeapPool(GPU_HEAP_POOL_SMALL_UPLOAD, resourceDesc.Width, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, buffer.allocation, buffer.offset)) {
+            GpuHeapBlock& block = heapPools[GPU_HEAP_POOL_SMALL_UPLOAD].blocks[buffer.allocation.block];
+            buffer.resource = block.buffer;
+            if (initToZero) {
+                memset(offsetPtr(block.mapped, buffer.offset), 0, resourceDesc.Width);
+            }
+            return buffer;
+        }
+    }
+
+    // Recycled heap memory isn't zeroed, so default heap buffers that need zeros get fresh memory.
+    GpuHeapPool pool = heapType == D3D12_HEAP_TYPE_UPLOAD ? GPU_HEAP_POOL_UPLOAD_BUFFERS : GPU_HEAP_POOL_DEFAULT_BUFFERS;
+    // Readback buffers are few and small, they don't get a pool of their own.
+    if (heapType != D3D12_HEAP_TYPE_READBACK && resourceDesc.Width <= NI_GPU_HEAP_BLOCK_SIZE / 2 && !(initToZero && heapType == D3D12_HEAP_TYPE_DEFAULT)) {
+        Resource buffer = { nullptr, trackedState, 0, {}, D3D12_RESOURCE_DIMENSION_BUFFER };
+        uint64_t heapOffset = 0;
+        if (allocateFromHeapPool(pool, resourceDesc.Width, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, buffer.allocation, heapOffset)) {
+            NI_D3D_ASSERT(renderer.device->CreatePlacedResource(
+                heapPools[pool].blocks[buffer.allocation.block].heap, heapOffset,
+                &resourceDesc, initialState, nullptr,
+                IID_PPV_ARGS(&buffer.resource)),
+                "Failed to create placed buffer resource");
+            buffer.resource->SetName(name);
+            if (initToZero) {
+                void* data = mapBuffer(buffer);
+                memset(data, 0, resourceDesc.Width);
+                unmapBuffer(buffer, resourceDesc.Width);
+            }
+            return buffer;
+        }
+    }
+
     D3D12_HEAP_FLAGS heapFlags = D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
     if (!initToZero) {
         heapFlags |= D3D12_HEAP_FLAG_CREATE_NOT_ZEROED;
@@ -617,7 +1164,60 @@ ni::Resource ni::createBuffer(const wchar_t* name, size_t bufferSize, BufferType
         IID_PPV_ARGS(&resource)),
         "Failed to create buffer resource");
     resource->SetName(name);
-    return { resource, initialState };
+    committedResourceNum++;
+    return { resource, trackedState, 0, {}, D3D12_RESOURCE_DIMENSION_BUFFER };
+}
+
+void* ni::mapBuffer(const Resource& buffer) {
+    if (buffer.allocation.pool == GPU_HEAP_POOL_SMALL_UPLOAD) {
+        return offsetPtr(heapPools[GPU_HEAP_POOL_SMALL_UPLOAD].blocks[buffer.allocation.block].mapped, buffer.offset);
+    }
+    void* data = nullptr;
+    D3D12_RANGE readRange = { 0, 0 };
+    NI_D3D_ASSERT(buffer.resource->Map(0, &readRange, &data), "Failed to map buffer");
+    return data;
+}
+
+void ni::unmapBuffer(const Resource& buffer, size_t writtenSize) {
+    if (buffer.allocation.pool == GPU_HEAP_POOL_SMALL_UPLOAD) return;
+    D3D12_RANGE writtenRange = { 0, writtenSize };
+    buffer.resource->Unmap(0, &writtenRange);
+}
+
+const void* ni::mapReadbackBuffer(const Resource& buffer, size_t readOffset, size_t readSize) {
+    void* data = nullptr;
+    D3D12_RANGE readRange = { readOffset, readOffset + readSize };
+    NI_D3D_ASSERT(buffer.resource->Map(0, &readRange, &data), "Failed to map readback buffer");
+    return offsetPtr(data, readOffset);
+}
+
+void ni::unmapReadbackBuffer(const Resource& buffer) {
+    D3D12_RANGE writtenRange = { 0, 0 };
+    buffer.resource->Unmap(0, &writtenRange);
+}
+
+void ni::destroyBuffer(Resource& buffer) {
+    releaseResource(buffer);
+}
+
+ni::GpuMemoryStats ni::getGpuMemoryStats() {
+    GpuMemoryStats stats = {};
+    for (uint32_t pool = GPU_HEAP_POOL_COMMITTED + 1; pool < GPU_HEAP_POOL_COUNT; ++pool) {
+        const GpuHeapPoolData& poolData = heapPools[pool];
+        for (uint32_t block = 0; block < poolData.blockNum; ++block) {
+            stats.heapBytes += poolData.blocks[block].allocator.getSize();
+        }
+        stats.heapNum += poolData.blockNum;
+        if (pool == GPU_HEAP_POOL_SMALL_UPLOAD) {
+            stats.smallUploadBytes += poolData.allocatedBytes;
+            stats.smallUploadNum += poolData.allocationNum;
+        } else {
+            stats.placedBytes += poolData.allocatedBytes;
+            stats.placedNum += poolData.allocationNum;
+        }
+    }
+    stats.committedNum = committedResourceNum;
+    return stats;
 }
 
 D3D12_CPU_DESCRIPTOR_HANDLE ni::getRenderTargetViewCPUHandle() {
@@ -650,186 +1250,23 @@ bool ni::keyDown(KeyCode keyCode) {
     return keysDown[(uint32_t)keyCode];
 }
 
-float ni::randomFloat() {
-    static std::random_device randDevice;
-    static std::mt19937 mtGen(randDevice());
-    static std::uniform_real_distribution<float> udt;
-    return udt(mtGen);
-}
-
-uint32_t ni::randomUint() {
-    static std::random_device randDevice;
-    static std::mt19937 mtGen(randDevice());
-    static std::uniform_int_distribution<unsigned int> udt;
-    return udt(mtGen);
-}
-
-double ni::getSeconds() {
-    double time = std::chrono::time_point_cast<std::chrono::duration<double>>(
-        std::chrono::high_resolution_clock::now())
-        .time_since_epoch()
-        .count();
-    return time;
-}
-
-size_t ni::getDXGIFormatBits(DXGI_FORMAT format) {
-    switch (format) {
-    case DXGI_FORMAT_R32G32B32A32_TYPELESS:
-    case DXGI_FORMAT_R32G32B32A32_FLOAT:
-    case DXGI_FORMAT_R32G32B32A32_UINT:
-    case DXGI_FORMAT_R32G32B32A32_SINT:
-        return 128;
-
-    case DXGI_FORMAT_R32G32B32_TYPELESS:
-    case DXGI_FORMAT_R32G32B32_FLOAT:
-    case DXGI_FORMAT_R32G32B32_UINT:
-    case DXGI_FORMAT_R32G32B32_SINT:
-        return 96;
-
-    case DXGI_FORMAT_R16G16B16A16_TYPELESS:
-    case DXGI_FORMAT_R16G16B16A16_FLOAT:
-    case DXGI_FORMAT_R16G16B16A16_UNORM:
-    case DXGI_FORMAT_R16G16B16A16_UINT:
-    case DXGI_FORMAT_R16G16B16A16_SNORM:
-    case DXGI_FORMAT_R16G16B16A16_SINT:
-    case DXGI_FORMAT_R32G32_TYPELESS:
-    case DXGI_FORMAT_R32G32_FLOAT:
-    case DXGI_FORMAT_R32G32_UINT:
-    case DXGI_FORMAT_R32G32_SINT:
-    case DXGI_FORMAT_R32G8X24_TYPELESS:
-    case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
-    case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
-    case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
-    case DXGI_FORMAT_Y416:
-    case DXGI_FORMAT_Y210:
-    case DXGI_FORMAT_Y216:
-        return 64;
-
-    case DXGI_FORMAT_R10G10B10A2_TYPELESS:
-    case DXGI_FORMAT_R10G10B10A2_UNORM:
-    case DXGI_FORMAT_R10G10B10A2_UINT:
-    case DXGI_FORMAT_R11G11B10_FLOAT:
-    case DXGI_FORMAT_R8G8B8A8_TYPELESS:
-    case DXGI_FORMAT_R8G8B8A8_UNORM:
-    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
-    case DXGI_FORMAT_R8G8B8A8_UINT:
-    case DXGI_FORMAT_R8G8B8A8_SNORM:
-    case DXGI_FORMAT_R8G8B8A8_SINT:
-    case DXGI_FORMAT_R16G16_TYPELESS:
-    case DXGI_FORMAT_R16G16_FLOAT:
-    case DXGI_FORMAT_R16G16_UNORM:
-    case DXGI_FORMAT_R16G16_UINT:
-    case DXGI_FORMAT_R16G16_SNORM:
-    case DXGI_FORMAT_R16G16_SINT:
-    case DXGI_FORMAT_R32_TYPELESS:
-    case DXGI_FORMAT_D32_FLOAT:
-    case DXGI_FORMAT_R32_FLOAT:
-    case DXGI_FORMAT_R32_UINT:
-    case DXGI_FORMAT_R32_SINT:
-    case DXGI_FORMAT_R24G8_TYPELESS:
-    case DXGI_FORMAT_D24_UNORM_S8_UINT:
-    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
-    case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
-    case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
-    case DXGI_FORMAT_R8G8_B8G8_UNORM:
-    case DXGI_FORMAT_G8R8_G8B8_UNORM:
-    case DXGI_FORMAT_B8G8R8A8_UNORM:
-    case DXGI_FORMAT_B8G8R8X8_UNORM:
-    case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
-    case DXGI_FORMAT_B8G8R8A8_TYPELESS:
-    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
-    case DXGI_FORMAT_B8G8R8X8_TYPELESS:
-    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
-    case DXGI_FORMAT_AYUV:
-    case DXGI_FORMAT_Y410:
-    case DXGI_FORMAT_YUY2:
-        return 32;
-
-    case DXGI_FORMAT_P010:
-    case DXGI_FORMAT_P016:
-        return 24;
-
-    case DXGI_FORMAT_R8G8_TYPELESS:
-    case DXGI_FORMAT_R8G8_UNORM:
-    case DXGI_FORMAT_R8G8_UINT:
-    case DXGI_FORMAT_R8G8_SNORM:
-    case DXGI_FORMAT_R8G8_SINT:
-    case DXGI_FORMAT_R16_TYPELESS:
-    case DXGI_FORMAT_R16_FLOAT:
-    case DXGI_FORMAT_D16_UNORM:
-    case DXGI_FORMAT_R16_UNORM:
-    case DXGI_FORMAT_R16_UINT:
-    case DXGI_FORMAT_R16_SNORM:
-    case DXGI_FORMAT_R16_SINT:
-    case DXGI_FORMAT_B5G6R5_UNORM:
-    case DXGI_FORMAT_B5G5R5A1_UNORM:
-    case DXGI_FORMAT_A8P8:
-    case DXGI_FORMAT_B4G4R4A4_UNORM:
-        return 16;
-
-    case DXGI_FORMAT_NV12:
-    case DXGI_FORMAT_420_OPAQUE:
-    case DXGI_FORMAT_NV11:
-        return 12;
-
-    case DXGI_FORMAT_R8_TYPELESS:
-    case DXGI_FORMAT_R8_UNORM:
-    case DXGI_FORMAT_R8_UINT:
-    case DXGI_FORMAT_R8_SNORM:
-    case DXGI_FORMAT_R8_SINT:
-    case DXGI_FORMAT_A8_UNORM:
-    case DXGI_FORMAT_BC2_TYPELESS:
-    case DXGI_FORMAT_BC2_UNORM:
-    case DXGI_FORMAT_BC2_UNORM_SRGB:
-    case DXGI_FORMAT_BC3_TYPELESS:
-    case DXGI_FORMAT_BC3_UNORM:
-    case DXGI_FORMAT_BC3_UNORM_SRGB:
-    case DXGI_FORMAT_BC5_TYPELESS:
-    case DXGI_FORMAT_BC5_UNORM:
-    case DXGI_FORMAT_BC5_SNORM:
-    case DXGI_FORMAT_BC6H_TYPELESS:
-    case DXGI_FORMAT_BC6H_UF16:
-    case DXGI_FORMAT_BC6H_SF16:
-    case DXGI_FORMAT_BC7_TYPELESS:
-    case DXGI_FORMAT_BC7_UNORM:
-    case DXGI_FORMAT_BC7_UNORM_SRGB:
-    case DXGI_FORMAT_AI44:
-    case DXGI_FORMAT_IA44:
-    case DXGI_FORMAT_P8:
-        return 8;
-
-    case DXGI_FORMAT_R1_UNORM:
-        return 1;
-
-    case DXGI_FORMAT_BC1_TYPELESS:
-    case DXGI_FORMAT_BC1_UNORM:
-    case DXGI_FORMAT_BC1_UNORM_SRGB:
-    case DXGI_FORMAT_BC4_TYPELESS:
-    case DXGI_FORMAT_BC4_UNORM:
-    case DXGI_FORMAT_BC4_SNORM:
-        return 4;
-
-    default:
-        return 0;
-    }
-}
-
-size_t ni::getDXGIFormatBytes(DXGI_FORMAT format) {
-    return getDXGIFormatBits(format) / 8;
-}
-
-ni::Texture* ni::createTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t depth, const void* pixels, DXGI_FORMAT dxgiFormat, D3D12_RESOURCE_FLAGS flags) {
+static ni::Texture* createTextureResource(const wchar_t* name, uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, DXGI_FORMAT dxgiFormat, D3D12_RESOURCE_FLAGS flags) {
     NI_ASSERT(depth == 1, "No 3D textures supported yet.");
-    Texture* texture = new Texture();
-    D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-    D3D12_RESOURCE_DIMENSION dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    NI_ASSERT(!ni::isBlockCompressed(dxgiFormat) || (width % NI_BC_BLOCK_DIM == 0 && height % NI_BC_BLOCK_DIM == 0), "Block compressed textures must be a multiple of 4 texels");
+    ni::Texture* texture = new ni::Texture();
+    // Sampled textures are uploaded on the copy queue, so they live in COMMON and get promoted to
+    // COPY_DEST or PIXEL_SHADER_RESOURCE on use. Render and depth targets keep explicit states.
+    D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON;
+    if ((flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) > 0) {
+        initialState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+    }
     D3D12_RESOURCE_DESC resourceDesc = {
         D3D12_RESOURCE_DIMENSION_TEXTURE2D,
         D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
         (uint64_t)width,
         height,
         (uint16_t)depth,
-        1,
+        (uint16_t)mipLevels,
         dxgiFormat,
         { 1,  0},
         D3D12_TEXTURE_LAYOUT_UNKNOWN,
@@ -861,143 +1298,159 @@ ni::Texture* ni::createTexture(const wchar_t* name, uint32_t width, uint32_t hei
         clearValuePtr = &clearValue;
     }
 
-    NI_D3D_ASSERT(ni::getDevice()->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES, &resourceDesc, initialState, clearValuePtr, IID_PPV_ARGS(&texture->texture.resource)), "Failed to create image resource");
+    // Render and depth targets need their own heap flags and a clear, they stay committed.
+    if (clearValuePtr == nullptr) {
+        resourceDesc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+        D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = ni::getDevice()->GetResourceAllocationInfo(0, 1, &resourceDesc);
+        if (allocationInfo.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {
+            resourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+            allocationInfo = ni::getDevice()->GetResourceAllocationInfo(0, 1, &resourceDesc);
+        }
+        uint64_t heapOffset = 0;
+        if (allocationInfo.SizeInBytes <= NI_GPU_HEAP_BLOCK_SIZE / 2 &&
+            allocateFromHeapPool(ni::GPU_HEAP_POOL_TEXTURES, allocationInfo.SizeInBytes, allocationInfo.Alignment, texture->texture.allocation, heapOffset)) {
+            NI_D3D_ASSERT(ni::getDevice()->CreatePlacedResource(heapPools[ni::GPU_HEAP_POOL_TEXTURES].blocks[texture->texture.allocation.block].heap, heapOffset, &resourceDesc, initialState, nullptr, IID_PPV_ARGS(&texture->texture.resource)), "Failed to create placed image resource");
+        } else {
+            resourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        }
+    }
+    if (texture->texture.resource == nullptr) {
+        NI_D3D_ASSERT(ni::getDevice()->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES, &resourceDesc, initialState, clearValuePtr, IID_PPV_ARGS(&texture->texture.resource)), "Failed to create image resource");
+        committedResourceNum++;
+    }
     texture->texture.resource->SetName(name);
     texture->texture.state = initialState;
+    texture->texture.dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    // The view never changes, so it's created once here instead of every frame the texture is drawn.
+    if ((flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) == 0) {
+        texture->shaderResourceView = ni::allocatePersistentDescriptors(1);
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = dxgiFormat;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Texture2D.MostDetailedMip = 0;
+        srvDesc.Texture2D.MipLevels = mipLevels;
+        srvDesc.Texture2D.PlaneSlice = 0;
+        srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+        ni::getDevice()->CreateShaderResourceView(texture->texture.resource, &srvDesc, texture->shaderResourceView.allocate().cpuHandle);
+    }
     texture->width = width;
     texture->height = height;
     texture->depth = depth;
+    texture->mipLevels = mipLevels;
+    texture->format = dxgiFormat;
     texture->state |= NI_IMAGE_STATE_CREATED;
-
-    if (pixels != nullptr) {
-        size_t pixelSize = ni::getDXGIFormatBytes(dxgiFormat);
-        uint64_t alignedWidth = alignSize(width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
-        uint64_t dataSize = alignedWidth * height * pixelSize;
-        uint64_t bufferSize = dataSize < 256 ? 256 : dataSize;
-        texture->upload = ni::createBuffer(L"SpriteImage::upload", bufferSize, ni::UPLOAD_BUFFER, false);
-        texture->cpuData = malloc(pixelSize * width * height);
-        NI_ASSERT(texture->cpuData != nullptr, "Failed to allocate cpu data for uploading to texture memory");
-        if (texture->cpuData != nullptr) {
-            memcpy((void*)texture->cpuData, pixels, pixelSize * width * height);
-        }
-        renderer.imagesToUpload[renderer.imageToUploadNum++] = texture;
-    }
+    texture->residency = ni::TEXTURE_RESIDENCY_RESIDENT;
     return texture;
 }
 
-void ni::destroyTexture(Texture*& texture) {
-    NI_D3D_RELEASE(texture->texture.resource);
-    NI_D3D_RELEASE(texture->upload.resource);
-    delete texture;
-    texture = nullptr;
+// Tries to copy the data into the staging ring right away, the copy itself is recorded in beginFrame. When the ring
+// is full the texture keeps a CPU copy instead and isn't drawable until a later beginFrame found room for it.
+static void queueTextureUpload(ni::Texture* texture, const void* data, bool pitched) {
+    uint64_t stagingSize = ni::getTextureFootprints(texture->width, texture->height, texture->mipLevels, texture->format, nullptr, nullptr, nullptr);
+    NI_ASSERT(stagingSize <= NI_STREAMING_STAGING_SIZE, "Texture upload of %llu bytes doesn't fit in NI_STREAMING_STAGING_SIZE", (unsigned long long)stagingSize);
+    if (renderer.streamer->allocateStaging(stagingSize, texture->staging)) {
+        copyTextureToStaging(texture, data, pitched, renderer.streamer->getStagingPointer(texture->staging));
+        texture->state |= NI_IMAGE_STATE_STAGED;
+    } else {
+        size_t cpuDataSize = pitched ? (size_t)stagingSize : ni::getMipChainSize(texture->width, texture->height, texture->mipLevels, texture->format);
+        void* cpuData = malloc(cpuDataSize);
+        NI_ASSERT(cpuData != nullptr, "Failed to allocate cpu data for uploading to texture memory");
+        memcpy(cpuData, data, cpuDataSize);
+        texture->cpuData = cpuData;
+        texture->state |= pitched ? NI_IMAGE_STATE_PITCHED : 0;
+        texture->residency = ni::TEXTURE_RESIDENCY_QUEUED;
+    }
+    renderer.imagesToUpload[renderer.imageToUploadNum++] = texture;
 }
 
-void ni::logFmt(const char* fmt, ...) {
-    static char bufferLarge[NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE * NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT] = {};
-    static uint32_t bufferIndex = 0;
-    va_list args;
-    va_start(args, fmt);
-    char* buffer = &bufferLarge[bufferIndex * NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE];
-    vsprintf_s(buffer, NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE, fmt, args);
-    bufferIndex = (bufferIndex + 1) % NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT;
-    va_end(args);
-    OutputDebugStringA(buffer);
-    printf("%s", buffer);
-}
-
-// Origin: https://github.com/niklas-ourmachinery/bitsquid-foundation/blob/master/murmur_hash.cpp
-uint64_t ni::murmurHash(const void* key, uint64_t keyLength, uint64_t seed) {
-    const uint64_t m = 0xc6a4a7935bd1e995ULL;
-    const uint32_t r = 47;
-    uint64_t h = seed ^ (keyLength * m);
-    const uint64_t* data = (const uint64_t*)key;
-    const uint64_t* end = data + (keyLength / 8);
-    while (data != end) {
-        uint64_t k = *data++;
-        k *= m;
-        k ^= k >> r;
-        k *= m;
-        h ^= k;
-        h *= m;
-    }
-    const unsigned char* data2 = (const unsigned char*)data;
-    switch (keyLength & 7) {
-    case 7: h ^= uint64_t(data2[6]) << 48;
-    case 6: h ^= uint64_t(data2[5]) << 40;
-    case 5: h ^= uint64_t(data2[4]) << 32;
-    case 4: h ^= uint64_t(data2[3]) << 24;
-    case 3: h ^= uint64_t(data2[2]) << 16;
-    case 2: h ^= uint64_t(data2[1]) << 8;
-    case 1: h ^= uint64_t(data2[0]);
-        h *= m;
-    };
-    h ^= h >> r;
-    h *= m;
-    h ^= h >> r;
-    return h;
-}
-
-size_t ni::getFileSize(const char* path) {
-    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (fileHandle != INVALID_HANDLE_VALUE) {
-        LARGE_INTEGER fileSize = {};
-        if (GetFileSizeEx(fileHandle, &fileSize)) {
-            return fileSize.QuadPart;
-        }
-        CloseHandle(fileHandle);
-    }
-    return 0;
-}
-
-bool ni::readFile(const char* path, void* outBuffer) {
-    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (fileHandle != INVALID_HANDLE_VALUE) {
-        LARGE_INTEGER fileSize = {};
-        GetFileSizeEx(fileHandle, &fileSize);
-        DWORD readBytes = 0;
-        if (!ReadFile(fileHandle, outBuffer, (DWORD)fileSize.QuadPart, &readBytes, nullptr)) {
-            CloseHandle(fileHandle);
-            return false;
-        }
-        CloseHandle(fileHandle);
-        return true;
+ni::Texture* ni::createTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t depth, const void* pixels, DXGI_FORMAT dxgiFormat, D3D12_RESOURCE_FLAGS flags, bool generateMips) {
+    NI_ASSERT(!generateMips || pixels != nullptr, "Can't generate mips without pixel data");
+    if (isBlockCompressed(dxgiFormat) && pixels != nullptr) {
+        NI_ASSERT(flags == D3D12_RESOURCE_FLAG_NONE, "Block compressed textures can't be render targets or UAVs");
+        return createCompressedTexture(name, width, height, pixels, dxgiFormat, generateMips);
     }
-    return false;
-}
-
-void* ni::allocReadFile(const char* path) {
-    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (fileHandle != INVALID_HANDLE_VALUE) {
-        LARGE_INTEGER fileSize = {};
-        GetFileSizeEx(fileHandle, &fileSize);
-        void* buffer = malloc(fileSize.QuadPart);
-        DWORD readBytes = 0;
-        if (!ReadFile(fileHandle, buffer, (DWORD)fileSize.QuadPart, &readBytes, nullptr)) {
-            CloseHandle(fileHandle);
-            free(buffer);
-            return nullptr;
-        }
-        CloseHandle(fileHandle);
-        return buffer;
+    NI_ASSERT(!generateMips || ni::getDXGIFormatBytes(dxgiFormat) == 4, "Mip generation only supports 8 bit RGBA formats");
+    uint32_t mipLevels = generateMips ? getMipLevelCount(width, height) : 1;
+    Texture* texture = createTextureResource(name, width, height, depth, mipLevels, dxgiFormat, flags);
+
+    if (pixels != nullptr && generateMips) {
+        void* mipChain = malloc(getMipChainSize(width, height, mipLevels, dxgiFormat));
+        NI_ASSERT(mipChain != nullptr, "Failed to allocate mip chain");
+        generateMipChainRGBA8(pixels, width, height, mipLevels, mipChain);
+        queueTextureUpload(texture, mipChain, false);
+        free(mipChain);
+    } else if (pixels != nullptr) {
+        queueTextureUpload(texture, pixels, false);
     }
-    return nullptr;
+    return texture;
+}
+
+ni::Texture* ni::createCompressedTexture(const wchar_t* name, uint32_t width, uint32_t height, const void* pixels, DXGI_FORMAT dxgiFormat, bool generateMips) {
+    CompressedMipChain mipChain = compressMipChain(pixels, width, height, dxgiFormat, generateMips);
+    Texture* texture = createTextureResource(name, mipChain.width, mipChain.height, 1, mipChain.mipLevels, dxgiFormat, D3D12_RESOURCE_FLAG_NONE);
+    queueTextureUpload(texture, mipChain.data, false);
+    free(mipChain.data);
+    return texture;
+}
+
+ni::Texture* ni::createTextureFromMipChain(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, const void* mipChain, DXGI_FORMAT dxgiFormat) {
+    NI_ASSERT(mipChain != nullptr, "Missing mip chain");
+    Texture* texture = createTextureResource(name, width, height, 1, mipLevels, dxgiFormat, D3D12_RESOURCE_FLAG_NONE);
+    queueTextureUpload(texture, mipChain, false);
+    return texture;
 }
 
-ni::FileReader::FileReader(const char* path) {
-    size = getFileSize(path);
-    buffer = allocReadFile(path);
+ni::Texture* ni::createTextureFromFootprints(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT dxgiFormat, const void* data, size_t dataSize) {
+    NI_ASSERT(data != nullptr, "Missing texture data");
+    Texture* texture = createTextureResource(name, width, height, 1, mipLevels, dxgiFormat, D3D12_RESOURCE_FLAG_NONE);
+    D3D12_RESOURCE_DESC resourceDesc = texture->texture.resource->GetDesc();
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT layouts[D3D12_REQ_MIP_LEVELS];
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT expectedLayouts[D3D12_REQ_MIP_LEVELS];
+    uint64_t totalBytes = 0;
+    renderer.device->GetCopyableFootprints(&resourceDesc, 0, mipLevels, 0, layouts, nullptr, nullptr, &totalBytes);
+    uint64_t expectedBytes = getTextureFootprints(width, height, mipLevels, dxgiFormat, expectedLayouts, nullptr, nullptr);
+    NI_ASSERT(totalBytes == expectedBytes && totalBytes <= dataSize, "Texture data doesn't match the device footprints");
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        NI_ASSERT(layouts[mip].Offset == expectedLayouts[mip].Offset && layouts[mip].Footprint.RowPitch == expectedLayouts[mip].Footprint.RowPitch, "Texture data doesn't match the device footprints");
+    }
+
+    // Already pitched, so when the staging ring has room this is the only copy between the source and the GPU.
+    queueTextureUpload(texture, data, true);
+    return texture;
 }
 
-ni::FileReader::~FileReader() {
-    free(buffer);
+ni::Texture* ni::streamTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT dxgiFormat, const void* data, size_t dataSize) {
+    NI_ASSERT(data != nullptr, "Missing texture data");
+    Texture* texture = createTextureResource(name, width, height, 1, mipLevels, dxgiFormat, D3D12_RESOURCE_FLAG_NONE);
+    uint64_t totalBytes = getTextureFootprints(width, height, mipLevels, dxgiFormat, nullptr, nullptr, nullptr);
+    NI_ASSERT(totalBytes <= dataSize, "Texture data doesn't match the upload footprints");
+    renderer.streamer->request(texture, texture->residency, data, totalBytes);
+    return texture;
 }
 
-void* ni::FileReader::operator*() const {
-    return buffer;
+ni::StreamingStats ni::getStreamingStats() {
+    return renderer.streamer->getStats();
 }
 
-size_t ni::FileReader::getSize() const {
-    return size;
+void ni::destroyTexture(Texture*& texture) {
+    // Textures still waiting for their upload are forgotten first, so neither beginFrame nor the streaming loader
+    // touches them once they're freed. Staging that was allocated but never submitted is submitted now, the ring
+    // reclaims in allocation order and would stop at its marker for good otherwise.
+    for (uint32_t index = 0; index < renderer.imageToUploadNum; ++index) {
+        if (renderer.imagesToUpload[index] != texture) continue;
+        if ((texture->state & (NI_IMAGE_STATE_STAGED | NI_IMAGE_STATE_UPLOADED)) == NI_IMAGE_STATE_STAGED) {
+            renderer.streamer->submitStaging(texture->staging, renderer.copyFenceValue);
+        }
+        renderer.imagesToUpload[index] = renderer.imagesToUpload[--renderer.imageToUploadNum];
+        break;
+    }
+    renderer.streamer->cancel(texture->residency, renderer.copyFenceValue);
+    freePersistentDescriptors(texture->shaderResourceView);
+    releaseResource(texture->texture);
+    free((void*)texture->cpuData);
+    delete texture;
+    texture = nullptr;
 }
 
 void ni::DescriptorTable::reset() {
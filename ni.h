@@ -1,6 +1,7 @@
 #pragma once
 
-#include <stdint.h>
+#include "ni_core.h"
+#include "texture_streaming.h"
 #include <d3d12.h>
 #include <dxgi1_6.h>
 
@@ -12,29 +13,47 @@
 #define NI_FRAME_COUNT 3
 #define NI_BACKBUFFER_COUNT 2
 #define NI_MAX_DESCRIPTORS (1<<12)
+// The shader visible heap holds NI_MAX_DESCRIPTORS persistent descriptors, followed by this many transient
+// ones per frame. Persistent descriptor indices double as bindless texture ids.
+#define NI_TRANSIENT_DESCRIPTORS 256
+// Runs FrameData::computeCommandList on its own queue so it overlaps with the previous frame's rendering.
+// When disabled computeCommandList is the direct command list.
+#define NI_USE_ASYNC_COMPUTE 1
+// Buffers the compute queue writes and the direct queue reads have to exist this many times. Compute work
+// of frame N waits until the direct queue finished frame N - NI_ASYNC_COMPUTE_BUFFER_COUNT.
+#define NI_ASYNC_COMPUTE_BUFFER_COUNT 2
+// Buffers and sampled textures are placed in ID3D12Heaps of this size. Anything larger than half a block
+// gets a committed resource instead.
+#define NI_GPU_HEAP_BLOCK_SIZE (64ull << 20)
+#define NI_GPU_HEAP_MAX_BLOCKS 32
+// Upload buffers below 64 KB share one persistently mapped buffer of this size instead of a 64 KB placement each.
+#define NI_SMALL_UPLOAD_BLOCK_SIZE (4ull << 20)
+// Compiled pipelines are kept here between runs, relative to the working directory.
+#define NI_PIPELINE_CACHE_PATH "pipeline_cache.bin"
+// Background threads for file reads and pipeline creation, 0 uses every core besides the render thread.
+#define NI_LOADER_THREAD_NUM 0
 
 ///////////////////////////////////////////////////////////////
 
-#define NI_EXIT(code) { ExitProcess(code); }
-#define NI_DEBUG_BREAK() __debugbreak()
-#define NI_LOG(fmt, ...) ni::logFmt(fmt "\n", ##__VA_ARGS__)
-#define NI_PANIC(fmt, ...) { ni::logFmt("PANIC: " fmt "\n", ##__VA_ARGS__); NI_DEBUG_BREAK(); NI_EXIT(~0); }
-#define NI_ASSERT(x, fmt, ...) if (!(x)) { ni::logFmt("ASSERT: " fmt "\n", ##__VA_ARGS__); NI_DEBUG_BREAK(); }
 #define NI_D3D_ASSERT(x, ...) if ((x) != S_OK) { NI_PANIC(__VA_ARGS__); }
 #define NI_D3D_RELEASE(obj) { if ((obj)) { (obj)->Release(); obj = nullptr; } }
-#define NI_COLOR_UINT(color) (((color) & 0xff) << 24) | ((((color) >> 8) & 0xff) << 16) | ((((color) >> 16) & 0xff) << 8) | ((color) >> 24)
-#define NI_COLOR_RGBA_UINT(r, g, b, a) ((uint32_t)(r)) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | ((uint32_t)(a) << 24)
-#define NI_COLOR_RGB_UINT(r, g, b) NI_COLOR_RGBA_UINT(r, g, b, 0xff)
-#define NI_COLOR_RGBA_FLOAT(r, g, b, a) NI_COLOR_RGBA_UINT((uint8_t)((r) * 255.0f), (uint8_t)((g) * 255.0f), (uint8_t)((b) * 255.0f), (uint8_t)((a) * 255.0f))
-#define NI_COLOR_RGB_FLOAT(r, g, b) NI_COLOR_RGBA_FLOAT(r, g, b, 1.0f)
 #define NI_IMAGE_STATE_NONE (0b000)
 #define NI_IMAGE_STATE_CREATED (0b001)
 #define NI_IMAGE_STATE_UPLOADED (0b010)
 #define NI_IMAGE_STATE_BOUND (0b100)
+// Data is in the shared staging ring (Texture::staging), ready for the copy queue.
+#define NI_IMAGE_STATE_STAGED (0b1000)
+// cpuData is already laid out like the upload footprints instead of tightly packed.
+#define NI_IMAGE_STATE_PITCHED (0b10000)
+
+struct SpriteMesh;
 
 namespace ni {
 
-	void logFmt(const char* fmt, ...);
+	struct GpuProfiler;
+	struct RendererStats;
+	struct FrameTiming;
+	struct ReadbackRing;
 
 	enum KeyCode : uint32_t {
 		ALT = 18,
@@ -146,63 +165,9 @@ namespace ni {
 		CONSTANT_BUFFER,
 		UNORDERED_BUFFER,
 		UPLOAD_BUFFER,
-		SHADER_RESOURCE_BUFFER
-	};
-
-	struct FileReader {
-		FileReader(const char* path);
-		~FileReader();
-		void* operator*() const;
-		size_t getSize() const;
-	private:
-		void* buffer = nullptr;
-		size_t size = 0;
-	};
-
-	template<typename T, typename TSize = uint64_t>
-	struct Array {
-		Array() : data(nullptr), num(0), capacity(0) {}
-
-		void reset() {
-			num = 0;
-		}
-
-		void add(const T& element) {
-			checkResize();
-			data[num++] = element;
-		}
-
-		void remove(TSize index) {
-			NI_ASSERT(index < num, "Index out of bounds");
-			for (TSize start = index; start < num - 1; ++start) {
-				data[start] = data[start + 1];
-			}
-			num--;
-		}
-
-		void resize(TSize newCapacity) {
-			T* newData = (T*)realloc(data, newCapacity * sizeof(T));
-			NI_ASSERT(newData != nullptr, "Failed to reallocate array");
-			data = newData;
-			capacity = newCapacity;
-		}
-
-		void checkResize() {
-			if (num + 1 >= capacity) {
-				resize(capacity > 0 ? capacity * 2 : 16);
-			}
-		}
-
-		T* getData() { return data; }
-		const T* getData() const { return data; }
-
-		TSize getNum() const { return num; }
-		TSize getCapacity() const { return capacity;  }
-
-	private:
-		T* data;
-		TSize num;
-		TSize capacity;
+		SHADER_RESOURCE_BUFFER,
+		// Committed and always in COPY_DEST, the GPU copies into it and the CPU reads it with mapReadbackBuffer.
+		READBACK_BUFFER
 	};
 
 	struct RootSignatureDescriptorRange {
@@ -224,7 +189,9 @@ namespace ni {
 		void addRootParameterDescriptorTable(const D3D12_DESCRIPTOR_RANGE* ranges, uint32_t rangeNum, D3D12_SHADER_VISIBILITY shaderVisibility);
 		void addRootParameterDescriptorTable(const RootSignatureDescriptorRange& ranges, D3D12_SHADER_VISIBILITY shaderVisibility);
 		void addRootParameterConstant(uint32_t shaderRegister, uint32_t registerSpace, uint32_t num32BitValues, D3D12_SHADER_VISIBILITY shaderVisibility);
-		void addStaticSampler(D3D12_FILTER filter, D3D12_TEXTURE_ADDRESS_MODE addressModeAll, uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility);
+		// A buffer view set by GPU address, without a descriptor. Only raw and structured buffers.
+		void addRootParameterShaderResourceView(uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility);
+		void addStaticSampler(D3D12_FILTER filter, D3D12_TEXTURE_ADDRESS_MODE addressModeAll, uint32_t shaderRegister, uint32_t registerSpace, D3D12_SHADER_VISIBILITY shaderVisibility, float maxLOD = D3D12_FLOAT32_MAX);
 		ID3D12RootSignature* build(bool isCompute);
 
 	private:
@@ -232,62 +199,43 @@ namespace ni {
 		Array<D3D12_STATIC_SAMPLER_DESC, uint32_t> staticSamplers;
 	};
 	
+	enum GpuHeapPool : uint32_t {
+		GPU_HEAP_POOL_COMMITTED,
+		GPU_HEAP_POOL_DEFAULT_BUFFERS,
+		GPU_HEAP_POOL_UPLOAD_BUFFERS,
+		GPU_HEAP_POOL_TEXTURES,
+		GPU_HEAP_POOL_SMALL_UPLOAD,
+		GPU_HEAP_POOL_COUNT
+	};
+
+	// Where a resource's memory came from. Zero initialized means a committed resource.
+	struct HeapAllocation {
+		uint32_t pool;
+		uint32_t block;
+		uint32_t node;
+	};
+
 	struct Resource {
 		ID3D12Resource* resource;
 		D3D12_RESOURCE_STATES state;
+		// Small upload buffers share one ID3D12Resource, copies and views have to add this offset.
+		uint64_t offset;
+		HeapAllocation allocation;
+		// Buffers can leave COMMON implicitly for any state, see ResourceStateTracker.
+		D3D12_RESOURCE_DIMENSION dimension;
 	};
 
-	template<uint32_t NUM_BARRIERS>
-	struct ResourceBarrierBatcher {
-
-		struct BarrierData {
-			D3D12_RESOURCE_BARRIER barrier;
-			Resource* resource1;
-			Resource* resource2;
-		};
-
-		ResourceBarrierBatcher() {
-			memset(barriers, 0, sizeof(barriers));
-			barrierNum = 0;
-		}
-
-		void transition(Resource* resource, D3D12_RESOURCE_STATES afterState) {
-			if (resource->state != afterState) {
-				BarrierData data = { {}, resource, nullptr };
-				data.barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-				data.barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-				data.barrier.Transition.Subresource = 0;
-				data.barrier.Transition.pResource = resource->resource;
-				data.barrier.Transition.StateBefore = resource->state;
-				data.barrier.Transition.StateAfter = afterState;
-				barriers[barrierNum++] = data;
-			}
-		}
-
-		void reset() {
-			barrierNum = 0;
-		}
-
-		void flush(ID3D12GraphicsCommandList* commandList) {
-			if (barrierNum == 0) return;
-			D3D12_RESOURCE_BARRIER barrierArray[NUM_BARRIERS] = {};
-			for (uint32_t index = 0; index < barrierNum; ++index) {
-				barrierArray[index] = barriers[index].barrier;
-			}
-			commandList->ResourceBarrier(barrierNum, barrierArray);
-			for (uint32_t index = 0; index < barrierNum; ++index) {
-				BarrierData& data = barriers[index];
-				if (data.barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
-					data.resource1->state = data.barrier.Transition.StateAfter;
-				}
-			}
-			reset();
-		}
-
-		BarrierData barriers[NUM_BARRIERS];
-		uint32_t barrierNum;
+	struct GpuMemoryStats {
+		uint64_t heapBytes;
+		uint64_t placedBytes;
+		uint64_t smallUploadBytes;
+		uint32_t heapNum;
+		uint32_t placedNum;
+		uint32_t smallUploadNum;
+		uint32_t committedNum;
 	};
 
+
 	struct DescriptorHandle {
 
 		D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle;
@@ -304,41 +252,67 @@ namespace ni {
 		uint32_t handleSize;
 		uint32_t allocated;
 		uint32_t capacity;
+		// Index of the first descriptor in the shader visible heap.
+		uint32_t heapIndex;
+		// Free list node of persistent tables, see allocatePersistentDescriptors.
+		uint32_t node;
 	};
 
+	// Linear allocator over one frame's transient region, reset in beginFrame.
 	struct DescriptorAllocator {
 
 		void reset();
 		DescriptorTable allocateDescriptorTable(uint32_t descriptorNum);
 
-		ID3D12DescriptorHeap* descriptorHeap;
 		D3D12_GPU_DESCRIPTOR_HANDLE gpuBaseHandle;
 		D3D12_CPU_DESCRIPTOR_HANDLE cpuBaseHandle;
 		uint32_t descriptorHandleSize;
 		uint32_t descriptorAllocated;
+		uint32_t descriptorCapacity;
+		uint32_t heapIndex;
 	};
 
 	struct FrameData {
-		DescriptorTable descriptorTable;
+		// Views that only live for this frame. Long lived ones come from allocatePersistentDescriptors.
 		DescriptorAllocator descriptorAllocator;
 		ID3D12GraphicsCommandList* commandList;
 		ID3D12CommandAllocator* commandAllocator;
+		// Recorded on the copy queue and submitted ahead of commandList, which waits for it on the GPU.
+		// Only COPY_DEST and COMMON are valid here, buffers and textures are promoted from COMMON implicitly.
+		ID3D12GraphicsCommandList* copyCommandList;
+		ID3D12CommandAllocator* copyCommandAllocator;
+		// Submitted after the copies and before commandList. Buffers come out of it in COMMON.
+		ID3D12GraphicsCommandList* computeCommandList;
+		ID3D12CommandAllocator* computeCommandAllocator;
 		ID3D12Fence* fence;
 		HANDLE fenceEvent;
 		uint64_t frameWaitValue;
 		uint64_t frameIndex;
+		// Counts up every frame, unlike frameIndex which cycles through NI_FRAME_COUNT.
+		uint64_t frameNumber;
 		void* userData;
 	};
 
 	struct Texture {
 		ni::Resource texture;
-		ni::Resource upload;
+		// Created once with the texture, shaderResourceView.heapIndex is its bindless index.
+		DescriptorTable shaderResourceView;
+		StagingAllocation staging;
 		uint32_t width;
 		uint32_t height;
 		uint32_t depth;
+		uint32_t mipLevels;
+		DXGI_FORMAT format;
 		const void* cpuData;
 		uint32_t textureId;
 		uint32_t state;
+		// TextureResidency, written by the streaming loader thread.
+		std::atomic<uint32_t> residency;
+		// Alpha trimmed mesh SpriteRenderer draws the texture with, the full quad when null.
+		const SpriteMesh* spriteMesh;
+		// Asset pack entry the texels came from, null for textures created from memory. Points into the pack.
+		const char* assetName;
+		void* userData;
 	};
 
 	struct Renderer {
@@ -347,11 +321,16 @@ namespace ni {
 		IDXGIFactory1* factory;
 		IDXGIAdapter1* adapter;
 		ID3D12CommandQueue* commandQueue;
+		ID3D12CommandQueue* copyQueue;
+		ID3D12CommandQueue* computeQueue;
 		IDXGISwapChain1* swapChain;
+		// Shader visible CBV/SRV/UAV heap, persistent region first and one transient region per frame after it.
+		ID3D12DescriptorHeap* descriptorHeap;
+		uint32_t descriptorHandleSize;
 		ID3D12DescriptorHeap* rtvDescriptorHeap;
 		ID3D12DescriptorHeap* dsvDescriptorHeap;
 		FrameData frames[NI_FRAME_COUNT];
-		ID3D12Resource* backbuffers[NI_FRAME_COUNT];
+		Resource backbuffers[NI_FRAME_COUNT];
 		ID3D12Fence* presentFence;
 		HANDLE presentFenceEvent;
 		HWND windowHandle;
@@ -362,12 +341,45 @@ namespace ni {
 		uint64_t currentFrame;
 		Texture** imagesToUpload;
 		uint32_t imageToUploadNum;
+		TextureStreamer* streamer;
+		GpuProfiler* gpuProfiler;
+		RendererStats* rendererStats;
+		FrameTiming* frameTiming;
+		ReadbackRing* readback;
+		// GPU profiler scope around the whole direct list, its samples are the GPU frame times.
+		uint32_t gpuFrameScope;
+		uint64_t gpuFrameSampleNum;
+		// CPU frames are measured from the end of one present to the end of the next, without the time blocked
+		// in present and frame waits in between.
+		double lastPresentSeconds;
+		double blockedSeconds;
+		// Persistently mapped upload heap shared by streamed and directly created textures.
+		Resource streamingStaging;
+		// Signaled by the copy queue once per frame. Streaming staging memory is reclaimed against it.
+		ID3D12Fence* copyFence;
+		uint64_t copyFenceValue;
+		ID3D12Fence* computeFence;
+		uint64_t computeFenceValue;
+		// Signaled by the direct queue once per frame, the compute queue waits on it before reusing its buffers.
+		ID3D12Fence* directFence;
+		uint64_t directFenceValue;
+		uint64_t frameNumber;
 		float mouseX;
 		float mouseY;
 		bool shouldQuit;
+		bool offscreen;
+	};
+
+	enum InitFlags : uint32_t {
+		// No window or swapchain. Frames render into NI_BACKBUFFER_COUNT textures that present only rotates,
+		// getReadback gets them to the CPU.
+		INIT_OFFSCREEN = 1 << 0,
+		// WARP, D3D12's software rasterizer, instead of the first adapter. Runs on machines without a GPU.
+		INIT_WARP_ADAPTER = 1 << 1
 	};
 
-	void init(uint32_t width, uint32_t height);
+	void init(uint32_t width, uint32_t height, uint32_t flags = 0);
+	bool isOffscreen();
 	void setFrameUserData(uint32_t frame, void* data);
 	void waitForCurrentFrame();
 	void waitForAllFrames();
@@ -378,13 +390,36 @@ namespace ni {
 	ID3D12Device* getDevice();
 	ni::FrameData& beginFrame();
 	void endFrame();
-	ID3D12Resource* getCurrentBackbuffer();
+	Resource* getCurrentBackbuffer();
+	// Scopes recorded on the frame's lists are collected NI_FRAME_COUNT frames later.
+	GpuProfiler* getGpuProfiler();
+	// Counters of the frame being recorded and the ones before it, GPU counters arrive NI_FRAME_COUNT frames later.
+	RendererStats* getRendererStats();
+	// CPU frame, GPU frame and present wait histograms since init.
+	FrameTiming* getFrameTiming();
+	// Backbuffer copies are recorded at the end of the frame they were requested in and handed out once it retired.
+	ReadbackRing* getReadback();
 	void present(bool vsync = true);
 	ID3D12PipelineState* createGraphicsPipelineState(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& psoDesc);
 	ID3D12PipelineState* createComputePipelineState(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& psoDesc);
 	float getViewWidth();
 	float getViewHeight();
+	// Placed in a shared heap unless it's large or initToZero needs fresh memory from a committed resource.
 	Resource createBuffer(const wchar_t* name, size_t bufferSize, BufferType type, bool initToZero = false);
+	// Returns a pointer to the start of the buffer, which isn't the start of the mapping for small upload buffers.
+	void* mapBuffer(const Resource& buffer);
+	void unmapBuffer(const Resource& buffer, size_t writtenSize);
+	// Only the range the CPU reads is made visible, the GPU must be done writing it.
+	const void* mapReadbackBuffer(const Resource& buffer, size_t readOffset, size_t readSize);
+	void unmapReadbackBuffer(const Resource& buffer);
+	// Released NI_FRAME_COUNT frames later, when the frames in flight can't be reading it anymore.
+	void destroyBuffer(Resource& buffer);
+	GpuMemoryStats getGpuMemoryStats();
+	// Contiguous descriptors that stay valid until freed. Frees are deferred until the GPU can't be reading them.
+	DescriptorTable allocatePersistentDescriptors(uint32_t descriptorNum);
+	void freePersistentDescriptors(DescriptorTable& table);
+	// Start of the persistent region, bind it as an unbounded table to index it with DescriptorTable::heapIndex.
+	D3D12_GPU_DESCRIPTOR_HANDLE getPersistentDescriptorBase();
 	D3D12_CPU_DESCRIPTOR_HANDLE getRenderTargetViewCPUHandle();
 	D3D12_GPU_DESCRIPTOR_HANDLE getRenderTargetViewGPUHandle();
 	D3D12_CPU_DESCRIPTOR_HANDLE getDepthStencilViewCPUHandle();
@@ -393,18 +428,24 @@ namespace ni {
 	float mouseY();
 	bool mouseDown(MouseButton button);
 	bool keyDown(KeyCode keyCode);
-	float randomFloat();
-	uint32_t randomUint();
-	double getSeconds();
 	size_t getDXGIFormatBits(DXGI_FORMAT format);
 	size_t getDXGIFormatBytes(DXGI_FORMAT format);
-	Texture* createTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t depth, const void* pixels, DXGI_FORMAT dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+	// Block compressed formats take 8 bit RGBA pixels and encode them on the CPU, see createCompressedTexture.
+	Texture* createTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t depth, const void* pixels, DXGI_FORMAT dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE, bool generateMips = false);
+	// Encodes 8 bit RGBA pixels into BC1, BC3 or BC7. The texture is padded with transparent texels to a
+	// multiple of 4, so its width and height can be larger than the source.
+	Texture* createCompressedTexture(const wchar_t* name, uint32_t width, uint32_t height, const void* pixels, DXGI_FORMAT dxgiFormat, bool generateMips = false);
+	// Cooked assets. mipChain is already in dxgiFormat, tightly packed one level after the other.
+	Texture* createTextureFromMipChain(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, const void* mipChain, DXGI_FORMAT dxgiFormat);
+	// Cooked assets already laid out like GetCopyableFootprints (see getTextureFootprints). The data is copied
+	// straight into the staging ring, so it only has to stay valid for the duration of the call.
+	Texture* createTextureFromFootprints(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT dxgiFormat, const void* data, size_t dataSize);
+	// Creates the texture right away and uploads it in the background. Only sample it once its residency is
+	// TEXTURE_RESIDENCY_RESIDENT. data follows getTextureFootprints and must stay valid until then.
+	Texture* streamTexture(const wchar_t* name, uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT dxgiFormat, const void* data, size_t dataSize);
+	StreamingStats getStreamingStats();
 	void destroyTexture(Texture*& image);
-	uint64_t murmurHash(const void* key, uint64_t keyLength, uint64_t seed);
-	inline void* offsetPtr(void* Ptr, intptr_t Offset) { return (void*)((intptr_t)Ptr + Offset); }
-	inline void* alignPtr(void* Ptr, size_t Alignment) { return (void*)(((uintptr_t)(Ptr)+((uintptr_t)(Alignment)-1LL)) & ~((uintptr_t)(Alignment)-1LL)); }
-	inline size_t alignSize(size_t Value, size_t Alignment) { return ((Value)+((Alignment)-1LL)) & ~((Alignment)-1LL); }
-	size_t getFileSize(const char* path);
-	bool readFile(const char* path, void* outBuffer);
-	void* allocReadFile(const char* path);
+	size_t getMipChainSize(uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT format);
+	// Same layout rules as ID3D12Device::GetCopyableFootprints for 2D textures, without needing a device. Returns the total size.
+	uint64_t getTextureFootprints(uint32_t width, uint32_t height, uint32_t mipLevels, DXGI_FORMAT format, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* outLayouts, uint32_t* outNumRows, uint64_t* outRowSizeInBytes);
 }
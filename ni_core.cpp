@@ -0,0 +1,349 @@
+#include "ni_core.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <chrono>
+#include <emmintrin.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The parts of ni that don't need a device or a window: logging, time, random numbers, hashing, files and
+// mip math. Tools like AssetPacker link this without the renderer in ni.cpp, files go through POSIX calls
+// everywhere but Windows. DXGI format math is in ni_dxgi.cpp.
+
+#define NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE  4096
+#define NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT 4
+
+float ni::randomFloat() {
+    static std::random_device randDevice;
+    static std::mt19937 mtGen(randDevice());
+    static std::uniform_real_distribution<float> udt;
+    return udt(mtGen);
+}
+
+uint32_t ni::randomUint() {
+    static std::random_device randDevice;
+    static std::mt19937 mtGen(randDevice());
+    static std::uniform_int_distribution<unsigned int> udt;
+    return udt(mtGen);
+}
+
+double ni::getSeconds() {
+    double time = std::chrono::time_point_cast<std::chrono::duration<double>>(
+        std::chrono::high_resolution_clock::now())
+        .time_since_epoch()
+        .count();
+    return time;
+}
+
+uint32_t ni::getMipLevelCount(uint32_t width, uint32_t height) {
+    uint32_t size = width > height ? width : height;
+    uint32_t mipLevels = 1;
+    while (size > 1) {
+        size >>= 1;
+        mipLevels++;
+    }
+    return mipLevels;
+}
+
+size_t ni::getMipChainSizeRGBA8(uint32_t width, uint32_t height, uint32_t mipLevels) {
+    size_t size = 0;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        size += (size_t)width * height * 4;
+        width = width > 1 ? width >> 1 : 1;
+        height = height > 1 ? height >> 1 : 1;
+    }
+    return size;
+}
+
+static inline __m128 loadTexelRGBA8(const uint8_t* texel) {
+    __m128i value = _mm_cvtsi32_si128(*(const int32_t*)texel);
+    value = _mm_unpacklo_epi8(value, _mm_setzero_si128());
+    value = _mm_unpacklo_epi16(value, _mm_setzero_si128());
+    return _mm_cvtepi32_ps(value);
+}
+
+// 2x2 box filter weighted by alpha. Sprites use straight alpha, so averaging the color of
+// transparent texels in directly would darken the edges of every downscaled sprite.
+static void downsampleRGBA8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight) {
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 epsilon = _mm_set1_ps(1.0f / 255.0f);
+    for (uint32_t y = 0; y < dstHeight; ++y) {
+        // Odd sizes drop the last row/column, same as the reference D3D box filter.
+        const uint8_t* row0 = &src[(size_t)(y * 2 < srcHeight ? y * 2 : srcHeight - 1) * srcWidth * 4];
+        const uint8_t* row1 = &src[(size_t)(y * 2 + 1 < srcHeight ? y * 2 + 1 : srcHeight - 1) * srcWidth * 4];
+        for (uint32_t x = 0; x < dstWidth; ++x) {
+            uint32_t x0 = x * 2 < srcWidth ? x * 2 : srcWidth - 1;
+            uint32_t x1 = x * 2 + 1 < srcWidth ? x * 2 + 1 : srcWidth - 1;
+            __m128 t0 = loadTexelRGBA8(&row0[x0 * 4]);
+            __m128 t1 = loadTexelRGBA8(&row0[x1 * 4]);
+            __m128 t2 = loadTexelRGBA8(&row1[x0 * 4]);
+            __m128 t3 = loadTexelRGBA8(&row1[x1 * 4]);
+            __m128 a0 = _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 a1 = _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 a2 = _mm_shuffle_ps(t2, t2, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 a3 = _mm_shuffle_ps(t3, t3, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 alphaSum = _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3));
+            __m128 colorSum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0, a0), _mm_mul_ps(t1, a1)), _mm_add_ps(_mm_mul_ps(t2, a2), _mm_mul_ps(t3, a3)));
+            __m128 color = _mm_div_ps(colorSum, _mm_max_ps(alphaSum, epsilon));
+            __m128 alpha = _mm_mul_ps(alphaSum, quarter);
+            __m128 result = _mm_or_ps(_mm_andnot_ps(alphaMask, color), _mm_and_ps(alphaMask, alpha));
+            __m128i packed = _mm_cvtps_epi32(result);
+            packed = _mm_packs_epi32(packed, packed);
+            packed = _mm_packus_epi16(packed, packed);
+            *(int32_t*)&dst[((size_t)y * dstWidth + x) * 4] = _mm_cvtsi128_si32(packed);
+        }
+    }
+}
+
+void ni::generateMipChainRGBA8(const void* pixels, uint32_t width, uint32_t height, uint32_t mipLevels, void* outMipChain) {
+    uint8_t* dst = (uint8_t*)outMipChain;
+    memcpy(dst, pixels, (size_t)width * height * 4);
+    for (uint32_t mip = 1; mip < mipLevels; ++mip) {
+        const uint8_t* src = dst;
+        uint32_t srcWidth = width;
+        uint32_t srcHeight = height;
+        dst += (size_t)width * height * 4;
+        width = width > 1 ? width >> 1 : 1;
+        height = height > 1 ? height >> 1 : 1;
+        downsampleRGBA8(src, srcWidth, srcHeight, dst, width, height);
+    }
+}
+
+void ni::logFmt(const char* fmt, ...) {
+    static char bufferLarge[NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE * NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT] = {};
+    static uint32_t bufferIndex = 0;
+    va_list args;
+    va_start(args, fmt);
+    char* buffer = &bufferLarge[bufferIndex * NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE];
+    vsnprintf(buffer, NI_UTILS_WINDOWS_LOG_MAX_BUFFER_SIZE, fmt, args);
+    bufferIndex = (bufferIndex + 1) % NI_UTILS_WINDOWS_LOG_MAX_BUFFER_COUNT;
+    va_end(args);
+#ifdef _WIN32
+    OutputDebugStringA(buffer);
+#endif
+    printf("%s", buffer);
+}
+
+// Origin: https://github.com/niklas-ourmachinery/bitsquid-foundation/blob/master/murmur_hash.cpp
+uint64_t ni::murmurHash(const void* key, uint64_t keyLength, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const uint32_t r = 47;
+    uint64_t h = seed ^ (keyLength * m);
+    const uint64_t* data = (const uint64_t*)key;
+    const uint64_t* end = data + (keyLength / 8);
+    while (data != end) {
+        uint64_t k = *data++;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    const unsigned char* data2 = (const unsigned char*)data;
+    switch (keyLength & 7) {
+    case 7: h ^= uint64_t(data2[6]) << 48;
+    case 6: h ^= uint64_t(data2[5]) << 40;
+    case 5: h ^= uint64_t(data2[4]) << 32;
+    case 4: h ^= uint64_t(data2[3]) << 24;
+    case 3: h ^= uint64_t(data2[2]) << 16;
+    case 2: h ^= uint64_t(data2[1]) << 8;
+    case 1: h ^= uint64_t(data2[0]);
+        h *= m;
+    };
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+#ifdef _WIN32
+size_t ni::getFileSize(const char* path) {
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize = {};
+        bool success = GetFileSizeEx(fileHandle, &fileSize);
+        CloseHandle(fileHandle);
+        return success ? (size_t)fileSize.QuadPart : 0;
+    }
+    return 0;
+}
+
+bool ni::readFile(const char* path, void* outBuffer) {
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize = {};
+        GetFileSizeEx(fileHandle, &fileSize);
+        DWORD readBytes = 0;
+        if (!ReadFile(fileHandle, outBuffer, (DWORD)fileSize.QuadPart, &readBytes, nullptr)) {
+            CloseHandle(fileHandle);
+            return false;
+        }
+        CloseHandle(fileHandle);
+        return true;
+    }
+    return false;
+}
+
+void* ni::allocReadFile(const char* path) {
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER fileSize = {};
+        GetFileSizeEx(fileHandle, &fileSize);
+        void* buffer = malloc(fileSize.QuadPart);
+        DWORD readBytes = 0;
+        if (!ReadFile(fileHandle, buffer, (DWORD)fileSize.QuadPart, &readBytes, nullptr)) {
+            CloseHandle(fileHandle);
+            free(buffer);
+            return nullptr;
+        }
+        CloseHandle(fileHandle);
+        return buffer;
+    }
+    return nullptr;
+}
+
+bool ni::writeFile(const char* path, const void* data, size_t size) {
+    HANDLE fileHandle = CreateFileA(path, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        DWORD writtenBytes = 0;
+        bool success = WriteFile(fileHandle, data, (DWORD)size, &writtenBytes, nullptr) && writtenBytes == (DWORD)size;
+        CloseHandle(fileHandle);
+        return success;
+    }
+    return false;
+}
+
+ni::MappedFile::MappedFile(const char* path) {
+    HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE) return;
+    LARGE_INTEGER fileSize = {};
+    HANDLE mappingHandle = nullptr;
+    if (GetFileSizeEx(fileHandle, &fileSize) && fileSize.QuadPart > 0) {
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    if (mappingHandle != nullptr) {
+        view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        size = view != nullptr ? (size_t)fileSize.QuadPart : 0;
+        CloseHandle(mappingHandle);
+    }
+    CloseHandle(fileHandle);
+}
+
+ni::MappedFile::~MappedFile() {
+    if (view != nullptr) UnmapViewOfFile(view);
+}
+#else
+size_t ni::getFileSize(const char* path) {
+    struct stat fileStat = {};
+    return stat(path, &fileStat) == 0 ? (size_t)fileStat.st_size : 0;
+}
+
+// Loops because read and write may transfer less than asked for, large files in particular.
+static bool readAll(int file, void* outBuffer, size_t size) {
+    uint8_t* buffer = (uint8_t*)outBuffer;
+    while (size > 0) {
+        ssize_t readBytes = read(file, buffer, size);
+        if (readBytes <= 0) return false;
+        buffer += readBytes;
+        size -= (size_t)readBytes;
+    }
+    return true;
+}
+
+bool ni::readFile(const char* path, void* outBuffer) {
+    int file = open(path, O_RDONLY);
+    if (file < 0) return false;
+    struct stat fileStat = {};
+    bool success = fstat(file, &fileStat) == 0 && readAll(file, outBuffer, (size_t)fileStat.st_size);
+    close(file);
+    return success;
+}
+
+void* ni::allocReadFile(const char* path) {
+    int file = open(path, O_RDONLY);
+    if (file < 0) return nullptr;
+    struct stat fileStat = {};
+    void* buffer = nullptr;
+    if (fstat(file, &fileStat) == 0) {
+        buffer = malloc((size_t)fileStat.st_size);
+        if (!readAll(file, buffer, (size_t)fileStat.st_size)) {
+            free(buffer);
+            buffer = nullptr;
+        }
+    }
+    close(file);
+    return buffer;
+}
+
+bool ni::writeFile(const char* path, const void* data, size_t size) {
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) return false;
+    const uint8_t* bytes = (const uint8_t*)data;
+    bool success = true;
+    while (success && size > 0) {
+        ssize_t writtenBytes = write(file, bytes, size);
+        success = writtenBytes > 0;
+        bytes += success ? writtenBytes : 0;
+        size -= success ? (size_t)writtenBytes : 0;
+    }
+    return close(file) == 0 && success;
+}
+
+ni::MappedFile::MappedFile(const char* path) {
+    int file = open(path, O_RDONLY);
+    if (file < 0) return;
+    struct stat fileStat = {};
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0) {
+        void* mapping = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping != MAP_FAILED) {
+            view = mapping;
+            size = (size_t)fileStat.st_size;
+        }
+    }
+    close(file);
+}
+
+ni::MappedFile::~MappedFile() {
+    if (view != nullptr) munmap((void*)view, size);
+}
+#endif
+
+const void* ni::MappedFile::operator*() const {
+    return view;
+}
+
+size_t ni::MappedFile::getSize() const {
+    return size;
+}
+
+bool ni::MappedFile::isValid() const {
+    return view != nullptr;
+}
+
+ni::FileReader::FileReader(const char* path) {
+    size = getFileSize(path);
+    buffer = allocReadFile(path);
+}
+
+ni::FileReader::~FileReader() {
+    free(buffer);
+}
+
+void* ni::FileReader::operator*() const {
+    return buffer;
+}
+
+size_t ni::FileReader::getSize() const {
+    return size;
+}
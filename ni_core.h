@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+
+// The parts of ni that don't need D3D12 or Windows, see ni_core.cpp. ni.h includes this, modules that only
+// need logging, files, arrays and hashing include it directly so they also build on Linux, see CMakeLists.txt.
+
+#ifdef _WIN32
+#define NI_DEBUG_BREAK() __debugbreak()
+#else
+#define NI_DEBUG_BREAK() __builtin_trap()
+#endif
+#define NI_EXIT(code) { exit((int)(code)); }
+#define NI_LOG(fmt, ...) ni::logFmt(fmt "\n", ##__VA_ARGS__)
+#define NI_PANIC(fmt, ...) { ni::logFmt("PANIC: " fmt "\n", ##__VA_ARGS__); NI_DEBUG_BREAK(); NI_EXIT(~0); }
+#define NI_ASSERT(x, fmt, ...) if (!(x)) { ni::logFmt("ASSERT: " fmt "\n", ##__VA_ARGS__); NI_DEBUG_BREAK(); }
+#define NI_COLOR_UINT(color) (((color) & 0xff) << 24) | ((((color) >> 8) & 0xff) << 16) | ((((color) >> 16) & 0xff) << 8) | ((color) >> 24)
+#define NI_COLOR_RGBA_UINT(r, g, b, a) ((uint32_t)(r)) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | ((uint32_t)(a) << 24)
+#define NI_COLOR_RGB_UINT(r, g, b) NI_COLOR_RGBA_UINT(r, g, b, 0xff)
+#define NI_COLOR_RGBA_FLOAT(r, g, b, a) NI_COLOR_RGBA_UINT((uint8_t)((r) * 255.0f), (uint8_t)((g) * 255.0f), (uint8_t)((b) * 255.0f), (uint8_t)((a) * 255.0f))
+#define NI_COLOR_RGB_FLOAT(r, g, b) NI_COLOR_RGBA_FLOAT(r, g, b, 1.0f)
+
+namespace ni {
+
+	void logFmt(const char* fmt, ...);
+
+	struct FileReader {
+		FileReader(const char* path);
+		~FileReader();
+		void* operator*() const;
+		size_t getSize() const;
+	private:
+		void* buffer = nullptr;
+		size_t size = 0;
+	};
+
+	// Read only view of a whole file. Stays valid until the MappedFile is destroyed.
+	struct MappedFile {
+		MappedFile(const char* path);
+		~MappedFile();
+		const void* operator*() const;
+		size_t getSize() const;
+		bool isValid() const;
+	private:
+		// The view keeps the file open, the handles are closed once it's mapped.
+		const void* view = nullptr;
+		size_t size = 0;
+	};
+
+	template<typename T, typename TSize = uint64_t>
+	struct Array {
+		Array() : data(nullptr), num(0), capacity(0) {}
+
+		void reset() {
+			num = 0;
+		}
+
+		void add(const T& element) {
+			checkResize();
+			data[num++] = element;
+		}
+
+		void remove(TSize index) {
+			NI_ASSERT(index < num, "Index out of bounds");
+			for (TSize start = index; start < num - 1; ++start) {
+				data[start] = data[start + 1];
+			}
+			num--;
+		}
+
+		void resize(TSize newCapacity) {
+			T* newData = (T*)realloc(data, newCapacity * sizeof(T));
+			NI_ASSERT(newData != nullptr, "Failed to reallocate array");
+			data = newData;
+			capacity = newCapacity;
+		}
+
+		void destroy() {
+			free(data);
+			data = nullptr;
+			num = 0;
+			capacity = 0;
+		}
+
+		void checkResize() {
+			if (num + 1 >= capacity) {
+				resize(capacity > 0 ? capacity * 2 : 16);
+			}
+		}
+
+		T* getData() { return data; }
+		const T* getData() const { return data; }
+
+		TSize getNum() const { return num; }
+		TSize getCapacity() const { return capacity;  }
+
+	private:
+		T* data;
+		TSize num;
+		TSize capacity;
+	};
+
+	float randomFloat();
+	uint32_t randomUint();
+	double getSeconds();
+	uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+	// Tightly packed 8 bit RGBA levels, the layout generateMipChainRGBA8 writes.
+	size_t getMipChainSizeRGBA8(uint32_t width, uint32_t height, uint32_t mipLevels);
+	void generateMipChainRGBA8(const void* pixels, uint32_t width, uint32_t height, uint32_t mipLevels, void* outMipChain);
+	uint64_t murmurHash(const void* key, uint64_t keyLength, uint64_t seed);
+	inline void* offsetPtr(void* Ptr, intptr_t Offset) { return (void*)((intptr_t)Ptr + Offset); }
+	inline void* alignPtr(void* Ptr, size_t Alignment) { return (void*)(((uintptr_t)(Ptr)+((uintptr_t)(Alignment)-1LL)) & ~((uintptr_t)(Alignment)-1LL)); }
+	inline size_t alignSize(size_t Value, size_t Alignment) { return ((Value)+((Alignment)-1LL)) & ~((Alignment)-1LL); }
+	size_t getFileSize(const char* path);
+	bool readFile(const char* path, void* outBuffer);
+	void* allocReadFile(const char* path);
+	bool writeFile(const char* path, const void* data, size_t size);
+}
@@ -0,0 +1,305 @@
+#include "pipeline_blob_store.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_PIPELINE_CACHE_BLOB_ALIGNMENT 16
+#define NI_PIPELINE_CACHE_VALIDATION_ENTRIES 64
+
+// Chains murmurHash over the parts of a description. Lengths go in before contents so moving bytes from one
+// part to the next changes the key.
+struct PipelineHasher {
+    void add(const void* data, size_t size) { hash = ni::murmurHash(data, size, hash); }
+    template<typename T> void addValue(T value) { add(&value, sizeof(T)); }
+
+    void addString(const char* string) {
+        if (string == nullptr) {
+            addValue<uint32_t>(~0u);
+        } else {
+            add(string, strlen(string) + 1);
+        }
+    }
+
+    void addBytes(const void* data, uint64_t size) {
+        addValue<uint64_t>(size);
+        if (size > 0) add(data, (size_t)size);
+    }
+
+    uint64_t hash;
+};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t ni::hashPipelineDescription(const PipelineDescription& desc) {
+    // Seeded differently so a compute pipeline never matches a graphics one.
+    PipelineHasher hasher = { desc.kind == PIPELINE_KIND_COMPUTE ? ~(uint64_t)NI_PIPELINE_CACHE_VERSION : NI_PIPELINE_CACHE_VERSION };
+    hasher.addValue(desc.rootSignatureHash);
+    for (uint32_t stage = 0; stage < NI_PIPELINE_SHADER_STAGE_COUNT; ++stage) {
+        hasher.addBytes(desc.shaders[stage].data, desc.shaders[stage].size);
+    }
+    hasher.addValue(desc.nameNum);
+    for (uint32_t index = 0; index < desc.nameNum; ++index) {
+        hasher.addString(desc.names[index]);
+    }
+    hasher.addBytes(desc.state, desc.stateSize);
+    // The library reserves NI_PIPELINE_LIBRARY_KEY.
+    return hasher.hash != NI_PIPELINE_LIBRARY_KEY ? hasher.hash : 1;
+}
+
+void ni::PipelineBlobStore::init(uint64_t storeDeviceHash) {
+    entries.reset();
+    deviceHash = storeDeviceHash;
+}
+
+void ni::PipelineBlobStore::destroy() {
+    for (uint32_t index = 0; index < entries.getNum(); ++index) {
+        free(entries.getData()[index].data);
+    }
+    entries.destroy();
+}
+
+bool ni::PipelineBlobStore::load(const void* data, size_t size) {
+    NI_ASSERT(entries.getNum() == 0, "Pipeline blob store loaded twice");
+    if (size < sizeof(PipelineCacheHeader)) return false;
+    const PipelineCacheHeader* header = (const PipelineCacheHeader*)data;
+    if (header->magic != NI_PIPELINE_CACHE_MAGIC || header->version != NI_PIPELINE_CACHE_VERSION) return false;
+    if (header->deviceHash != deviceHash || header->fileSize != size) return false;
+    if (sizeof(PipelineCacheHeader) + (uint64_t)header->entryNum * sizeof(PipelineCacheEntry) > size) return false;
+
+    // Check everything first so a bad file leaves the store empty.
+    const PipelineCacheEntry* fileEntries = (const PipelineCacheEntry*)(header + 1);
+    for (uint32_t index = 0; index < header->entryNum; ++index) {
+        const PipelineCacheEntry& entry = fileEntries[index];
+        if (entry.dataOffset > size || entry.dataSize > size - entry.dataOffset) return false;
+        if (murmurHash((const uint8_t*)data + entry.dataOffset, entry.dataSize, entry.key) != entry.dataHash) return false;
+    }
+    for (uint32_t index = 0; index < header->entryNum; ++index) {
+        const PipelineCacheEntry& entry = fileEntries[index];
+        store(entry.key, (const uint8_t*)data + entry.dataOffset, entry.dataSize);
+    }
+    return true;
+}
+
+size_t ni::PipelineBlobStore::getSerializedSize() const {
+    uint64_t size = sizeof(PipelineCacheHeader) + entries.getNum() * sizeof(PipelineCacheEntry);
+    for (uint32_t index = 0; index < entries.getNum(); ++index) {
+        size = alignUp(size, NI_PIPELINE_CACHE_BLOB_ALIGNMENT) + entries.getData()[index].size;
+    }
+    return (size_t)size;
+}
+
+void ni::PipelineBlobStore::serialize(void* outData) const {
+    size_t size = getSerializedSize();
+    memset(outData, 0, size);
+    PipelineCacheHeader* header = (PipelineCacheHeader*)outData;
+    header->magic = NI_PIPELINE_CACHE_MAGIC;
+    header->version = NI_PIPELINE_CACHE_VERSION;
+    header->entryNum = entries.getNum();
+    header->deviceHash = deviceHash;
+    header->fileSize = size;
+    PipelineCacheEntry* fileEntries = (PipelineCacheEntry*)(header + 1);
+    uint64_t offset = sizeof(PipelineCacheHeader) + entries.getNum() * sizeof(PipelineCacheEntry);
+    for (uint32_t index = 0; index < entries.getNum(); ++index) {
+        const Entry& entry = entries.getData()[index];
+        offset = alignUp(offset, NI_PIPELINE_CACHE_BLOB_ALIGNMENT);
+        memcpy((uint8_t*)outData + offset, entry.data, entry.size);
+        fileEntries[index] = { entry.key, offset, entry.size, murmurHash(entry.data, entry.size, entry.key) };
+        offset += entry.size;
+    }
+}
+
+const void* ni::PipelineBlobStore::find(uint64_t key, size_t& outSize) const {
+    for (uint32_t index = 0; index < entries.getNum(); ++index) {
+        const Entry& entry = entries.getData()[index];
+        if (entry.key == key) {
+            outSize = entry.size;
+            return entry.data;
+        }
+    }
+    outSize = 0;
+    return nullptr;
+}
+
+void ni::PipelineBlobStore::store(uint64_t key, const void* data, size_t size) {
+    void* copy = malloc(size > 0 ? size : 1);
+    memcpy(copy, data, size);
+    for (uint32_t index = 0; index < entries.getNum(); ++index) {
+        Entry& entry = entries.getData()[index];
+        if (entry.key == key) {
+            free(entry.data);
+            entry.data = copy;
+            entry.size = size;
+            return;
+        }
+    }
+    entries.add({ key, copy, size });
+}
+
+// Vertex and pixel shader, two semantic names and a few bytes of fixed function state, roughly what
+// pipeline_cache.cpp makes of SpriteRenderer's pipeline.
+struct ValidationDescription {
+    uint8_t vertexShader[256];
+    uint8_t pixelShader[256];
+    char positionName[16];
+    char texcoordName[16];
+    const char* names[2];
+    uint8_t state[64];
+    ni::PipelineDescription desc;
+};
+
+static void fillValidationDescription(ValidationDescription& validation) {
+    for (uint32_t index = 0; index < sizeof(validation.vertexShader); ++index) {
+        validation.vertexShader[index] = (uint8_t)(index * 7);
+        validation.pixelShader[index] = (uint8_t)(index * 13);
+    }
+    strcpy(validation.positionName, "POSITION");
+    strcpy(validation.texcoordName, "TEXCOORD");
+    validation.names[0] = validation.positionName;
+    validation.names[1] = validation.texcoordName;
+    for (uint32_t index = 0; index < sizeof(validation.state); ++index) {
+        validation.state[index] = (uint8_t)(index * 5 + 1);
+    }
+    ni::PipelineDescription& desc = validation.desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.kind = ni::PIPELINE_KIND_GRAPHICS;
+    desc.rootSignatureHash = 0x1234;
+    desc.shaders[0] = { validation.vertexShader, sizeof(validation.vertexShader) };
+    desc.shaders[1] = { validation.pixelShader, sizeof(validation.pixelShader) };
+    desc.names = validation.names;
+    desc.nameNum = 2;
+    desc.state = validation.state;
+    desc.stateSize = sizeof(validation.state);
+}
+
+uint32_t ni::validatePipelineBlobStore() {
+    uint32_t errorNum = 0;
+    // Same contents at other addresses must give the same key.
+    ValidationDescription* validation = (ValidationDescription*)malloc(sizeof(ValidationDescription));
+    ValidationDescription* copy = (ValidationDescription*)malloc(sizeof(ValidationDescription));
+    fillValidationDescription(*validation);
+    fillValidationDescription(*copy);
+    uint64_t key = hashPipelineDescription(validation->desc);
+    if (hashPipelineDescription(copy->desc) != key) {
+        NI_LOG(" ERROR: equal descriptions at other addresses hash differently");
+        errorNum++;
+    }
+    if (key == NI_PIPELINE_LIBRARY_KEY) {
+        NI_LOG(" ERROR: a description got the library key");
+        errorNum++;
+    }
+
+    // Every change that produces another pipeline has to produce another key.
+    struct Mutation {
+        const char* name;
+        void(*apply)(ValidationDescription& validation);
+    };
+    static const Mutation mutations[] = {
+        { "pixel shader byte", [](ValidationDescription& validation) { validation.pixelShader[100] ^= 1; } },
+        { "pixel shader length", [](ValidationDescription& validation) { validation.desc.shaders[1].size--; } },
+        { "shader stage", [](ValidationDescription& validation) { validation.desc.shaders[2] = validation.desc.shaders[1]; validation.desc.shaders[1] = {}; } },
+        { "state byte", [](ValidationDescription& validation) { validation.state[40] ^= 1; } },
+        { "state length", [](ValidationDescription& validation) { validation.desc.stateSize--; } },
+        { "semantic name", [](ValidationDescription& validation) { strcpy(validation.texcoordName, "COLOR"); } },
+        { "null semantic name", [](ValidationDescription& validation) { validation.texcoordName[0] = 0; validation.names[1] = nullptr; } },
+        { "semantic name count", [](ValidationDescription& validation) { validation.desc.nameNum--; } },
+        { "root signature", [](ValidationDescription& validation) { validation.desc.rootSignatureHash++; } },
+        { "pipeline kind", [](ValidationDescription& validation) { validation.desc.kind = PIPELINE_KIND_COMPUTE; } },
+    };
+    const uint32_t mutationNum = sizeof(mutations) / sizeof(mutations[0]);
+    for (uint32_t index = 0; index < mutationNum; ++index) {
+        fillValidationDescription(*copy);
+        mutations[index].apply(*copy);
+        if (hashPipelineDescription(copy->desc) == key) {
+            NI_LOG(" ERROR: changing the %s keeps the key", mutations[index].name);
+            errorNum++;
+        }
+    }
+    // An empty name has to stay apart from a missing one.
+    fillValidationDescription(*copy);
+    copy->texcoordName[0] = 0;
+    uint64_t emptyNameKey = hashPipelineDescription(copy->desc);
+    copy->names[1] = nullptr;
+    if (hashPipelineDescription(copy->desc) == emptyNameKey) {
+        NI_LOG(" ERROR: null and empty semantic names hash the same");
+        errorNum++;
+    }
+    free(copy);
+    free(validation);
+
+    // File format round trip.
+    const uint64_t deviceHash = 0xfeedull;
+    PipelineBlobStore store;
+    store.init(deviceHash);
+    for (uint32_t index = 0; index < NI_PIPELINE_CACHE_VALIDATION_ENTRIES; ++index) {
+        uint8_t blob[1024];
+        size_t blobSize = (randomUint() % sizeof(blob)) + 1;
+        for (size_t byte = 0; byte < blobSize; ++byte) blob[byte] = (uint8_t)(index + byte * 31);
+        store.store(index == 0 ? NI_PIPELINE_LIBRARY_KEY : (uint64_t)randomUint() << 32 | index, blob, blobSize);
+    }
+    uint8_t replacement[3] = { 1, 2, 3 };
+    store.store(NI_PIPELINE_LIBRARY_KEY, replacement, sizeof(replacement));
+    size_t fileSize = store.getSerializedSize();
+    uint8_t* file = (uint8_t*)malloc(fileSize);
+    store.serialize(file);
+
+    PipelineBlobStore loaded;
+    loaded.init(deviceHash);
+    if (!loaded.load(file, fileSize) || loaded.getEntryNum() != store.getEntryNum()) {
+        NI_LOG(" ERROR: serialized store doesn't load back");
+        errorNum++;
+    }
+    const PipelineCacheEntry* fileEntries = (const PipelineCacheEntry*)(file + sizeof(PipelineCacheHeader));
+    for (uint32_t index = 0; index < store.getEntryNum(); ++index) {
+        size_t expectedSize = 0;
+        size_t loadedSize = 0;
+        const void* expected = store.find(fileEntries[index].key, expectedSize);
+        const void* actual = loaded.find(fileEntries[index].key, loadedSize);
+        if (actual == nullptr || loadedSize != expectedSize || memcmp(expected, actual, expectedSize) != 0) {
+            NI_LOG(" ERROR: blob %u differs after loading", index);
+            errorNum++;
+        }
+    }
+    size_t librarySize = 0;
+    loaded.find(NI_PIPELINE_LIBRARY_KEY, librarySize);
+    if (librarySize != sizeof(replacement)) {
+        NI_LOG(" ERROR: replaced blob wasn't replaced");
+        errorNum++;
+    }
+    loaded.destroy();
+
+    // Anything that isn't exactly what this build on this device wrote is dropped.
+    struct Rejection {
+        const char* name;
+        uint64_t deviceHash;
+        size_t size;
+        size_t corruptOffset;
+    };
+    const Rejection rejections[] = {
+        { "other device", deviceHash + 1, fileSize, 0 },
+        { "truncated file", deviceHash, fileSize - 1, 0 },
+        { "corrupt blob", deviceHash, fileSize, fileSize - 1 },
+        { "other version", deviceHash, fileSize, offsetof(PipelineCacheHeader, version) },
+        { "empty file", deviceHash, 0, 0 },
+    };
+    const uint32_t rejectionNum = sizeof(rejections) / sizeof(rejections[0]);
+    for (uint32_t index = 0; index < rejectionNum; ++index) {
+        const Rejection& rejection = rejections[index];
+        if (rejection.corruptOffset != 0) file[rejection.corruptOffset] ^= 0x5a;
+        PipelineBlobStore rejected;
+        rejected.init(rejection.deviceHash);
+        if (rejected.load(file, rejection.size) || rejected.getEntryNum() != 0) {
+            NI_LOG(" ERROR: loaded a cache with %s", rejection.name);
+            errorNum++;
+        }
+        rejected.destroy();
+        if (rejection.corruptOffset != 0) file[rejection.corruptOffset] ^= 0x5a;
+    }
+    free(file);
+    store.destroy();
+
+    NI_LOG("Pipeline blob store: %u key checks, %u file checks, %zu byte file for %u blobs, %u error(s)",
+        mutationNum + 3, rejectionNum + 2, fileSize, NI_PIPELINE_CACHE_VALIDATION_ENTRIES, errorNum);
+    return errorNum;
+}
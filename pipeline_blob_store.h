@@ -0,0 +1,89 @@
+#pragma once
+
+#include "ni_core.h"
+
+// Pipeline cache file. Layout:
+//   PipelineCacheHeader
+//   PipelineCacheEntry[entryNum]
+//   blobs, each aligned to 16 bytes
+// The whole file is dropped when the version or the device it was written on changes.
+#define NI_PIPELINE_CACHE_MAGIC 0x4350494e // 'NIPC'
+#define NI_PIPELINE_CACHE_VERSION 2
+// Entry holding the serialized ID3D12PipelineLibrary. The other keys are pipeline description hashes.
+#define NI_PIPELINE_LIBRARY_KEY 0ull
+#define NI_PIPELINE_SHADER_STAGE_COUNT 5
+
+namespace ni {
+
+	struct PipelineCacheHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryNum;
+		uint32_t reserved;
+		uint64_t deviceHash;
+		uint64_t fileSize;
+	};
+
+	struct PipelineCacheEntry {
+		uint64_t key;
+		uint64_t dataOffset;
+		uint64_t dataSize;
+		uint64_t dataHash;
+	};
+
+	enum PipelineKind : uint32_t {
+		PIPELINE_KIND_GRAPHICS,
+		PIPELINE_KIND_COMPUTE
+	};
+
+	struct PipelineShaderBytes {
+		const void* data;
+		uint64_t size;
+	};
+
+	// Everything that changes the compiled pipeline, with the pointers of the API description followed to their
+	// contents. pipeline_cache.cpp fills it from the D3D12 descs: the shaders in stage order, the semantic names
+	// in names, and every other field appended to state one at a time so padding never reaches the key. The
+	// root signature is identified by the hash of its serialized form.
+	struct PipelineDescription {
+		PipelineKind kind;
+		uint64_t rootSignatureHash;
+		PipelineShaderBytes shaders[NI_PIPELINE_SHADER_STAGE_COUNT];
+		// Null names are allowed and hash differently from empty ones.
+		const char* const* names;
+		uint32_t nameNum;
+		const void* state;
+		uint64_t stateSize;
+	};
+
+	// Never returns NI_PIPELINE_LIBRARY_KEY.
+	uint64_t hashPipelineDescription(const PipelineDescription& desc);
+
+	// Key to blob map that reads and writes the cache file format. Cached blobs only work on the device and
+	// driver that produced them, deviceHash stands for both.
+	struct PipelineBlobStore {
+		void init(uint64_t storeDeviceHash);
+		void destroy();
+		// Returns false and stays empty when the data is corrupt or from another version or device.
+		bool load(const void* data, size_t size);
+		size_t getSerializedSize() const;
+		void serialize(void* outData) const;
+		const void* find(uint64_t key, size_t& outSize) const;
+		// Replaces the blob if the key is already there.
+		void store(uint64_t key, const void* data, size_t size);
+		uint32_t getEntryNum() const { return entries.getNum(); }
+
+	private:
+		struct Entry {
+			uint64_t key;
+			void* data;
+			size_t size;
+		};
+
+		Array<Entry, uint32_t> entries;
+		uint64_t deviceHash;
+	};
+
+	// Checks the description keying and the file format, needs neither a device nor D3D12.
+	uint32_t validatePipelineBlobStore();
+}
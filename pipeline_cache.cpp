@@ -0,0 +1,523 @@
+#include "pipeline_cache.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mutex>
+
+struct RootSignatureHash {
+    ID3D12RootSignature* rootSignature;
+    uint64_t hash;
+};
+
+static ni::Array<RootSignatureHash, uint32_t> rootSignatureHashes;
+static ni::PipelineBlobStore pipelineStore;
+static ID3D12PipelineLibrary* pipelineLibrary = nullptr;
+static const char* pipelineCachePath = nullptr;
+static ni::PipelineCacheStats pipelineStats = {};
+static bool pipelineCacheDirty = false;
+// Pipelines are created from the loader threads. The lock only covers the bookkeeping, the drivers compile in
+// parallel and the pipeline library synchronizes itself.
+static std::mutex pipelineCacheMutex;
+
+// Flattens a D3D12 desc into a PipelineDescription. Structs with padding are added field by field so garbage in
+// the padding doesn't change the key.
+struct PipelineDescriptionWriter {
+    PipelineDescriptionWriter(ni::PipelineKind kind, uint64_t rootSignatureHash) : desc{}, shaderNum(0) {
+        desc.kind = kind;
+        desc.rootSignatureHash = rootSignatureHash;
+    }
+
+    void add(const void* data, size_t size) {
+        for (size_t byte = 0; byte < size; ++byte) state.add(((const uint8_t*)data)[byte]);
+    }
+    template<typename T> void addValue(T value) { add(&value, sizeof(T)); }
+    void addString(const char* string) { names.add(string); }
+
+    void addBytecode(const D3D12_SHADER_BYTECODE& bytecode) {
+        NI_ASSERT(shaderNum < NI_PIPELINE_SHADER_STAGE_COUNT, "Too many shader stages");
+        desc.shaders[shaderNum++] = { bytecode.pShaderBytecode, bytecode.BytecodeLength };
+    }
+
+    uint64_t hash() {
+        desc.names = names.getData();
+        desc.nameNum = names.getNum();
+        desc.state = state.getData();
+        desc.stateSize = state.getNum();
+        uint64_t key = ni::hashPipelineDescription(desc);
+        names.destroy();
+        state.destroy();
+        return key;
+    }
+
+    ni::PipelineDescription desc;
+    ni::Array<const char*, uint32_t> names;
+    ni::Array<uint8_t, uint32_t> state;
+    uint32_t shaderNum;
+};
+
+uint64_t ni::hashGraphicsPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash) {
+    PipelineDescriptionWriter writer(PIPELINE_KIND_GRAPHICS, rootSignatureHash);
+    writer.addBytecode(desc.VS);
+    writer.addBytecode(desc.PS);
+    writer.addBytecode(desc.DS);
+    writer.addBytecode(desc.HS);
+    writer.addBytecode(desc.GS);
+
+    writer.addValue(desc.StreamOutput.NumEntries);
+    for (uint32_t index = 0; index < desc.StreamOutput.NumEntries; ++index) {
+        const D3D12_SO_DECLARATION_ENTRY& entry = desc.StreamOutput.pSODeclaration[index];
+        writer.addValue(entry.Stream);
+        writer.addString(entry.SemanticName);
+        writer.addValue(entry.SemanticIndex);
+        writer.addValue(entry.StartComponent);
+        writer.addValue(entry.ComponentCount);
+        writer.addValue(entry.OutputSlot);
+    }
+    writer.addValue(desc.StreamOutput.NumStrides);
+    if (desc.StreamOutput.NumStrides > 0) writer.add(desc.StreamOutput.pBufferStrides, desc.StreamOutput.NumStrides * sizeof(UINT));
+    writer.addValue(desc.StreamOutput.RasterizedStream);
+
+    writer.addValue(desc.BlendState.AlphaToCoverageEnable);
+    writer.addValue(desc.BlendState.IndependentBlendEnable);
+    for (uint32_t index = 0; index < 8; ++index) {
+        const D3D12_RENDER_TARGET_BLEND_DESC& blend = desc.BlendState.RenderTarget[index];
+        writer.addValue(blend.BlendEnable);
+        writer.addValue(blend.LogicOpEnable);
+        writer.addValue(blend.SrcBlend);
+        writer.addValue(blend.DestBlend);
+        writer.addValue(blend.BlendOp);
+        writer.addValue(blend.SrcBlendAlpha);
+        writer.addValue(blend.DestBlendAlpha);
+        writer.addValue(blend.BlendOpAlpha);
+        writer.addValue(blend.LogicOp);
+        writer.addValue(blend.RenderTargetWriteMask);
+    }
+    writer.addValue(desc.SampleMask);
+    // Only 4 byte members, no padding.
+    writer.add(&desc.RasterizerState, sizeof(desc.RasterizerState));
+
+    writer.addValue(desc.DepthStencilState.DepthEnable);
+    writer.addValue(desc.DepthStencilState.DepthWriteMask);
+    writer.addValue(desc.DepthStencilState.DepthFunc);
+    writer.addValue(desc.DepthStencilState.StencilEnable);
+    writer.addValue(desc.DepthStencilState.StencilReadMask);
+    writer.addValue(desc.DepthStencilState.StencilWriteMask);
+    writer.add(&desc.DepthStencilState.FrontFace, sizeof(desc.DepthStencilState.FrontFace));
+    writer.add(&desc.DepthStencilState.BackFace, sizeof(desc.DepthStencilState.BackFace));
+
+    writer.addValue(desc.InputLayout.NumElements);
+    for (uint32_t index = 0; index < desc.InputLayout.NumElements; ++index) {
+        const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[index];
+        writer.addString(element.SemanticName);
+        writer.addValue(element.SemanticIndex);
+        writer.addValue(element.Format);
+        writer.addValue(element.InputSlot);
+        writer.addValue(element.AlignedByteOffset);
+        writer.addValue(element.InputSlotClass);
+        writer.addValue(element.InstanceDataStepRate);
+    }
+    writer.addValue(desc.IBStripCutValue);
+    writer.addValue(desc.PrimitiveTopologyType);
+    writer.addValue(desc.NumRenderTargets);
+    writer.add(desc.RTVFormats, sizeof(desc.RTVFormats));
+    writer.addValue(desc.DSVFormat);
+    writer.add(&desc.SampleDesc, sizeof(desc.SampleDesc));
+    writer.addValue(desc.NodeMask);
+    writer.addValue(desc.Flags);
+    return writer.hash();
+}
+
+uint64_t ni::hashComputePipelineDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash) {
+    PipelineDescriptionWriter writer(PIPELINE_KIND_COMPUTE, rootSignatureHash);
+    writer.addBytecode(desc.CS);
+    writer.addValue(desc.NodeMask);
+    writer.addValue(desc.Flags);
+    return writer.hash();
+}
+
+void ni::registerRootSignature(ID3D12RootSignature* rootSignature, const void* data, size_t size) {
+    uint64_t hash = murmurHash(data, size, 0);
+    std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+    for (uint32_t index = 0; index < rootSignatureHashes.getNum(); ++index) {
+        if (rootSignatureHashes.getData()[index].rootSignature == rootSignature) {
+            rootSignatureHashes.getData()[index].hash = hash;
+            return;
+        }
+    }
+    rootSignatureHashes.add({ rootSignature, hash });
+}
+
+static uint64_t findRootSignatureHash(ID3D12RootSignature* rootSignature) {
+    std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+    for (uint32_t index = 0; index < rootSignatureHashes.getNum(); ++index) {
+        if (rootSignatureHashes.getData()[index].rootSignature == rootSignature) return rootSignatureHashes.getData()[index].hash;
+    }
+    // Unknown root signatures all share a key, the library still rejects a pipeline whose root signature changed.
+    return 0;
+}
+
+void ni::initPipelineCache(const char* path, uint64_t deviceHash) {
+    pipelineStore.init(deviceHash);
+    pipelineCachePath = path;
+    pipelineStats = {};
+    pipelineCacheDirty = false;
+    size_t fileSize = getFileSize(path);
+    if (fileSize > 0) {
+        void* data = allocReadFile(path);
+        if (data != nullptr && !pipelineStore.load(data, fileSize)) {
+            NI_LOG("Pipeline cache %s is from another version or device, starting over", path);
+        }
+        free(data);
+    }
+
+    ID3D12Device1* device1 = nullptr;
+    if (getDevice()->QueryInterface(IID_PPV_ARGS(&device1)) == S_OK) {
+        // The library keeps pointing into the blob, the store holds on to it until destroyPipelineCache.
+        size_t librarySize = 0;
+        const void* libraryData = pipelineStore.find(NI_PIPELINE_LIBRARY_KEY, librarySize);
+        HRESULT result = device1->CreatePipelineLibrary(libraryData, librarySize, IID_PPV_ARGS(&pipelineLibrary));
+        if (result != S_OK && libraryData != nullptr) {
+            // Written by an older driver, rebuild it.
+            pipelineCacheDirty = true;
+            result = device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&pipelineLibrary));
+        }
+        if (result != S_OK) pipelineLibrary = nullptr;
+        device1->Release();
+    }
+    pipelineStats.usesLibrary = pipelineLibrary != nullptr;
+}
+
+void ni::destroyPipelineCache() {
+    if (pipelineLibrary != nullptr) {
+        if (pipelineCacheDirty) {
+            size_t size = pipelineLibrary->GetSerializedSize();
+            void* data = malloc(size);
+            bool serialized = pipelineLibrary->Serialize(data, size) == S_OK;
+            NI_D3D_RELEASE(pipelineLibrary);
+            if (serialized) pipelineStore.store(NI_PIPELINE_LIBRARY_KEY, data, size);
+            free(data);
+        }
+        NI_D3D_RELEASE(pipelineLibrary);
+    }
+    if (pipelineCacheDirty) {
+        size_t size = pipelineStore.getSerializedSize();
+        void* data = malloc(size);
+        pipelineStore.serialize(data);
+        if (!writeFile(pipelineCachePath, data, size)) {
+            NI_LOG("Failed to write pipeline cache %s", pipelineCachePath);
+        }
+        free(data);
+    }
+    NI_LOG("Pipelines: %u loaded from cache, %u created, %.2f ms%s", pipelineStats.loadedNum, pipelineStats.createdNum,
+        pipelineStats.createSeconds * 1000.0, pipelineStats.usesLibrary ? " (pipeline library)" : "");
+    pipelineStore.destroy();
+    rootSignatureHashes.destroy();
+    pipelineCacheDirty = false;
+}
+
+static void writePipelineName(uint64_t key, wchar_t* outName) {
+    for (uint32_t digit = 0; digit < 16; ++digit) {
+        outName[digit] = L"0123456789abcdef"[(key >> ((15 - digit) * 4)) & 0xf];
+    }
+    outName[16] = 0;
+}
+
+static void storeCachedBlob(uint64_t key, ID3D12PipelineState* pso) {
+    ID3DBlob* blob = nullptr;
+    if (pso->GetCachedBlob(&blob) == S_OK) {
+        std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+        pipelineStore.store(key, blob->GetBufferPointer(), blob->GetBufferSize());
+        blob->Release();
+    }
+}
+
+static void countPipeline(bool created, double seconds) {
+    std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+    if (created) {
+        pipelineStats.createdNum++;
+        pipelineCacheDirty = true;
+    } else {
+        pipelineStats.loadedNum++;
+    }
+    pipelineStats.createSeconds += seconds;
+}
+
+// Library hit, cached blob hit, or created from scratch and added to whichever cache is in use.
+template<typename Desc>
+static ID3D12PipelineState* loadPipelineState(const Desc& desc, uint64_t key,
+    HRESULT(*create)(const Desc& desc, ID3D12PipelineState** outPso),
+    HRESULT(*loadFromLibrary)(const wchar_t* name, const Desc& desc, ID3D12PipelineState** outPso)) {
+    double startTime = ni::getSeconds();
+    ID3D12PipelineState* pso = nullptr;
+    bool created = false;
+    if (pipelineLibrary != nullptr) {
+        wchar_t name[17];
+        writePipelineName(key, name);
+        if (loadFromLibrary(name, desc, &pso) != S_OK) {
+            pso = nullptr;
+            NI_D3D_ASSERT(create(desc, &pso), "Failed to create pipeline state");
+            // Only fails when the name is taken by a pipeline with another root signature, it stays uncached then.
+            pipelineLibrary->StorePipeline(name, pso);
+            created = true;
+        }
+    } else {
+        // Copied out, another thread creating the same pipeline may replace the blob meanwhile.
+        void* blob = nullptr;
+        size_t blobSize = 0;
+        {
+            std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+            const void* storedBlob = pipelineStore.find(key, blobSize);
+            if (storedBlob != nullptr) {
+                blob = malloc(blobSize);
+                memcpy(blob, storedBlob, blobSize);
+            }
+        }
+        if (blob != nullptr) {
+            Desc cachedDesc = desc;
+            cachedDesc.CachedPSO = { blob, blobSize };
+            // A driver update makes the blob useless, it's replaced below.
+            if (create(cachedDesc, &pso) != S_OK) pso = nullptr;
+            free(blob);
+        }
+        if (pso == nullptr) {
+            NI_D3D_ASSERT(create(desc, &pso), "Failed to create pipeline state");
+            storeCachedBlob(key, pso);
+            created = true;
+        }
+    }
+    countPipeline(created, ni::getSeconds() - startTime);
+    return pso;
+}
+
+static HRESULT createGraphicsPipeline(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ID3D12PipelineState** outPso) {
+    return ni::getDevice()->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(outPso));
+}
+
+static HRESULT loadGraphicsPipelineFromLibrary(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, ID3D12PipelineState** outPso) {
+    return pipelineLibrary->LoadGraphicsPipeline(name, &desc, IID_PPV_ARGS(outPso));
+}
+
+static HRESULT createComputePipeline(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, ID3D12PipelineState** outPso) {
+    return ni::getDevice()->CreateComputePipelineState(&desc, IID_PPV_ARGS(outPso));
+}
+
+static HRESULT loadComputePipelineFromLibrary(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, ID3D12PipelineState** outPso) {
+    return pipelineLibrary->LoadComputePipeline(name, &desc, IID_PPV_ARGS(outPso));
+}
+
+ID3D12PipelineState* ni::loadGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+    uint64_t key = hashGraphicsPipelineDesc(desc, findRootSignatureHash(desc.pRootSignature));
+    return loadPipelineState(desc, key, createGraphicsPipeline, loadGraphicsPipelineFromLibrary);
+}
+
+ID3D12PipelineState* ni::loadComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc) {
+    uint64_t key = hashComputePipelineDesc(desc, findRootSignatureHash(desc.pRootSignature));
+    return loadPipelineState(desc, key, createComputePipeline, loadComputePipelineFromLibrary);
+}
+
+ni::PipelineCacheStats ni::getPipelineCacheStats() {
+    std::lock_guard<std::mutex> lock(pipelineCacheMutex);
+    return pipelineStats;
+}
+
+// Roughly SpriteRenderer's pipeline, filled on top of garbage so padding bytes differ between copies.
+static void fillValidationDesc(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const uint8_t* vertexShader, const uint8_t* pixelShader, size_t shaderSize, const D3D12_INPUT_ELEMENT_DESC* elements, uint8_t garbage) {
+    memset(&desc, garbage, sizeof(desc));
+    desc.pRootSignature = (ID3D12RootSignature*)(uintptr_t)(0x1000 + garbage);
+    desc.VS = { vertexShader, shaderSize };
+    desc.PS = { pixelShader, shaderSize };
+    desc.DS = {};
+    desc.HS = {};
+    desc.GS = {};
+    desc.StreamOutput = {};
+    desc.BlendState.AlphaToCoverageEnable = false;
+    desc.BlendState.IndependentBlendEnable = false;
+    for (uint32_t index = 0; index < 8; ++index) {
+        D3D12_RENDER_TARGET_BLEND_DESC& blend = desc.BlendState.RenderTarget[index];
+        blend.BlendEnable = index == 0;
+        blend.LogicOpEnable = false;
+        blend.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+        blend.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+        blend.BlendOp = D3D12_BLEND_OP_ADD;
+        blend.SrcBlendAlpha = D3D12_BLEND_ONE;
+        blend.DestBlendAlpha = D3D12_BLEND_ZERO;
+        blend.BlendOpAlpha = D3D12_BLEND_OP_ADD;
+        blend.LogicOp = D3D12_LOGIC_OP_NOOP;
+        blend.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+    }
+    desc.SampleMask = UINT_MAX;
+    desc.RasterizerState = {};
+    desc.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+    desc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+    desc.DepthStencilState.DepthEnable = false;
+    desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+    desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+    desc.DepthStencilState.StencilEnable = false;
+    desc.DepthStencilState.StencilReadMask = D3D12_DEFAULT_STENCIL_READ_MASK;
+    desc.DepthStencilState.StencilWriteMask = D3D12_DEFAULT_STENCIL_WRITE_MASK;
+    desc.DepthStencilState.FrontFace = { D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_KEEP, D3D12_STENCIL_OP_KEEP, D3D12_COMPARISON_FUNC_ALWAYS };
+    desc.DepthStencilState.BackFace = desc.DepthStencilState.FrontFace;
+    desc.InputLayout = { elements, 2 };
+    desc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
+    desc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    desc.NumRenderTargets = 1;
+    for (uint32_t index = 0; index < 8; ++index) {
+        desc.RTVFormats[index] = index == 0 ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_UNKNOWN;
+    }
+    desc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+    desc.SampleDesc = { 1, 0 };
+    desc.NodeMask = 0;
+    desc.CachedPSO = {};
+    desc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+}
+
+uint32_t ni::validatePipelineCache() {
+    uint32_t errorNum = 0;
+    uint8_t vertexShader[256];
+    uint8_t pixelShader[256];
+    for (uint32_t index = 0; index < sizeof(vertexShader); ++index) {
+        vertexShader[index] = (uint8_t)(index * 7);
+        pixelShader[index] = (uint8_t)(index * 13);
+    }
+    // Same contents at other addresses must give the same key.
+    uint8_t vertexShaderCopy[256];
+    uint8_t pixelShaderCopy[256];
+    memcpy(vertexShaderCopy, vertexShader, sizeof(vertexShader));
+    memcpy(pixelShaderCopy, pixelShader, sizeof(pixelShader));
+    char positionName[] = "POSITION";
+    char texcoordName[] = "TEXCOORD";
+    D3D12_INPUT_ELEMENT_DESC elements[2] = {
+        { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+    D3D12_INPUT_ELEMENT_DESC elementsCopy[2] = {
+        { positionName, 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { texcoordName, 0, DXGI_FORMAT_R32G32_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+    const uint64_t rootSignatureHash = 0x1234;
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC desc;
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC copy;
+    fillValidationDesc(desc, vertexShader, pixelShader, sizeof(vertexShader), elements, 0x00);
+    fillValidationDesc(copy, vertexShaderCopy, pixelShaderCopy, sizeof(vertexShader), elementsCopy, 0xcd);
+    uint64_t key = hashGraphicsPipelineDesc(desc, rootSignatureHash);
+    if (hashGraphicsPipelineDesc(copy, rootSignatureHash) != key) {
+        NI_LOG(" ERROR: equal descriptions at other addresses or with other padding hash differently");
+        errorNum++;
+    }
+    copy.CachedPSO = { vertexShader, 16 };
+    if (hashGraphicsPipelineDesc(copy, rootSignatureHash) != key) {
+        NI_LOG(" ERROR: CachedPSO changes the key");
+        errorNum++;
+    }
+
+    // Every change that produces another pipeline has to produce another key.
+    struct Mutation {
+        const char* name;
+        void(*apply)(D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t* pixelShader, D3D12_INPUT_ELEMENT_DESC* elements);
+    };
+    static const Mutation mutations[] = {
+        { "pixel shader byte", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC&, uint8_t* shader, D3D12_INPUT_ELEMENT_DESC*) { shader[100] ^= 1; } },
+        { "pixel shader length", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.PS.BytecodeLength--; } },
+        { "blend enable", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.BlendState.RenderTarget[0].BlendEnable = false; } },
+        { "write mask", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_RED; } },
+        { "cull mode", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.RasterizerState.CullMode = D3D12_CULL_MODE_BACK; } },
+        { "stencil mask", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.DepthStencilState.StencilReadMask = 0x0f; } },
+        { "semantic index", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC&, uint8_t*, D3D12_INPUT_ELEMENT_DESC* elements) { elements[1].SemanticIndex = 1; } },
+        { "semantic name", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC&, uint8_t*, D3D12_INPUT_ELEMENT_DESC* elements) { elements[1].SemanticName = "COLOR"; } },
+        { "render target format", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM; } },
+        { "sample count", [](D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint8_t*, D3D12_INPUT_ELEMENT_DESC*) { desc.SampleDesc.Count = 4; } },
+    };
+    for (uint32_t index = 0; index < sizeof(mutations) / sizeof(mutations[0]); ++index) {
+        uint8_t mutatedShader[256];
+        D3D12_INPUT_ELEMENT_DESC mutatedElements[2];
+        memcpy(mutatedShader, pixelShader, sizeof(pixelShader));
+        memcpy(mutatedElements, elements, sizeof(elements));
+        D3D12_GRAPHICS_PIPELINE_STATE_DESC mutated;
+        fillValidationDesc(mutated, vertexShader, mutatedShader, sizeof(mutatedShader), mutatedElements, 0x00);
+        mutations[index].apply(mutated, mutatedShader, mutatedElements);
+        if (hashGraphicsPipelineDesc(mutated, rootSignatureHash) == key) {
+            NI_LOG(" ERROR: changing the %s keeps the key", mutations[index].name);
+            errorNum++;
+        }
+    }
+    if (hashGraphicsPipelineDesc(desc, rootSignatureHash + 1) == key) {
+        NI_LOG(" ERROR: changing the root signature keeps the key");
+        errorNum++;
+    }
+    D3D12_COMPUTE_PIPELINE_STATE_DESC computeDesc = {};
+    computeDesc.CS = { vertexShader, sizeof(vertexShader) };
+    uint64_t computeKey = hashComputePipelineDesc(computeDesc, rootSignatureHash);
+    computeDesc.CS.pShaderBytecode = vertexShaderCopy;
+    if (hashComputePipelineDesc(computeDesc, rootSignatureHash) != computeKey) {
+        NI_LOG(" ERROR: equal compute descriptions hash differently");
+        errorNum++;
+    }
+    vertexShaderCopy[0] ^= 1;
+    if (hashComputePipelineDesc(computeDesc, rootSignatureHash) == computeKey) {
+        NI_LOG(" ERROR: changing the compute shader keeps the key");
+        errorNum++;
+    }
+
+    NI_LOG("Pipeline cache: %u key checks, %u error(s)", (uint32_t)(sizeof(mutations) / sizeof(mutations[0])) + 5, errorNum);
+    return errorNum;
+}
+
+ni::AsyncPipeline::AsyncPipeline() : name(nullptr), graphicsDesc{}, computeDesc{}, shaders{}, pso(nullptr) {}
+
+ni::AsyncPipeline::~AsyncPipeline() {
+    waitJobs(counter);
+    inputElements.destroy();
+}
+
+void ni::AsyncPipeline::createGraphics(const wchar_t* pipelineName, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, AsyncFile* vertexShader, AsyncFile* pixelShader) {
+    destroy();
+    name = pipelineName;
+    graphicsDesc = desc;
+    inputElements.reset();
+    for (uint32_t index = 0; index < desc.InputLayout.NumElements; ++index) {
+        inputElements.add(desc.InputLayout.pInputElementDescs[index]);
+    }
+    graphicsDesc.InputLayout.pInputElementDescs = inputElements.getData();
+    shaders[0] = vertexShader;
+    shaders[1] = pixelShader;
+    submitJob(createGraphicsJob, this, counter);
+}
+
+void ni::AsyncPipeline::createCompute(const wchar_t* pipelineName, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, AsyncFile* computeShader) {
+    destroy();
+    name = pipelineName;
+    computeDesc = desc;
+    shaders[0] = computeShader;
+    shaders[1] = nullptr;
+    submitJob(createComputeJob, this, counter);
+}
+
+static D3D12_SHADER_BYTECODE getShaderBytecode(ni::AsyncFile* file) {
+    const void* data = file->getData();
+    NI_ASSERT(data != nullptr, "Failed to read shader %s", file->getPath());
+    return { data, file->getSize() };
+}
+
+void ni::AsyncPipeline::createGraphicsJob(void* userData) {
+    AsyncPipeline* pipeline = (AsyncPipeline*)userData;
+    if (pipeline->shaders[0] != nullptr) pipeline->graphicsDesc.VS = getShaderBytecode(pipeline->shaders[0]);
+    if (pipeline->shaders[1] != nullptr) pipeline->graphicsDesc.PS = getShaderBytecode(pipeline->shaders[1]);
+    pipeline->pso = createGraphicsPipelineState(pipeline->name, pipeline->graphicsDesc);
+}
+
+void ni::AsyncPipeline::createComputeJob(void* userData) {
+    AsyncPipeline* pipeline = (AsyncPipeline*)userData;
+    if (pipeline->shaders[0] != nullptr) pipeline->computeDesc.CS = getShaderBytecode(pipeline->shaders[0]);
+    pipeline->pso = createComputePipelineState(pipeline->name, pipeline->computeDesc);
+}
+
+ID3D12PipelineState* ni::AsyncPipeline::get() {
+    waitJobs(counter);
+    return pso;
+}
+
+void ni::AsyncPipeline::destroy() {
+    waitJobs(counter);
+    NI_D3D_RELEASE(pso);
+}
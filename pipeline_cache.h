@@ -0,0 +1,60 @@
+#pragma once
+
+#include "ni.h"
+#include "async_loader.h"
+#include "pipeline_blob_store.h"
+
+namespace ni {
+
+	struct PipelineCacheStats {
+		uint32_t loadedNum;
+		uint32_t createdNum;
+		double createSeconds;
+		bool usesLibrary;
+	};
+
+	// Flattened into a PipelineDescription and hashed by hashPipelineDescription.
+	uint64_t hashGraphicsPipelineDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+	uint64_t hashComputePipelineDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, uint64_t rootSignatureHash);
+
+	// Uses an ID3D12PipelineLibrary when the driver supports it and cached blobs in CachedPSO otherwise. Loading
+	// and registering is thread safe, init and destroy are not.
+	void initPipelineCache(const char* path, uint64_t deviceHash);
+	// Writes the file if anything was created since it was loaded.
+	void destroyPipelineCache();
+	// Called by RootSignatureBuilder with the serialized root signature.
+	void registerRootSignature(ID3D12RootSignature* rootSignature, const void* data, size_t size);
+	ID3D12PipelineState* loadGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	ID3D12PipelineState* loadComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+	PipelineCacheStats getPipelineCacheStats();
+	// Checks that the D3D12 descs are flattened field by field without a device, validatePipelineBlobStore
+	// covers the hashing and the file format.
+	uint32_t validatePipelineCache();
+
+	// Pipeline created on a loader thread through the pipeline cache. The description and its input layout are
+	// copied, the semantic names and anything else it points to have to stay valid until get. Shaders passed as
+	// AsyncFiles replace the matching bytecode in the description, the job waits for their reads itself.
+	struct AsyncPipeline {
+		AsyncPipeline();
+		~AsyncPipeline();
+
+		void createGraphics(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, AsyncFile* vertexShader, AsyncFile* pixelShader);
+		void createCompute(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc, AsyncFile* computeShader);
+		// Waits the first time it's called after a create.
+		ID3D12PipelineState* get();
+		// Waits and releases the pipeline.
+		void destroy();
+
+	private:
+		static void createGraphicsJob(void* userData);
+		static void createComputeJob(void* userData);
+
+		const wchar_t* name;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC graphicsDesc;
+		D3D12_COMPUTE_PIPELINE_STATE_DESC computeDesc;
+		Array<D3D12_INPUT_ELEMENT_DESC, uint32_t> inputElements;
+		AsyncFile* shaders[2];
+		ID3D12PipelineState* pso;
+		JobCounter counter;
+	};
+}
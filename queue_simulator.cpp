@@ -0,0 +1,291 @@
+#include "queue_simulator.h"
+#include <stdlib.h>
+#include <string.h>
+
+ni::QueueSimulator::QueueSimulator() {
+    memset(queueNames, 0, sizeof(queueNames));
+    queueNum = 0;
+    fenceNum = 0;
+}
+
+ni::QueueSimulator::~QueueSimulator() {
+    ops.destroy();
+}
+
+uint32_t ni::QueueSimulator::addQueue(const char* name) {
+    NI_ASSERT(queueNum < NI_QUEUE_SIM_MAX_QUEUES, "Can't add more than %u queues", NI_QUEUE_SIM_MAX_QUEUES);
+    queueNames[queueNum] = name;
+    return queueNum++;
+}
+
+uint32_t ni::QueueSimulator::addFence() {
+    return fenceNum++;
+}
+
+void ni::QueueSimulator::execute(uint32_t queue, const char* label, double duration, const QueueSimAccess* accesses, uint32_t accessNum) {
+    NI_ASSERT(queue < queueNum && accessNum <= NI_QUEUE_SIM_MAX_ACCESSES, "Invalid execute op");
+    QueueSimOp op = {};
+    op.type = QUEUE_SIM_OP_EXECUTE;
+    op.queue = queue;
+    op.label = label;
+    op.duration = duration;
+    memcpy(op.accesses, accesses, accessNum * sizeof(QueueSimAccess));
+    op.accessNum = accessNum;
+    ops.add(op);
+}
+
+void ni::QueueSimulator::signal(uint32_t queue, uint32_t fence, uint64_t value) {
+    NI_ASSERT(queue < queueNum && fence < fenceNum, "Invalid signal op");
+    QueueSimOp op = {};
+    op.type = QUEUE_SIM_OP_SIGNAL;
+    op.queue = queue;
+    op.fence = fence;
+    op.fenceValue = value;
+    ops.add(op);
+}
+
+void ni::QueueSimulator::wait(uint32_t queue, uint32_t fence, uint64_t value) {
+    NI_ASSERT(queue < queueNum && fence < fenceNum, "Invalid wait op");
+    QueueSimOp op = {};
+    op.type = QUEUE_SIM_OP_WAIT;
+    op.queue = queue;
+    op.fence = fence;
+    op.fenceValue = value;
+    ops.add(op);
+}
+
+ni::QueueSimResult ni::QueueSimulator::run(bool logHazards) {
+    QueueSimResult result = {};
+    double queueTime[NI_QUEUE_SIM_MAX_QUEUES] = {};
+    uint32_t queueClock[NI_QUEUE_SIM_MAX_QUEUES][NI_QUEUE_SIM_MAX_QUEUES] = {};
+    uint32_t queueCursor[NI_QUEUE_SIM_MAX_QUEUES] = {};
+    Array<FenceSignal, uint32_t>* signals = new Array<FenceSignal, uint32_t>[fenceNum];
+    Array<AccessRecord, uint32_t> accesses;
+
+    // Each queue only looks at its own ops, in the order they were added. Sweep over the queues until
+    // nothing can make progress anymore, a queue stalls on a wait whose signal hasn't been reached yet.
+    uint32_t opNum = ops.getNum();
+    const QueueSimOp* opData = ops.getData();
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (uint32_t queue = 0; queue < queueNum; ++queue) {
+            while (queueCursor[queue] < opNum) {
+                const QueueSimOp& op = opData[queueCursor[queue]];
+                if (op.queue != queue) {
+                    queueCursor[queue]++;
+                    continue;
+                }
+                if (op.type == QUEUE_SIM_OP_WAIT) {
+                    const FenceSignal* reached = nullptr;
+                    for (uint32_t index = 0; index < signals[op.fence].getNum(); ++index) {
+                        if (signals[op.fence].getData()[index].value >= op.fenceValue) {
+                            reached = &signals[op.fence].getData()[index];
+                            break;
+                        }
+                    }
+                    // A value of 0 is the initial fence value and never blocks.
+                    if (reached == nullptr && op.fenceValue > 0) break;
+                    if (reached != nullptr) {
+                        queueTime[queue] = reached->time > queueTime[queue] ? reached->time : queueTime[queue];
+                        for (uint32_t other = 0; other < queueNum; ++other) {
+                            queueClock[queue][other] = reached->clock[other] > queueClock[queue][other] ? reached->clock[other] : queueClock[queue][other];
+                        }
+                    }
+                } else if (op.type == QUEUE_SIM_OP_SIGNAL) {
+                    FenceSignal fenceSignal = {};
+                    fenceSignal.value = op.fenceValue;
+                    fenceSignal.time = queueTime[queue];
+                    memcpy(fenceSignal.clock, queueClock[queue], sizeof(fenceSignal.clock));
+                    uint32_t signalNum = signals[op.fence].getNum();
+                    NI_ASSERT(signalNum == 0 || signals[op.fence].getData()[signalNum - 1].value <= op.fenceValue, "Fence values have to increase");
+                    signals[op.fence].add(fenceSignal);
+                } else {
+                    queueClock[queue][queue]++;
+                    for (uint32_t index = 0; index < op.accessNum; ++index) {
+                        AccessRecord record = {};
+                        record.access = op.accesses[index];
+                        record.queue = queue;
+                        record.label = op.label;
+                        memcpy(record.clock, queueClock[queue], sizeof(record.clock));
+                        accesses.add(record);
+                    }
+                    queueTime[queue] += op.duration;
+                    result.busyTime[queue] += op.duration;
+                }
+                queueCursor[queue]++;
+                progress = true;
+            }
+        }
+    }
+
+    for (uint32_t queue = 0; queue < queueNum; ++queue) {
+        result.deadlocked |= queueCursor[queue] < opNum;
+        result.totalTime = queueTime[queue] > result.totalTime ? queueTime[queue] : result.totalTime;
+    }
+
+    // a happened before b if b's queue had already seen a's op when b ran.
+    const AccessRecord* records = accesses.getData();
+    for (uint32_t first = 0; first < accesses.getNum(); ++first) {
+        const AccessRecord& a = records[first];
+        for (uint32_t second = first + 1; second < accesses.getNum(); ++second) {
+            const AccessRecord& b = records[second];
+            if (a.access.resource != b.access.resource || a.queue == b.queue || (!a.access.write && !b.access.write)) continue;
+            bool ordered = a.clock[a.queue] <= b.clock[a.queue] || b.clock[b.queue] <= a.clock[b.queue];
+            if (ordered) continue;
+            if (logHazards && result.hazardNum < 4) {
+                NI_LOG("Hazard on resource %u: %s on %s (%s) and %s on %s (%s)", a.access.resource,
+                    a.label, queueNames[a.queue], a.access.write ? "write" : "read",
+                    b.label, queueNames[b.queue], b.access.write ? "write" : "read");
+            }
+            result.hazardNum++;
+        }
+    }
+
+    for (uint32_t fence = 0; fence < fenceNum; ++fence) {
+        signals[fence].destroy();
+    }
+    delete[] signals;
+    accesses.destroy();
+    return result;
+}
+
+// Rough costs of a GPU bound frame that streams textures at the full NI_STREAMING_FRAME_BUDGET. Queues are
+// modeled as fully independent, on hardware compute and graphics share the shader cores so overlap is lower.
+#define NI_QUEUE_SIM_CPU_RECORD_MS 2.0
+#define NI_QUEUE_SIM_LOADER_MS 1.5
+#define NI_QUEUE_SIM_COPY_MS 3.0
+#define NI_QUEUE_SIM_SPRITE_GEN_MS 1.5
+#define NI_QUEUE_SIM_DRAW_MS 3.5
+// Frames worth of upload budget that fit in the staging ring.
+#define NI_QUEUE_SIM_STAGING_SLOTS 4
+
+struct QueueSimSchedule {
+    const char* name;
+    bool copyQueue;
+    bool asyncCompute;
+    // Whoever consumes the copies waits on the copy fence.
+    bool waitForCopy;
+    // Compute waits for the direct queue to finish with the sprite gen buffers it's about to overwrite.
+    bool waitForDraw;
+    uint32_t spriteGenBufferNum;
+    bool expectHazards;
+};
+
+static ni::QueueSimResult simulateSchedule(uint32_t frameNum, const QueueSimSchedule& schedule) {
+    ni::QueueSimulator simulator;
+    uint32_t cpu = simulator.addQueue("cpu");
+    uint32_t loader = simulator.addQueue("loader");
+    uint32_t direct = simulator.addQueue("direct");
+    uint32_t copy = schedule.copyQueue ? simulator.addQueue("copy") : direct;
+    uint32_t compute = schedule.asyncCompute ? simulator.addQueue("compute") : direct;
+    uint32_t submitFence = simulator.addFence();
+    uint32_t stagedFence = simulator.addFence();
+    uint32_t copyFence = simulator.addFence();
+    uint32_t computeFence = simulator.addFence();
+    uint32_t frameFence = simulator.addFence();
+
+    // Resources: per frame upload and draw command buffers, staging ring slots, the sprite gen counters that
+    // only SpriteGen touches, the sprite gen output (vertices and indirect arguments) and the texture streamed in that frame.
+    const uint32_t uploadBase = 0;
+    const uint32_t drawCommandsBase = uploadBase + NI_FRAME_COUNT;
+    const uint32_t stagingBase = drawCommandsBase + NI_FRAME_COUNT;
+    const uint32_t spriteGenCounter = stagingBase + NI_QUEUE_SIM_STAGING_SLOTS;
+    const uint32_t spriteGenOutputBase = spriteGenCounter + 1;
+    const uint32_t textureBase = spriteGenOutputBase + schedule.spriteGenBufferNum;
+
+    for (uint64_t frame = 1; frame <= frameNum; ++frame) {
+        uint32_t slot = (uint32_t)((frame - 1) % NI_FRAME_COUNT);
+        uint32_t stagingSlot = (uint32_t)((frame - 1) % NI_QUEUE_SIM_STAGING_SLOTS);
+        uint32_t spriteGenOutput = spriteGenOutputBase + (uint32_t)(frame % schedule.spriteGenBufferNum);
+        uint32_t texture = textureBase + (uint32_t)frame;
+
+        // Loader thread, blocks while the staging ring is full.
+        simulator.wait(loader, copyFence, frame > NI_QUEUE_SIM_STAGING_SLOTS ? frame - NI_QUEUE_SIM_STAGING_SLOTS : 0);
+        ni::QueueSimAccess loaderAccesses[] = { { stagingBase + stagingSlot, true } };
+        simulator.execute(loader, "stage textures", NI_QUEUE_SIM_LOADER_MS, loaderAccesses, 1);
+        simulator.signal(loader, stagedFence, frame);
+
+        // Render thread, waitForCurrentFrame and then beginFrame/flushCommands/endFrame.
+        simulator.wait(cpu, frameFence, frame > NI_FRAME_COUNT ? frame - NI_FRAME_COUNT : 0);
+        simulator.wait(cpu, stagedFence, frame);
+        ni::QueueSimAccess cpuAccesses[] = { { uploadBase + slot, true } };
+        simulator.execute(cpu, "record frame", NI_QUEUE_SIM_CPU_RECORD_MS, cpuAccesses, 1);
+        simulator.signal(cpu, submitFence, frame);
+
+        ni::QueueSimAccess copyAccesses[] = {
+            { uploadBase + slot, false },
+            { stagingBase + stagingSlot, false },
+            { drawCommandsBase + slot, true },
+            { texture, true }
+        };
+        ni::QueueSimAccess spriteGenAccesses[] = {
+            { drawCommandsBase + slot, false },
+            { spriteGenCounter, true },
+            { spriteGenOutput, true }
+        };
+        ni::QueueSimAccess drawAccesses[] = {
+            { spriteGenOutput, false },
+            { texture, false }
+        };
+
+        // Same order as ni::endFrame, one queue after the other with the waits in front.
+        if (schedule.copyQueue) {
+            simulator.wait(copy, submitFence, frame);
+            simulator.execute(copy, "upload", NI_QUEUE_SIM_COPY_MS, copyAccesses, 4);
+            simulator.signal(copy, copyFence, frame);
+        }
+        if (schedule.asyncCompute) {
+            simulator.wait(compute, submitFence, frame);
+            if (schedule.waitForCopy) {
+                simulator.wait(compute, copyFence, frame);
+            }
+            if (schedule.waitForDraw) {
+                simulator.wait(compute, frameFence, frame > schedule.spriteGenBufferNum ? frame - schedule.spriteGenBufferNum : 0);
+            }
+            simulator.execute(compute, "sprite gen", NI_QUEUE_SIM_SPRITE_GEN_MS, spriteGenAccesses, 3);
+            simulator.signal(compute, computeFence, frame);
+        }
+        simulator.wait(direct, submitFence, frame);
+        if (schedule.asyncCompute) {
+            simulator.wait(direct, computeFence, frame);
+        } else if (schedule.copyQueue && schedule.waitForCopy) {
+            simulator.wait(direct, copyFence, frame);
+        }
+        if (!schedule.copyQueue) {
+            simulator.execute(direct, "upload", NI_QUEUE_SIM_COPY_MS, copyAccesses, 4);
+            simulator.signal(direct, copyFence, frame);
+        }
+        if (!schedule.asyncCompute) {
+            simulator.execute(direct, "sprite gen", NI_QUEUE_SIM_SPRITE_GEN_MS, spriteGenAccesses, 3);
+        }
+        simulator.execute(direct, "draw", NI_QUEUE_SIM_DRAW_MS, drawAccesses, 2);
+        simulator.signal(direct, frameFence, frame);
+    }
+    return simulator.run(!schedule.expectHazards);
+}
+
+uint32_t ni::simulateFrameQueues(uint32_t frameNum) {
+    const QueueSimSchedule schedules[] = {
+        { "direct queue only", false, false, true, true, 1, false },
+        { "copy queue", true, false, true, true, 1, false },
+        { "copy queue + async compute", true, true, true, true, NI_ASYNC_COMPUTE_BUFFER_COUNT, false },
+        { "async compute, single buffered", true, true, true, true, 1, false },
+        { "copy queue without the cross-queue wait", true, false, false, true, 1, true },
+        { "async compute without waiting for the draw", true, true, true, false, NI_ASYNC_COMPUTE_BUFFER_COUNT, true }
+    };
+    NI_LOG("Queue simulation, %u frames (record %.1f ms, copy %.1f ms, sprite gen %.1f ms, draw %.1f ms)", frameNum,
+        NI_QUEUE_SIM_CPU_RECORD_MS, NI_QUEUE_SIM_COPY_MS, NI_QUEUE_SIM_SPRITE_GEN_MS, NI_QUEUE_SIM_DRAW_MS);
+    uint32_t errorNum = 0;
+    for (const QueueSimSchedule& schedule : schedules) {
+        QueueSimResult result = simulateSchedule(frameNum, schedule);
+        NI_LOG("  %-42s %.2f ms per frame, %u hazards%s%s", schedule.name, result.totalTime / frameNum, result.hazardNum,
+            schedule.expectHazards ? " (expected > 0)" : "", result.deadlocked ? ", DEADLOCK" : "");
+        if (result.deadlocked || (result.hazardNum > 0) != schedule.expectHazards) {
+            errorNum++;
+        }
+    }
+    NI_LOG("Queue simulation: %u schedules, %u error(s)", (uint32_t)(sizeof(schedules) / sizeof(schedules[0])), errorNum);
+    NI_ASSERT(errorNum == 0, "A frame queue schedule deadlocked or didn't match its expected hazards");
+    return errorNum;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ni.h"
+
+#define NI_QUEUE_SIM_MAX_QUEUES 5
+#define NI_QUEUE_SIM_MAX_ACCESSES 4
+
+namespace ni {
+
+	enum QueueSimOpType : uint32_t {
+		QUEUE_SIM_OP_EXECUTE,
+		QUEUE_SIM_OP_SIGNAL,
+		QUEUE_SIM_OP_WAIT
+	};
+
+	struct QueueSimAccess {
+		uint32_t resource;
+		bool write;
+	};
+
+	struct QueueSimOp {
+		QueueSimOpType type;
+		uint32_t queue;
+		const char* label;
+		double duration;
+		uint32_t fence;
+		uint64_t fenceValue;
+		QueueSimAccess accesses[NI_QUEUE_SIM_MAX_ACCESSES];
+		uint32_t accessNum;
+	};
+
+	struct QueueSimResult {
+		double totalTime;
+		double busyTime[NI_QUEUE_SIM_MAX_QUEUES];
+		uint32_t hazardNum;
+		bool deadlocked;
+	};
+
+	// Headless model of D3D12 queue ordering. Every queue (the CPU timeline counts as one too) runs its ops
+	// in order, a wait blocks until the fence got signaled with at least that value somewhere else. Ops only
+	// carry a duration, run() works out the timeline and uses vector clocks to find accesses to the same
+	// resource from different queues that aren't ordered by a fence, with at least one of them writing.
+	struct QueueSimulator {
+		QueueSimulator();
+		~QueueSimulator();
+
+		uint32_t addQueue(const char* name);
+		uint32_t addFence();
+		void execute(uint32_t queue, const char* label, double duration, const QueueSimAccess* accesses, uint32_t accessNum);
+		void signal(uint32_t queue, uint32_t fence, uint64_t value);
+		void wait(uint32_t queue, uint32_t fence, uint64_t value);
+		QueueSimResult run(bool logHazards);
+
+	private:
+		struct FenceSignal {
+			uint64_t value;
+			double time;
+			uint32_t clock[NI_QUEUE_SIM_MAX_QUEUES];
+		};
+
+		struct AccessRecord {
+			QueueSimAccess access;
+			uint32_t queue;
+			const char* label;
+			uint32_t clock[NI_QUEUE_SIM_MAX_QUEUES];
+		};
+
+		const char* queueNames[NI_QUEUE_SIM_MAX_QUEUES];
+		uint32_t queueNum;
+		uint32_t fenceNum;
+		Array<QueueSimOp, uint32_t> ops;
+	};
+
+	// Models ni's frame loop with and without the copy queue and async compute and checks every schedule for
+	// hazards and deadlocks. Also runs schedules with a missing wait to make sure the hazards are caught.
+	uint32_t simulateFrameQueues(uint32_t frameNum);
+}
@@ -0,0 +1,208 @@
+#include "readback.h"
+#include "cpu_trace.h"
+#include "image_codec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ni::ReadbackRing::ReadbackRing() : recordingPrefix{}, recordingEncoding(READBACK_ENCODING_QOI), recordingFrameNum(0), recording(false),
+    requestedNum(0), completedNum(0), droppedNum(0), maxLatencyFrames(0), writtenNum(0), failedNum(0) {
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        Slot& slot = slots[index];
+        slot.buffer = {};
+        slot.bufferSize = 0;
+        slot.width = 0;
+        slot.height = 0;
+        slot.state = SLOT_FREE;
+        slot.fence = nullptr;
+        slot.callback = nullptr;
+        slot.userData = nullptr;
+        slot.path[0] = '\0';
+        slot.ring = this;
+    }
+}
+
+void ni::ReadbackRing::destroy() {
+    stopRecording();
+    waitIdle();
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        Slot& slot = slots[index];
+        if (slot.buffer.resource != nullptr) {
+            destroyBuffer(slot.buffer);
+        }
+    }
+}
+
+void ni::ReadbackRing::waitIdle() {
+    // Every frame retired, so the copies that are still marked in flight are done.
+    poll(~0ull);
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        waitJobs(slots[index].counter);
+    }
+}
+
+bool ni::ReadbackRing::hasFreeSlot() const {
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        if (slots[index].state.load(std::memory_order_acquire) == SLOT_FREE) return true;
+    }
+    return false;
+}
+
+ni::ReadbackRing::Slot* ni::ReadbackRing::acquireSlot() {
+    requestedNum++;
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        Slot& slot = slots[index];
+        if (slot.state.load(std::memory_order_acquire) == SLOT_FREE) {
+            slot.state.store(SLOT_REQUESTED, std::memory_order_relaxed);
+            slot.callback = nullptr;
+            slot.userData = nullptr;
+            slot.path[0] = '\0';
+            return &slot;
+        }
+    }
+    droppedNum++;
+    return nullptr;
+}
+
+bool ni::ReadbackRing::requestCapture(ReadbackCallback callback, void* userData) {
+    Slot* slot = acquireSlot();
+    if (slot == nullptr) return false;
+    slot->callback = callback;
+    slot->userData = userData;
+    return true;
+}
+
+bool ni::ReadbackRing::requestScreenshot(const char* path, ReadbackEncoding encoding) {
+    NI_ASSERT(strlen(path) < NI_READBACK_MAX_PATH, "Screenshot path %s is too long", path);
+    Slot* slot = acquireSlot();
+    if (slot == nullptr) return false;
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->encoding = encoding;
+    return true;
+}
+
+void ni::ReadbackRing::startRecording(const char* pathPrefix, ReadbackEncoding encoding) {
+    // Leaves room for the frame number and the extension.
+    NI_ASSERT(strlen(pathPrefix) + 16 < NI_READBACK_MAX_PATH, "Recording prefix %s is too long", pathPrefix);
+    snprintf(recordingPrefix, sizeof(recordingPrefix), "%s", pathPrefix);
+    recordingEncoding = encoding;
+    recordingFrameNum = 0;
+    recording = true;
+}
+
+void ni::ReadbackRing::stopRecording() {
+    if (!recording) return;
+    recording = false;
+    NI_LOG("Recorded %llu frames to %s_*, %llu dropped so far", recordingFrameNum, recordingPrefix, droppedNum);
+}
+
+void ni::ReadbackRing::recordCopies(ID3D12GraphicsCommandList* commandList, Resource* backbuffer, ID3D12Fence* fence, uint64_t fenceValue, uint64_t frameNumber) {
+    if (recording) {
+        char path[NI_READBACK_MAX_PATH];
+        snprintf(path, sizeof(path), "%s_%06llu.%s", recordingPrefix, recordingFrameNum++, recordingEncoding == READBACK_ENCODING_QOI ? "qoi" : "png");
+        requestScreenshot(path, recordingEncoding);
+    }
+
+    D3D12_RESOURCE_DESC desc = {};
+    D3D12_RESOURCE_STATES previousState = backbuffer->state;
+    bool copied = false;
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        Slot& slot = slots[index];
+        if (slot.state.load(std::memory_order_relaxed) != SLOT_REQUESTED) continue;
+        if (!copied) {
+            desc = backbuffer->resource->GetDesc();
+            NI_ASSERT(desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM, "Readback expects an RGBA8 backbuffer");
+            barriers.require(backbuffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
+            barriers.flush(commandList);
+            copied = true;
+        }
+        // Buffers are created on first use and follow the backbuffer size. A slot that isn't in flight is safe to replace.
+        if (slot.width != (uint32_t)desc.Width || slot.height != desc.Height) {
+            if (slot.buffer.resource != nullptr) {
+                destroyBuffer(slot.buffer);
+            }
+            slot.width = (uint32_t)desc.Width;
+            slot.height = desc.Height;
+            slot.bufferSize = getTextureFootprints(slot.width, slot.height, 1, desc.Format, &slot.footprint, nullptr, nullptr);
+            slot.buffer = createBuffer(L"ReadbackRing::buffer", slot.bufferSize, READBACK_BUFFER);
+        }
+        D3D12_TEXTURE_COPY_LOCATION srcLocation = {};
+        srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        srcLocation.pResource = backbuffer->resource;
+        srcLocation.SubresourceIndex = 0;
+        D3D12_TEXTURE_COPY_LOCATION dstLocation = {};
+        dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+        dstLocation.pResource = slot.buffer.resource;
+        dstLocation.PlacedFootprint = slot.footprint;
+        commandList->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
+        slot.fence = fence;
+        slot.fenceValue = fenceValue;
+        slot.frameNumber = frameNumber;
+        slot.state.store(SLOT_COPYING, std::memory_order_relaxed);
+    }
+    if (copied) {
+        barriers.require(backbuffer, previousState);
+        barriers.flush(commandList);
+    }
+}
+
+void ni::ReadbackRing::poll(uint64_t frameNumber) {
+    for (uint32_t index = 0; index < NI_READBACK_SLOT_COUNT; ++index) {
+        Slot& slot = slots[index];
+        if (slot.state.load(std::memory_order_relaxed) != SLOT_COPYING) continue;
+        if (frameNumber != ~0ull) {
+            if (slot.fence->GetCompletedValue() < slot.fenceValue) continue;
+            maxLatencyFrames = frameNumber - slot.frameNumber > maxLatencyFrames ? frameNumber - slot.frameNumber : maxLatencyFrames;
+        }
+        completedNum++;
+        if (slot.callback != nullptr) {
+            NI_TRACE_SCOPE("Readback callback");
+            ReadbackImage image = {};
+            image.pixels = mapReadbackBuffer(slot.buffer, 0, (size_t)slot.bufferSize);
+            image.width = slot.width;
+            image.height = slot.height;
+            image.rowPitch = slot.footprint.Footprint.RowPitch;
+            image.frameNumber = slot.frameNumber;
+            slot.callback(image, slot.userData);
+            unmapReadbackBuffer(slot.buffer);
+            slot.state.store(SLOT_FREE, std::memory_order_release);
+        } else {
+            slot.state.store(SLOT_ENCODING, std::memory_order_relaxed);
+            submitJob(encodeJob, &slot, slot.counter);
+        }
+    }
+}
+
+void ni::ReadbackRing::encodeJob(void* userData) {
+    NI_TRACE_SCOPE("Readback encode");
+    Slot& slot = *(Slot*)userData;
+    const void* pixels = mapReadbackBuffer(slot.buffer, 0, (size_t)slot.bufferSize);
+    size_t size = 0;
+    void* data = nullptr;
+    // The backbuffer's alpha isn't meaningful, RGB keeps the files smaller.
+    if (slot.encoding == READBACK_ENCODING_QOI) {
+        data = encodeQoi(pixels, slot.width, slot.height, slot.footprint.Footprint.RowPitch, false, size);
+    } else {
+        data = encodePng(pixels, slot.width, slot.height, slot.footprint.Footprint.RowPitch, false, size);
+    }
+    unmapReadbackBuffer(slot.buffer);
+    if (writeFile(slot.path, data, size)) {
+        slot.ring->writtenNum++;
+    } else {
+        slot.ring->failedNum++;
+        NI_LOG("Failed to write %s", slot.path);
+    }
+    free(data);
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+}
+
+ni::ReadbackStats ni::ReadbackRing::getStats() const {
+    ReadbackStats stats = {};
+    stats.requestedNum = requestedNum;
+    stats.completedNum = completedNum;
+    stats.droppedNum = droppedNum;
+    stats.writtenNum = writtenNum.load();
+    stats.failedNum = failedNum.load();
+    stats.maxLatencyFrames = maxLatencyFrames;
+    return stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "ni.h"
+#include "async_loader.h"
+#include "resource_state_tracker.h"
+#include <atomic>
+
+// Copies in flight plus a couple being encoded. Requests beyond that are dropped, never waited for.
+#define NI_READBACK_SLOT_COUNT (NI_FRAME_COUNT + 2)
+#define NI_READBACK_MAX_PATH 260
+
+namespace ni {
+
+	enum ReadbackEncoding {
+		READBACK_ENCODING_QOI,
+		READBACK_ENCODING_PNG
+	};
+
+	// RGBA8 backbuffer contents, only valid during the callback.
+	struct ReadbackImage {
+		const void* pixels;
+		uint32_t width;
+		uint32_t height;
+		uint32_t rowPitch;
+		uint64_t frameNumber;
+	};
+
+	typedef void(*ReadbackCallback)(const ReadbackImage& image, void* userData);
+
+	struct ReadbackStats {
+		uint64_t requestedNum;
+		uint64_t completedNum;
+		// Requests that found every slot busy.
+		uint64_t droppedNum;
+		uint64_t writtenNum;
+		uint64_t failedNum;
+		// Frames between the copy and the render thread seeing it complete, the worst one so far.
+		uint64_t maxLatencyFrames;
+	};
+
+	// Fence tracked ring of readback buffers for the backbuffer. endFrame records the copies of the slots
+	// requested during the frame, beginFrame hands the ones whose fence has passed to their callback on the
+	// render thread or to a loader thread that encodes and writes them. Nothing here waits on the GPU.
+	struct ReadbackRing {
+		ReadbackRing();
+
+		// Finishes the copies of retired frames and waits for the encoders, call after waitForAllFrames.
+		void destroy();
+		// Copies the backbuffer at the end of the frame being recorded. Returns false when no slot is free.
+		bool requestCapture(ReadbackCallback callback, void* userData);
+		// Same, encoded and written on a loader thread. The path is copied.
+		bool requestScreenshot(const char* path, ReadbackEncoding encoding);
+		// Captures every frame to <pathPrefix>_<number>.qoi or .png until stopRecording. Frames that find no
+		// free slot are skipped, the numbers keep counting so the gaps show.
+		void startRecording(const char* pathPrefix, ReadbackEncoding encoding);
+		void stopRecording();
+		bool isRecording() const { return recording; }
+		// Called by endFrame before the direct list closes. fenceValue is what fence reaches after the list ran.
+		void recordCopies(ID3D12GraphicsCommandList* commandList, Resource* backbuffer, ID3D12Fence* fence, uint64_t fenceValue, uint64_t frameNumber);
+		// Called by beginFrame.
+		void poll(uint64_t frameNumber);
+		// Whether a request made now would get a slot.
+		bool hasFreeSlot() const;
+		// Hands out every copy and waits for the encoders. Only valid once the GPU is idle, see waitForAllFrames.
+		void waitIdle();
+		ReadbackStats getStats() const;
+
+	private:
+		enum SlotState : uint32_t {
+			SLOT_FREE,
+			SLOT_REQUESTED,
+			SLOT_COPYING,
+			SLOT_ENCODING
+		};
+
+		struct Slot {
+			Resource buffer;
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+			uint64_t bufferSize;
+			uint32_t width;
+			uint32_t height;
+			// Written by the render thread, set back to free by the encoder.
+			std::atomic<uint32_t> state;
+			ID3D12Fence* fence;
+			uint64_t fenceValue;
+			uint64_t frameNumber;
+			ReadbackCallback callback;
+			void* userData;
+			char path[NI_READBACK_MAX_PATH];
+			ReadbackEncoding encoding;
+			ReadbackRing* ring;
+			JobCounter counter;
+		};
+
+		static void encodeJob(void* userData);
+		Slot* acquireSlot();
+
+		Slot slots[NI_READBACK_SLOT_COUNT];
+		ResourceStateTracker barriers;
+		char recordingPrefix[NI_READBACK_MAX_PATH];
+		ReadbackEncoding recordingEncoding;
+		uint64_t recordingFrameNum;
+		bool recording;
+		uint64_t requestedNum;
+		uint64_t completedNum;
+		uint64_t droppedNum;
+		uint64_t maxLatencyFrames;
+		std::atomic<uint64_t> writtenNum;
+		std::atomic<uint64_t> failedNum;
+	};
+}
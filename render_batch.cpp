@@ -0,0 +1,304 @@
+#include "render_batch.h"
+#include "cpu_trace.h"
+#include "draw_capture.h"
+#include "image_codec.h"
+#include "software_rasterizer.h"
+#include "sprite_renderer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RENDER_BATCH_MAX_LINE 1024
+
+// Textures are the same for every scene that draws them, so they live for the whole batch and scenes never wait
+// for the GPU to let go of the previous one's textures. A texture is handed out once per scene, replayFrame binds
+// every image to its own mesh slot.
+struct BatchTexture {
+    ni::DrawCaptureTexture desc;
+    ni::Texture* texture;
+    uint32_t lastScene;
+    bool placeholder;
+};
+
+// Decoded once per captured texture, every scene drawing it samples the same mip chain.
+struct SoftwareBatchTexture {
+    ni::DrawCaptureTexture desc;
+    // Null when the pack doesn't have the texture.
+    void* mipChain;
+};
+
+static const BatchTexture& acquireBatchTexture(ni::Array<BatchTexture, uint32_t>& textures, const ni::AssetPack* pack, const ni::DrawCaptureTexture& desc, uint32_t scene) {
+    for (uint32_t index = 0; index < textures.getNum(); ++index) {
+        BatchTexture& entry = textures.getData()[index];
+        if (entry.lastScene != scene && memcmp(&entry.desc, &desc, sizeof(desc)) == 0) {
+            entry.lastScene = scene;
+            return entry;
+        }
+    }
+    BatchTexture entry = { desc, nullptr, scene, false };
+    const ni::AssetPackTexture* packTexture = ni::findCapturedTexture(pack, desc);
+    if (packTexture != nullptr) {
+        entry.texture = pack->createTexture(L"RenderBatch::texture", *packTexture);
+    } else {
+        // Opaque white, zero alpha would be discarded. Created directly, so it's resident by the first flush.
+        size_t mipChainSize = ni::getMipChainSize(desc.width, desc.height, desc.mipLevels, (DXGI_FORMAT)desc.format);
+        void* mipChain = malloc(mipChainSize);
+        memset(mipChain, 0xff, mipChainSize);
+        entry.texture = ni::createTextureFromMipChain(L"RenderBatch::texture", desc.width, desc.height, desc.mipLevels, mipChain, (DXGI_FORMAT)desc.format);
+        entry.placeholder = true;
+        free(mipChain);
+    }
+    textures.add(entry);
+    return textures.getData()[textures.getNum() - 1];
+}
+
+static const SoftwareBatchTexture& acquireSoftwareBatchTexture(ni::Array<SoftwareBatchTexture, uint32_t>& textures, const ni::AssetPack* pack, const ni::DrawCaptureTexture& desc) {
+    for (uint32_t index = 0; index < textures.getNum(); ++index) {
+        const SoftwareBatchTexture& entry = textures.getData()[index];
+        if (memcmp(&entry.desc, &desc, sizeof(desc)) == 0) {
+            return entry;
+        }
+    }
+    const ni::AssetPackTexture* packTexture = ni::findCapturedTexture(pack, desc);
+    SoftwareBatchTexture entry = { desc, packTexture != nullptr ? pack->decodeTexture(*packTexture) : nullptr };
+    textures.add(entry);
+    return textures.getData()[textures.getNum() - 1];
+}
+
+static void getOutputPath(const char* capturePath, const ni::RenderBatchOptions& options, char* outPath, size_t outPathSize) {
+    const char* name = capturePath;
+    for (const char* c = capturePath; *c != '\0'; ++c) {
+        if (*c == '/' || *c == '\\') {
+            name = c + 1;
+        }
+    }
+    const char* extension = strrchr(name, '.');
+    int nameLength = extension != nullptr ? (int)(extension - name) : (int)strlen(name);
+    snprintf(outPath, outPathSize, "%s/%.*s.%s", options.outputDir, nameLength, name, options.encoding == ni::READBACK_ENCODING_QOI ? "qoi" : "png");
+}
+
+// Next capture of this process' shard, false at the end of the list.
+static bool readScene(FILE* list, const ni::RenderBatchOptions& options, uint32_t& lineIndex, char* line, size_t lineSize) {
+    while (fgets(line, (int)lineSize, list) != nullptr) {
+        size_t length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') continue;
+        if (lineIndex++ % options.shardNum != options.shardIndex) continue;
+        return true;
+    }
+    return false;
+}
+
+// Transforms are in the captured view's pixels. Scaling the translation and scale of every command fits the scene
+// without touching the shaders, culling then runs against the output size.
+static void fitCommands(const ni::DrawCapture& capture, const ni::DrawCaptureFrame& frame, float viewWidth, float viewHeight, DrawCommand* outCommands) {
+    float scale = viewWidth / frame.viewWidth < viewHeight / frame.viewHeight ? viewWidth / frame.viewWidth : viewHeight / frame.viewHeight;
+    float offsetX = (viewWidth - frame.viewWidth * scale) * 0.5f;
+    float offsetY = (viewHeight - frame.viewHeight * scale) * 0.5f;
+    const DrawCommand* capturedCommands = capture.getFrameDrawCommands(frame);
+    for (uint32_t index = 0; index < frame.drawCommandNum; ++index) {
+        DrawCommand& cmd = outCommands[index];
+        cmd = capturedCommands[index];
+        cmd.transform[0] = cmd.transform[0] * scale + offsetX;
+        cmd.transform[1] = cmd.transform[1] * scale + offsetY;
+        cmd.transform[2] *= scale;
+    }
+}
+
+// Scenes drawn with placeholders are still written, but they don't show what was captured and count as skipped.
+static void countScene(const char* capturePath, uint32_t placeholderNum, uint32_t imageNum, ni::RenderBatchStats& stats) {
+    if (placeholderNum > 0) {
+        NI_LOG("Skipping %s, %u of %u images aren't in the asset pack and were drawn as placeholders", capturePath, placeholderNum, imageNum);
+        stats.skippedNum++;
+    } else {
+        stats.renderedNum++;
+    }
+}
+
+static void logBatchStats(const ni::RenderBatchOptions& options, const ni::RenderBatchStats& stats) {
+    NI_LOG("Shard %u/%u of %s: %u scenes rendered, %u skipped, %llu images written, %llu failed in %.2f s (%.1f scenes/s)",
+        options.shardIndex, options.shardNum, options.listPath, stats.renderedNum, stats.skippedNum, stats.writtenNum, stats.failedNum,
+        stats.seconds, stats.seconds > 0.0 ? (double)stats.renderedNum / stats.seconds : 0.0);
+}
+
+bool ni::parseShard(const char* text, uint32_t& outShardIndex, uint32_t& outShardNum) {
+    uint32_t shardIndex = 0;
+    uint32_t shardNum = 0;
+    if (sscanf(text, "%u/%u", &shardIndex, &shardNum) != 2 || shardNum == 0 || shardIndex >= shardNum) {
+        return false;
+    }
+    outShardIndex = shardIndex;
+    outShardNum = shardNum;
+    return true;
+}
+
+ni::RenderBatchStats ni::renderBatch(SpriteRenderer* spriteRenderer, const RenderBatchOptions& options) {
+    NI_ASSERT(isOffscreen(), "Batch rendering expects ni::init with INIT_OFFSCREEN");
+    NI_ASSERT(options.shardIndex < options.shardNum, "Shard %u of %u doesn't exist", options.shardIndex, options.shardNum);
+    RenderBatchStats stats = {};
+    FILE* list = fopen(options.listPath, "r");
+    if (list == nullptr) {
+        NI_LOG("Failed to open scene list %s", options.listPath);
+        return stats;
+    }
+    ReadbackRing* readback = getReadback();
+    ReadbackStats readbackStart = readback->getStats();
+    Array<BatchTexture, uint32_t> textures;
+    Texture** frameImages = (Texture**)malloc(NI_MAX_DESCRIPTORS * sizeof(Texture*));
+    SpriteMesh* frameMeshes = (SpriteMesh*)malloc(NI_MAX_DESCRIPTORS * sizeof(SpriteMesh));
+    DrawCommand* commands = (DrawCommand*)malloc(MAX_DRAW_COMMANDS * sizeof(DrawCommand));
+    float viewWidth = getViewWidth();
+    float viewHeight = getViewHeight();
+    uint32_t lineIndex = 0;
+    char line[RENDER_BATCH_MAX_LINE];
+    double startTime = getSeconds();
+    while (readScene(list, options, lineIndex, line, sizeof(line))) {
+        NI_TRACE_SCOPE("RenderBatch scene");
+        uint32_t scene = stats.sceneNum++;
+        DrawCapture capture(line);
+        if (!capture.isValid() || capture.getFrameNum() == 0) {
+            NI_LOG("Skipping %s, it isn't a draw capture with frames", line);
+            stats.skippedNum++;
+            continue;
+        }
+        const DrawCaptureFrame& frame = capture.getFrame(capture.getFrameNum() - 1);
+        const DrawCaptureImage* images = capture.getFrameImages(frame);
+        uint32_t placeholderNum = 0;
+        for (uint32_t image = 0; image < frame.imageNum; ++image) {
+            const BatchTexture& texture = acquireBatchTexture(textures, options.pack, capture.getTexture(images[image].textureIndex), scene);
+            frameImages[image] = texture.texture;
+            frameMeshes[image] = images[image].mesh;
+            placeholderNum += texture.placeholder ? 1 : 0;
+        }
+        fitCommands(capture, frame, viewWidth, viewHeight, commands);
+
+        char path[NI_READBACK_MAX_PATH];
+        getOutputPath(line, options, path, sizeof(path));
+        // Unlike screenshots every scene has to reach the disk. When the encoders fall behind the ring fills up,
+        // let the GPU and them catch up instead of dropping the scene.
+        if (!readback->hasFreeSlot()) {
+            NI_TRACE_SCOPE("RenderBatch wait for readback");
+            waitForAllFrames();
+            readback->waitIdle();
+        }
+        spriteRenderer->replayFrame(commands, frame.drawCommandNum, frameImages, frameMeshes, frame.imageNum);
+        FrameData& frameData = beginFrame();
+        spriteRenderer->flushCommands(frameData);
+        readback->requestScreenshot(path, options.encoding);
+        endFrame();
+        present(false);
+        waitForCurrentFrame();
+        countScene(line, placeholderNum, frame.imageNum, stats);
+    }
+    fclose(list);
+    waitForAllFrames();
+    readback->waitIdle();
+    stats.seconds = getSeconds() - startTime;
+    ReadbackStats readbackEnd = readback->getStats();
+    stats.writtenNum = readbackEnd.writtenNum - readbackStart.writtenNum;
+    stats.failedNum = readbackEnd.failedNum - readbackStart.failedNum;
+    logBatchStats(options, stats);
+
+    spriteRenderer->reset();
+    for (uint32_t index = 0; index < textures.getNum(); ++index) {
+        destroyTexture(textures.getData()[index].texture);
+    }
+    textures.destroy();
+    free(commands);
+    free(frameMeshes);
+    free(frameImages);
+    return stats;
+}
+
+ni::RenderBatchStats ni::renderBatchSoftware(const RenderBatchOptions& options, uint32_t width, uint32_t height) {
+    NI_ASSERT(options.shardIndex < options.shardNum, "Shard %u of %u doesn't exist", options.shardIndex, options.shardNum);
+    RenderBatchStats stats = {};
+    FILE* list = fopen(options.listPath, "r");
+    if (list == nullptr) {
+        NI_LOG("Failed to open scene list %s", options.listPath);
+        return stats;
+    }
+    SoftwareRasterizer rasterizer;
+    rasterizer.init(width, height);
+    Array<SoftwareBatchTexture, uint32_t> textures;
+    // Missing textures are opaque white, their size doesn't change what a solid color samples to.
+    const uint32_t placeholder = NI_COLOR_RGBA_UINT(0xff, 0xff, 0xff, 0xff);
+    SpriteMesh* frameMeshes = (SpriteMesh*)malloc(NI_MAX_DESCRIPTORS * sizeof(SpriteMesh));
+    DrawCommand* commands = (DrawCommand*)malloc(MAX_DRAW_COMMANDS * sizeof(DrawCommand));
+    // Grown to the largest scene, a full flush worth of quads would be 200 MB.
+    SpriteQuad* quads = nullptr;
+    uint32_t quadCapacity = 0;
+    uint32_t lineIndex = 0;
+    char line[RENDER_BATCH_MAX_LINE];
+    double startTime = getSeconds();
+    while (readScene(list, options, lineIndex, line, sizeof(line))) {
+        NI_TRACE_SCOPE("RenderBatch software scene");
+        stats.sceneNum++;
+        DrawCapture capture(line);
+        if (!capture.isValid() || capture.getFrameNum() == 0) {
+            NI_LOG("Skipping %s, it isn't a draw capture with frames", line);
+            stats.skippedNum++;
+            continue;
+        }
+        const DrawCaptureFrame& frame = capture.getFrame(capture.getFrameNum() - 1);
+        const DrawCaptureImage* images = capture.getFrameImages(frame);
+        uint32_t placeholderNum = 0;
+        for (uint32_t image = 0; image < frame.imageNum; ++image) {
+            const DrawCaptureTexture& desc = capture.getTexture(images[image].textureIndex);
+            const SoftwareBatchTexture& texture = acquireSoftwareBatchTexture(textures, options.pack, desc);
+            if (texture.mipChain != nullptr) {
+                rasterizer.setTexture(image, { (const uint8_t*)texture.mipChain, desc.width, desc.height, desc.mipLevels });
+            } else {
+                rasterizer.setTexture(image, { (const uint8_t*)&placeholder, 1, 1, 1 });
+                placeholderNum++;
+            }
+            frameMeshes[image] = images[image].mesh;
+        }
+        fitCommands(capture, frame, (float)width, (float)height, commands);
+        // Images are set at their mesh slot, which the capture keeps above the bindless index.
+        for (uint32_t index = 0; index < frame.drawCommandNum; ++index) {
+            uint32_t textureId = commands[index].textureId;
+            commands[index].textureId = (textureId & ~TEXTURE_ID_INDEX_MASK) | (textureId >> TEXTURE_ID_MESH_SHIFT);
+        }
+        if (frame.drawCommandNum > quadCapacity) {
+            free(quads);
+            quadCapacity = frame.drawCommandNum;
+            quads = (SpriteQuad*)malloc((size_t)quadCapacity * sizeof(SpriteQuad));
+        }
+        generateSpritesCpu(commands, frame.drawCommandNum, frameMeshes, (float)width, (float)height, quads);
+        rasterizer.clear(NI_COLOR_RGBA_UINT(0, 0, 0, 0xff));
+        rasterizer.drawSprites(quads, frame.drawCommandNum);
+        countScene(line, placeholderNum, frame.imageNum, stats);
+
+        char path[NI_READBACK_MAX_PATH];
+        getOutputPath(line, options, path, sizeof(path));
+        size_t size = 0;
+        void* data = options.encoding == READBACK_ENCODING_QOI ? encodeQoi(rasterizer.getPixels(), width, height, width * 4, false, size)
+            : encodePng(rasterizer.getPixels(), width, height, width * 4, false, size);
+        if (writeFile(path, data, size)) {
+            stats.writtenNum++;
+        } else {
+            NI_LOG("Failed to write %s", path);
+            stats.failedNum++;
+        }
+        free(data);
+    }
+    fclose(list);
+    stats.seconds = getSeconds() - startTime;
+    logBatchStats(options, stats);
+    const SoftwareRasterStats& rasterStats = rasterizer.getStats();
+    NI_LOG("Software rasterizer: %llu triangles, %llu pixels shaded, bin %.2f ms, raster %.2f ms", rasterStats.trianglesRasterized,
+        rasterStats.pixelsShaded, rasterStats.binMs, rasterStats.rasterMs);
+
+    rasterizer.destroy();
+    for (uint32_t index = 0; index < textures.getNum(); ++index) {
+        free(textures.getData()[index].mipChain);
+    }
+    textures.destroy();
+    free(quads);
+    free(commands);
+    free(frameMeshes);
+    return stats;
+}
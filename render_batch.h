@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ni.h"
+#include "asset_pack.h"
+#include "readback.h"
+
+struct SpriteRenderer;
+
+namespace ni {
+
+	struct RenderBatchOptions {
+		// Text file with one draw capture per line, see draw_capture.h. Empty lines and lines starting with #
+		// are ignored. Every capture is a scene and its last frame is the one rendered, earlier frames can miss
+		// textures that were still streaming in.
+		const char* listPath;
+		// Images are written here as <capture name>.png or .qoi. The directory has to exist.
+		const char* outputDir;
+		ReadbackEncoding encoding;
+		// Processes given the same list and shardNum split it without talking to each other, scene n of the
+		// list goes to shard n % shardNum.
+		uint32_t shardIndex;
+		uint32_t shardNum;
+		// Captured images are looked up here by asset name, can be null. Images it doesn't have are drawn as
+		// opaque white placeholders.
+		const AssetPack* pack;
+	};
+
+	struct RenderBatchStats {
+		uint32_t sceneNum;
+		uint32_t renderedNum;
+		// Captures that didn't open or had no frames, and scenes with images the pack doesn't have.
+		uint32_t skippedNum;
+		uint64_t writtenNum;
+		uint64_t failedNum;
+		double seconds;
+	};
+
+	// Renders the scenes of this process' shard at the renderer's size, scaled to fit and centered, and writes
+	// them through the readback ring. Expects ni::init with INIT_OFFSCREEN, add INIT_WARP_ADAPTER where there's
+	// no GPU. Captured textures are the pack's like on replay.
+	RenderBatchStats renderBatch(SpriteRenderer* spriteRenderer, const RenderBatchOptions& options);
+	// Same scenes and textures drawn by SoftwareRasterizer at width x height, no device needed. Rasterizes on
+	// the loader threads and encodes on the calling one.
+	RenderBatchStats renderBatchSoftware(const RenderBatchOptions& options, uint32_t width, uint32_t height);
+	// Parses "<index>/<num>".
+	bool parseShard(const char* text, uint32_t& outShardIndex, uint32_t& outShardNum);
+}
@@ -0,0 +1,553 @@
+#include "render_graph.h"
+#include "gpu_profiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_RENDER_GRAPH_BENCH_ITERATIONS 200
+#define NI_RENDER_GRAPH_BENCH_WIDTH 1920
+#define NI_RENDER_GRAPH_BENCH_HEIGHT 1080
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t getBytesPerPixel(DXGI_FORMAT format) {
+    switch (format) {
+    case DXGI_FORMAT_R8_UNORM: return 1;
+    case DXGI_FORMAT_R16_FLOAT: return 2;
+    case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
+    case DXGI_FORMAT_R32G32_FLOAT: return 8;
+    case DXGI_FORMAT_R32G32B32A32_FLOAT: return 16;
+    default: return 4;
+    }
+}
+
+static ni::RenderGraphHeap getTransientHeap(const D3D12_RESOURCE_DESC& desc) {
+    if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER) return ni::RENDER_GRAPH_HEAP_BUFFERS;
+    if ((desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0) return ni::RENDER_GRAPH_HEAP_TARGETS;
+    return ni::RENDER_GRAPH_HEAP_TEXTURES;
+}
+
+static D3D12_RESOURCE_STATES getTransientInitialState(const D3D12_RESOURCE_DESC& desc) {
+    if ((desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0) return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    if ((desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) != 0) return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    return D3D12_RESOURCE_STATE_COMMON;
+}
+
+static bool isSameDesc(const D3D12_RESOURCE_DESC& a, const D3D12_RESOURCE_DESC& b) {
+    return a.Dimension == b.Dimension && a.Width == b.Width && a.Height == b.Height && a.Format == b.Format && a.Flags == b.Flags;
+}
+
+ni::Resource* ni::RenderPassContext::getResource(RenderGraphHandle handle) const {
+    return graph->getResource(handle);
+}
+
+ni::RenderGraph::RenderGraph() : stats({}), frameNumber(0), compiled(false) {
+    for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+        planners[heap].init(NI_RENDER_GRAPH_PLAN_SIZE, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+        heaps[heap] = { nullptr, 0 };
+        heapPeaks[heap] = 0;
+    }
+}
+
+ni::RenderGraph::~RenderGraph() {
+    destroy();
+    for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+        planners[heap].destroy();
+    }
+    resources.destroy();
+    accesses.destroy();
+    passes.destroy();
+    order.destroy();
+    lifetimeStarts.destroy();
+    lifetimeEnds.destroy();
+    physicalResources.destroy();
+    retiredHeaps.destroy();
+}
+
+void ni::RenderGraph::destroy() {
+    for (uint32_t index = 0; index < physicalResources.getNum(); ++index) {
+        PhysicalResource& physical = physicalResources.getData()[index];
+        if (physical.heap != nullptr) NI_D3D_RELEASE(physical.resource.resource);
+    }
+    physicalResources.reset();
+    for (uint32_t index = 0; index < retiredHeaps.getNum(); ++index) {
+        NI_D3D_RELEASE(retiredHeaps.getData()[index].heap);
+    }
+    retiredHeaps.reset();
+    for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+        NI_D3D_RELEASE(heaps[heap].heap);
+        heaps[heap].size = 0;
+    }
+}
+
+void ni::RenderGraph::reset() {
+    frameNumber++;
+    for (uint32_t index = 0; index < physicalResources.getNum();) {
+        PhysicalResource& physical = physicalResources.getData()[index];
+        physical.inUse = false;
+        // Buffers decayed to COMMON when the last frame's command list was executed.
+        if (physical.resource.dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+            physical.resource.state = D3D12_RESOURCE_STATE_COMMON;
+        }
+        // Frames that could still use it have finished once NI_FRAME_COUNT more frames began.
+        if (frameNumber - physical.lastUsedFrame > NI_FRAME_COUNT) {
+            if (physical.heap != nullptr) NI_D3D_RELEASE(physical.resource.resource);
+            physicalResources.getData()[index] = physicalResources.getData()[physicalResources.getNum() - 1];
+            physicalResources.remove(physicalResources.getNum() - 1);
+            continue;
+        }
+        index++;
+    }
+    for (uint32_t index = 0; index < retiredHeaps.getNum();) {
+        RetiredHeap& retired = retiredHeaps.getData()[index];
+        if (frameNumber - retired.retiredFrame > NI_FRAME_COUNT) {
+            NI_D3D_RELEASE(retired.heap);
+            retiredHeaps.getData()[index] = retiredHeaps.getData()[retiredHeaps.getNum() - 1];
+            retiredHeaps.remove(retiredHeaps.getNum() - 1);
+            continue;
+        }
+        index++;
+    }
+    resources.reset();
+    accesses.reset();
+    passes.reset();
+    order.reset();
+    compiled = false;
+}
+
+ni::RenderGraphHandle ni::RenderGraph::addResource(const char* name, Resource* imported, const D3D12_RESOURCE_DESC& desc, bool output) {
+    ResourceData data = {};
+    data.name = name;
+    data.imported = imported;
+    data.desc = desc;
+    data.physicalIndex = NI_RENDER_GRAPH_INVALID_HANDLE;
+    data.output = output;
+    if (imported == nullptr) {
+        data.heap = getTransientHeap(desc);
+        ID3D12Device* device = getDevice();
+        if (device != nullptr) {
+            D3D12_RESOURCE_ALLOCATION_INFO allocationInfo = device->GetResourceAllocationInfo(0, 1, &desc);
+            data.allocationSize = allocationInfo.SizeInBytes;
+            data.allocationAlignment = allocationInfo.Alignment;
+        } else {
+            // Headless, close enough to what the driver reports for uncompressed single mip resources.
+            uint64_t size = desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER ? desc.Width : desc.Width * desc.Height * getBytesPerPixel(desc.Format);
+            data.allocationSize = alignUp(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+            data.allocationAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        }
+    }
+    resources.add(data);
+    return resources.getNum() - 1;
+}
+
+ni::RenderGraphHandle ni::RenderGraph::importResource(const char* name, Resource* resource, bool output) {
+    NI_ASSERT(resource != nullptr, "Imported a null resource into the render graph");
+    D3D12_RESOURCE_DESC desc = {};
+    desc.Dimension = resource->dimension;
+    return addResource(name, resource, desc, output);
+}
+
+ni::RenderGraphHandle ni::RenderGraph::createBuffer(const char* name, uint64_t size, D3D12_RESOURCE_FLAGS flags) {
+    D3D12_RESOURCE_DESC desc = {
+        D3D12_RESOURCE_DIMENSION_BUFFER,
+        0,
+        size,
+        1,
+        1,
+        1,
+        DXGI_FORMAT_UNKNOWN,
+        { 1, 0 },
+        D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+        flags
+    };
+    return addResource(name, nullptr, desc, false);
+}
+
+ni::RenderGraphHandle ni::RenderGraph::createTexture(const char* name, uint32_t width, uint32_t height, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags) {
+    D3D12_RESOURCE_DESC desc = {
+        D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+        0,
+        width,
+        height,
+        1,
+        1,
+        format,
+        { 1, 0 },
+        D3D12_TEXTURE_LAYOUT_UNKNOWN,
+        flags
+    };
+    return addResource(name, nullptr, desc, false);
+}
+
+uint32_t ni::RenderGraph::addPass(const char* name, RenderPassFunction function, void* userData) {
+    NI_ASSERT(!compiled, "Added a pass to a compiled render graph, reset it first");
+    passes.add({ name, function, userData, accesses.getNum(), 0, false });
+    return passes.getNum() - 1;
+}
+
+void ni::RenderGraph::addAccess(RenderGraphHandle handle, D3D12_RESOURCE_STATES state, bool write) {
+    NI_ASSERT(passes.getNum() > 0, "Render graph access without a pass");
+    NI_ASSERT(handle < resources.getNum(), "Invalid render graph handle");
+    PassData& pass = passes.getData()[passes.getNum() - 1];
+    // Reading a resource in several read states is one access in the combined state.
+    for (uint32_t index = pass.firstAccess; index < pass.firstAccess + pass.accessNum; ++index) {
+        Access& access = accesses.getData()[index];
+        if (access.resource != handle) continue;
+        NI_ASSERT(!write && !access.write, "Pass %s accesses %s twice while writing it", pass.name, resources.getData()[handle].name);
+        access.state |= state;
+        return;
+    }
+    accesses.add({ handle, state, D3D12_RESOURCE_STATE_COMMON, false, write });
+    pass.accessNum++;
+}
+
+void ni::RenderGraph::read(RenderGraphHandle handle, D3D12_RESOURCE_STATES state) {
+    addAccess(handle, state, false);
+}
+
+void ni::RenderGraph::write(RenderGraphHandle handle, D3D12_RESOURCE_STATES state) {
+    addAccess(handle, state, true);
+}
+
+void ni::RenderGraph::compile() {
+    stats = {};
+    stats.passNum = passes.getNum();
+
+    // Walk backwards from the outputs. A pass survives when it writes something a surviving later pass reads.
+    for (uint32_t index = 0; index < resources.getNum(); ++index) {
+        ResourceData& resource = resources.getData()[index];
+        resource.needed = resource.output;
+        resource.firstPass = NI_RENDER_GRAPH_INVALID_HANDLE;
+        resource.lastPass = NI_RENDER_GRAPH_INVALID_HANDLE;
+        resource.lastAccess = NI_RENDER_GRAPH_INVALID_HANDLE;
+        resource.physicalIndex = NI_RENDER_GRAPH_INVALID_HANDLE;
+    }
+    for (uint32_t passIndex = passes.getNum(); passIndex-- > 0;) {
+        PassData& pass = passes.getData()[passIndex];
+        const Access* passAccesses = accesses.getData() + pass.firstAccess;
+        pass.culled = true;
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            if (passAccesses[index].write && resources.getData()[passAccesses[index].resource].needed) {
+                pass.culled = false;
+                break;
+            }
+        }
+        if (pass.culled) {
+            stats.culledPassNum++;
+            continue;
+        }
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            if (!passAccesses[index].write) resources.getData()[passAccesses[index].resource].needed = true;
+        }
+    }
+
+    // Lifetimes in execution order, and the state every access hands over to the next one.
+    order.reset();
+    for (uint32_t passIndex = 0; passIndex < passes.getNum(); ++passIndex) {
+        const PassData& pass = passes.getData()[passIndex];
+        if (pass.culled) continue;
+        uint32_t position = order.getNum();
+        order.add(passIndex);
+        for (uint32_t index = pass.firstAccess; index < pass.firstAccess + pass.accessNum; ++index) {
+            Access& access = accesses.getData()[index];
+            ResourceData& resource = resources.getData()[access.resource];
+            if (resource.firstPass == NI_RENDER_GRAPH_INVALID_HANDLE) resource.firstPass = position;
+            resource.lastPass = position;
+            if (resource.lastAccess != NI_RENDER_GRAPH_INVALID_HANDLE) {
+                Access& previous = accesses.getData()[resource.lastAccess];
+                previous.nextState = access.state;
+                previous.hasNext = true;
+            }
+            access.hasNext = false;
+            resource.lastAccess = index;
+        }
+    }
+
+    // Sweep over the passes: a transient gets its memory before its first pass and returns it after its last,
+    // so later transients reuse it.
+    lifetimeStarts.reset();
+    lifetimeEnds.reset();
+    for (uint32_t index = 0; index < resources.getNum(); ++index) {
+        const ResourceData& resource = resources.getData()[index];
+        if (resource.imported != nullptr || resource.firstPass == NI_RENDER_GRAPH_INVALID_HANDLE) continue;
+        lifetimeStarts.add(index);
+        lifetimeEnds.add(index);
+    }
+    // qsort has no context argument, the keys go through a static.
+    static thread_local const ResourceData* sortResources = nullptr;
+    sortResources = resources.getData();
+    qsort(lifetimeStarts.getData(), lifetimeStarts.getNum(), sizeof(RenderGraphHandle), [](const void* a, const void* b) {
+        uint32_t left = sortResources[*(const uint32_t*)a].firstPass;
+        uint32_t right = sortResources[*(const uint32_t*)b].firstPass;
+        return left < right ? -1 : (left > right ? 1 : 0);
+    });
+    qsort(lifetimeEnds.getData(), lifetimeEnds.getNum(), sizeof(RenderGraphHandle), [](const void* a, const void* b) {
+        uint32_t left = sortResources[*(const uint32_t*)a].lastPass;
+        uint32_t right = sortResources[*(const uint32_t*)b].lastPass;
+        return left < right ? -1 : (left > right ? 1 : 0);
+    });
+    for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+        heapPeaks[heap] = 0;
+    }
+    uint32_t startIndex = 0;
+    uint32_t endIndex = 0;
+    for (uint32_t position = 0; position < order.getNum(); ++position) {
+        for (; startIndex < lifetimeStarts.getNum(); ++startIndex) {
+            ResourceData& resource = resources.getData()[lifetimeStarts.getData()[startIndex]];
+            if (resource.firstPass != position) break;
+            HeapRange range = {};
+            bool allocated = planners[resource.heap].allocate(resource.allocationSize, resource.allocationAlignment, range);
+            NI_ASSERT(allocated, "Render graph transients don't fit in NI_RENDER_GRAPH_PLAN_SIZE");
+            resource.heapOffset = range.offset;
+            resource.heapNode = range.node;
+            uint64_t end = range.offset + resource.allocationSize;
+            heapPeaks[resource.heap] = end > heapPeaks[resource.heap] ? end : heapPeaks[resource.heap];
+            stats.transientNum++;
+            stats.transientBytes += resource.allocationSize;
+        }
+        for (; endIndex < lifetimeEnds.getNum(); ++endIndex) {
+            ResourceData& resource = resources.getData()[lifetimeEnds.getData()[endIndex]];
+            if (resource.lastPass != position) break;
+            planners[resource.heap].free(resource.heapNode);
+        }
+    }
+    for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+        stats.heapBytes += heapPeaks[heap];
+    }
+    compiled = true;
+}
+
+uint32_t ni::RenderGraph::findPhysicalResource(const ResourceData& resourceData) {
+    ID3D12Heap* heap = heaps[resourceData.heap].heap;
+    for (uint32_t index = 0; index < physicalResources.getNum(); ++index) {
+        const PhysicalResource& physical = physicalResources.getData()[index];
+        if (!physical.inUse && physical.heap == heap && physical.heapOffset == resourceData.heapOffset && isSameDesc(physical.desc, resourceData.desc)) {
+            return index;
+        }
+    }
+    return NI_RENDER_GRAPH_INVALID_HANDLE;
+}
+
+void ni::RenderGraph::realizeTransients() {
+    ID3D12Device* device = getDevice();
+    if (device != nullptr) {
+        for (uint32_t heap = 0; heap < RENDER_GRAPH_HEAP_COUNT; ++heap) {
+            if (heapPeaks[heap] <= heaps[heap].size) continue;
+            // Placed resources of the old heap keep it alive, it goes once the frames using them are done.
+            if (heaps[heap].heap != nullptr) retiredHeaps.add({ heaps[heap].heap, frameNumber });
+            static const D3D12_HEAP_FLAGS heapFlags[RENDER_GRAPH_HEAP_COUNT] = {
+                D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+                D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+                D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES
+            };
+            D3D12_HEAP_DESC heapDesc = {
+                alignUp(heapPeaks[heap], NI_RENDER_GRAPH_HEAP_ALIGNMENT),
+                { D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 0, 0 },
+                D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
+                heapFlags[heap] | D3D12_HEAP_FLAG_CREATE_NOT_ZEROED
+            };
+            NI_D3D_ASSERT(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heaps[heap].heap)), "Failed to create render graph heap");
+            heaps[heap].heap->SetName(L"ni::RenderGraph::transientHeap");
+            heaps[heap].size = heapDesc.SizeInBytes;
+        }
+    }
+
+    for (uint32_t index = 0; index < resources.getNum(); ++index) {
+        ResourceData& resource = resources.getData()[index];
+        if (resource.imported != nullptr || resource.firstPass == NI_RENDER_GRAPH_INVALID_HANDLE) continue;
+        uint32_t physicalIndex = findPhysicalResource(resource);
+        if (physicalIndex == NI_RENDER_GRAPH_INVALID_HANDLE) {
+            PhysicalResource physical = {};
+            physical.desc = resource.desc;
+            physical.heap = heaps[resource.heap].heap;
+            physical.heapOffset = resource.heapOffset;
+            physical.resource.state = getTransientInitialState(resource.desc);
+            physical.resource.dimension = resource.desc.Dimension;
+            if (device != nullptr) {
+                NI_D3D_ASSERT(device->CreatePlacedResource(physical.heap, physical.heapOffset, &resource.desc, physical.resource.state, nullptr, IID_PPV_ARGS(&physical.resource.resource)), "Failed to create render graph transient");
+                wchar_t name[128] = {};
+                mbstowcs(name, resource.name, 127);
+                physical.resource.resource->SetName(name);
+            } else {
+                // Headless resources are never dereferenced, they only need to be unique for the barriers.
+                physical.resource.resource = (ID3D12Resource*)(uintptr_t)(((frameNumber << 24) + physicalResources.getNum() + 1) << 4);
+            }
+            physicalResources.add(physical);
+            physicalIndex = physicalResources.getNum() - 1;
+        }
+        PhysicalResource& physical = physicalResources.getData()[physicalIndex];
+        physical.inUse = true;
+        physical.lastUsedFrame = frameNumber;
+        resource.physicalIndex = physicalIndex;
+    }
+}
+
+ni::Resource* ni::RenderGraph::getResource(RenderGraphHandle handle) {
+    ResourceData& resource = resources.getData()[handle];
+    if (resource.imported != nullptr) return resource.imported;
+    NI_ASSERT(resource.physicalIndex != NI_RENDER_GRAPH_INVALID_HANDLE, "Render graph transient %s has no memory, it's unused or the graph isn't executing", resource.name);
+    return &physicalResources.getData()[resource.physicalIndex].resource;
+}
+
+void ni::RenderGraph::execute(ID3D12GraphicsCommandList* commandList, ResourceStateTracker& barriers, GpuProfiler* profiler) {
+    NI_ASSERT(compiled, "Render graph executed without compiling");
+    realizeTransients();
+    uint32_t startBarrierNum = barriers.getBarrierNum();
+    RenderPassContext context = { this, commandList, 0 };
+    for (uint32_t position = 0; position < order.getNum(); ++position) {
+        const PassData& pass = passes.getData()[order.getData()[position]];
+        const Access* passAccesses = accesses.getData() + pass.firstAccess;
+
+        // The memory may have belonged to another transient earlier in this frame or the last one.
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            const ResourceData& resource = resources.getData()[passAccesses[index].resource];
+            if (resource.imported == nullptr && resource.firstPass == position) barriers.aliasingBarrier(getResource(passAccesses[index].resource));
+        }
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            Resource* resource = getResource(passAccesses[index].resource);
+            if (passAccesses[index].state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && resource->state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS) {
+                barriers.uavBarrier(resource);
+            }
+            barriers.require(resource, passAccesses[index].state);
+        }
+        barriers.flush(commandList);
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            const ResourceData& resource = resources.getData()[passAccesses[index].resource];
+            D3D12_RESOURCE_STATES state = passAccesses[index].state;
+            bool discard = state == D3D12_RESOURCE_STATE_RENDER_TARGET || state == D3D12_RESOURCE_STATE_DEPTH_WRITE ||
+                (state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && resource.desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER);
+            if (resource.imported == nullptr && resource.firstPass == position && discard && commandList != nullptr) {
+                commandList->DiscardResource(getResource(passAccesses[index].resource)->resource, nullptr);
+            }
+        }
+
+        context.pass = order.getData()[position];
+        uint32_t scope = profiler != nullptr ? profiler->beginScope(commandList, GPU_PROFILER_QUEUE_DIRECT, pass.name) : NI_GPU_PROFILER_INVALID_SCOPE;
+        if (pass.function != nullptr) pass.function(context, pass.userData);
+        if (profiler != nullptr) profiler->endScope(commandList, scope);
+
+        // Transitions to the next user's state begin now and end right before that pass.
+        for (uint32_t index = 0; index < pass.accessNum; ++index) {
+            if (passAccesses[index].hasNext) barriers.prepare(getResource(passAccesses[index].resource), passAccesses[index].nextState);
+        }
+    }
+    stats.barrierNum = barriers.getBarrierNum() - startBarrierNum;
+}
+
+struct RenderGraphBench {
+    ni::Resource backbuffer;
+    uint8_t fakeBackbuffer;
+    uint32_t executedNum;
+    uint32_t expectedCulledNum;
+};
+
+static void benchPass(ni::RenderPassContext&, void* userData) {
+    ((RenderGraphBench*)userData)->executedNum++;
+}
+
+// Sprite generation and rendering followed by a chain of post effects, alternating full and reduced resolution
+// render targets and compute passes. Every seventh pass draws a debug view nobody reads.
+static void buildBenchGraph(ni::RenderGraph& graph, RenderGraphBench& bench, uint32_t passNum) {
+    bench.expectedCulledNum = 0;
+    ni::RenderGraphHandle backbuffer = graph.importResource("backbuffer", &bench.backbuffer, true);
+    ni::RenderGraphHandle vertices = graph.createBuffer("vertices", 64ull << 20, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+    graph.addPass("SpriteGen", benchPass, &bench);
+    graph.write(vertices, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    ni::RenderGraphHandle color = graph.createTexture("sceneColor", NI_RENDER_GRAPH_BENCH_WIDTH, NI_RENDER_GRAPH_BENCH_HEIGHT, DXGI_FORMAT_R16G16B16A16_FLOAT, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+    graph.addPass("SpriteRender", benchPass, &bench);
+    graph.read(vertices, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    graph.write(color, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    for (uint32_t pass = 2; pass + 1 < passNum; ++pass) {
+        uint32_t shift = pass % 4;
+        uint32_t width = NI_RENDER_GRAPH_BENCH_WIDTH >> shift;
+        uint32_t height = NI_RENDER_GRAPH_BENCH_HEIGHT >> shift;
+        if (pass % 7 == 0) {
+            ni::RenderGraphHandle debug = graph.createTexture("debugView", width, height, DXGI_FORMAT_R8G8B8A8_UNORM, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+            graph.addPass("DebugView", benchPass, &bench);
+            graph.read(color, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            graph.write(debug, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            bench.expectedCulledNum++;
+        } else if (pass % 5 == 0) {
+            ni::RenderGraphHandle target = graph.createTexture("computePost", width, height, DXGI_FORMAT_R16G16B16A16_FLOAT, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+            graph.addPass("ComputePost", benchPass, &bench);
+            graph.read(color, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+            graph.write(target, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+            color = target;
+        } else {
+            ni::RenderGraphHandle target = graph.createTexture("post", width, height, DXGI_FORMAT_R16G16B16A16_FLOAT, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+            graph.addPass("Post", benchPass, &bench);
+            graph.read(color, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+            graph.write(target, D3D12_RESOURCE_STATE_RENDER_TARGET);
+            color = target;
+        }
+    }
+
+    graph.addPass("Composite", benchPass, &bench);
+    graph.read(color, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+    graph.write(backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+}
+
+// Transients alive during the same pass in the same heap must not share memory.
+static uint32_t countOverlaps(const ni::RenderGraph& graph) {
+    uint32_t overlapNum = 0;
+    for (uint32_t a = 0; a < graph.getResourceNum(); ++a) {
+        if (!graph.isTransient(a) || graph.getFirstPass(a) == NI_RENDER_GRAPH_INVALID_HANDLE) continue;
+        for (uint32_t b = a + 1; b < graph.getResourceNum(); ++b) {
+            if (!graph.isTransient(b) || graph.getFirstPass(b) == NI_RENDER_GRAPH_INVALID_HANDLE || graph.getHeap(a) != graph.getHeap(b)) continue;
+            bool livesTogether = graph.getFirstPass(a) <= graph.getLastPass(b) && graph.getFirstPass(b) <= graph.getLastPass(a);
+            bool sharesMemory = graph.getHeapOffset(a) < graph.getHeapOffset(b) + graph.getAllocationSize(b) &&
+                graph.getHeapOffset(b) < graph.getHeapOffset(a) + graph.getAllocationSize(a);
+            if (livesTogether && sharesMemory) overlapNum++;
+        }
+    }
+    return overlapNum;
+}
+
+uint32_t ni::benchmarkRenderGraph() {
+    static const uint32_t passNums[] = { 16, 64, 256, 1024 };
+    NI_LOG("Render graph, %u builds per size:", NI_RENDER_GRAPH_BENCH_ITERATIONS);
+    uint32_t errorNum = 0;
+    for (uint32_t size = 0; size < sizeof(passNums) / sizeof(passNums[0]); ++size) {
+        RenderGraph graph;
+        ResourceStateTracker barriers;
+        RenderGraphBench bench = {};
+        bench.backbuffer = { (ID3D12Resource*)&bench.fakeBackbuffer, D3D12_RESOURCE_STATE_PRESENT, 0, {}, D3D12_RESOURCE_DIMENSION_TEXTURE2D };
+        barriers.setRecording(true);
+
+        double buildTime = 0.0;
+        double executeTime = 0.0;
+        uint32_t overlapNum = 0;
+        for (uint32_t iteration = 0; iteration < NI_RENDER_GRAPH_BENCH_ITERATIONS; ++iteration) {
+            double startTime = getSeconds();
+            graph.reset();
+            buildBenchGraph(graph, bench, passNums[size]);
+            graph.compile();
+            buildTime += getSeconds() - startTime;
+
+            bench.executedNum = 0;
+            barriers.clearHistory();
+            startTime = getSeconds();
+            graph.execute(nullptr, barriers);
+            barriers.require(&bench.backbuffer, D3D12_RESOURCE_STATE_PRESENT);
+            barriers.flush(nullptr);
+            executeTime += getSeconds() - startTime;
+
+            if (iteration == 0) overlapNum = countOverlaps(graph);
+        }
+
+        const RenderGraphStats& stats = graph.getStats();
+        bool culledRight = stats.culledPassNum == bench.expectedCulledNum && bench.executedNum == stats.passNum - stats.culledPassNum;
+        // Every transition has to start where the resource is, which the tracker only gets wrong if the graph
+        // handed it accesses out of order.
+        bool statesRight = bench.backbuffer.state == D3D12_RESOURCE_STATE_PRESENT && !barriers.hasPendingSplits();
+        errorNum += (culledRight ? 0 : 1) + (statesRight ? 0 : 1) + overlapNum;
+        NI_LOG(" %4u passes: %3u culled, %4u transients %7.1f MB aliased into %5.1f MB, build+compile %8.2f us, execute %8.2f us, %u barriers, %u overlaps%s",
+            stats.passNum, stats.culledPassNum, stats.transientNum,
+            (double)stats.transientBytes / (1 << 20), (double)stats.heapBytes / (1 << 20),
+            buildTime * 1e6 / NI_RENDER_GRAPH_BENCH_ITERATIONS, executeTime * 1e6 / NI_RENDER_GRAPH_BENCH_ITERATIONS,
+            barriers.getHistory().getNum(), overlapNum, culledRight && statesRight ? "" : " INVALID");
+    }
+    return errorNum;
+}
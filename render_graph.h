@@ -0,0 +1,167 @@
+#pragma once
+
+#include "ni.h"
+#include "heap_allocator.h"
+#include "resource_state_tracker.h"
+
+#define NI_RENDER_GRAPH_INVALID_HANDLE 0xffffffffu
+// Transient heaps grow in steps of this size so a graph that changes a little every frame doesn't recreate them.
+#define NI_RENDER_GRAPH_HEAP_ALIGNMENT (4ull << 20)
+// Address space the transient allocators plan in, the heaps only get as large as the peak of a frame.
+#define NI_RENDER_GRAPH_PLAN_SIZE (16ull << 30)
+
+namespace ni {
+
+	typedef uint32_t RenderGraphHandle;
+	struct RenderGraph;
+
+	struct RenderPassContext {
+		Resource* getResource(RenderGraphHandle handle) const;
+
+		RenderGraph* graph;
+		// Null when the graph runs headless.
+		ID3D12GraphicsCommandList* commandList;
+		uint32_t pass;
+	};
+
+	typedef void(*RenderPassFunction)(RenderPassContext& context, void* userData);
+
+	// Same split as the persistent heap pools, so it also works on resource heap tier 1.
+	enum RenderGraphHeap {
+		RENDER_GRAPH_HEAP_BUFFERS,
+		RENDER_GRAPH_HEAP_TEXTURES,
+		RENDER_GRAPH_HEAP_TARGETS,
+		RENDER_GRAPH_HEAP_COUNT
+	};
+
+	struct RenderGraphStats {
+		uint32_t passNum;
+		uint32_t culledPassNum;
+		uint32_t transientNum;
+		// Sum of all transient allocations, what the frame would need without aliasing.
+		uint64_t transientBytes;
+		// Peak of the aliased transient heaps.
+		uint64_t heapBytes;
+		uint32_t barrierNum;
+	};
+
+	// Built again every frame: declare resources and passes, compile, execute. Passes run in the order they
+	// were added, a pass can only read what was imported or written by an earlier one. Passes that don't
+	// contribute to an output are culled. Transient resources live in heaps that the graph keeps across
+	// frames and share memory when their lifetimes don't overlap. Writes are assumed to keep the previous
+	// contents, so every writer of a needed resource stays. A transient's first writer has to overwrite all
+	// of it, render targets, depth buffers and UAV textures are discarded before that.
+	struct RenderGraph {
+		RenderGraph();
+		~RenderGraph();
+
+		void reset();
+		// Outputs keep the passes writing them alive. The graph leaves them in the state of their last access.
+		RenderGraphHandle importResource(const char* name, Resource* resource, bool output);
+		RenderGraphHandle createBuffer(const char* name, uint64_t size, D3D12_RESOURCE_FLAGS flags);
+		RenderGraphHandle createTexture(const char* name, uint32_t width, uint32_t height, DXGI_FORMAT format, D3D12_RESOURCE_FLAGS flags);
+		// Reads and writes belong to the last added pass.
+		uint32_t addPass(const char* name, RenderPassFunction function, void* userData);
+		void read(RenderGraphHandle handle, D3D12_RESOURCE_STATES state);
+		void write(RenderGraphHandle handle, D3D12_RESOURCE_STATES state);
+		// Culls passes, finds the transient lifetimes and plans the heap offsets. Doesn't touch the device.
+		void compile();
+		// Without a device the transients get placeholder resources and the barriers are only recorded. With a
+		// profiler every pass gets a direct queue scope under its name, its barriers not included.
+		void execute(ID3D12GraphicsCommandList* commandList, ResourceStateTracker& barriers, GpuProfiler* profiler = nullptr);
+		// Releases the heaps and transients, the GPU must be done with them.
+		void destroy();
+		Resource* getResource(RenderGraphHandle handle);
+		bool isPassCulled(uint32_t pass) const { return passes.getData()[pass].culled; }
+		uint64_t getHeapOffset(RenderGraphHandle handle) const { return resources.getData()[handle].heapOffset; }
+		uint64_t getAllocationSize(RenderGraphHandle handle) const { return resources.getData()[handle].allocationSize; }
+		uint32_t getFirstPass(RenderGraphHandle handle) const { return resources.getData()[handle].firstPass; }
+		uint32_t getLastPass(RenderGraphHandle handle) const { return resources.getData()[handle].lastPass; }
+		uint32_t getHeap(RenderGraphHandle handle) const { return resources.getData()[handle].heap; }
+		bool isTransient(RenderGraphHandle handle) const { return resources.getData()[handle].imported == nullptr; }
+		uint32_t getResourceNum() const { return resources.getNum(); }
+		const RenderGraphStats& getStats() const { return stats; }
+
+	private:
+		struct ResourceData {
+			const char* name;
+			// Null for transients.
+			Resource* imported;
+			D3D12_RESOURCE_DESC desc;
+			uint64_t allocationSize;
+			uint64_t allocationAlignment;
+			uint64_t heapOffset;
+			uint32_t heap;
+			uint32_t heapNode;
+			uint32_t physicalIndex;
+			// Positions among the passes that weren't culled, NI_RENDER_GRAPH_INVALID_HANDLE while unused.
+			uint32_t firstPass;
+			uint32_t lastPass;
+			uint32_t lastAccess;
+			bool output;
+			bool needed;
+		};
+
+		struct Access {
+			RenderGraphHandle resource;
+			D3D12_RESOURCE_STATES state;
+			// State of the resource's next access in a later pass, its transition begins right after this pass.
+			D3D12_RESOURCE_STATES nextState;
+			bool hasNext;
+			bool write;
+		};
+
+		struct PassData {
+			const char* name;
+			RenderPassFunction function;
+			void* userData;
+			uint32_t firstAccess;
+			uint32_t accessNum;
+			bool culled;
+		};
+
+		// Placed resources survive the graph so the same layout next frame doesn't create anything.
+		struct PhysicalResource {
+			Resource resource;
+			D3D12_RESOURCE_DESC desc;
+			ID3D12Heap* heap;
+			uint64_t heapOffset;
+			uint64_t lastUsedFrame;
+			bool inUse;
+		};
+
+		struct TransientHeap {
+			ID3D12Heap* heap;
+			uint64_t size;
+		};
+
+		struct RetiredHeap {
+			ID3D12Heap* heap;
+			uint64_t retiredFrame;
+		};
+
+		RenderGraphHandle addResource(const char* name, Resource* imported, const D3D12_RESOURCE_DESC& desc, bool output);
+		void addAccess(RenderGraphHandle handle, D3D12_RESOURCE_STATES state, bool write);
+		void realizeTransients();
+		uint32_t findPhysicalResource(const ResourceData& resourceData);
+
+		Array<ResourceData, uint32_t> resources;
+		Array<Access, uint32_t> accesses;
+		Array<PassData, uint32_t> passes;
+		Array<uint32_t, uint32_t> order;
+		Array<RenderGraphHandle, uint32_t> lifetimeStarts;
+		Array<RenderGraphHandle, uint32_t> lifetimeEnds;
+		Array<PhysicalResource, uint32_t> physicalResources;
+		Array<RetiredHeap, uint32_t> retiredHeaps;
+		TLSFAllocator planners[RENDER_GRAPH_HEAP_COUNT];
+		TransientHeap heaps[RENDER_GRAPH_HEAP_COUNT];
+		uint64_t heapPeaks[RENDER_GRAPH_HEAP_COUNT];
+		RenderGraphStats stats;
+		uint64_t frameNumber;
+		bool compiled;
+	};
+
+	// Builds post-processing style graphs of growing size on the CPU, logs compile cost and aliasing savings,
+	// then executes them headless and checks culling, memory overlap and the barrier sequence. Returns the error count.
+	uint32_t benchmarkRenderGraph();
+}
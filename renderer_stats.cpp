@@ -0,0 +1,176 @@
+#include "renderer_stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_RENDERER_STATS_SLOT_SIZE (FRAME_GPU_COUNTER_COUNT * sizeof(uint32_t))
+#define NI_RENDERER_STATS_VALIDATION_FRAMES 600
+
+ni::RendererStats::RendererStats() : history{}, slots{}, readbackBuffer{}, headlessCounters(nullptr), recordedFrameNum(0), currentSlot(0) {}
+
+void ni::RendererStats::init() {
+    readbackBuffer = createBuffer(L"RendererStats::readbackBuffer", NI_FRAME_COUNT * NI_RENDERER_STATS_SLOT_SIZE, READBACK_BUFFER);
+}
+
+void ni::RendererStats::initHeadless() {
+    headlessCounters = (uint32_t*)calloc(1, NI_FRAME_COUNT * NI_RENDERER_STATS_SLOT_SIZE);
+}
+
+void ni::RendererStats::destroy() {
+    if (readbackBuffer.resource != nullptr) {
+        destroyBuffer(readbackBuffer);
+    }
+    free(headlessCounters);
+    headlessCounters = nullptr;
+}
+
+void ni::RendererStats::beginFrame(uint64_t frameNumber) {
+    currentSlot = (uint32_t)(frameNumber % NI_FRAME_COUNT);
+    if (slots[currentSlot].pending) {
+        collectSlot(currentSlot);
+    }
+    slots[currentSlot] = { frameNumber, false };
+    FrameStats& frame = history[recordedFrameNum % NI_RENDERER_STATS_HISTORY];
+    frame = {};
+    frame.frameNumber = frameNumber;
+    recordedFrameNum++;
+}
+
+ni::FrameStats& ni::RendererStats::getCurrentFrame() {
+    NI_ASSERT(recordedFrameNum > 0, "No frame has begun");
+    return history[(recordedFrameNum - 1) % NI_RENDERER_STATS_HISTORY];
+}
+
+void ni::RendererStats::resolveGpuCounters(ID3D12GraphicsCommandList* commandList, const Resource& counters) {
+    NI_ASSERT(headlessCounters == nullptr, "Headless stats take synthetic counters");
+    commandList->CopyBufferRegion(readbackBuffer.resource, currentSlot * NI_RENDERER_STATS_SLOT_SIZE, counters.resource, counters.offset, NI_RENDERER_STATS_SLOT_SIZE);
+    slots[currentSlot].pending = true;
+}
+
+void ni::RendererStats::setSyntheticGpuCounters(const uint32_t counters[FRAME_GPU_COUNTER_COUNT]) {
+    NI_ASSERT(headlessCounters != nullptr, "Synthetic counters are only taken when headless");
+    memcpy(&headlessCounters[currentSlot * FRAME_GPU_COUNTER_COUNT], counters, NI_RENDERER_STATS_SLOT_SIZE);
+    slots[currentSlot].pending = true;
+}
+
+void ni::RendererStats::collectSlot(uint32_t slot) {
+    slots[slot].pending = false;
+    // The history is far longer than the frames in flight, so the record is only missing if nothing began it.
+    FrameStats* frame = (FrameStats*)findFrame(slots[slot].frameNumber);
+    if (frame == nullptr) return;
+    const uint32_t* counters = nullptr;
+    if (headlessCounters != nullptr) {
+        counters = &headlessCounters[slot * FRAME_GPU_COUNTER_COUNT];
+    } else {
+        counters = (const uint32_t*)mapReadbackBuffer(readbackBuffer, slot * NI_RENDERER_STATS_SLOT_SIZE, NI_RENDERER_STATS_SLOT_SIZE);
+    }
+    memcpy(frame->gpuCounters, counters, NI_RENDERER_STATS_SLOT_SIZE);
+    frame->gpuCountersValid = true;
+    if (headlessCounters == nullptr) {
+        unmapReadbackBuffer(readbackBuffer);
+    }
+}
+
+const ni::FrameStats& ni::RendererStats::getFrame(uint32_t index) const {
+    NI_ASSERT(index < getFrameNum(), "Frame %u isn't in the history", index);
+    uint64_t first = recordedFrameNum - getFrameNum();
+    return history[(first + index) % NI_RENDERER_STATS_HISTORY];
+}
+
+uint32_t ni::RendererStats::getFrameNum() const {
+    return recordedFrameNum < NI_RENDERER_STATS_HISTORY ? (uint32_t)recordedFrameNum : NI_RENDERER_STATS_HISTORY;
+}
+
+const ni::FrameStats* ni::RendererStats::findFrame(uint64_t frameNumber) const {
+    // Frame numbers count up by one, so the record sits at a fixed distance from the newest one.
+    uint32_t frameNum = getFrameNum();
+    if (frameNum == 0) return nullptr;
+    const FrameStats& newest = getFrame(frameNum - 1);
+    if (frameNumber > newest.frameNumber || newest.frameNumber - frameNumber >= frameNum) return nullptr;
+    const FrameStats& frame = getFrame(frameNum - 1 - (uint32_t)(newest.frameNumber - frameNumber));
+    return frame.frameNumber == frameNumber ? &frame : nullptr;
+}
+
+const ni::FrameStats* ni::RendererStats::getLatestCompleteFrame() const {
+    uint32_t frameNum = getFrameNum();
+    for (uint32_t index = 0; index < frameNum; ++index) {
+        const FrameStats& frame = getFrame(frameNum - 1 - index);
+        if (frame.gpuCountersValid) return &frame;
+    }
+    return nullptr;
+}
+
+void ni::RendererStats::log() const {
+    const FrameStats* frame = getLatestCompleteFrame();
+    if (frame == nullptr) return;
+    NI_LOG("  Frame %llu: %u sprites submitted, %u drawn, %u culled, %u skipped, %u images, %u textures uploaded, %.2f MB uploaded, %u transient and %u persistent descriptors",
+        frame->frameNumber, frame->spritesSubmitted, frame->gpuCounters[FRAME_GPU_COUNTER_SPRITES_DRAWN], frame->gpuCounters[FRAME_GPU_COUNTER_SPRITES_CULLED],
+        frame->spritesSkipped, frame->imagesBound, frame->texturesUploaded, (double)frame->uploadBytes / (1024.0 * 1024.0), frame->transientDescriptors, frame->persistentDescriptors);
+}
+
+uint32_t ni::validateRendererStats() {
+    RendererStats* stats = new RendererStats();
+    stats->initHeadless();
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+    // Every frame submits one more sprite than the one before and culls a third of them. Every fifth frame
+    // resolves nothing, like a frame without draws.
+    for (uint64_t frame = 0; frame < NI_RENDERER_STATS_VALIDATION_FRAMES; ++frame) {
+        stats->beginFrame(frame);
+        if (frame >= NI_FRAME_COUNT) {
+            uint64_t collected = frame - NI_FRAME_COUNT;
+            const FrameStats* collectedStats = stats->findFrame(collected);
+            bool resolved = collected % 5 != 0;
+            uint32_t submitted = (uint32_t)collected + 1;
+            checkNum++;
+            if (collectedStats == nullptr || collectedStats->gpuCountersValid != resolved || collectedStats->spritesSubmitted != submitted ||
+                (resolved && (collectedStats->gpuCounters[FRAME_GPU_COUNTER_SPRITES_DRAWN] != submitted - submitted / 3 || collectedStats->gpuCounters[FRAME_GPU_COUNTER_SPRITES_CULLED] != submitted / 3))) {
+                NI_LOG("Renderer stats: frame %llu has the wrong counters after it was collected", collected);
+                errorNum++;
+            }
+        }
+        FrameStats& current = stats->getCurrentFrame();
+        current.spritesSubmitted = (uint32_t)frame + 1;
+        current.uploadBytes = (frame + 1) * 1024;
+        if (frame % 5 != 0) {
+            uint32_t culled = current.spritesSubmitted / 3;
+            uint32_t counters[FRAME_GPU_COUNTER_COUNT] = { current.spritesSubmitted - culled, culled };
+            stats->setSyntheticGpuCounters(counters);
+        }
+    }
+
+    // The history holds the newest frames oldest first, older ones can't be found anymore.
+    checkNum++;
+    if (stats->getFrameNum() != NI_RENDERER_STATS_HISTORY) {
+        NI_LOG("Renderer stats: %u frames in the history instead of %u", stats->getFrameNum(), NI_RENDERER_STATS_HISTORY);
+        errorNum++;
+    }
+    uint64_t firstFrame = NI_RENDERER_STATS_VALIDATION_FRAMES - NI_RENDERER_STATS_HISTORY;
+    for (uint32_t index = 0; index < stats->getFrameNum(); ++index) {
+        const FrameStats& frame = stats->getFrame(index);
+        checkNum++;
+        if (frame.frameNumber != firstFrame + index || frame.uploadBytes != (frame.frameNumber + 1) * 1024 || stats->findFrame(frame.frameNumber) != &frame) {
+            NI_LOG("Renderer stats: history entry %u holds frame %llu instead of %llu", index, frame.frameNumber, firstFrame + index);
+            errorNum++;
+        }
+    }
+    checkNum++;
+    if (stats->findFrame(firstFrame - 1) != nullptr || stats->findFrame(NI_RENDERER_STATS_VALIDATION_FRAMES) != nullptr) {
+        NI_LOG("Renderer stats: found a frame outside of the history");
+        errorNum++;
+    }
+
+    // The newest frames are still in flight, the latest complete one is the newest collected frame that resolved.
+    uint64_t expectedComplete = NI_RENDERER_STATS_VALIDATION_FRAMES - 1 - NI_FRAME_COUNT;
+    while (expectedComplete % 5 == 0) expectedComplete--;
+    const FrameStats* complete = stats->getLatestCompleteFrame();
+    checkNum++;
+    if (complete == nullptr || complete->frameNumber != expectedComplete) {
+        NI_LOG("Renderer stats: latest complete frame is %lld instead of %llu", complete != nullptr ? (long long)complete->frameNumber : -1ll, expectedComplete);
+        errorNum++;
+    }
+    stats->log();
+    stats->destroy();
+    delete stats;
+    NI_LOG("Renderer stats: %u checks, %u error(s)", checkNum, errorNum);
+    return errorNum;
+}
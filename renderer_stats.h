@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ni.h"
+
+// Frames kept in the history, the oldest is overwritten.
+#define NI_RENDERER_STATS_HISTORY 256
+
+namespace ni {
+
+	// Counters the GPU accumulates during a frame, one uint32_t each in this order. Shaders that write them
+	// use the same indices.
+	enum FrameGpuCounter {
+		FRAME_GPU_COUNTER_SPRITES_DRAWN,
+		FRAME_GPU_COUNTER_SPRITES_CULLED,
+		FRAME_GPU_COUNTER_COUNT
+	};
+
+	struct FrameStats {
+		uint64_t frameNumber;
+		// Known on the CPU when the frame is submitted.
+		uint32_t spritesSubmitted;
+		// Drawn while their texture was still streaming in, no draw command was recorded for them.
+		uint32_t spritesSkipped;
+		uint32_t imagesBound;
+		uint32_t texturesUploaded;
+		// Everything recorded on the copy queue: draw commands, sprite meshes and texture data.
+		uint64_t uploadBytes;
+		uint32_t transientDescriptors;
+		uint32_t persistentDescriptors;
+		// Read back NI_FRAME_COUNT frames later, zero until gpuCountersValid. Frames that never resolved
+		// their counters stay invalid.
+		uint32_t gpuCounters[FRAME_GPU_COUNTER_COUNT];
+		bool gpuCountersValid;
+	};
+
+	// Per frame counters with a history of the last NI_RENDERER_STATS_HISTORY frames. The CPU counters are
+	// added to the current frame while it's recorded. The GPU counters are copied into the frame slot's range
+	// of a readback buffer and patched into the frame's record the next time the slot is used.
+	struct RendererStats {
+		RendererStats();
+
+		void init();
+		// Nothing is read back, the GPU counters come from setSyntheticGpuCounters instead.
+		void initHeadless();
+		void destroy();
+		// Collects the GPU counters of the frame that used this slot before and starts a new record.
+		void beginFrame(uint64_t frameNumber);
+		FrameStats& getCurrentFrame();
+		// counters holds FRAME_GPU_COUNTER_COUNT uint32_t and has to be in COPY_SOURCE.
+		void resolveGpuCounters(ID3D12GraphicsCommandList* commandList, const Resource& counters);
+		// Headless only, the values the current frame's counters would have resolved to.
+		void setSyntheticGpuCounters(const uint32_t counters[FRAME_GPU_COUNTER_COUNT]);
+		// Oldest first, index below getFrameNum.
+		const FrameStats& getFrame(uint32_t index) const;
+		uint32_t getFrameNum() const;
+		// Null once the frame dropped out of the history.
+		const FrameStats* findFrame(uint64_t frameNumber) const;
+		// Newest frame with its GPU counters read back, null if there is none yet.
+		const FrameStats* getLatestCompleteFrame() const;
+		void log() const;
+
+	private:
+		struct FrameSlot {
+			uint64_t frameNumber;
+			bool pending;
+		};
+
+		void collectSlot(uint32_t slot);
+
+		FrameStats history[NI_RENDERER_STATS_HISTORY];
+		FrameSlot slots[NI_FRAME_COUNT];
+		// NI_FRAME_COUNT ranges of FRAME_GPU_COUNTER_COUNT counters, the same memory is malloced when headless.
+		Resource readbackBuffer;
+		uint32_t* headlessCounters;
+		uint64_t recordedFrameNum;
+		uint32_t currentSlot;
+	};
+
+	// Feeds synthetic frames through the stats and checks the history and the delayed GPU counters.
+	uint32_t validateRendererStats();
+}
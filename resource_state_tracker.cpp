@@ -0,0 +1,340 @@
+#include "resource_state_tracker.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_READ_ONLY_STATES (D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | \
+    D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_COPY_SOURCE | D3D12_RESOURCE_STATE_DEPTH_READ)
+// Textures without simultaneous access can only leave COMMON implicitly for these.
+#define NI_TEXTURE_PROMOTABLE_STATES (D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | \
+    D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE)
+
+static bool isReadOnlyState(D3D12_RESOURCE_STATES state) {
+    return state != D3D12_RESOURCE_STATE_COMMON && ((uint32_t)state & ~(uint32_t)NI_READ_ONLY_STATES) == 0;
+}
+
+static bool canPromote(const ni::Resource* resource, D3D12_RESOURCE_STATES state) {
+    if (resource->dimension == D3D12_RESOURCE_DIMENSION_BUFFER) return true;
+    return ((uint32_t)state & ~(uint32_t)NI_TEXTURE_PROMOTABLE_STATES) == 0;
+}
+
+ni::ResourceStateTracker::ResourceStateTracker() : barrierNum(0), flushNum(0), recording(false) {}
+
+ni::ResourceStateTracker::~ResourceStateTracker() {
+    NI_ASSERT(pending.getNum() == 0, "Resource state tracker destroyed with pending barriers");
+    pending.destroy();
+    splits.destroy();
+    batch.destroy();
+    history.destroy();
+}
+
+void ni::ResourceStateTracker::addTransition(Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags) {
+    PendingBarrier data = { {}, resource, false };
+    data.barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+    data.barrier.Flags = flags;
+    data.barrier.Transition.pResource = resource->resource;
+    data.barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+    data.barrier.Transition.StateBefore = before;
+    data.barrier.Transition.StateAfter = after;
+    pending.add(data);
+}
+
+void ni::ResourceStateTracker::endSplit(uint32_t splitIndex) {
+    SplitBarrier split = splits.getData()[splitIndex];
+    splits.getData()[splitIndex] = splits.getData()[splits.getNum() - 1];
+    splits.remove(splits.getNum() - 1);
+    if (split.begun) {
+        addTransition(split.resource, split.resource->state, split.state, D3D12_RESOURCE_BARRIER_FLAG_END_ONLY);
+    } else {
+        // Begin and end would land in the same ResourceBarrier call, a plain transition is cheaper.
+        for (uint32_t index = 0; index < pending.getNum(); ++index) {
+            PendingBarrier& data = pending.getData()[index];
+            if (data.resource == split.resource && data.barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) {
+                data.barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+                break;
+            }
+        }
+    }
+    split.resource->state = split.state;
+}
+
+void ni::ResourceStateTracker::require(Resource* resource, D3D12_RESOURCE_STATES state) {
+    for (uint32_t index = 0; index < splits.getNum(); ++index) {
+        if (splits.getData()[index].resource == resource) {
+            endSplit(index);
+            break;
+        }
+    }
+
+    // A transition or promotion of this resource that hasn't been flushed yet was never used, start over from its source state.
+    D3D12_RESOURCE_STATES origin = resource->state;
+    for (uint32_t index = 0; index < pending.getNum(); ++index) {
+        const PendingBarrier& data = pending.getData()[index];
+        if (data.resource == resource && (data.promotion || (data.barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION && data.barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_NONE))) {
+            origin = data.promotion ? D3D12_RESOURCE_STATE_COMMON : data.barrier.Transition.StateBefore;
+            pending.remove(index);
+            break;
+        }
+    }
+    resource->state = origin;
+
+    if (origin == state) return;
+    if (isReadOnlyState(origin) && isReadOnlyState(state) && ((uint32_t)origin & (uint32_t)state) == (uint32_t)state) return;
+    if (origin == D3D12_RESOURCE_STATE_COMMON && canPromote(resource, state)) {
+        // Kept as a pending entry so a later require before the flush still knows the resource is in COMMON.
+        // flush drops it, promotion happens on first use.
+        addTransition(resource, origin, state, D3D12_RESOURCE_BARRIER_FLAG_NONE);
+        pending.getData()[pending.getNum() - 1].promotion = true;
+        resource->state = state;
+        return;
+    }
+    addTransition(resource, origin, state, D3D12_RESOURCE_BARRIER_FLAG_NONE);
+    resource->state = state;
+}
+
+void ni::ResourceStateTracker::prepare(Resource* resource, D3D12_RESOURCE_STATES state) {
+    for (uint32_t index = 0; index < pending.getNum(); ++index) {
+        NI_ASSERT(pending.getData()[index].resource != resource, "Prepared a resource the next work still uses, flush first");
+    }
+    for (uint32_t index = 0; index < splits.getNum(); ++index) {
+        if (splits.getData()[index].resource == resource) return;
+    }
+    if (resource->state == state) return;
+    if (isReadOnlyState(resource->state) && isReadOnlyState(state) && ((uint32_t)resource->state & (uint32_t)state) == (uint32_t)state) return;
+    if (resource->state == D3D12_RESOURCE_STATE_COMMON && canPromote(resource, state)) return;
+    addTransition(resource, resource->state, state, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+    splits.add({ resource, state, false });
+}
+
+void ni::ResourceStateTracker::uavBarrier(Resource* resource) {
+    for (uint32_t index = 0; index < pending.getNum(); ++index) {
+        const PendingBarrier& data = pending.getData()[index];
+        if (data.resource == resource && data.barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) return;
+    }
+    PendingBarrier data = { {}, resource, false };
+    data.barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+    data.barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    data.barrier.UAV.pResource = resource->resource;
+    pending.add(data);
+}
+
+void ni::ResourceStateTracker::aliasingBarrier(Resource* resource) {
+    PendingBarrier data = { {}, resource, false };
+    data.barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+    data.barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    // No resource before means any placed resource that overlaps it.
+    data.barrier.Aliasing.pResourceBefore = nullptr;
+    data.barrier.Aliasing.pResourceAfter = resource->resource;
+    pending.add(data);
+}
+
+void ni::ResourceStateTracker::flush(ID3D12GraphicsCommandList* commandList) {
+    batch.reset();
+    for (uint32_t index = 0; index < pending.getNum(); ++index) {
+        const PendingBarrier& data = pending.getData()[index];
+        if (data.promotion) continue;
+        batch.add(data.barrier);
+        if (recording) history.add(data.barrier);
+    }
+    pending.reset();
+    for (uint32_t index = 0; index < splits.getNum(); ++index) {
+        splits.getData()[index].begun = true;
+    }
+    if (batch.getNum() == 0) return;
+    if (commandList != nullptr) {
+        commandList->ResourceBarrier(batch.getNum(), batch.getData());
+    }
+    barrierNum += batch.getNum();
+    flushNum++;
+}
+
+const char* ni::getResourceStateName(D3D12_RESOURCE_STATES state) {
+    switch (state) {
+    case D3D12_RESOURCE_STATE_COMMON: return "COMMON";
+    case D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER: return "VERTEX_AND_CONSTANT_BUFFER";
+    case D3D12_RESOURCE_STATE_INDEX_BUFFER: return "INDEX_BUFFER";
+    case D3D12_RESOURCE_STATE_RENDER_TARGET: return "RENDER_TARGET";
+    case D3D12_RESOURCE_STATE_UNORDERED_ACCESS: return "UNORDERED_ACCESS";
+    case D3D12_RESOURCE_STATE_DEPTH_WRITE: return "DEPTH_WRITE";
+    case D3D12_RESOURCE_STATE_DEPTH_READ: return "DEPTH_READ";
+    case D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE: return "NON_PIXEL_SHADER_RESOURCE";
+    case D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE: return "PIXEL_SHADER_RESOURCE";
+    case D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT: return "INDIRECT_ARGUMENT";
+    case D3D12_RESOURCE_STATE_COPY_DEST: return "COPY_DEST";
+    case D3D12_RESOURCE_STATE_COPY_SOURCE: return "COPY_SOURCE";
+    case D3D12_RESOURCE_STATE_GENERIC_READ: return "GENERIC_READ";
+    case D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE: return "ALL_SHADER_RESOURCE";
+    default: return "COMBINED";
+    }
+}
+
+enum ValidationResource : uint32_t {
+    VALIDATION_DRAW_COMMANDS,
+    VALIDATION_SPRITE_MESHES,
+    VALIDATION_VERTICES,
+    VALIDATION_INDIRECT,
+    VALIDATION_COUNTER,
+    VALIDATION_VISIBLE_LIST,
+    VALIDATION_PER_LANE_OFFSET,
+    VALIDATION_INDICES,
+    VALIDATION_BACKBUFFER,
+    VALIDATION_RESOURCE_COUNT
+};
+
+static const char* validationResourceNames[VALIDATION_RESOURCE_COUNT] = {
+    "drawCommands", "spriteMeshes", "spriteVertices", "indirectCommands", "spriteVertexCounter",
+    "visibleList", "perLaneOffset", "spriteIndices", "backbuffer"
+};
+
+struct ValidationState {
+    ni::Resource resources[VALIDATION_RESOURCE_COUNT];
+    D3D12_RESOURCE_STATES shadowStates[VALIDATION_RESOURCE_COUNT];
+    bool splitBegun[VALIDATION_RESOURCE_COUNT];
+    uint8_t fakeResources[VALIDATION_RESOURCE_COUNT];
+    uint32_t errorNum;
+};
+
+static uint32_t findValidationResource(ValidationState& validation, const ID3D12Resource* resource) {
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        if (validation.resources[index].resource == resource) return index;
+    }
+    return VALIDATION_RESOURCE_COUNT;
+}
+
+// Promotions don't show up as barriers, the shadow state follows the tracked state whenever the tracker promoted.
+static void syncPromotions(ValidationState& validation) {
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        if (validation.shadowStates[index] == D3D12_RESOURCE_STATE_COMMON && !validation.splitBegun[index]) {
+            validation.shadowStates[index] = validation.resources[index].state;
+        }
+    }
+}
+
+// Logs the barriers of one flush and replays them on the shadow states. Every transition has to start from the
+// state the previous one left, or from COMMON through a legal implicit promotion.
+static void checkFlush(ValidationState& validation, ni::ResourceStateTracker& tracker, const char* queueName, const char* label, bool log) {
+    const ni::Array<D3D12_RESOURCE_BARRIER, uint32_t>& history = tracker.getHistory();
+    if (log) NI_LOG("  %s %s: %u barrier(s)", queueName, label, history.getNum());
+    for (uint32_t index = 0; index < history.getNum(); ++index) {
+        const D3D12_RESOURCE_BARRIER& barrier = history.getData()[index];
+        if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) {
+            uint32_t resource = findValidationResource(validation, barrier.UAV.pResource);
+            if (log) NI_LOG("    %s UAV", validationResourceNames[resource]);
+            continue;
+        }
+        uint32_t resource = findValidationResource(validation, barrier.Transition.pResource);
+        D3D12_RESOURCE_STATES before = barrier.Transition.StateBefore;
+        D3D12_RESOURCE_STATES after = barrier.Transition.StateAfter;
+        const char* split = barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY ? " (begin)" : (barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY ? " (end)" : "");
+        if (log) NI_LOG("    %s %s -> %s%s", validationResourceNames[resource], ni::getResourceStateName(before), ni::getResourceStateName(after), split);
+
+        D3D12_RESOURCE_STATES shadow = validation.shadowStates[resource];
+        bool promoted = shadow == D3D12_RESOURCE_STATE_COMMON && canPromote(&validation.resources[resource], before);
+        bool valid = before != after && (before == shadow || promoted);
+        if (barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) {
+            valid &= !validation.splitBegun[resource];
+            validation.splitBegun[resource] = true;
+        } else if (barrier.Flags == D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) {
+            valid &= validation.splitBegun[resource];
+            validation.splitBegun[resource] = false;
+            validation.shadowStates[resource] = after;
+        } else {
+            valid &= !validation.splitBegun[resource];
+            validation.shadowStates[resource] = after;
+        }
+        if (!valid) {
+            NI_LOG("    ERROR: %s barrier from %s doesn't follow %s", validationResourceNames[resource], ni::getResourceStateName(before), ni::getResourceStateName(shadow));
+            validation.errorNum++;
+        }
+    }
+    tracker.clearHistory();
+    syncPromotions(validation);
+}
+
+static void decayBuffers(ValidationState& validation) {
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        if (validation.resources[index].dimension == D3D12_RESOURCE_DIMENSION_BUFFER) {
+            validation.resources[index].state = D3D12_RESOURCE_STATE_COMMON;
+            validation.shadowStates[index] = D3D12_RESOURCE_STATE_COMMON;
+        }
+    }
+}
+
+// Mirrors SpriteRenderer::flushCommands, the double and triple buffered resources share one entry each.
+static uint32_t validateSpriteFrames(bool asyncCompute, uint32_t frameNum) {
+    ValidationState validation = {};
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        validation.resources[index] = { (ID3D12Resource*)&validation.fakeResources[index], D3D12_RESOURCE_STATE_COMMON, 0, {}, D3D12_RESOURCE_DIMENSION_BUFFER };
+    }
+    validation.resources[VALIDATION_INDICES].state = D3D12_RESOURCE_STATE_INDEX_BUFFER;
+    validation.resources[VALIDATION_BACKBUFFER].dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        validation.shadowStates[index] = validation.resources[index].state;
+    }
+
+    ni::ResourceStateTracker directTracker;
+    ni::ResourceStateTracker asyncTracker;
+    ni::ResourceStateTracker& computeTracker = asyncCompute ? asyncTracker : directTracker;
+    const char* computeQueueName = asyncCompute ? "compute" : "direct";
+    directTracker.setRecording(true);
+    asyncTracker.setRecording(true);
+    ni::Resource* resources = validation.resources;
+
+    NI_LOG("Barriers %s async compute:", asyncCompute ? "with" : "without");
+    for (uint32_t frame = 0; frame < frameNum; ++frame) {
+        bool log = frame < 2;
+        if (log) NI_LOG(" frame %u", frame);
+        decayBuffers(validation);
+        directTracker.prepare(&resources[VALIDATION_BACKBUFFER], D3D12_RESOURCE_STATE_RENDER_TARGET);
+        if (frame == 0) {
+            directTracker.require(&resources[VALIDATION_INDICES], D3D12_RESOURCE_STATE_COPY_DEST);
+            directTracker.flush(nullptr);
+            syncPromotions(validation);
+            checkFlush(validation, directTracker, "direct", "index upload", log);
+            directTracker.prepare(&resources[VALIDATION_INDICES], D3D12_RESOURCE_STATE_INDEX_BUFFER);
+        }
+
+        computeTracker.require(&resources[VALIDATION_INDIRECT], D3D12_RESOURCE_STATE_COPY_DEST);
+        computeTracker.require(&resources[VALIDATION_COUNTER], D3D12_RESOURCE_STATE_COPY_DEST);
+        computeTracker.flush(nullptr);
+        checkFlush(validation, computeTracker, computeQueueName, "counter clears", log);
+
+        for (uint32_t resource = VALIDATION_DRAW_COMMANDS; resource <= VALIDATION_PER_LANE_OFFSET; ++resource) {
+            computeTracker.require(&resources[resource], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        }
+        computeTracker.flush(nullptr);
+        checkFlush(validation, computeTracker, computeQueueName, "SpriteGen", log);
+
+        if (asyncCompute) {
+            resources[VALIDATION_VERTICES].state = D3D12_RESOURCE_STATE_COMMON;
+            resources[VALIDATION_INDIRECT].state = D3D12_RESOURCE_STATE_COMMON;
+            validation.shadowStates[VALIDATION_VERTICES] = D3D12_RESOURCE_STATE_COMMON;
+            validation.shadowStates[VALIDATION_INDIRECT] = D3D12_RESOURCE_STATE_COMMON;
+        }
+        directTracker.require(&resources[VALIDATION_BACKBUFFER], D3D12_RESOURCE_STATE_RENDER_TARGET);
+        directTracker.require(&resources[VALIDATION_VERTICES], D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+        directTracker.require(&resources[VALIDATION_INDIRECT], D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+        directTracker.require(&resources[VALIDATION_INDICES], D3D12_RESOURCE_STATE_INDEX_BUFFER);
+        directTracker.flush(nullptr);
+        checkFlush(validation, directTracker, "direct", "render", log);
+
+        directTracker.require(&resources[VALIDATION_BACKBUFFER], D3D12_RESOURCE_STATE_PRESENT);
+        directTracker.flush(nullptr);
+        checkFlush(validation, directTracker, "direct", "present", log);
+    }
+    for (uint32_t index = 0; index < VALIDATION_RESOURCE_COUNT; ++index) {
+        if (validation.splitBegun[index]) {
+            NI_LOG("  ERROR: split barrier of %s never ended", validationResourceNames[index]);
+            validation.errorNum++;
+        }
+    }
+    uint32_t barrierNum = directTracker.getBarrierNum() + (asyncCompute ? asyncTracker.getBarrierNum() : 0);
+    uint32_t flushNum = directTracker.getFlushNum() + (asyncCompute ? asyncTracker.getFlushNum() : 0);
+    NI_LOG(" %u frames: %u barriers in %u ResourceBarrier calls (%.1f per frame), %u error(s)",
+        frameNum, barrierNum, flushNum, (double)barrierNum / frameNum, validation.errorNum);
+    NI_ASSERT(validation.errorNum == 0, "Resource state tracker emitted an invalid barrier sequence");
+    return validation.errorNum;
+}
+
+uint32_t ni::validateResourceStateTracker() {
+    return validateSpriteFrames(false, 60) + validateSpriteFrames(true, 60);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ni.h"
+
+namespace ni {
+
+	// Collects the states the next piece of work needs and records the barriers for them in one
+	// ResourceBarrier call. Resource::state is the state the resource is in once the pending barriers
+	// ran, so require can be called again before a flush and the transitions collapse.
+	struct ResourceStateTracker {
+		ResourceStateTracker();
+		~ResourceStateTracker();
+
+		// Work recorded after the next flush uses the resource in this state. Buffers in COMMON, and
+		// textures in COMMON that are only read or copied to, are promoted implicitly without a barrier.
+		void require(Resource* resource, D3D12_RESOURCE_STATES state);
+		// Nothing uses the resource until a later require of this state. The next flush begins a split
+		// barrier and that require ends it, unless they'd end up in the same flush anyway.
+		void prepare(Resource* resource, D3D12_RESOURCE_STATES state);
+		// UAV writes of earlier work finish before work after the next flush reads or writes the resource.
+		void uavBarrier(Resource* resource);
+		// The resource takes over memory that other placed resources used before, recorded ahead of its transitions.
+		void aliasingBarrier(Resource* resource);
+		// Without a command list the barriers are only recorded, for headless validation.
+		void flush(ID3D12GraphicsCommandList* commandList);
+		void setRecording(bool record) { recording = record; }
+		const Array<D3D12_RESOURCE_BARRIER, uint32_t>& getHistory() const { return history; }
+		void clearHistory() { history.reset(); }
+		uint32_t getBarrierNum() const { return barrierNum; }
+		uint32_t getFlushNum() const { return flushNum; }
+		bool hasPendingSplits() const { return splits.getNum() > 0; }
+
+	private:
+		struct PendingBarrier {
+			D3D12_RESOURCE_BARRIER barrier;
+			Resource* resource;
+			// Implicit promotion out of COMMON. Kept until the flush but never recorded.
+			bool promotion;
+		};
+
+		struct SplitBarrier {
+			Resource* resource;
+			D3D12_RESOURCE_STATES state;
+			// False while the begin half is still pending and can become a full transition.
+			bool begun;
+		};
+
+		void addTransition(Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after, D3D12_RESOURCE_BARRIER_FLAGS flags);
+		void endSplit(uint32_t splitIndex);
+
+		Array<PendingBarrier, uint32_t> pending;
+		Array<SplitBarrier, uint32_t> splits;
+		Array<D3D12_RESOURCE_BARRIER, uint32_t> batch;
+		Array<D3D12_RESOURCE_BARRIER, uint32_t> history;
+		uint32_t barrierNum;
+		uint32_t flushNum;
+		bool recording;
+	};
+
+	const char* getResourceStateName(D3D12_RESOURCE_STATES state);
+	// Runs SpriteRenderer's barrier sequence with and without async compute on fake resources, logs the
+	// barriers of every flush and checks that each one starts from the state the previous one left.
+	uint32_t validateResourceStateTracker();
+}
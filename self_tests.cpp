@@ -0,0 +1,69 @@
+#include "ni_core.h"
+#include "frame_timing.h"
+#include "image_codec.h"
+#include "pipeline_blob_store.h"
+#include "software_rasterizer.h"
+#include "tiny_sprites.h"
+#include <string.h>
+
+// Checks of the ni subsystems on the portable core, built as their own executable so the renderer keeps its
+// options for running and benchmarking, and by CMakeLists.txt so they also run where there's no D3D12. The
+// checks that need the D3D12 types run from the renderer's --validate. Runs every test, or the ones named on
+// the command line, and exits with 1 if any of them reports an error.
+// Usage: SelfTests [--list] [test name...]
+
+struct SelfTest {
+    const char* name;
+    uint32_t(*run)();
+};
+
+static const SelfTest selfTests[] = {
+    { "pipeline-blob-store", ni::validatePipelineBlobStore },
+    { "frame-timing", ni::validateFrameTiming },
+    { "image-codec", ni::validateImageCodec },
+    { "software-rasterizer", ni::validateSoftwareRasterizer },
+    { "tiny-sprites", ni::validateTinySprites },
+};
+static const uint32_t selfTestNum = sizeof(selfTests) / sizeof(selfTests[0]);
+
+static const SelfTest* findSelfTest(const char* name) {
+    for (uint32_t index = 0; index < selfTestNum; ++index) {
+        if (strcmp(selfTests[index].name, name) == 0) return &selfTests[index];
+    }
+    return nullptr;
+}
+
+static uint32_t runSelfTest(const SelfTest& test) {
+    NI_LOG("[%s]", test.name);
+    double startTime = ni::getSeconds();
+    uint32_t errorNum = test.run();
+    NI_LOG("[%s] %s in %.2f ms", test.name, errorNum == 0 ? "passed" : "FAILED", (ni::getSeconds() - startTime) * 1000.0);
+    return errorNum;
+}
+
+int main(int argc, char** argv) {
+    uint32_t failedNum = 0;
+    uint32_t runNum = 0;
+    for (int index = 1; index < argc; ++index) {
+        if (strcmp(argv[index], "--list") == 0) {
+            for (uint32_t test = 0; test < selfTestNum; ++test) {
+                NI_LOG("%s", selfTests[test].name);
+            }
+            return 0;
+        }
+        const SelfTest* test = findSelfTest(argv[index]);
+        if (test == nullptr) {
+            NI_PANIC("Unknown self test %s, --list shows them", argv[index]);
+        }
+        failedNum += runSelfTest(*test) > 0 ? 1 : 0;
+        runNum++;
+    }
+    if (runNum == 0) {
+        for (uint32_t test = 0; test < selfTestNum; ++test) {
+            failedNum += runSelfTest(selfTests[test]) > 0 ? 1 : 0;
+            runNum++;
+        }
+    }
+    NI_LOG("%u of %u self tests failed", failedNum, runNum);
+    return failedNum == 0 ? 0 : 1;
+}
@@ -0,0 +1,826 @@
+#include "software_rasterizer.h"
+#include "cpu_trace.h"
+#include <algorithm>
+#include <emmintrin.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Quads binned by one job at least, smaller draws aren't worth waking the loader threads for.
+#define NI_SOFTWARE_RASTER_BIN_CHUNK 4096
+// Subpixel precision of the snapped vertices, 8 bits like D3D's rasterizer.
+#define NI_SOFTWARE_RASTER_SUBPIXEL_BITS 8
+#define NI_SOFTWARE_RASTER_SUBPIXEL (1 << NI_SOFTWARE_RASTER_SUBPIXEL_BITS)
+// Edge functions are stepped in 32 bits from a 64 bit value at the start of every row. Clamping that value
+// keeps a row of a tile, at most NI_SOFTWARE_RASTER_TILE_SIZE steps of under 2^23, from overflowing, and a
+// value this far out can't change sign inside the tile anyway.
+#define NI_SOFTWARE_RASTER_EDGE_LIMIT ((int64_t)1 << 30)
+#define NI_SOFTWARE_RASTER_TEXTURE_NUM (TEXTURE_ID_INDEX_MASK + 1)
+
+static_assert(NI_SOFTWARE_RASTER_TILE_SIZE % 4 == 0, "Tiles are rasterized 4 pixels at a time");
+static_assert(NI_SOFTWARE_RASTER_GUARD_BAND * NI_SOFTWARE_RASTER_SUBPIXEL * 2.0f < (float)(1 << 23), "Edge steps have to fit in 23 bits");
+
+// Integer edge function, origin + stepY * py + stepX * px is >= 0 for pixels inside the edge, top-left rule
+// included.
+struct RasterEdge {
+    int32_t stepX;
+    int32_t stepY;
+    int64_t origin;
+};
+
+struct RasterMip {
+    const uint8_t* texels;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Texture coordinates are affine over a triangle, w is 1. Planes through the attributes at (originX, originY).
+struct RasterGradients {
+    float originX;
+    float originY;
+    float u;
+    float v;
+    float dudx;
+    float dudy;
+    float dvdx;
+    float dvdy;
+
+    // At the center of pixel (px, py).
+    float getU(float px, float py) const { return u + dudx * (px + 0.5f - originX) + dudy * (py + 0.5f - originY); }
+    float getV(float px, float py) const { return v + dvdx * (px + 0.5f - originX) + dvdy * (py + 0.5f - originY); }
+};
+
+// The flat inputs of SpriteRender_PS and the mips its sample reads, constant over a triangle. texture is null
+// when every pixel is discarded.
+struct RasterShading {
+    const ni::SoftwareTexture* texture;
+    RasterMip mip0;
+    RasterMip mip1;
+    float mipBlend;
+    __m128 vertexColor;
+    bool modulate;
+};
+
+// Same transform as SpriteGen_CS.hlsl.
+static inline void transformPoint(float x, float y, const DrawCommand& cmd, float& outX, float& outY) {
+    float cr = cosf(cmd.transform[3]);
+    float sr = sinf(cmd.transform[3]);
+    x *= cmd.transform[2];
+    y *= cmd.transform[2];
+    outX = x * cr - y * sr + cmd.transform[0];
+    outY = x * sr + y * cr + cmd.transform[1];
+}
+
+static inline int64_t floorDiv(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return quotient * divisor > value ? quotient - 1 : quotient;
+}
+
+static inline int32_t snapCoordinate(float value) {
+    value = std::clamp(value, -NI_SOFTWARE_RASTER_GUARD_BAND, NI_SOFTWARE_RASTER_GUARD_BAND);
+    return (int32_t)lrintf(value * (float)NI_SOFTWARE_RASTER_SUBPIXEL);
+}
+
+// Edge a->b of a triangle wound so its area is positive. With pixel centers at (p + 0.5) the edge function is
+// dx * (py - ay) - dy * (px - ax) in subpixel units squared, dividing it by the subpixel size leaves an integer
+// function of the pixel and a remainder that only matters to pixels exactly on the edge, where the top-left rule
+// decides. Folding both into the constant makes coverage a sign test.
+static RasterEdge setupEdge(int32_t ax, int32_t ay, int32_t bx, int32_t by) {
+    int64_t dx = (int64_t)bx - ax;
+    int64_t dy = (int64_t)by - ay;
+    bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+    const int64_t half = NI_SOFTWARE_RASTER_SUBPIXEL / 2;
+    int64_t constant = dx * (half - ay) - dy * (half - ax);
+    int64_t quotient = floorDiv(constant, NI_SOFTWARE_RASTER_SUBPIXEL);
+    int64_t remainder = constant - quotient * NI_SOFTWARE_RASTER_SUBPIXEL;
+    RasterEdge edge;
+    edge.stepX = (int32_t)-dy;
+    edge.stepY = (int32_t)dx;
+    edge.origin = quotient - (!topLeft && remainder == 0 ? 1 : 0);
+    return edge;
+}
+
+static inline int32_t getEdgeValue(const RasterEdge& edge, int32_t px, int32_t py) {
+    int64_t value = edge.origin + (int64_t)edge.stepY * py + (int64_t)edge.stepX * px;
+    return (int32_t)std::clamp(value, -NI_SOFTWARE_RASTER_EDGE_LIMIT, NI_SOFTWARE_RASTER_EDGE_LIMIT);
+}
+
+static inline __m128 loadTexelRGBA8(const uint8_t* texel) {
+    __m128i value = _mm_cvtsi32_si128(*(const int32_t*)texel);
+    value = _mm_unpacklo_epi8(value, _mm_setzero_si128());
+    value = _mm_unpacklo_epi16(value, _mm_setzero_si128());
+    return _mm_cvtepi32_ps(value);
+}
+
+static RasterMip getMip(const ni::SoftwareTexture& texture, uint32_t level) {
+    RasterMip mip = { texture.mipChain, texture.width, texture.height };
+    for (uint32_t index = 0; index < level; ++index) {
+        mip.texels += (size_t)mip.width * mip.height * 4;
+        mip.width = mip.width > 1 ? mip.width >> 1 : 1;
+        mip.height = mip.height > 1 ? mip.height >> 1 : 1;
+    }
+    return mip;
+}
+
+// Linear filtering with clamped addressing, 0-255 per channel.
+static inline __m128 sampleBilinear(const RasterMip& mip, float u, float v) {
+    float s = u * (float)mip.width - 0.5f;
+    float t = v * (float)mip.height - 0.5f;
+    // floorf is a call without SSE4.1, coordinates are far inside the int range.
+    int32_t floorS = (int32_t)s - (s < (float)(int32_t)s ? 1 : 0);
+    int32_t floorT = (int32_t)t - (t < (float)(int32_t)t ? 1 : 0);
+    __m128 fracS = _mm_set1_ps(s - (float)floorS);
+    __m128 fracT = _mm_set1_ps(t - (float)floorT);
+    int32_t maxX = (int32_t)mip.width - 1;
+    int32_t maxY = (int32_t)mip.height - 1;
+    int32_t x0 = std::clamp(floorS, 0, maxX);
+    int32_t x1 = std::clamp(floorS + 1, 0, maxX);
+    int32_t y0 = std::clamp(floorT, 0, maxY);
+    int32_t y1 = std::clamp(floorT + 1, 0, maxY);
+    const uint8_t* row0 = &mip.texels[(size_t)y0 * mip.width * 4];
+    const uint8_t* row1 = &mip.texels[(size_t)y1 * mip.width * 4];
+    __m128 t00 = loadTexelRGBA8(&row0[x0 * 4]);
+    __m128 t10 = loadTexelRGBA8(&row0[x1 * 4]);
+    __m128 t01 = loadTexelRGBA8(&row1[x0 * 4]);
+    __m128 t11 = loadTexelRGBA8(&row1[x1 * 4]);
+    __m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), fracS));
+    __m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), fracS));
+    return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fracT));
+}
+
+// SpriteRender_PS and the blend state for one covered pixel. Returns false when the pixel is discarded.
+static inline bool shadePixel(uint32_t* pixel, const RasterShading& shading, float u, float v) {
+    const __m128 toUnit = _mm_set1_ps(1.0f / 255.0f);
+    __m128 color = sampleBilinear(shading.mip0, u, v);
+    if (shading.mipBlend > 0.0f) {
+        __m128 color1 = sampleBilinear(shading.mip1, u, v);
+        color = _mm_add_ps(color, _mm_mul_ps(_mm_sub_ps(color1, color), _mm_set1_ps(shading.mipBlend)));
+    }
+    color = _mm_mul_ps(color, toUnit);
+    __m128 alpha = _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3));
+    if (_mm_cvtss_f32(alpha) == 0.0f) return false;
+    if (shading.modulate) {
+        color = _mm_mul_ps(color, shading.vertexColor);
+        alpha = _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    // SRC_ALPHA / INV_SRC_ALPHA for color, ONE / INV_SRC_ALPHA for alpha.
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 srcFactor = _mm_or_ps(_mm_andnot_ps(alphaMask, alpha), _mm_and_ps(alphaMask, one));
+    __m128 destination = _mm_mul_ps(loadTexelRGBA8((const uint8_t*)pixel), toUnit);
+    __m128 result = _mm_add_ps(_mm_mul_ps(color, srcFactor), _mm_mul_ps(destination, _mm_sub_ps(one, alpha)));
+    result = _mm_min_ps(_mm_max_ps(result, _mm_setzero_ps()), one);
+    __m128i packed = _mm_cvtps_epi32(_mm_mul_ps(result, _mm_set1_ps(255.0f)));
+    packed = _mm_packs_epi32(packed, packed);
+    packed = _mm_packus_epi16(packed, packed);
+    *pixel = (uint32_t)_mm_cvtsi128_si32(packed);
+    return true;
+}
+
+// Attribute planes of triangle index0, index1, index2 of a quad. doubleArea is its signed area in subpixels
+// squared, either winding works.
+static RasterGradients setupGradients(const SpriteVertex* vertices, const int32_t* snapped, uint32_t index0, uint32_t index1, uint32_t index2, int64_t doubleArea) {
+    const float subpixel = (float)NI_SOFTWARE_RASTER_SUBPIXEL;
+    float fx0 = (float)snapped[index0 * 2] / subpixel;
+    float fy0 = (float)snapped[index0 * 2 + 1] / subpixel;
+    float ex1 = (float)snapped[index1 * 2] / subpixel - fx0;
+    float ey1 = (float)snapped[index1 * 2 + 1] / subpixel - fy0;
+    float ex2 = (float)snapped[index2 * 2] / subpixel - fx0;
+    float ey2 = (float)snapped[index2 * 2 + 1] / subpixel - fy0;
+    float inverseArea = (float)((double)(NI_SOFTWARE_RASTER_SUBPIXEL * NI_SOFTWARE_RASTER_SUBPIXEL) / (double)doubleArea);
+    const float* uv0 = vertices[index0].texCoord;
+    const float* uv1 = vertices[index1].texCoord;
+    const float* uv2 = vertices[index2].texCoord;
+    float du1 = uv1[0] - uv0[0];
+    float dv1 = uv1[1] - uv0[1];
+    float du2 = uv2[0] - uv0[0];
+    float dv2 = uv2[1] - uv0[1];
+    RasterGradients gradients;
+    gradients.originX = fx0;
+    gradients.originY = fy0;
+    gradients.u = uv0[0];
+    gradients.v = uv0[1];
+    gradients.dudx = (du1 * ey2 - du2 * ey1) * inverseArea;
+    gradients.dudy = (du2 * ex1 - du1 * ex2) * inverseArea;
+    gradients.dvdx = (dv1 * ey2 - dv2 * ey1) * inverseArea;
+    gradients.dvdy = (dv2 * ex1 - dv1 * ex2) * inverseArea;
+    return gradients;
+}
+
+static RasterShading setupShading(const ni::SoftwareTexture* textures, const SpriteVertex& provoking, const RasterGradients& gradients) {
+    RasterShading shading = {};
+    shading.texture = (provoking.textureId >> TEXTURE_ID_MESH_SHIFT) != (0xffffffffu >> TEXTURE_ID_MESH_SHIFT) ? &textures[provoking.textureId & TEXTURE_ID_INDEX_MASK] : nullptr;
+    if (shading.texture != nullptr && shading.texture->mipChain == nullptr) {
+        shading.texture = nullptr;
+    }
+    if (shading.texture != nullptr) {
+        // The derivatives are constant over the triangle, so is the level of detail.
+        const ni::SoftwareTexture* texture = shading.texture;
+        float width = (float)texture->width;
+        float height = (float)texture->height;
+        float lengthX = gradients.dudx * gradients.dudx * width * width + gradients.dvdx * gradients.dvdx * height * height;
+        float lengthY = gradients.dudy * gradients.dudy * width * width + gradients.dvdy * gradients.dvdy * height * height;
+        float lod = 0.5f * log2f(std::max(std::max(lengthX, lengthY), 1e-20f));
+        lod = std::clamp(lod, 0.0f, (float)std::min(texture->mipLevels - 1, (uint32_t)SPRITE_MESH_MAX_FILTER_MIP));
+        uint32_t level = (uint32_t)lod;
+        shading.mipBlend = lod - (float)level;
+        shading.mip0 = getMip(*texture, level);
+        shading.mip1 = shading.mipBlend > 0.0f ? getMip(*texture, level + 1) : shading.mip0;
+    }
+    const uint8_t* colorBytes = (const uint8_t*)&provoking.color;
+    float colorR = colorBytes[0] / 255.0f;
+    float colorG = colorBytes[1] / 255.0f;
+    float colorB = colorBytes[2] / 255.0f;
+    float colorA = colorBytes[3] / 255.0f;
+    shading.vertexColor = _mm_setr_ps(colorR, colorG, colorB, colorA);
+    shading.modulate = colorR + colorG + colorB + colorA != 1.0f;
+    return shading;
+}
+
+// Rasterizes one fan triangle of a quad inside [minX, maxX] x [minY, maxY], vertex 0 is the provoking vertex
+// the flat attributes come from.
+static void drawTriangle(uint32_t* pixels, uint32_t pitch, const ni::SoftwareTexture* textures, const SpriteVertex* vertices, const int32_t* snapped,
+    uint32_t index0, uint32_t index1, uint32_t index2, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY, ni::SoftwareRasterStats& stats) {
+    int32_t x0 = snapped[index0 * 2];
+    int32_t y0 = snapped[index0 * 2 + 1];
+    int32_t x1 = snapped[index1 * 2];
+    int32_t y1 = snapped[index1 * 2 + 1];
+    int32_t x2 = snapped[index2 * 2];
+    int32_t y2 = snapped[index2 * 2 + 1];
+    int64_t doubleArea = ((int64_t)x1 - x0) * ((int64_t)y2 - y0) - ((int64_t)y1 - y0) * ((int64_t)x2 - x0);
+    if (doubleArea == 0) return;
+    // Both windings are drawn, cull mode is none.
+    if (doubleArea < 0) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+        std::swap(index1, index2);
+        doubleArea = -doubleArea;
+    }
+    const int32_t subpixel = NI_SOFTWARE_RASTER_SUBPIXEL;
+    const int32_t half = NI_SOFTWARE_RASTER_SUBPIXEL / 2;
+    // Pixels whose centers are inside the snapped bounds.
+    int32_t startX = std::max(minX, (int32_t)floorDiv((int64_t)std::min(std::min(x0, x1), x2) - half + subpixel - 1, subpixel));
+    int32_t startY = std::max(minY, (int32_t)floorDiv((int64_t)std::min(std::min(y0, y1), y2) - half + subpixel - 1, subpixel));
+    int32_t endX = std::min(maxX, (int32_t)floorDiv((int64_t)std::max(std::max(x0, x1), x2) - half, subpixel));
+    int32_t endY = std::min(maxY, (int32_t)floorDiv((int64_t)std::max(std::max(y0, y1), y2) - half, subpixel));
+    if (startX > endX || startY > endY) return;
+    stats.trianglesRasterized++;
+
+    RasterEdge edges[3] = { setupEdge(x1, y1, x2, y2), setupEdge(x2, y2, x0, y0), setupEdge(x0, y0, x1, y1) };
+
+    RasterGradients gradients = setupGradients(vertices, snapped, index0, index1, index2, doubleArea);
+    RasterShading shading = setupShading(textures, vertices[index0], gradients);
+    float dudx = gradients.dudx;
+    float dvdx = gradients.dvdx;
+
+    __m128i stepX4[3];
+    for (uint32_t edge = 0; edge < 3; ++edge) {
+        stepX4[edge] = _mm_set1_epi32(edges[edge].stepX * 4);
+    }
+    for (int32_t py = startY; py <= endY; ++py) {
+        __m128i values[3];
+        for (uint32_t edge = 0; edge < 3; ++edge) {
+            int32_t value = getEdgeValue(edges[edge], startX, py);
+            int32_t stepX = edges[edge].stepX;
+            values[edge] = _mm_setr_epi32(value, value + stepX, value + stepX * 2, value + stepX * 3);
+        }
+        float rowU = gradients.getU((float)startX, (float)py);
+        float rowV = gradients.getV((float)startX, (float)py);
+        uint32_t* row = &pixels[(size_t)py * pitch];
+        for (int32_t px = startX; px <= endX; px += 4) {
+            __m128i outside = _mm_or_si128(_mm_or_si128(values[0], values[1]), values[2]);
+            uint32_t covered = ~(uint32_t)_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xf;
+            if (endX - px < 3) {
+                covered &= (1u << (endX - px + 1)) - 1;
+            }
+            while (covered != 0) {
+                uint32_t lane = 0;
+                while ((covered & (1u << lane)) == 0) {
+                    lane++;
+                }
+                covered &= covered - 1;
+                float offset = (float)(px - startX + (int32_t)lane);
+                if (shading.texture != nullptr && shadePixel(&row[px + lane], shading, rowU + dudx * offset, rowV + dvdx * offset)) {
+                    stats.pixelsShaded++;
+                } else {
+                    stats.pixelsDiscarded++;
+                }
+            }
+            for (uint32_t edge = 0; edge < 3; ++edge) {
+                values[edge] = _mm_add_epi32(values[edge], stepX4[edge]);
+            }
+        }
+    }
+}
+
+// Covers one quad inside [minX, maxX] x [minY, maxY] without its triangles. The mesh is convex, so a pixel is inside
+// the fan exactly when it's inside every edge of the outline, with the same top-left rule on them. Texture
+// coordinates are affine over the whole quad, they and the level of detail come from its largest fan triangle.
+static void splatQuad(uint32_t* pixels, uint32_t pitch, const ni::SoftwareTexture* textures, const SpriteVertex* vertices, const int32_t* snapped,
+    int32_t minX, int32_t minY, int32_t maxX, int32_t maxY, ni::SoftwareRasterStats& stats) {
+    int64_t doubleArea = 0;
+    int32_t boundsMinX = snapped[0];
+    int32_t boundsMinY = snapped[1];
+    int32_t boundsMaxX = boundsMinX;
+    int32_t boundsMaxY = boundsMinY;
+    for (uint32_t vertex = 0; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+        uint32_t next = (vertex + 1) % SPRITE_VERTEX_COUNT;
+        doubleArea += (int64_t)snapped[vertex * 2] * snapped[next * 2 + 1] - (int64_t)snapped[next * 2] * snapped[vertex * 2 + 1];
+        boundsMinX = std::min(boundsMinX, snapped[vertex * 2]);
+        boundsMinY = std::min(boundsMinY, snapped[vertex * 2 + 1]);
+        boundsMaxX = std::max(boundsMaxX, snapped[vertex * 2]);
+        boundsMaxY = std::max(boundsMaxY, snapped[vertex * 2 + 1]);
+    }
+    if (doubleArea == 0) return;
+    const int32_t subpixel = NI_SOFTWARE_RASTER_SUBPIXEL;
+    const int32_t half = NI_SOFTWARE_RASTER_SUBPIXEL / 2;
+    int32_t startX = std::max(minX, (int32_t)floorDiv((int64_t)boundsMinX - half + subpixel - 1, subpixel));
+    int32_t startY = std::max(minY, (int32_t)floorDiv((int64_t)boundsMinY - half + subpixel - 1, subpixel));
+    int32_t endX = std::min(maxX, (int32_t)floorDiv((int64_t)boundsMaxX - half, subpixel));
+    int32_t endY = std::min(maxY, (int32_t)floorDiv((int64_t)boundsMaxY - half, subpixel));
+    if (startX > endX || startY > endY) return;
+    stats.quadsSplatted++;
+
+    // Repeated vertices leave edges without a direction, they don't bound anything.
+    RasterEdge edges[SPRITE_VERTEX_COUNT];
+    uint32_t edgeNum = 0;
+    for (uint32_t vertex = 0; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+        uint32_t next = (vertex + 1) % SPRITE_VERTEX_COUNT;
+        int32_t ax = snapped[vertex * 2];
+        int32_t ay = snapped[vertex * 2 + 1];
+        int32_t bx = snapped[next * 2];
+        int32_t by = snapped[next * 2 + 1];
+        if (ax == bx && ay == by) continue;
+        edges[edgeNum++] = doubleArea > 0 ? setupEdge(ax, ay, bx, by) : setupEdge(bx, by, ax, ay);
+    }
+
+    uint32_t attributeTriangle = 0;
+    int64_t attributeArea = 0;
+    for (uint32_t triangle = 0; triangle < SPRITE_INDEX_COUNT / 3; ++triangle) {
+        int64_t ex1 = (int64_t)snapped[(triangle + 1) * 2] - snapped[0];
+        int64_t ey1 = (int64_t)snapped[(triangle + 1) * 2 + 1] - snapped[1];
+        int64_t ex2 = (int64_t)snapped[(triangle + 2) * 2] - snapped[0];
+        int64_t ey2 = (int64_t)snapped[(triangle + 2) * 2 + 1] - snapped[1];
+        int64_t area = ex1 * ey2 - ey1 * ex2;
+        if ((area < 0 ? -area : area) > (attributeArea < 0 ? -attributeArea : attributeArea)) {
+            attributeTriangle = triangle;
+            attributeArea = area;
+        }
+    }
+    RasterGradients gradients = setupGradients(vertices, snapped, 0, attributeTriangle + 1, attributeTriangle + 2, attributeArea);
+    RasterShading shading = setupShading(textures, vertices[0], gradients);
+
+    int32_t values[SPRITE_VERTEX_COUNT];
+    for (int32_t py = startY; py <= endY; ++py) {
+        for (uint32_t edge = 0; edge < edgeNum; ++edge) {
+            values[edge] = getEdgeValue(edges[edge], startX, py);
+        }
+        uint32_t* row = &pixels[(size_t)py * pitch];
+        for (int32_t px = startX; px <= endX; ++px) {
+            int32_t outside = 0;
+            for (uint32_t edge = 0; edge < edgeNum; ++edge) {
+                outside |= values[edge];
+                values[edge] += edges[edge].stepX;
+            }
+            if (outside < 0) continue;
+            if (shading.texture != nullptr && shadePixel(&row[px], shading, gradients.getU((float)px, (float)py), gradients.getV((float)px, (float)py))) {
+                stats.pixelsShaded++;
+            } else {
+                stats.pixelsDiscarded++;
+            }
+        }
+    }
+}
+
+ni::SoftwareRasterizer::SoftwareRasterizer()
+    : pixels(nullptr), width(0), height(0), tileCountX(0), tileCountY(0), textures(nullptr), bins(nullptr), chunkNum(0), binChunkCapacity(0),
+      quads(nullptr), quadNum(0), splatMaxSubpixels(-1.0f), nextTile(0), quadsBinned(0), trianglesRasterized(0), quadsSplatted(0), pixelsShaded(0), pixelsDiscarded(0), stats() {}
+
+void ni::SoftwareRasterizer::init(uint32_t width, uint32_t height) {
+    NI_ASSERT(pixels == nullptr, "Software rasterizer is already initialized");
+    NI_ASSERT(width > 0 && height > 0 && (float)width <= NI_SOFTWARE_RASTER_GUARD_BAND && (float)height <= NI_SOFTWARE_RASTER_GUARD_BAND, "Invalid software raster size %ux%u", width, height);
+    this->width = width;
+    this->height = height;
+    tileCountX = (width + NI_SOFTWARE_RASTER_TILE_SIZE - 1) / NI_SOFTWARE_RASTER_TILE_SIZE;
+    tileCountY = (height + NI_SOFTWARE_RASTER_TILE_SIZE - 1) / NI_SOFTWARE_RASTER_TILE_SIZE;
+    pixels = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+    textures = (SoftwareTexture*)calloc(NI_SOFTWARE_RASTER_TEXTURE_NUM, sizeof(SoftwareTexture));
+    stats = {};
+    clear(NI_COLOR_RGBA_UINT(0, 0, 0, 0xff));
+}
+
+void ni::SoftwareRasterizer::destroy() {
+    for (uint32_t index = 0; index < binChunkCapacity * tileCountX * tileCountY; ++index) {
+        bins[index].destroy();
+    }
+    delete[] bins;
+    free(textures);
+    free(pixels);
+    bins = nullptr;
+    binChunkCapacity = 0;
+    textures = nullptr;
+    pixels = nullptr;
+    width = 0;
+    height = 0;
+    tileCountX = 0;
+    tileCountY = 0;
+}
+
+void ni::SoftwareRasterizer::setTexture(uint32_t index, const SoftwareTexture& texture) {
+    NI_ASSERT(index < NI_SOFTWARE_RASTER_TEXTURE_NUM, "Texture index %u out of range", index);
+    NI_ASSERT(texture.mipChain != nullptr && texture.width > 0 && texture.height > 0 && texture.mipLevels > 0, "Invalid software texture");
+    textures[index] = texture;
+}
+
+void ni::SoftwareRasterizer::clearTexture(uint32_t index) {
+    NI_ASSERT(index < NI_SOFTWARE_RASTER_TEXTURE_NUM, "Texture index %u out of range", index);
+    textures[index] = {};
+}
+
+void ni::SoftwareRasterizer::clear(uint32_t color) {
+    std::fill(pixels, pixels + (size_t)width * height, color);
+}
+
+void ni::SoftwareRasterizer::binJob(void* userData) {
+    Job* job = (Job*)userData;
+    SoftwareRasterizer* rasterizer = job->rasterizer;
+    uint32_t tileNum = rasterizer->tileCountX * rasterizer->tileCountY;
+    Array<uint32_t, uint32_t>* chunkBins = &rasterizer->bins[job->chunk * tileNum];
+    for (uint32_t tile = 0; tile < tileNum; ++tile) {
+        chunkBins[tile].reset();
+    }
+    uint32_t first = (uint32_t)((uint64_t)rasterizer->quadNum * job->chunk / rasterizer->chunkNum);
+    uint32_t last = (uint32_t)((uint64_t)rasterizer->quadNum * (job->chunk + 1) / rasterizer->chunkNum);
+    const float width = (float)rasterizer->width;
+    const float height = (float)rasterizer->height;
+    const float tileSize = (float)NI_SOFTWARE_RASTER_TILE_SIZE;
+    uint64_t binnedNum = 0;
+    for (uint32_t index = first; index < last; ++index) {
+        const SpriteVertex* vertices = rasterizer->quads[index].vertices;
+        float minX = vertices[0].position[0];
+        float minY = vertices[0].position[1];
+        float maxX = minX;
+        float maxY = minY;
+        for (uint32_t vertex = 1; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+            minX = std::min(minX, vertices[vertex].position[0]);
+            minY = std::min(minY, vertices[vertex].position[1]);
+            maxX = std::max(maxX, vertices[vertex].position[0]);
+            maxY = std::max(maxY, vertices[vertex].position[1]);
+        }
+        // Culled quads collapse to the origin and have no area, NaNs fail the comparison too.
+        if (!(maxX > minX && maxY > minY) || maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) continue;
+        uint32_t tileMinX = (uint32_t)std::max(minX / tileSize, 0.0f);
+        uint32_t tileMinY = (uint32_t)std::max(minY / tileSize, 0.0f);
+        uint32_t tileMaxX = (uint32_t)std::min(maxX / tileSize, (float)(rasterizer->tileCountX - 1));
+        uint32_t tileMaxY = (uint32_t)std::min(maxY / tileSize, (float)(rasterizer->tileCountY - 1));
+        for (uint32_t tileY = tileMinY; tileY <= tileMaxY; ++tileY) {
+            for (uint32_t tileX = tileMinX; tileX <= tileMaxX; ++tileX) {
+                chunkBins[tileY * rasterizer->tileCountX + tileX].add(index);
+            }
+        }
+        binnedNum++;
+    }
+    rasterizer->quadsBinned += binnedNum;
+}
+
+void ni::SoftwareRasterizer::rasterJob(void* userData) {
+    Job* job = (Job*)userData;
+    SoftwareRasterizer* rasterizer = job->rasterizer;
+    uint32_t tileNum = rasterizer->tileCountX * rasterizer->tileCountY;
+    SoftwareRasterStats tileStats = {};
+    for (uint32_t tile = rasterizer->nextTile++; tile < tileNum; tile = rasterizer->nextTile++) {
+        rasterizer->rasterizeTile(tile, tileStats);
+    }
+    rasterizer->trianglesRasterized += tileStats.trianglesRasterized;
+    rasterizer->quadsSplatted += tileStats.quadsSplatted;
+    rasterizer->pixelsShaded += tileStats.pixelsShaded;
+    rasterizer->pixelsDiscarded += tileStats.pixelsDiscarded;
+}
+
+void ni::SoftwareRasterizer::rasterizeTile(uint32_t tile, SoftwareRasterStats& tileStats) {
+    uint32_t tileNum = tileCountX * tileCountY;
+    int32_t minX = (int32_t)(tile % tileCountX * NI_SOFTWARE_RASTER_TILE_SIZE);
+    int32_t minY = (int32_t)(tile / tileCountX * NI_SOFTWARE_RASTER_TILE_SIZE);
+    int32_t maxX = std::min(minX + NI_SOFTWARE_RASTER_TILE_SIZE, (int32_t)width) - 1;
+    int32_t maxY = std::min(minY + NI_SOFTWARE_RASTER_TILE_SIZE, (int32_t)height) - 1;
+    int32_t snapped[SPRITE_VERTEX_COUNT * 2];
+    // Chunks hold consecutive quads, walking them in order keeps the blending order of the draw.
+    for (uint32_t chunk = 0; chunk < chunkNum; ++chunk) {
+        Array<uint32_t, uint32_t>& bin = bins[chunk * tileNum + tile];
+        for (uint32_t binIndex = 0; binIndex < bin.getNum(); ++binIndex) {
+            const SpriteVertex* vertices = quads[bin.getData()[binIndex]].vertices;
+            for (uint32_t vertex = 0; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+                snapped[vertex * 2] = snapCoordinate(vertices[vertex].position[0]);
+                snapped[vertex * 2 + 1] = snapCoordinate(vertices[vertex].position[1]);
+            }
+            int32_t boundsMinX = snapped[0];
+            int32_t boundsMinY = snapped[1];
+            int32_t boundsMaxX = boundsMinX;
+            int32_t boundsMaxY = boundsMinY;
+            for (uint32_t vertex = 1; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+                boundsMinX = std::min(boundsMinX, snapped[vertex * 2]);
+                boundsMinY = std::min(boundsMinY, snapped[vertex * 2 + 1]);
+                boundsMaxX = std::max(boundsMaxX, snapped[vertex * 2]);
+                boundsMaxY = std::max(boundsMaxY, snapped[vertex * 2 + 1]);
+            }
+            if ((float)(boundsMaxX - boundsMinX) <= splatMaxSubpixels && (float)(boundsMaxY - boundsMinY) <= splatMaxSubpixels) {
+                splatQuad(pixels, width, textures, vertices, snapped, minX, minY, maxX, maxY, tileStats);
+                continue;
+            }
+            // The sprite index pattern, a fan around vertex 0.
+            for (uint32_t triangle = 0; triangle < SPRITE_INDEX_COUNT / 3; ++triangle) {
+                drawTriangle(pixels, width, textures, vertices, snapped, 0, triangle + 1, triangle + 2, minX, minY, maxX, maxY, tileStats);
+            }
+        }
+    }
+}
+
+void ni::SoftwareRasterizer::drawSprites(const SpriteQuad* quads, uint32_t quadNum) {
+    NI_TRACE_SCOPE("SoftwareRasterizer::drawSprites");
+    draw(quads, quadNum, -1.0f);
+}
+
+void ni::SoftwareRasterizer::splatSprites(const SpriteQuad* quads, uint32_t quadNum) {
+    NI_TRACE_SCOPE("SoftwareRasterizer::splatSprites");
+    draw(quads, quadNum, FLT_MAX);
+}
+
+void ni::SoftwareRasterizer::drawSprites(const SpriteQuad* quads, uint32_t quadNum, float splatMaxSize) {
+    NI_TRACE_SCOPE("SoftwareRasterizer::drawSprites");
+    draw(quads, quadNum, splatMaxSize);
+}
+
+void ni::SoftwareRasterizer::draw(const SpriteQuad* quads, uint32_t quadNum, float splatMaxSize) {
+    NI_ASSERT(pixels != nullptr, "Software rasterizer isn't initialized");
+    if (quadNum == 0) return;
+    this->quads = quads;
+    this->quadNum = quadNum;
+    splatMaxSubpixels = splatMaxSize < 0.0f ? -1.0f : splatMaxSize * (float)NI_SOFTWARE_RASTER_SUBPIXEL;
+    uint32_t jobNum = getLoaderThreadNum() + 1;
+    chunkNum = std::clamp((quadNum + NI_SOFTWARE_RASTER_BIN_CHUNK - 1) / NI_SOFTWARE_RASTER_BIN_CHUNK, 1u, jobNum);
+    uint32_t tileNum = tileCountX * tileCountY;
+    if (chunkNum > binChunkCapacity) {
+        for (uint32_t index = 0; index < binChunkCapacity * tileNum; ++index) {
+            bins[index].destroy();
+        }
+        delete[] bins;
+        bins = new Array<uint32_t, uint32_t>[chunkNum * tileNum];
+        binChunkCapacity = chunkNum;
+    }
+    Job* jobs = (Job*)malloc(jobNum * sizeof(Job));
+    for (uint32_t index = 0; index < jobNum; ++index) {
+        jobs[index] = { this, index };
+    }
+
+    double startTime = getSeconds();
+    quadsBinned = 0;
+    for (uint32_t chunk = 0; chunk < chunkNum; ++chunk) {
+        submitJob(binJob, &jobs[chunk], counter);
+    }
+    waitJobs(counter);
+    double binTime = getSeconds();
+
+    nextTile = 0;
+    trianglesRasterized = 0;
+    quadsSplatted = 0;
+    pixelsShaded = 0;
+    pixelsDiscarded = 0;
+    for (uint32_t index = 0; index < std::min(jobNum, tileNum); ++index) {
+        submitJob(rasterJob, &jobs[index], counter);
+    }
+    waitJobs(counter);
+    double rasterTime = getSeconds();
+    free(jobs);
+
+    stats.quadsBinned += quadsBinned;
+    stats.trianglesRasterized += trianglesRasterized;
+    stats.quadsSplatted += quadsSplatted;
+    stats.pixelsShaded += pixelsShaded;
+    stats.pixelsDiscarded += pixelsDiscarded;
+    stats.binMs += (binTime - startTime) * 1000.0;
+    stats.rasterMs += (rasterTime - binTime) * 1000.0;
+    this->quads = nullptr;
+    this->quadNum = 0;
+}
+
+uint32_t ni::generateSpritesCpu(const DrawCommand* drawCommands, uint32_t commandNum, const SpriteMesh* meshes, float viewWidth, float viewHeight, SpriteQuad* outQuads) {
+    uint32_t drawnNum = 0;
+    for (uint32_t index = 0; index < commandNum; ++index) {
+        const DrawCommand& cmd = drawCommands[index];
+        const float* image = cmd.image;
+        float corners[4][2];
+        transformPoint(image[0], image[1], cmd, corners[0][0], corners[0][1]);
+        transformPoint(image[0], image[1] + image[3], cmd, corners[1][0], corners[1][1]);
+        transformPoint(image[0] + image[2], image[1] + image[3], cmd, corners[2][0], corners[2][1]);
+        transformPoint(image[0] + image[2], image[1], cmd, corners[3][0], corners[3][1]);
+        float minX = std::min(std::min(corners[0][0], corners[1][0]), std::min(corners[2][0], corners[3][0]));
+        float minY = std::min(std::min(corners[0][1], corners[1][1]), std::min(corners[2][1], corners[3][1]));
+        float maxX = std::max(std::max(corners[0][0], corners[1][0]), std::max(corners[2][0], corners[3][0]));
+        float maxY = std::max(std::max(corners[0][1], corners[1][1]), std::max(corners[2][1], corners[3][1]));
+        bool isVisible = minX < viewWidth && maxX > 0.0f && minY < viewHeight && maxY > 0.0f;
+        float visible = isVisible ? 1.0f : 0.0f;
+        drawnNum += isVisible ? 1 : 0;
+        const SpriteMesh& mesh = meshes[cmd.textureId >> TEXTURE_ID_MESH_SHIFT];
+        SpriteQuad& quad = outQuads[index];
+        for (uint32_t vertex = 0; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+            float texCoordX = mesh.vertices[vertex][0];
+            float texCoordY = mesh.vertices[vertex][1];
+            float positionX;
+            float positionY;
+            transformPoint(image[0] + texCoordX * image[2], image[1] + texCoordY * image[3], cmd, positionX, positionY);
+            quad.vertices[vertex] = { { positionX * visible, positionY * visible }, { texCoordX, texCoordY }, cmd.color, cmd.textureId & TEXTURE_ID_INDEX_MASK };
+        }
+    }
+    return drawnNum;
+}
+
+// Every level of the chain one color, levels colors[level] when given.
+static ni::SoftwareTexture createSolidTexture(uint32_t size, uint32_t mipLevels, const uint32_t* colors, uint32_t color) {
+    uint32_t* mipChain = (uint32_t*)malloc(ni::getMipChainSizeRGBA8(size, size, mipLevels));
+    uint32_t* level = mipChain;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        uint32_t levelSize = size >> mip > 0 ? size >> mip : 1;
+        std::fill(level, level + levelSize * levelSize, colors != nullptr ? colors[mip] : color);
+        level += levelSize * levelSize;
+    }
+    return { (const uint8_t*)mipChain, size, size, mipLevels };
+}
+
+static void drawCommands(ni::SoftwareRasterizer& rasterizer, const DrawCommand* commands, uint32_t commandNum, SpriteQuad* quads) {
+    SpriteMesh mesh = getFullSpriteMesh();
+    ni::generateSpritesCpu(commands, commandNum, &mesh, (float)rasterizer.getWidth(), (float)rasterizer.getHeight(), quads);
+    rasterizer.drawSprites(quads, commandNum);
+}
+
+static DrawCommand makeCommand(float x, float y, float size, float rotation, uint32_t color, uint32_t texture) {
+    return { { -size * 0.5f, -size * 0.5f, size, size }, { x, y, 1.0f, rotation }, color, texture };
+}
+
+static uint32_t countPixels(const ni::SoftwareRasterizer& rasterizer, uint32_t color) {
+    const uint32_t* pixels = rasterizer.getPixels();
+    return (uint32_t)std::count(pixels, pixels + (size_t)rasterizer.getWidth() * rasterizer.getHeight(), color);
+}
+
+static bool isChannelClose(uint32_t pixel, uint32_t expected) {
+    for (uint32_t channel = 0; channel < 4; ++channel) {
+        int32_t difference = (int32_t)((pixel >> (channel * 8)) & 0xff) - (int32_t)((expected >> (channel * 8)) & 0xff);
+        if (difference < -1 || difference > 1) return false;
+    }
+    return true;
+}
+
+uint32_t ni::validateSoftwareRasterizer() {
+    const uint32_t black = NI_COLOR_RGBA_UINT(0, 0, 0, 0xff);
+    const uint32_t white = NI_COLOR_RGBA_UINT(0xff, 0xff, 0xff, 0xff);
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+    SoftwareRasterizer rasterizer;
+    rasterizer.init(256, 256);
+    SpriteQuad* quads = (SpriteQuad*)malloc(20000 * sizeof(SpriteQuad));
+    SoftwareTexture opaque = createSolidTexture(4, 3, nullptr, white);
+    SoftwareTexture halfAlpha = createSolidTexture(4, 3, nullptr, NI_COLOR_RGBA_UINT(0xff, 0, 0, 0x80));
+    SoftwareTexture transparent = createSolidTexture(4, 3, nullptr, NI_COLOR_RGBA_UINT(0xff, 0xff, 0xff, 0));
+    const uint32_t mipColors[] = {
+        NI_COLOR_RGB_UINT(0xff, 0, 0), NI_COLOR_RGB_UINT(0, 0xff, 0), NI_COLOR_RGB_UINT(0, 0, 0xff), NI_COLOR_RGB_UINT(0xff, 0xff, 0),
+        NI_COLOR_RGB_UINT(0, 0xff, 0xff), NI_COLOR_RGB_UINT(0xff, 0, 0xff), NI_COLOR_RGB_UINT(0x80, 0x80, 0x80),
+    };
+    SoftwareTexture mipmapped = createSolidTexture(64, 7, mipColors, 0);
+    rasterizer.setTexture(0, opaque);
+    rasterizer.setTexture(1, halfAlpha);
+    rasterizer.setTexture(2, transparent);
+    rasterizer.setTexture(3, mipmapped);
+
+    // Edges through pixel centers, the top-left rule takes the left column and top row and leaves the others.
+    rasterizer.clear(black);
+    DrawCommand rect = makeCommand(19.5f, 19.5f, 20.0f, 0.0f, NI_COLOR_UINT(0xffffffff), 0);
+    drawCommands(rasterizer, &rect, 1, quads);
+    checkNum++;
+    if (countPixels(rasterizer, white) != 400 || rasterizer.getPixels()[9 * 256 + 9] != white || rasterizer.getPixels()[29 * 256 + 29] != black) {
+        NI_LOG("Software rasterizer: 20x20 rect on pixel centers covers %u pixels instead of 400", countPixels(rasterizer, white));
+        errorNum++;
+    }
+
+    // Fan triangles share edges inside the sprite, with half alpha a pixel drawn twice would come out brighter.
+    rasterizer.clear(black);
+    DrawCommand rotated = makeCommand(128.0f, 128.0f, 150.0f, 0.7f, NI_COLOR_UINT(0xffffffff), 1);
+    drawCommands(rasterizer, &rotated, 1, quads);
+    uint32_t blended = rasterizer.getPixels()[128 * 256 + 128];
+    checkNum++;
+    if (countPixels(rasterizer, black) + countPixels(rasterizer, blended) != 256 * 256 || blended == black) {
+        NI_LOG("Software rasterizer: rotated sprite has %u pixels drawn more than once", 256 * 256 - countPixels(rasterizer, black) - countPixels(rasterizer, blended));
+        errorNum++;
+    }
+
+    // SRC_ALPHA / INV_SRC_ALPHA color and ONE / INV_SRC_ALPHA alpha over the clear color.
+    float alpha = 128.0f / 255.0f;
+    uint32_t expectedBlend = NI_COLOR_RGBA_UINT((uint32_t)(alpha * 255.0f + 0.5f), 0, (uint32_t)((1.0f - alpha) * 0x40 + 0.5f), 0xff);
+    rasterizer.clear(NI_COLOR_RGBA_UINT(0, 0, 0x40, 0xff));
+    DrawCommand blendCommand = makeCommand(128.0f, 128.0f, 32.0f, 0.0f, NI_COLOR_UINT(0xffffffff), 1);
+    drawCommands(rasterizer, &blendCommand, 1, quads);
+    checkNum++;
+    if (!isChannelClose(rasterizer.getPixels()[128 * 256 + 128], expectedBlend)) {
+        NI_LOG("Software rasterizer: blended 0x%08x, expected 0x%08x", rasterizer.getPixels()[128 * 256 + 128], expectedBlend);
+        errorNum++;
+    }
+
+    // Vertex colors whose channels add up to exactly 1 don't tint, like in SpriteRender_PS.
+    rasterizer.clear(black);
+    DrawCommand tints[2] = {
+        makeCommand(64.0f, 64.0f, 32.0f, 0.0f, NI_COLOR_RGBA_UINT(0xff, 0, 0, 0), 0),
+        makeCommand(192.0f, 64.0f, 32.0f, 0.0f, NI_COLOR_RGBA_UINT(0, 0xff, 0, 0xff), 0),
+    };
+    drawCommands(rasterizer, tints, 2, quads);
+    const uint32_t green = NI_COLOR_RGB_UINT(0, 0xff, 0);
+    checkNum++;
+    if (rasterizer.getPixels()[64 * 256 + 64] != white || rasterizer.getPixels()[64 * 256 + 192] != green) {
+        NI_LOG("Software rasterizer: tints 0x%08x and 0x%08x, expected 0x%08x and 0x%08x", rasterizer.getPixels()[64 * 256 + 64],
+            rasterizer.getPixels()[64 * 256 + 192], white, green);
+        errorNum++;
+    }
+
+    // Zero alpha texels and textures that aren't set leave the target alone, alpha included.
+    rasterizer.clear(NI_COLOR_RGBA_UINT(0x10, 0x20, 0x30, 0x40));
+    DrawCommand discarded[2] = {
+        makeCommand(64.0f, 64.0f, 64.0f, 0.3f, NI_COLOR_UINT(0xffffffff), 2),
+        makeCommand(192.0f, 192.0f, 64.0f, 0.3f, NI_COLOR_UINT(0xffffffff), 4),
+    };
+    uint64_t discardedStart = rasterizer.getStats().pixelsDiscarded;
+    drawCommands(rasterizer, discarded, 2, quads);
+    checkNum++;
+    if (countPixels(rasterizer, NI_COLOR_RGBA_UINT(0x10, 0x20, 0x30, 0x40)) != 256 * 256 || rasterizer.getStats().pixelsDiscarded == discardedStart) {
+        NI_LOG("Software rasterizer: discarded pixels were written");
+        errorNum++;
+    }
+
+    // A 64 texel texture drawn at 64 >> level pixels samples exactly that level, or SPRITE_MESH_MAX_FILTER_MIP
+    // past it like the GPU sampler. Centered on a pixel center so the 1 pixel sprite covers it.
+    for (uint32_t level = 0; level < 7; ++level) {
+        rasterizer.clear(black);
+        float size = (float)(64 >> level);
+        uint32_t expectedLevel = std::min(level, (uint32_t)SPRITE_MESH_MAX_FILTER_MIP);
+        DrawCommand mipCommand = makeCommand(128.5f, 128.5f, size, 0.0f, NI_COLOR_UINT(0xffffffff), 3);
+        drawCommands(rasterizer, &mipCommand, 1, quads);
+        checkNum++;
+        if (rasterizer.getPixels()[128 * 256 + 128] != mipColors[expectedLevel]) {
+            NI_LOG("Software rasterizer: %.0f pixel sprite shows 0x%08x, expected mip %u 0x%08x", size, rasterizer.getPixels()[128 * 256 + 128], expectedLevel, mipColors[expectedLevel]);
+            errorNum++;
+        }
+    }
+
+    // The same scene drawn in one call, in small calls and with loader threads has to come out the same.
+    DrawCommand* scene = (DrawCommand*)malloc(20000 * sizeof(DrawCommand));
+    uint32_t state = 0x2545f491u;
+    for (uint32_t index = 0; index < 20000; ++index) {
+        float values[6];
+        for (uint32_t value = 0; value < 6; ++value) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            values[value] = (float)(state >> 8) * (1.0f / 16777216.0f);
+        }
+        scene[index] = makeCommand(values[0] * 320.0f - 32.0f, values[1] * 320.0f - 32.0f, 1.0f + values[2] * 40.0f, values[3] * 6.2831853f,
+            NI_COLOR_RGBA_UINT((uint32_t)(values[4] * 255.0f), 0x80, 0xff, (uint32_t)(values[5] * 255.0f)), index % 4);
+    }
+    uint32_t* reference = (uint32_t*)malloc(256 * 256 * sizeof(uint32_t));
+    rasterizer.clear(black);
+    drawCommands(rasterizer, scene, 20000, quads);
+    memcpy(reference, rasterizer.getPixels(), 256 * 256 * sizeof(uint32_t));
+    rasterizer.clear(black);
+    for (uint32_t first = 0; first < 20000; first += 97) {
+        drawCommands(rasterizer, &scene[first], std::min(97u, 20000 - first), quads);
+    }
+    checkNum++;
+    if (memcmp(reference, rasterizer.getPixels(), 256 * 256 * sizeof(uint32_t)) != 0) {
+        NI_LOG("Software rasterizer: scene drawn in one call differs from the same scene in small calls");
+        errorNum++;
+    }
+    bool ownThreads = getLoaderThreadNum() == 0;
+    if (ownThreads) {
+        initLoaderThreads(4);
+    }
+    rasterizer.clear(black);
+    drawCommands(rasterizer, scene, 20000, quads);
+    checkNum++;
+    if (memcmp(reference, rasterizer.getPixels(), 256 * 256 * sizeof(uint32_t)) != 0) {
+        NI_LOG("Software rasterizer: scene differs with %u loader threads", getLoaderThreadNum());
+        errorNum++;
+    }
+    if (ownThreads) {
+        destroyLoaderThreads();
+    }
+
+    const SoftwareRasterStats& stats = rasterizer.getStats();
+    NI_LOG("Software rasterizer: %llu quads binned, %llu triangles, %llu pixels shaded, %llu discarded, bin %.2f ms, raster %.2f ms",
+        stats.quadsBinned, stats.trianglesRasterized, stats.pixelsShaded, stats.pixelsDiscarded, stats.binMs, stats.rasterMs);
+    NI_LOG("Software rasterizer: %u checks, %u error(s)", checkNum, errorNum);
+    free(reference);
+    free(scene);
+    free((void*)mipmapped.mipChain);
+    free((void*)transparent.mipChain);
+    free((void*)halfAlpha.mipChain);
+    free((void*)opaque.mipChain);
+    free(quads);
+    rasterizer.destroy();
+    return errorNum;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "async_loader.h"
+#include "sprite_types.h"
+
+// Tiles are square, a sprite goes into the bin of every tile its bounds touch.
+#define NI_SOFTWARE_RASTER_TILE_SIZE 64
+// Vertices are clamped to this many pixels around the target, triangles reaching further are distorted where the
+// GPU would clip them. Keeps the edge functions inside 32 bits, see software_rasterizer.cpp.
+#define NI_SOFTWARE_RASTER_GUARD_BAND 8192.0f
+
+namespace ni {
+
+	// RGBA8 mip chain, tightly packed one level after the other like generateMipChainRGBA8 writes it.
+	struct SoftwareTexture {
+		const uint8_t* mipChain;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+	};
+
+	struct SoftwareRasterStats {
+		uint64_t quadsBinned;
+		uint64_t trianglesRasterized;
+		// Quads covered as a whole by splatting, their triangles aren't counted. Once per tile they touch.
+		uint64_t quadsSplatted;
+		uint64_t pixelsShaded;
+		// Transparent texels and missing textures.
+		uint64_t pixelsDiscarded;
+		double binMs;
+		double rasterMs;
+	};
+
+	// SpriteRender_VS and SpriteRender_PS on the CPU, for checking the GPU's output and rendering without one.
+	// Draws the vertex stream SpriteGen writes with the sprite index pattern, a fan of SPRITE_INDEX_COUNT / 3
+	// triangles per quad. Positions snap to 1/256 pixel, coverage follows the top-left rule at pixel centers,
+	// textures are sampled trilinearly with clamping and blended with SRC_ALPHA / INV_SRC_ALPHA into RGBA8.
+	// Quads are binned into tiles and the tiles are rasterized on the loader threads, each tile draws its quads
+	// in submission order, so the image doesn't depend on the thread count.
+	struct SoftwareRasterizer {
+		SoftwareRasterizer();
+
+		void init(uint32_t width, uint32_t height);
+		void destroy();
+		// By bindless index, the low TEXTURE_ID_MESH_SHIFT bits of the vertices' texture id. The mip chain has
+		// to stay valid while it's set. Pixels of unset textures are discarded.
+		void setTexture(uint32_t index, const SoftwareTexture& texture);
+		void clearTexture(uint32_t index);
+		// Same packing as NI_COLOR_RGBA_UINT, SpriteRenderer clears to opaque black.
+		void clear(uint32_t color);
+		void drawSprites(const SpriteQuad* quads, uint32_t quadNum);
+		// Covers each quad as a whole instead of its triangles, see tiny_sprites.h. Covers the same pixels as
+		// drawSprites, texture coordinates and mip selection can differ in the last bits. Same binning and order.
+		void splatSprites(const SpriteQuad* quads, uint32_t quadNum);
+		// Splats the quads whose bounds are at most splatMaxSize pixels on both sides and rasterizes the others.
+		// Decided quad by quad inside the tiles, so mixing the paths doesn't split the draw or change its order.
+		void drawSprites(const SpriteQuad* quads, uint32_t quadNum, float splatMaxSize);
+		// RGBA8 rows of width pixels.
+		const uint32_t* getPixels() const { return pixels; }
+		uint32_t getWidth() const { return width; }
+		uint32_t getHeight() const { return height; }
+		// Accumulated since init.
+		const SoftwareRasterStats& getStats() const { return stats; }
+
+	private:
+		struct Job {
+			SoftwareRasterizer* rasterizer;
+			uint32_t chunk;
+		};
+
+		void draw(const SpriteQuad* quads, uint32_t quadNum, float splatMaxSize);
+		static void binJob(void* userData);
+		static void rasterJob(void* userData);
+		void rasterizeTile(uint32_t tile, SoftwareRasterStats& tileStats);
+
+		uint32_t* pixels;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tileCountX;
+		uint32_t tileCountY;
+		SoftwareTexture* textures;
+		// One bin per tile for every chunk of the quads, chunk after chunk, so binning runs in parallel without
+		// losing the submission order.
+		Array<uint32_t, uint32_t>* bins;
+		uint32_t chunkNum;
+		uint32_t binChunkCapacity;
+		const SpriteQuad* quads;
+		uint32_t quadNum;
+		// In subpixels, negative never splats.
+		float splatMaxSubpixels;
+		std::atomic<uint32_t> nextTile;
+		std::atomic<uint64_t> quadsBinned;
+		std::atomic<uint64_t> trianglesRasterized;
+		std::atomic<uint64_t> quadsSplatted;
+		std::atomic<uint64_t> pixelsShaded;
+		std::atomic<uint64_t> pixelsDiscarded;
+		SoftwareRasterStats stats;
+		JobCounter counter;
+	};
+
+	// SpriteGen_CS.hlsl on the CPU: culls each command's quad against the view and writes its mesh vertices,
+	// collapsed to the origin when culled. meshes is indexed by the texture id's bits above TEXTURE_ID_MESH_SHIFT.
+	// Returns the number of visible sprites.
+	uint32_t generateSpritesCpu(const DrawCommand* drawCommands, uint32_t commandNum, const SpriteMesh* meshes, float viewWidth, float viewHeight, SpriteQuad* outQuads);
+	// Draws scenes with known coverage and blending results and checks that the image doesn't change with the
+	// number of loader threads. Doesn't need a device.
+	uint32_t validateSoftwareRasterizer();
+}
@@ -0,0 +1,381 @@
+#include "sprite_benchmark.h"
+#include "gpu_profiler.h"
+#include "renderer_stats.h"
+#include "software_rasterizer.h"
+#include "sprite_renderer.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The CPU emulation culls against the view main opens.
+#define NI_SPRITE_BENCH_VIEW_WIDTH 1920.0f
+#define NI_SPRITE_BENCH_VIEW_HEIGHT 1080.0f
+#define NI_SPRITE_BENCH_TEXTURE_SIZE 64
+#define NI_SPRITE_BENCH_TEXTURE_MIPS 7
+#define NI_SPRITE_BENCH_SPRITE_SCALE 0.5f
+// Pixels per second along each axis.
+#define NI_SPRITE_BENCH_SPEED 120.0f
+#define NI_SPRITE_BENCH_DT (1.0f / 60.0f)
+// CPU scenarios run until about this many sprites went through every stage, within the frame limits.
+#define NI_SPRITE_BENCH_CPU_SPRITE_BUDGET 20000000
+#define NI_SPRITE_BENCH_CPU_MIN_FRAMES 3
+#define NI_SPRITE_BENCH_CPU_MAX_FRAMES 60
+// SpriteGen's output is emulated in chunks, 10M sprites would need 2 GB of vertices at once.
+#define NI_SPRITE_BENCH_CPU_CHUNK 65536
+// GPU scopes are collected NI_FRAME_COUNT frames late and averaged over the last NI_GPU_PROFILER_AVERAGE_FRAMES
+// samples, so after this many frames the averages only hold frames of the current scenario past its warmup.
+#define NI_SPRITE_BENCH_GPU_WARMUP_FRAMES 8
+#define NI_SPRITE_BENCH_GPU_FRAMES (NI_SPRITE_BENCH_GPU_WARMUP_FRAMES + NI_GPU_PROFILER_AVERAGE_FRAMES + NI_FRAME_COUNT)
+#define NI_SPRITE_BENCH_EXPORT_SIZE (64 * 1024)
+
+static const ni::SpriteBenchScenario scenarios[] = {
+    // name, sprites, on screen, textures, moving, rotating
+    { "1k_static", 1000, 1.0f, 4, false, false },
+    { "10k_moving_rotating", 10000, 1.0f, 4, true, true },
+    { "100k_moving_16_textures", 100000, 1.0f, 16, true, false },
+    { "100k_10pct_on_screen", 100000, 0.1f, 16, true, true },
+    { "1m_half_on_screen", 1000000, 0.5f, 4, true, true },
+    { "1m_static_256_textures", 1000000, 1.0f, 256, false, false },
+    { "1m_1pct_on_screen", 1000000, 0.01f, 4, true, true },
+    { "10m_quarter_on_screen", 10000000, 0.25f, 64, true, true },
+    { "10m_static", 10000000, 1.0f, 4, false, false },
+};
+static const uint32_t scenarioNum = sizeof(scenarios) / sizeof(scenarios[0]);
+
+struct BenchSprite {
+    float x;
+    float y;
+    float velocityX;
+    float velocityY;
+    float rotation;
+    // Left edge of the view sized region the sprite wraps around in, the view itself or one far right of it.
+    float regionX;
+    uint32_t texture;
+};
+
+// Scenarios have to place the same sprites on every run to be comparable, so they don't share ni::randomUint's state.
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static float nextRandomFloat(uint32_t& state) {
+    return (float)(nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+static void initSprites(BenchSprite* sprites, const ni::SpriteBenchScenario& scenario, float viewWidth, float viewHeight) {
+    uint32_t state = 0x9e3779b9u ^ scenario.spriteNum;
+    for (uint32_t index = 0; index < scenario.spriteNum; ++index) {
+        BenchSprite& sprite = sprites[index];
+        // Spreads the on screen sprites evenly over the stream instead of putting them first, like a real scene
+        // would mix them inside a wave.
+        bool onScreen = floorf((float)(index + 1) * scenario.onScreenFraction) > floorf((float)index * scenario.onScreenFraction);
+        sprite.regionX = onScreen ? 0.0f : viewWidth * 2.0f;
+        sprite.x = sprite.regionX + nextRandomFloat(state) * viewWidth;
+        sprite.y = nextRandomFloat(state) * viewHeight;
+        sprite.velocityX = (nextRandomFloat(state) * 2.0f - 1.0f) * NI_SPRITE_BENCH_SPEED;
+        sprite.velocityY = (nextRandomFloat(state) * 2.0f - 1.0f) * NI_SPRITE_BENCH_SPEED;
+        sprite.rotation = nextRandomFloat(state) * 6.2831853f;
+        sprite.texture = index % scenario.textureNum;
+    }
+}
+
+static void updateSprites(BenchSprite* sprites, const ni::SpriteBenchScenario& scenario, float viewWidth, float viewHeight) {
+    if (!scenario.moving && !scenario.rotating) return;
+    for (uint32_t index = 0; index < scenario.spriteNum; ++index) {
+        BenchSprite& sprite = sprites[index];
+        if (scenario.moving) {
+            // Wrapping keeps the share of sprites on screen constant.
+            sprite.x += sprite.velocityX * NI_SPRITE_BENCH_DT;
+            sprite.y += sprite.velocityY * NI_SPRITE_BENCH_DT;
+            if (sprite.x < sprite.regionX) sprite.x += viewWidth;
+            if (sprite.x >= sprite.regionX + viewWidth) sprite.x -= viewWidth;
+            if (sprite.y < 0.0f) sprite.y += viewHeight;
+            if (sprite.y >= viewHeight) sprite.y -= viewHeight;
+        }
+        if (scenario.rotating) {
+            sprite.rotation -= NI_SPRITE_BENCH_DT;
+        }
+    }
+}
+
+// What main's loop and SpriteRenderer::drawImage do per sprite, minus the residency check.
+static uint32_t packSprites(const BenchSprite* sprites, uint32_t spriteNum, TransformStack& matrixStack, uint32_t* textureIds, uint32_t textureNum, DrawCommand* drawCommands) {
+    const float size = (float)NI_SPRITE_BENCH_TEXTURE_SIZE;
+    uint32_t imageNum = 0;
+    memset(textureIds, 0xff, textureNum * sizeof(uint32_t));
+    for (uint32_t index = 0; index < spriteNum; ++index) {
+        const BenchSprite& sprite = sprites[index];
+        matrixStack.pushMatrix();
+        matrixStack.translate(sprite.x, sprite.y);
+        matrixStack.rotate(sprite.rotation);
+        matrixStack.scale(NI_SPRITE_BENCH_SPRITE_SCALE, NI_SPRITE_BENCH_SPRITE_SCALE);
+        DrawCommand& cmd = drawCommands[index];
+        memcpy(cmd.transform, &matrixStack.current, sizeof(float) * 4);
+        if (textureIds[sprite.texture] == ~0u) {
+            textureIds[sprite.texture] = sprite.texture | (imageNum++ << TEXTURE_ID_MESH_SHIFT);
+        }
+        cmd.image[0] = -size * 0.5f;
+        cmd.image[1] = -size * 0.5f;
+        cmd.image[2] = size;
+        cmd.image[3] = size;
+        cmd.color = NI_COLOR_UINT(0xffffffff);
+        cmd.textureId = textureIds[sprite.texture];
+        matrixStack.popMatrix();
+    }
+    return imageNum;
+}
+
+// The draw up to the rasterizer: fetches every fan triangle through the index pattern, moves it to clip space
+// like SpriteRender_VS and sets it up. Returns the pixel area of the triangles that survive setup, culled
+// sprites collapse to a point and fall out there like on the GPU.
+static double drawSprites(const SpriteQuad* quads, uint32_t quadNum, float viewWidth, float viewHeight) {
+    const float scaleX = 2.0f / viewWidth;
+    const float scaleY = -2.0f / viewHeight;
+    const float toPixels = viewWidth * viewHeight * 0.125f;
+    double area = 0.0;
+    for (uint32_t index = 0; index < quadNum; ++index) {
+        const SpriteVertex* vertices = quads[index].vertices;
+        float clip[SPRITE_VERTEX_COUNT][2];
+        for (uint32_t vertex = 0; vertex < SPRITE_VERTEX_COUNT; ++vertex) {
+            clip[vertex][0] = vertices[vertex].position[0] * scaleX - 1.0f;
+            clip[vertex][1] = vertices[vertex].position[1] * scaleY + 1.0f;
+        }
+        for (uint32_t triangle = 1; triangle + 1 < SPRITE_VERTEX_COUNT; ++triangle) {
+            float edge0X = clip[triangle][0] - clip[0][0];
+            float edge0Y = clip[triangle][1] - clip[0][1];
+            float edge1X = clip[triangle + 1][0] - clip[0][0];
+            float edge1Y = clip[triangle + 1][1] - clip[0][1];
+            float doubleArea = edge0X * edge1Y - edge0Y * edge1X;
+            if (doubleArea != 0.0f) {
+                area += fabsf(doubleArea) * toPixels;
+            }
+        }
+    }
+    return area;
+}
+
+static void logResult(const ni::SpriteBenchResult& result) {
+    const ni::SpriteBenchScenario& scenario = *result.scenario;
+    if (!result.ran) {
+        NI_LOG(" %-26s skipped, %u sprites don't fit in one flush", scenario.name, scenario.spriteNum);
+        return;
+    }
+    double totalMs = result.packMs + std::max(result.uploadMs, 0.0) + result.cullMs + result.drawMs;
+    NI_LOG(" %-26s %8u sprites, %8u drawn, pack %8.3f ms, upload %8.3f ms, cull %8.3f ms, draw %8.3f ms, %7.1f M sprites/s",
+        scenario.name, scenario.spriteNum, result.drawnNum, result.packMs, result.uploadMs, result.cullMs, result.drawMs,
+        totalMs > 0.0 ? (double)scenario.spriteNum / (totalMs * 1000.0) : 0.0);
+}
+
+static bool exportResults(const ni::SpriteBenchResult* results, uint32_t resultNum, const char* csvPath, const char* jsonPath) {
+    char* text = (char*)malloc(NI_SPRITE_BENCH_EXPORT_SIZE);
+    int size = snprintf(text, NI_SPRITE_BENCH_EXPORT_SIZE, "scenario,mode,sprites,on_screen,textures,moving,rotating,frames,drawn,culled,pack_ms,upload_ms,cull_ms,draw_ms\n");
+    for (uint32_t index = 0; index < resultNum; ++index) {
+        const ni::SpriteBenchResult& result = results[index];
+        const ni::SpriteBenchScenario& scenario = *result.scenario;
+        if (!result.ran) continue;
+        size += snprintf(text + size, NI_SPRITE_BENCH_EXPORT_SIZE - size, "%s,%s,%u,%.3f,%u,%d,%d,%u,%u,%u,%.4f,%.4f,%.4f,%.4f\n",
+            scenario.name, result.gpu ? "gpu" : "cpu", scenario.spriteNum, scenario.onScreenFraction, scenario.textureNum, scenario.moving, scenario.rotating,
+            result.frameNum, result.drawnNum, result.culledNum, result.packMs, result.uploadMs, result.cullMs, result.drawMs);
+    }
+    bool written = ni::writeFile(csvPath, text, size);
+
+    size = snprintf(text, NI_SPRITE_BENCH_EXPORT_SIZE, "[\n");
+    bool first = true;
+    for (uint32_t index = 0; index < resultNum; ++index) {
+        const ni::SpriteBenchResult& result = results[index];
+        const ni::SpriteBenchScenario& scenario = *result.scenario;
+        if (!result.ran) continue;
+        size += snprintf(text + size, NI_SPRITE_BENCH_EXPORT_SIZE - size,
+            "%s  {\"scenario\": \"%s\", \"mode\": \"%s\", \"sprites\": %u, \"on_screen\": %.3f, \"textures\": %u, \"moving\": %s, \"rotating\": %s, "
+            "\"frames\": %u, \"drawn\": %u, \"culled\": %u, \"pack_ms\": %.4f, \"upload_ms\": %.4f, \"cull_ms\": %.4f, \"draw_ms\": %.4f}",
+            first ? "" : ",\n", scenario.name, result.gpu ? "gpu" : "cpu", scenario.spriteNum, scenario.onScreenFraction, scenario.textureNum,
+            scenario.moving ? "true" : "false", scenario.rotating ? "true" : "false", result.frameNum, result.drawnNum, result.culledNum,
+            result.packMs, result.uploadMs, result.cullMs, result.drawMs);
+        first = false;
+    }
+    size += snprintf(text + size, NI_SPRITE_BENCH_EXPORT_SIZE - size, "\n]\n");
+    written &= ni::writeFile(jsonPath, text, size);
+    free(text);
+    if (written) {
+        NI_LOG("Sprite benchmark results written to %s and %s", csvPath, jsonPath);
+    } else {
+        NI_LOG("Failed to write sprite benchmark results %s and %s", csvPath, jsonPath);
+    }
+    return written;
+}
+
+static ni::SpriteBenchResult runCpuScenario(const ni::SpriteBenchScenario& scenario) {
+    const float viewWidth = NI_SPRITE_BENCH_VIEW_WIDTH;
+    const float viewHeight = NI_SPRITE_BENCH_VIEW_HEIGHT;
+    ni::SpriteBenchResult result = {};
+    result.scenario = &scenario;
+    result.ran = true;
+    result.frameNum = std::clamp(NI_SPRITE_BENCH_CPU_SPRITE_BUDGET / scenario.spriteNum, (uint32_t)NI_SPRITE_BENCH_CPU_MIN_FRAMES, (uint32_t)NI_SPRITE_BENCH_CPU_MAX_FRAMES);
+
+    BenchSprite* sprites = (BenchSprite*)malloc(scenario.spriteNum * sizeof(BenchSprite));
+    DrawCommand* drawCommands = (DrawCommand*)malloc(scenario.spriteNum * sizeof(DrawCommand));
+    void* uploadBuffer = malloc(scenario.spriteNum * sizeof(DrawCommand) + scenario.textureNum * sizeof(SpriteMesh));
+    SpriteQuad* quads = (SpriteQuad*)malloc(NI_SPRITE_BENCH_CPU_CHUNK * sizeof(SpriteQuad));
+    SpriteMesh* meshes = (SpriteMesh*)malloc(scenario.textureNum * sizeof(SpriteMesh));
+    uint32_t* textureIds = (uint32_t*)malloc(scenario.textureNum * sizeof(uint32_t));
+    TransformStack* matrixStack = new TransformStack();
+    for (uint32_t index = 0; index < scenario.textureNum; ++index) {
+        meshes[index] = getFullSpriteMesh();
+    }
+    initSprites(sprites, scenario, viewWidth, viewHeight);
+    // Touches every page before the first timed frame.
+    memset(drawCommands, 0, scenario.spriteNum * sizeof(DrawCommand));
+    memset(uploadBuffer, 0, scenario.spriteNum * sizeof(DrawCommand));
+
+    double packTime = 0.0;
+    double uploadTime = 0.0;
+    double cullTime = 0.0;
+    double drawTime = 0.0;
+    double coveredPixels = 0.0;
+    for (uint32_t frame = 0; frame < result.frameNum; ++frame) {
+        updateSprites(sprites, scenario, viewWidth, viewHeight);
+
+        double startTime = ni::getSeconds();
+        uint32_t imageNum = packSprites(sprites, scenario.spriteNum, *matrixStack, textureIds, scenario.textureNum, drawCommands);
+        packTime += ni::getSeconds() - startTime;
+
+        startTime = ni::getSeconds();
+        memcpy(uploadBuffer, drawCommands, scenario.spriteNum * sizeof(DrawCommand));
+        memcpy(ni::offsetPtr(uploadBuffer, scenario.spriteNum * sizeof(DrawCommand)), meshes, imageNum * sizeof(SpriteMesh));
+        uploadTime += ni::getSeconds() - startTime;
+
+        uint32_t drawnNum = 0;
+        for (uint32_t chunk = 0; chunk < scenario.spriteNum; chunk += NI_SPRITE_BENCH_CPU_CHUNK) {
+            uint32_t chunkNum = std::min(scenario.spriteNum - chunk, (uint32_t)NI_SPRITE_BENCH_CPU_CHUNK);
+            startTime = ni::getSeconds();
+            drawnNum += ni::generateSpritesCpu(&drawCommands[chunk], chunkNum, meshes, viewWidth, viewHeight, quads);
+            double generatedTime = ni::getSeconds();
+            cullTime += generatedTime - startTime;
+            coveredPixels += drawSprites(quads, chunkNum, viewWidth, viewHeight);
+            drawTime += ni::getSeconds() - generatedTime;
+        }
+        result.drawnNum = drawnNum;
+        result.culledNum = scenario.spriteNum - drawnNum;
+    }
+    result.packMs = packTime * 1000.0 / result.frameNum;
+    result.uploadMs = uploadTime * 1000.0 / result.frameNum;
+    result.cullMs = cullTime * 1000.0 / result.frameNum;
+    result.drawMs = drawTime * 1000.0 / result.frameNum;
+    // Keeps the draw emulation from being optimized away, and is a sanity check of the scene's fill.
+    if (coveredPixels < 0.0) {
+        NI_LOG("Sprite benchmark: negative coverage in %s", scenario.name);
+    }
+
+    delete matrixStack;
+    free(textureIds);
+    free(meshes);
+    free(quads);
+    free(uploadBuffer);
+    free(drawCommands);
+    free(sprites);
+    return result;
+}
+
+void ni::benchmarkSpritesCpu(const char* csvPath, const char* jsonPath) {
+    NI_LOG("Sprite benchmark, CPU emulation at %.0fx%.0f:", NI_SPRITE_BENCH_VIEW_WIDTH, NI_SPRITE_BENCH_VIEW_HEIGHT);
+    SpriteBenchResult results[scenarioNum];
+    for (uint32_t index = 0; index < scenarioNum; ++index) {
+        results[index] = runCpuScenario(scenarios[index]);
+        logResult(results[index]);
+    }
+    exportResults(results, scenarioNum, csvPath, jsonPath);
+}
+
+static double getScopeAverage(const char* name, ni::GpuProfilerQueue queue) {
+    const ni::GpuScopeStats* scope = ni::getGpuProfiler()->findScope(name, queue);
+    return scope != nullptr && scope->sampleNum > 0 ? scope->averageMs : -1.0;
+}
+
+static ni::SpriteBenchResult runGpuScenario(SpriteRenderer* spriteRenderer, const ni::SpriteBenchScenario& scenario) {
+    ni::SpriteBenchResult result = {};
+    result.scenario = &scenario;
+    result.gpu = true;
+    if (scenario.spriteNum > MAX_DRAW_COMMANDS) return result;
+    result.ran = true;
+    const float viewWidth = ni::getViewWidth();
+    const float viewHeight = ni::getViewHeight();
+    const float size = (float)NI_SPRITE_BENCH_TEXTURE_SIZE;
+
+    // Opaque so the pixel shader doesn't discard them.
+    size_t mipChainSize = ni::getMipChainSize(NI_SPRITE_BENCH_TEXTURE_SIZE, NI_SPRITE_BENCH_TEXTURE_SIZE, NI_SPRITE_BENCH_TEXTURE_MIPS, DXGI_FORMAT_R8G8B8A8_UNORM);
+    void* mipChain = malloc(mipChainSize);
+    memset(mipChain, 0xff, mipChainSize);
+    ni::Texture** textures = (ni::Texture**)malloc(scenario.textureNum * sizeof(ni::Texture*));
+    for (uint32_t index = 0; index < scenario.textureNum; ++index) {
+        textures[index] = ni::createTextureFromMipChain(L"SpriteBenchmark::texture", NI_SPRITE_BENCH_TEXTURE_SIZE, NI_SPRITE_BENCH_TEXTURE_SIZE, NI_SPRITE_BENCH_TEXTURE_MIPS, mipChain, DXGI_FORMAT_R8G8B8A8_UNORM);
+    }
+    free(mipChain);
+    BenchSprite* sprites = (BenchSprite*)malloc(scenario.spriteNum * sizeof(BenchSprite));
+    initSprites(sprites, scenario, viewWidth, viewHeight);
+
+    double packTime = 0.0;
+    uint32_t frame = 0;
+    for (; frame < NI_SPRITE_BENCH_GPU_FRAMES && !ni::shouldQuit(); ++frame) {
+        ni::pollEvents();
+        updateSprites(sprites, scenario, viewWidth, viewHeight);
+
+        double startTime = ni::getSeconds();
+        spriteRenderer->reset();
+        for (uint32_t index = 0; index < scenario.spriteNum; ++index) {
+            const BenchSprite& sprite = sprites[index];
+            spriteRenderer->pushMatrix();
+            spriteRenderer->translate(sprite.x, sprite.y);
+            spriteRenderer->rotate(sprite.rotation);
+            spriteRenderer->scale(NI_SPRITE_BENCH_SPRITE_SCALE, NI_SPRITE_BENCH_SPRITE_SCALE);
+            spriteRenderer->drawImage(-size * 0.5f, -size * 0.5f, size, size, NI_COLOR_UINT(0xffffffff), textures[sprite.texture]);
+            spriteRenderer->popMatrix();
+        }
+        if (frame >= NI_SPRITE_BENCH_GPU_WARMUP_FRAMES) {
+            packTime += ni::getSeconds() - startTime;
+        }
+
+        ni::FrameData& frameData = ni::beginFrame();
+        spriteRenderer->flushCommands(frameData);
+        ni::endFrame();
+        ni::present(false);
+        ni::waitForCurrentFrame();
+    }
+    result.frameNum = frame > NI_SPRITE_BENCH_GPU_WARMUP_FRAMES ? frame - NI_SPRITE_BENCH_GPU_WARMUP_FRAMES : 0;
+    result.packMs = result.frameNum > 0 ? packTime * 1000.0 / result.frameNum : 0.0;
+    result.uploadMs = getScopeAverage("Upload", ni::GPU_PROFILER_QUEUE_COPY);
+#if NI_USE_ASYNC_COMPUTE
+    result.cullMs = getScopeAverage("SpriteGen", ni::GPU_PROFILER_QUEUE_COMPUTE);
+#else
+    result.cullMs = getScopeAverage("SpriteGen", ni::GPU_PROFILER_QUEUE_DIRECT);
+#endif
+    result.drawMs = getScopeAverage("SpriteRender", ni::GPU_PROFILER_QUEUE_DIRECT);
+    const ni::FrameStats* frameStats = ni::getRendererStats()->getLatestCompleteFrame();
+    if (frameStats != nullptr) {
+        result.drawnNum = frameStats->gpuCounters[ni::FRAME_GPU_COUNTER_SPRITES_DRAWN];
+        result.culledNum = frameStats->gpuCounters[ni::FRAME_GPU_COUNTER_SPRITES_CULLED];
+    }
+
+    ni::waitForAllFrames();
+    spriteRenderer->reset();
+    for (uint32_t index = 0; index < scenario.textureNum; ++index) {
+        ni::destroyTexture(textures[index]);
+    }
+    free(sprites);
+    free(textures);
+    return result;
+}
+
+void ni::benchmarkSpritesGpu(SpriteRenderer* spriteRenderer, const char* csvPath, const char* jsonPath) {
+    NI_LOG("Sprite benchmark, GPU at %.0fx%.0f, %u frames per scenario:", getViewWidth(), getViewHeight(), NI_SPRITE_BENCH_GPU_FRAMES);
+    SpriteBenchResult results[scenarioNum];
+    for (uint32_t index = 0; index < scenarioNum; ++index) {
+        results[index] = runGpuScenario(spriteRenderer, scenarios[index]);
+        logResult(results[index]);
+    }
+    exportResults(results, scenarioNum, csvPath, jsonPath);
+}
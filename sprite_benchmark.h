@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ni.h"
+
+struct SpriteRenderer;
+
+namespace ni {
+
+	struct SpriteBenchScenario {
+		const char* name;
+		uint32_t spriteNum;
+		// Share of the sprites placed inside the view, the rest sit fully outside of it.
+		float onScreenFraction;
+		uint32_t textureNum;
+		bool moving;
+		bool rotating;
+	};
+
+	// Stage times are means per frame. On the GPU, cullMs is the SpriteGen dispatch, which culls and
+	// generates the vertices in one pass, and uploadMs is -1 when the copy queue can't take timestamps.
+	struct SpriteBenchResult {
+		const SpriteBenchScenario* scenario;
+		bool gpu;
+		// False when the scenario didn't fit, like more sprites than one flush takes.
+		bool ran;
+		uint32_t frameNum;
+		uint32_t drawnNum;
+		uint32_t culledNum;
+		double packMs;
+		double uploadMs;
+		double cullMs;
+		double drawMs;
+	};
+
+	// Runs every scenario through CPU emulations of the stages: drawImage's packing, the copy into the upload
+	// buffer, SpriteGen's culling and vertex generation, and the vertex fetch and triangle setup of the draw.
+	// Needs no device, results are comparable between runs on the same machine, not with the GPU ones.
+	void benchmarkSpritesCpu(const char* csvPath, const char* jsonPath);
+	// Same scenarios through the renderer, timed with CPU timers and the GPU profiler's scopes.
+	void benchmarkSpritesGpu(SpriteRenderer* spriteRenderer, const char* csvPath, const char* jsonPath);
+}
@@ -0,0 +1,149 @@
+#include "sprite_mesh.h"
+#include "ni_core.h"
+#include <math.h>
+#include <string.h>
+
+static uint32_t buildSpriteRect(const SpriteBounds& bounds, float outVertices[8][2]) {
+    const float rect[4][2] = {
+        { bounds.minX, bounds.minY },
+        { bounds.minX, bounds.maxY },
+        { bounds.maxX, bounds.maxY },
+        { bounds.maxX, bounds.minY }
+    };
+    memcpy(outVertices, rect, sizeof(rect));
+    return 4;
+}
+
+static uint32_t buildSpriteOctagon(const SpriteBounds& bounds, float outVertices[8][2]) {
+    // Intersections of the 8-DOP planes, same winding as the quad (top-left, down the left side).
+    const float octagon[8][2] = {
+        { bounds.minDiagonalSum - bounds.minY, bounds.minY },
+        { bounds.minX, bounds.minDiagonalSum - bounds.minX },
+        { bounds.minX, bounds.minX - bounds.minDiagonalDiff },
+        { bounds.minDiagonalDiff + bounds.maxY, bounds.maxY },
+        { bounds.maxDiagonalSum - bounds.maxY, bounds.maxY },
+        { bounds.maxX, bounds.maxDiagonalSum - bounds.maxX },
+        { bounds.maxX, bounds.maxX - bounds.maxDiagonalDiff },
+        { bounds.maxDiagonalDiff + bounds.minY, bounds.minY }
+    };
+    // Corners that aren't cut collapse into the same point. Drop them.
+    uint32_t vertexNum = 0;
+    for (uint32_t index = 0; index < 8; ++index) {
+        const float* vertex = octagon[index];
+        if (vertexNum > 0 && outVertices[vertexNum - 1][0] == vertex[0] && outVertices[vertexNum - 1][1] == vertex[1]) {
+            continue;
+        }
+        outVertices[vertexNum][0] = vertex[0];
+        outVertices[vertexNum][1] = vertex[1];
+        vertexNum++;
+    }
+    if (vertexNum > 1 && outVertices[vertexNum - 1][0] == outVertices[0][0] && outVertices[vertexNum - 1][1] == outVertices[0][1]) {
+        vertexNum--;
+    }
+    return vertexNum;
+}
+
+static float getPolygonArea(const float vertices[][2], uint32_t vertexNum) {
+    float area = 0.0f;
+    for (uint32_t index = 0; index < vertexNum; ++index) {
+        const float* a = vertices[index];
+        const float* b = vertices[(index + 1) % vertexNum];
+        area += a[0] * b[1] - b[0] * a[1];
+    }
+    return fabsf(area) * 0.5f;
+}
+
+SpriteBounds computeSpriteBounds(const void* pixels, uint32_t width, uint32_t height) {
+    const uint8_t* texels = (const uint8_t*)pixels;
+    int32_t minX = INT32_MAX, minY = INT32_MAX, maxX = INT32_MIN, maxY = INT32_MIN;
+    int32_t minSum = INT32_MAX, maxSum = INT32_MIN, minDiff = INT32_MAX, maxDiff = INT32_MIN;
+    uint32_t opaqueTexelNum = 0;
+    for (int32_t y = 0; y < (int32_t)height; ++y) {
+        const uint8_t* row = &texels[(size_t)y * width * 4];
+        for (int32_t x = 0; x < (int32_t)width; ++x) {
+            if (row[x * 4 + 3] <= SPRITE_MESH_ALPHA_THRESHOLD) continue;
+            minX = x < minX ? x : minX;
+            maxX = x > maxX ? x : maxX;
+            minY = y < minY ? y : minY;
+            maxY = y > maxY ? y : maxY;
+            minSum = x + y < minSum ? x + y : minSum;
+            maxSum = x + y > maxSum ? x + y : maxSum;
+            minDiff = x - y < minDiff ? x - y : minDiff;
+            maxDiff = x - y > maxDiff ? x - y : maxDiff;
+            opaqueTexelNum++;
+        }
+    }
+
+    SpriteBounds bounds = {};
+    if (opaqueTexelNum == 0) {
+        return bounds;
+    }
+    // Texel (x, y) covers [x, x + 1] x [y, y + 1], so extend each extent to the texel corner that reaches furthest,
+    // then by the filter footprint. Within a square of that half size x + y and x - y change twice as much.
+    const float padding = SPRITE_MESH_FILTER_PADDING;
+    bounds.minX = fmaxf((float)minX - padding, 0.0f);
+    bounds.minY = fmaxf((float)minY - padding, 0.0f);
+    bounds.maxX = fminf((float)(maxX + 1) + padding, (float)width);
+    bounds.maxY = fminf((float)(maxY + 1) + padding, (float)height);
+    // Clamped to the rect's corners, so the octagon's vertices stay inside the clamped rect.
+    bounds.minDiagonalSum = fmaxf((float)minSum - 2.0f * padding, bounds.minX + bounds.minY);
+    bounds.maxDiagonalSum = fminf((float)(maxSum + 2) + 2.0f * padding, bounds.maxX + bounds.maxY);
+    bounds.minDiagonalDiff = fmaxf((float)(minDiff - 1) - 2.0f * padding, bounds.minX - bounds.maxY);
+    bounds.maxDiagonalDiff = fminf((float)(maxDiff + 1) + 2.0f * padding, bounds.maxX - bounds.minY);
+    bounds.opaqueTexelNum = opaqueTexelNum;
+    return bounds;
+}
+
+SpriteMesh buildSpriteMesh(const SpriteBounds& bounds, uint32_t width, uint32_t height) {
+    SpriteMesh mesh = {};
+    if (bounds.opaqueTexelNum == 0) {
+        // Fully transparent, every triangle collapses to a point.
+        return mesh;
+    }
+    float vertices[8][2] = {};
+    uint32_t vertexNum = SPRITE_MESH_VERTEX_COUNT == 4 ? buildSpriteRect(bounds, vertices) : buildSpriteOctagon(bounds, vertices);
+    for (uint32_t index = 0; index < SPRITE_MESH_VERTEX_COUNT; ++index) {
+        const float* vertex = vertices[index < vertexNum ? index : vertexNum - 1];
+        mesh.vertices[index][0] = vertex[0] / (float)width;
+        mesh.vertices[index][1] = vertex[1] / (float)height;
+    }
+    return mesh;
+}
+
+SpriteMesh buildSpriteMesh(const void* pixels, uint32_t width, uint32_t height) {
+    return buildSpriteMesh(computeSpriteBounds(pixels, width, height), width, height);
+}
+
+SpriteMesh getFullSpriteMesh() {
+    SpriteBounds bounds = {};
+    bounds.maxX = 1.0f;
+    bounds.maxY = 1.0f;
+    bounds.minDiagonalSum = 0.0f;
+    bounds.maxDiagonalSum = 2.0f;
+    bounds.minDiagonalDiff = -1.0f;
+    bounds.maxDiagonalDiff = 1.0f;
+    bounds.opaqueTexelNum = 1;
+    return buildSpriteMesh(bounds, 1, 1);
+}
+
+float getSpriteMeshArea(const SpriteMesh& mesh) {
+    return getPolygonArea(mesh.vertices, SPRITE_MESH_VERTEX_COUNT);
+}
+
+void logSpriteMeshReport(const char* name, const void* pixels, uint32_t width, uint32_t height) {
+    SpriteBounds bounds = computeSpriteBounds(pixels, width, height);
+    float vertices[8][2] = {};
+    float quadArea = (float)width * (float)height;
+    float opaqueArea = (float)bounds.opaqueTexelNum;
+    float rectArea = 0.0f;
+    float octagonArea = 0.0f;
+    if (bounds.opaqueTexelNum > 0) {
+        rectArea = getPolygonArea(vertices, buildSpriteRect(bounds, vertices));
+        octagonArea = getPolygonArea(vertices, buildSpriteOctagon(bounds, vertices));
+    }
+    NI_LOG("SpriteMesh %s (%ux%u): opaque %.1f%%, trimmed rect %.1f%% (-%.1f%%), trimmed octagon %.1f%% (-%.1f%%) of quad area",
+        name, width, height,
+        opaqueArea / quadArea * 100.0f,
+        rectArea / quadArea * 100.0f, (1.0f - rectArea / quadArea) * 100.0f,
+        octagonArea / quadArea * 100.0f, (1.0f - octagonArea / quadArea) * 100.0f);
+}
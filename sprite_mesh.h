@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// Vertices per sprite mesh. 4 renders alpha trimmed rects, 8 renders trimmed octagons
+// that also cut away the transparent corners. Must match SpriteGen_CS.hlsl.
+#define SPRITE_MESH_VERTEX_COUNT 8
+
+// Texels with alpha at or below this value are treated as empty. The pixel shader
+// discards alpha == 0 so anything above must stay inside the mesh.
+#define SPRITE_MESH_ALPHA_THRESHOLD 0
+
+// Sprites are sampled trilinearly down to this mip and no further, the samplers clamp their LOD to it. Each
+// level reaches further past the opaque texels, a texel of mip k averages 2^k texels of mip 0 and bilinear
+// filtering blends in its neighbours, so the mesh has to grow by 1.5 * 2^k - 1 texels to keep every texel
+// filtering can make visible. Sampling all the way down would need the full quad.
+#define SPRITE_MESH_MAX_FILTER_MIP 2
+#define SPRITE_MESH_FILTER_PADDING (1.5f * (float)(1 << SPRITE_MESH_MAX_FILTER_MIP) - 1.0f)
+
+static_assert(SPRITE_MESH_VERTEX_COUNT == 4 || SPRITE_MESH_VERTEX_COUNT == 8, "Sprite meshes are either trimmed rects or trimmed octagons");
+
+// Convex polygon in normalized texture coordinates. Triangulated as a fan from
+// vertices[0]. Unused vertices repeat the last one so the extra triangles are degenerate.
+struct SpriteMesh {
+    float vertices[SPRITE_MESH_VERTEX_COUNT][2];
+};
+
+// Bounds of an image in texel space. diagonalSum is x + y and diagonalDiff is x - y, which together with the
+// axis extents describe an 8-DOP around the opaque texels, grown by SPRITE_MESH_FILTER_PADDING and clamped to
+// the image.
+struct SpriteBounds {
+    float minX, minY, maxX, maxY;
+    float minDiagonalSum, maxDiagonalSum;
+    float minDiagonalDiff, maxDiagonalDiff;
+    uint32_t opaqueTexelNum;
+};
+
+SpriteBounds computeSpriteBounds(const void* pixels, uint32_t width, uint32_t height);
+SpriteMesh buildSpriteMesh(const SpriteBounds& bounds, uint32_t width, uint32_t height);
+SpriteMesh buildSpriteMesh(const void* pixels, uint32_t width, uint32_t height);
+SpriteMesh getFullSpriteMesh();
+float getSpriteMeshArea(const SpriteMesh& mesh);
+void logSpriteMeshReport(const char* name, const void* pixels, uint32_t width, uint32_t height);
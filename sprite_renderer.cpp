@@ -1,39 +1,78 @@
 #include "sprite_renderer.h"
+#include "cpu_trace.h"
+#include "draw_capture.h"
+#include "gpu_profiler.h"
+#include "renderer_stats.h"
+#include "texture_compression.h"
+#include "texture_streaming.h"
 #include <algorithm>
+#include <math.h>
 
 SpriteRenderer::SpriteRenderer() {
+    // Started first so the reads overlap the buffer creation below.
+    spriteGenShader.read(OUTPUT_PATH "SpriteGen_CS.cso");
+    spriteRenderVertexShader.read(OUTPUT_PATH "SpriteRender_VS.cso");
+    spriteRenderPixelShader.read(OUTPUT_PATH "SpriteRender_PS.cso");
     const size_t bufferSize = sizeof(DrawCommand) * MAX_DRAW_COMMANDS;
+    const size_t meshBufferSize = sizeof(SpriteMesh) * NI_MAX_DESCRIPTORS;
     drawCommands = (DrawCommand*)malloc(bufferSize);
     drawCommandNum = 0;
-    gpuUploadBuffer = ni::createBuffer(L"SpriteRenderer::uploadBuffer", bufferSize, ni::UPLOAD_BUFFER);
+    skippedDrawNum = 0;
+    capture = nullptr;
     for (uint32_t index = 0; index < NI_FRAME_COUNT; ++index) {
+        // Sprite meshes are uploaded right after the draw commands. One per frame, the copy queue
+        // may still be reading the previous one while the CPU fills the next.
+        gpuUploadBuffer[index] = ni::createBuffer(L"SpriteRenderer::uploadBuffer", bufferSize + meshBufferSize, ni::UPLOAD_BUFFER);
         gpuDrawCommands[index] = ni::createBuffer(L"SpriteRenderer::drawCommands", bufferSize, ni::UNORDERED_BUFFER);
+        gpuSpriteMeshes[index] = ni::createBuffer(L"SpriteRenderer::spriteMeshes", meshBufferSize, ni::UNORDERED_BUFFER);
     }
     images = (ni::Texture**)malloc(NI_MAX_DESCRIPTORS * sizeof(ni::Texture*));
+    spriteMeshes = (SpriteMesh*)malloc(meshBufferSize);
+    imageCoverage = (float*)malloc(NI_MAX_DESCRIPTORS * sizeof(float));
+    imageDrawNums = (uint32_t*)malloc(NI_MAX_DESCRIPTORS * sizeof(uint32_t));
     imageNum = 0;
-    gpuCounterZero = ni::createBuffer(L"SpriteRenderer::counterZero", sizeof(uint32_t), ni::UPLOAD_BUFFER, true);
+    stats = {};
+    // Clears the vertex counter and the frame counters.
+    gpuCounterZero = ni::createBuffer(L"SpriteRenderer::counterZero", sizeof(uint32_t) * ni::FRAME_GPU_COUNTER_COUNT, ni::UPLOAD_BUFFER, true);
 
     buildSpriteGen();
     buildSpriteRender();
+    buildSpriteGenDescriptors();
 }
 
 SpriteRenderer::~SpriteRenderer() {
     free(images);
+    free(spriteMeshes);
+    free(imageCoverage);
+    free(imageDrawNums);
     free(drawCommands);
     NI_D3D_RELEASE(gpuDrawCommandSignature);
-    NI_D3D_RELEASE(gpuCounterZero.resource);
-    NI_D3D_RELEASE(gpuUploadBuffer.resource);
+    for (uint32_t frameIndex = 0; frameIndex < NI_FRAME_COUNT; ++frameIndex) {
+        for (uint32_t bufferIndex = 0; bufferIndex < NI_ASYNC_COMPUTE_BUFFER_COUNT; ++bufferIndex) {
+            ni::freePersistentDescriptors(gpuSpriteGenDescriptors[frameIndex][bufferIndex]);
+        }
+    }
+    ni::destroyBuffer(gpuCounterZero);
     for (uint32_t index = 0; index < NI_FRAME_COUNT; ++index) {
-        NI_D3D_RELEASE(gpuDrawCommands[index].resource);
+        ni::destroyBuffer(gpuUploadBuffer[index]);
+        ni::destroyBuffer(gpuDrawCommands[index]);
+        ni::destroyBuffer(gpuSpriteMeshes[index]);
+    }
+    ni::destroyBuffer(gpuClearIndirectCommandBuffer);
+    for (uint32_t index = 0; index < NI_ASYNC_COMPUTE_BUFFER_COUNT; ++index) {
+        ni::destroyBuffer(gpuIndirectCommandBuffer[index]);
+        ni::destroyBuffer(gpuSpriteVertices[index]);
     }
-    NI_D3D_RELEASE(gpuClearIndirectCommandBuffer.resource);
-    NI_D3D_RELEASE(gpuIndirectCommandBuffer.resource);
-    NI_D3D_RELEASE(gpuSpriteVertices.resource);
+    ni::destroyBuffer(gpuSpriteIndices);
+    ni::destroyBuffer(gpuSpriteIndicesUpload);
+    gpuSpriteRenderPSO.destroy();
+    gpuSpriteGenPSO.destroy();
     NI_D3D_RELEASE(gpuSpriteRenderRootSignature);
-    NI_D3D_RELEASE(gpuSpriteRenderPSO);
     NI_D3D_RELEASE(gpuSpriteGenRootSignature);
-    NI_D3D_RELEASE(gpuSpriteGenPSO);
-    NI_D3D_RELEASE(gpuVisibleList.resource);
+    ni::destroyBuffer(gpuSpriteVerticesCounter);
+    ni::destroyBuffer(gpuFrameCounters);
+    ni::destroyBuffer(gpuVisibleList);
+    ni::destroyBuffer(gpuPerLaneOffset);
 }
 
 void SpriteRenderer::buildSpriteRender() {
@@ -42,17 +81,18 @@ void SpriteRenderer::buildSpriteRender() {
     ni::RootSignatureBuilder rootSigBuilder;
     rootSigBuilder.addRootParameterConstant(0, 0, 2, D3D12_SHADER_VISIBILITY_VERTEX);
     rootSigBuilder.addRootParameterDescriptorTable(rootSigRanges, D3D12_SHADER_VISIBILITY_PIXEL);
-    rootSigBuilder.addStaticSampler(D3D12_FILTER_MIN_MAG_MIP_POINT, D3D12_TEXTURE_ADDRESS_MODE_WRAP, 0, 0, D3D12_SHADER_VISIBILITY_PIXEL);
+    // The vertex shader pulls the sprite vertices itself, a root view needs no descriptor.
+    rootSigBuilder.addRootParameterShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX);
+    // Trilinear with clamp, wrapping would bleed the opposite edge of the sprite into the filtered border. Stops at
+    // the mip the sprite meshes are padded for, see SPRITE_MESH_MAX_FILTER_MIP.
+    rootSigBuilder.addStaticSampler(D3D12_FILTER_MIN_MAG_MIP_LINEAR, D3D12_TEXTURE_ADDRESS_MODE_CLAMP, 0, 0, D3D12_SHADER_VISIBILITY_PIXEL, (float)SPRITE_MESH_MAX_FILTER_MIP);
 
     gpuSpriteRenderRootSignature = rootSigBuilder.build(false);
     gpuSpriteRenderRootSignature->SetName(L"SpriteRenderer::spriteRenderRootSig");
 
-    ni::FileReader vertexShaderFile(OUTPUT_PATH "SpriteRender_VS.cso");
-    ni::FileReader pixelShaderFile(OUTPUT_PATH "SpriteRender_PS.cso");
+    // The shaders come from spriteRenderVertexShader and spriteRenderPixelShader.
     D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
     psoDesc.pRootSignature = gpuSpriteRenderRootSignature;
-    psoDesc.VS = { *vertexShaderFile, vertexShaderFile.getSize() };
-    psoDesc.PS = { *pixelShaderFile, pixelShaderFile.getSize() };
     psoDesc.BlendState.AlphaToCoverageEnable = false;
     psoDesc.BlendState.IndependentBlendEnable = false;
     psoDesc.BlendState.RenderTarget[0].BlendEnable = true;
@@ -91,44 +131,9 @@ void SpriteRenderer::buildSpriteRender() {
     psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
     psoDesc.SampleDesc = { 1, 0 };
     psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+    psoDesc.InputLayout = {};
 
-    D3D12_INPUT_ELEMENT_DESC inputElementDesc[4] = {};
-    inputElementDesc[0].SemanticName = "POSITION";
-    inputElementDesc[0].SemanticIndex = 0;
-    inputElementDesc[0].Format = DXGI_FORMAT_R32G32_FLOAT; 
-    inputElementDesc[0].InputSlot = 0;
-    inputElementDesc[0].AlignedByteOffset = offsetof(SpriteVertex, position);
-    inputElementDesc[0].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-    inputElementDesc[0].InstanceDataStepRate = 0;
-
-    inputElementDesc[1].SemanticName = "TEXCOORD";
-    inputElementDesc[1].SemanticIndex = 0;
-    inputElementDesc[1].Format = DXGI_FORMAT_R32G32_FLOAT;
-    inputElementDesc[1].InputSlot = 0;
-    inputElementDesc[1].AlignedByteOffset = offsetof(SpriteVertex, texCoord);
-    inputElementDesc[1].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-    inputElementDesc[1].InstanceDataStepRate = 0;
-
-    inputElementDesc[2].SemanticName = "COLOR";
-    inputElementDesc[2].SemanticIndex = 0;
-    inputElementDesc[2].Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    inputElementDesc[2].InputSlot = 0;
-    inputElementDesc[2].AlignedByteOffset = offsetof(SpriteVertex, color);
-    inputElementDesc[2].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-    inputElementDesc[2].InstanceDataStepRate = 0;
-
-    inputElementDesc[3].SemanticName = "TEXCOORD";
-    inputElementDesc[3].SemanticIndex = 1;
-    inputElementDesc[3].Format = DXGI_FORMAT_R32_UINT;
-    inputElementDesc[3].InputSlot = 0;
-    inputElementDesc[3].AlignedByteOffset = offsetof(SpriteVertex, textureId);
-    inputElementDesc[3].InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA;
-    inputElementDesc[3].InstanceDataStepRate = 0;
-
-    psoDesc.InputLayout.pInputElementDescs = inputElementDesc;
-    psoDesc.InputLayout.NumElements = sizeof(inputElementDesc) / sizeof(D3D12_INPUT_ELEMENT_DESC);
-
-    gpuSpriteRenderPSO = ni::createGraphicsPipelineState(L"SpriteRenderer::spriteRenderPSO", psoDesc);
+    gpuSpriteRenderPSO.createGraphics(L"SpriteRenderer::spriteRenderPSO", psoDesc, &spriteRenderVertexShader, &spriteRenderPixelShader);
 }
 
 void SpriteRenderer::buildSpriteGen() {
@@ -137,56 +142,127 @@ void SpriteRenderer::buildSpriteGen() {
     rootSigBuilder.addRootParameterConstant(0, 0, 4, D3D12_SHADER_VISIBILITY_ALL);
     rootSigBuilder.addRootParameterDescriptorTable(
         rootSigRanges
-        .addRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 5, 0, 0),
+        .addRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, SPRITE_GEN_UAV_COUNT, 0, 0),
         D3D12_SHADER_VISIBILITY_ALL);
 
     gpuSpriteGenRootSignature = rootSigBuilder.build(true);
     gpuSpriteGenRootSignature->SetName(L"SpriteRenderer::spriteGenRootSig");
 
-    ni::FileReader shaderFile(OUTPUT_PATH "SpriteGen_CS.cso");
     D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
     psoDesc.pRootSignature = gpuSpriteGenRootSignature;
-    psoDesc.CS = { *shaderFile, shaderFile.getSize() };
     psoDesc.NodeMask = 0;
     psoDesc.CachedPSO = {};
     psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
-    gpuSpriteGenPSO = ni::createComputePipelineState(L"SpriteRenderer::spriteGen_CS", psoDesc);
-    gpuSpriteVertices = ni::createBuffer(L"SpriteRenderer::spriteVertices", MAX_DRAW_COMMANDS * (sizeof(SpriteVertex) * SPRITE_VERTEX_COUNT), ni::UNORDERED_BUFFER);
+    gpuSpriteGenPSO.createCompute(L"SpriteRenderer::spriteGen_CS", psoDesc, &spriteGenShader);
+    for (uint32_t index = 0; index < NI_ASYNC_COMPUTE_BUFFER_COUNT; ++index) {
+        gpuSpriteVertices[index] = ni::createBuffer(L"SpriteRenderer::spriteVertices", MAX_DRAW_COMMANDS * (sizeof(SpriteVertex) * SPRITE_VERTEX_COUNT), ni::UNORDERED_BUFFER);
+    }
+
+    // Every sprite mesh is a convex polygon so all of them share one triangle fan, drawn once per sprite as an
+    // instance. It's copied to the default heap on the first flush and the upload buffer is released once that
+    // frame retires.
+    const size_t indexBufferSize = SPRITE_INDEX_COUNT * sizeof(uint16_t);
+    gpuSpriteIndices = ni::createBuffer(L"SpriteRenderer::spriteIndices", indexBufferSize, ni::INDEX_BUFFER);
+    gpuSpriteIndicesUpload = ni::createBuffer(L"SpriteRenderer::spriteIndicesUpload", indexBufferSize, ni::UPLOAD_BUFFER);
+    uint16_t* indices = (uint16_t*)ni::mapBuffer(gpuSpriteIndicesUpload);
+    for (uint16_t triangle = 0; triangle < SPRITE_VERTEX_COUNT - 2; ++triangle) {
+        *indices++ = 0;
+        *indices++ = triangle + 1;
+        *indices++ = triangle + 2;
+    }
+    ni::unmapBuffer(gpuSpriteIndicesUpload, indexBufferSize);
+    spriteIndicesUploadFrames = 0;
 
     D3D12_INDIRECT_ARGUMENT_DESC argumentsDesc[1] = {};
-    argumentsDesc[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+    argumentsDesc[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
     D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
     commandSignatureDesc.pArgumentDescs = argumentsDesc;
     commandSignatureDesc.NumArgumentDescs = sizeof(argumentsDesc) / sizeof(argumentsDesc[0]);
     commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
     NI_D3D_ASSERT(ni::getDevice()->CreateCommandSignature(&commandSignatureDesc, nullptr, IID_PPV_ARGS(&gpuDrawCommandSignature)), "Failed to create command signature");
     gpuDrawCommandSignature->SetName(L"SpriteRenderer::drawCommandSignature");
-    gpuIndirectCommandBuffer = ni::createBuffer(L"SpriteRenderer::indirectCommandBuffer", sizeof(IndirectCommand), ni::UNORDERED_BUFFER, true);
+    for (uint32_t index = 0; index < NI_ASYNC_COMPUTE_BUFFER_COUNT; ++index) {
+        gpuIndirectCommandBuffer[index] = ni::createBuffer(L"SpriteRenderer::indirectCommandBuffer", sizeof(IndirectCommand), ni::UNORDERED_BUFFER);
+    }
     gpuClearIndirectCommandBuffer = ni::createBuffer(L"SpriteRenderer::clearIndirectCommandBuffer", sizeof(IndirectCommand), ni::UPLOAD_BUFFER, true);
-    void* data = nullptr;
-    NI_D3D_ASSERT(gpuClearIndirectCommandBuffer.resource->Map(0, nullptr, &data), "Failed to map clear indirect draw command buffer");
+    void* data = ni::mapBuffer(gpuClearIndirectCommandBuffer);
+    // SpriteGen adds an instance for every sprite.
     IndirectCommand emptyCommand = {};
-    emptyCommand.draw.InstanceCount = 1;
-    emptyCommand.draw.StartVertexLocation = 0;
+    emptyCommand.draw.IndexCountPerInstance = SPRITE_INDEX_COUNT;
+    emptyCommand.draw.InstanceCount = 0;
+    emptyCommand.draw.StartIndexLocation = 0;
+    emptyCommand.draw.BaseVertexLocation = 0;
     memcpy(data, &emptyCommand, sizeof(IndirectCommand));
-    gpuClearIndirectCommandBuffer.resource->Unmap(0, nullptr);
-    gpuSpriteVerticesCounter = ni::createBuffer(L"SpriteRenderer::spriteVertexCounter", sizeof(uint32_t), ni::UNORDERED_BUFFER, true);
-    gpuVisibleList = ni::createBuffer(L"SpriteRenderer::spriteCounter", sizeof(uint32_t) * MAX_DRAW_COMMANDS, ni::UNORDERED_BUFFER, true);
-    gpuPerLaneOffset = ni::createBuffer(L"SpriteRenderer::spriteCounter", sizeof(uint32_t) * MAX_DRAW_COMMANDS, ni::UNORDERED_BUFFER, true);
+    ni::unmapBuffer(gpuClearIndirectCommandBuffer, sizeof(IndirectCommand));
+    // The counter and the indirect arguments are cleared by a copy every frame, none of these need zeroed memory.
+    gpuSpriteVerticesCounter = ni::createBuffer(L"SpriteRenderer::spriteVertexCounter", sizeof(uint32_t), ni::UNORDERED_BUFFER);
+    gpuFrameCounters = ni::createBuffer(L"SpriteRenderer::frameCounters", sizeof(uint32_t) * ni::FRAME_GPU_COUNTER_COUNT, ni::UNORDERED_BUFFER);
+    gpuVisibleList = ni::createBuffer(L"SpriteRenderer::spriteCounter", sizeof(uint32_t) * MAX_DRAW_COMMANDS, ni::UNORDERED_BUFFER);
+    gpuPerLaneOffset = ni::createBuffer(L"SpriteRenderer::spriteCounter", sizeof(uint32_t) * MAX_DRAW_COMMANDS, ni::UNORDERED_BUFFER);
+}
+
+// The views cover the whole buffers, SpriteGen stops at the draw command count it gets as a constant.
+void SpriteRenderer::buildSpriteGenDescriptors() {
+    for (uint32_t frameIndex = 0; frameIndex < NI_FRAME_COUNT; ++frameIndex) {
+        for (uint32_t bufferIndex = 0; bufferIndex < NI_ASYNC_COMPUTE_BUFFER_COUNT; ++bufferIndex) {
+            ni::DescriptorTable& table = gpuSpriteGenDescriptors[frameIndex][bufferIndex];
+            table = ni::allocatePersistentDescriptors(SPRITE_GEN_UAV_COUNT);
+
+            D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+            uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+            uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.FirstElement = 0;
+            uavDesc.Buffer.CounterOffsetInBytes = 0;
+            uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
+            uavDesc.Buffer.StructureByteStride = sizeof(DrawCommand);
+            ni::getDevice()->CreateUnorderedAccessView(gpuDrawCommands[frameIndex].resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
+            uavDesc.Buffer.StructureByteStride = sizeof(SpriteQuad);
+            ni::getDevice()->CreateUnorderedAccessView(gpuSpriteVertices[bufferIndex].resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = 1;
+            uavDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
+            ni::getDevice()->CreateUnorderedAccessView(gpuIndirectCommandBuffer[bufferIndex].resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
+            uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
+            ni::getDevice()->CreateUnorderedAccessView(gpuVisibleList.resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
+            uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
+            ni::getDevice()->CreateUnorderedAccessView(gpuPerLaneOffset.resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = NI_MAX_DESCRIPTORS;
+            uavDesc.Buffer.StructureByteStride = sizeof(SpriteMesh);
+            ni::getDevice()->CreateUnorderedAccessView(gpuSpriteMeshes[frameIndex].resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+
+            uavDesc.Buffer.NumElements = ni::FRAME_GPU_COUNTER_COUNT;
+            uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
+            ni::getDevice()->CreateUnorderedAccessView(gpuFrameCounters.resource, nullptr, &uavDesc, table.allocate().cpuHandle);
+        }
+    }
 }
 
 void SpriteRenderer::reset() {
     imageNum = 0;
     drawCommandNum = 0;
+    skippedDrawNum = 0;
 }
 
 void SpriteRenderer::drawImage(float x, float y, float width, float height, uint32_t color, ni::Texture* image) {
     NI_ASSERT(drawCommandNum + 1 <= MAX_DRAW_COMMANDS, "Reached limit of draw commands");
     NI_ASSERT(image != nullptr, "Image can't be null");
+    if (image->residency != ni::TEXTURE_RESIDENCY_RESIDENT) {
+        // Still streaming in, skip it rather than sampling an empty texture.
+        skippedDrawNum++;
+        return;
+    }
     DrawCommand& cmd = drawCommands[drawCommandNum++];
     memcpy(cmd.transform, &matrixStack.current, sizeof(float) * 4);
     if ((image->state & NI_IMAGE_STATE_BOUND) == 0) {
-        image->textureId = TEXTURE_ID_OFFSET + imageNum;
+        image->textureId = image->shaderResourceView.heapIndex | (imageNum << TEXTURE_ID_MESH_SHIFT);
+        spriteMeshes[imageNum] = image->spriteMesh != nullptr ? *image->spriteMesh : getFullSpriteMesh();
         images[imageNum++] = image;
         image->state |= NI_IMAGE_STATE_BOUND;
     }
@@ -198,72 +274,169 @@ void SpriteRenderer::drawImage(float x, float y, float width, float height, uint
     cmd.textureId = image->textureId;
 }
 
+void SpriteRenderer::replayFrame(const DrawCommand* commands, uint32_t commandNum, ni::Texture* const* frameImages, const SpriteMesh* meshes, uint32_t frameImageNum) {
+    NI_ASSERT(commandNum <= MAX_DRAW_COMMANDS, "Reached limit of draw commands");
+    NI_ASSERT(frameImageNum <= NI_MAX_DESCRIPTORS, "Too many images in one frame");
+    reset();
+    for (uint32_t index = 0; index < frameImageNum; ++index) {
+        ni::Texture* image = frameImages[index];
+        image->textureId = image->shaderResourceView.heapIndex | (index << TEXTURE_ID_MESH_SHIFT);
+        image->state |= NI_IMAGE_STATE_BOUND;
+        images[index] = image;
+        spriteMeshes[index] = meshes[index];
+    }
+    imageNum = frameImageNum;
+    for (uint32_t index = 0; index < commandNum; ++index) {
+        DrawCommand& cmd = drawCommands[index];
+        cmd = commands[index];
+        uint32_t imageIndex = cmd.textureId >> TEXTURE_ID_MESH_SHIFT;
+        NI_ASSERT(imageIndex < frameImageNum, "Draw command references image %u of %u", imageIndex, frameImageNum);
+        cmd.textureId = images[imageIndex]->textureId;
+    }
+    drawCommandNum = commandNum;
+}
+
+// Walks the recorded commands once per flush instead of accumulating in drawImage, which stays free of
+// anything that only feeds the estimate.
+void SpriteRenderer::computeTextureBandwidthEstimate() {
+    stats.estimatedTextureBytes = 0;
+    stats.estimatedTextureBytesWithoutMips = 0;
+    for (uint32_t index = 0; index < imageNum; ++index) {
+        imageCoverage[index] = 0.0f;
+        imageDrawNums[index] = 0;
+    }
+    for (uint32_t index = 0; index < drawCommandNum; ++index) {
+        const DrawCommand& cmd = drawCommands[index];
+        uint32_t imageIndex = cmd.textureId >> TEXTURE_ID_MESH_SHIFT;
+        imageCoverage[imageIndex] += cmd.image[2] * cmd.image[3] * cmd.transform[2] * cmd.transform[2];
+        imageDrawNums[imageIndex]++;
+    }
+    for (uint32_t index = 0; index < imageNum; ++index) {
+        const ni::Texture* image = images[index];
+        if (imageDrawNums[index] == 0) continue;
+        float textureArea = (float)image->width * (float)image->height;
+        float averageCoverage = imageCoverage[index] / (float)imageDrawNums[index];
+        uint32_t level = 0;
+        if (averageCoverage > 0.0f && averageCoverage < textureArea) {
+            // Each mip level quarters the area, so the sampled level is half the log2 of the minification.
+            level = (uint32_t)(0.5f * log2f(textureArea / averageCoverage));
+        }
+        level = std::min(level, image->mipLevels - 1);
+        uint64_t levelWidth = std::max(image->width >> level, 1u);
+        uint64_t levelHeight = std::max(image->height >> level, 1u);
+        stats.estimatedTextureBytes += imageDrawNums[index] * ni::getTextureDataSize((uint32_t)levelWidth, (uint32_t)levelHeight, image->format);
+        stats.estimatedTextureBytesWithoutMips += imageDrawNums[index] * ni::getTextureDataSize(image->width, image->height, image->format);
+    }
+}
+
 void SpriteRenderer::flushCommands(ni::FrameData& frame) {
 
+    ni::FrameStats& frameStats = ni::getRendererStats()->getCurrentFrame();
+    frameStats.spritesSubmitted += drawCommandNum;
+    frameStats.spritesSkipped += skippedDrawNum;
+    frameStats.imagesBound += imageNum;
+    frameStats.uploadBytes += drawCommandNum * sizeof(DrawCommand) + imageNum * sizeof(SpriteMesh);
+    if (capture != nullptr) {
+        capture->writeFrame(drawCommands, drawCommandNum, images, spriteMeshes, imageNum);
+    }
     if (drawCommandNum == 0) return;
+    NI_TRACE_SCOPE("flushCommands");
+
+    computeTextureBandwidthEstimate();
 
     ID3D12GraphicsCommandList* commandList = frame.commandList;
+    ID3D12GraphicsCommandList* copyCommandList = frame.copyCommandList;
+    ID3D12GraphicsCommandList* computeCommandList = frame.computeCommandList;
     uint64_t frameIndex = frame.frameIndex;
-    ni::ResourceBarrierBatcher<10> barriers;
-
-    void* gpuUploadBufferData = nullptr;
-    NI_D3D_ASSERT(gpuUploadBuffer.resource->Map(0, nullptr, &gpuUploadBufferData), "Failed to map draw command upload buffer");
+    uint64_t bufferIndex = frame.frameNumber % NI_ASYNC_COMPUTE_BUFFER_COUNT;
+#if NI_USE_ASYNC_COMPUTE
+    ni::ResourceStateTracker& computeBarriers = asyncComputeBarriers;
+    ni::GpuProfilerQueue computeQueue = ni::GPU_PROFILER_QUEUE_COMPUTE;
+#else
+    ni::ResourceStateTracker& computeBarriers = directBarriers;
+    ni::GpuProfilerQueue computeQueue = ni::GPU_PROFILER_QUEUE_DIRECT;
+#endif
+    ni::GpuProfiler* profiler = ni::getGpuProfiler();
+    ni::Resource* backbuffer = ni::getCurrentBackbuffer();
+
+    void* gpuUploadBufferData = ni::mapBuffer(gpuUploadBuffer[frameIndex]);
+    const size_t meshUploadOffset = sizeof(DrawCommand) * MAX_DRAW_COMMANDS;
     memcpy(gpuUploadBufferData, drawCommands, drawCommandNum * sizeof(DrawCommand));
-    D3D12_RANGE writtenRange = { 0, drawCommandNum * sizeof(DrawCommand) };
-    gpuUploadBuffer.resource->Unmap(0, &writtenRange);
-
-    barriers.transition(&gpuDrawCommands[frameIndex], D3D12_RESOURCE_STATE_COPY_DEST);
-    barriers.transition(&gpuIndirectCommandBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
-    barriers.transition(&gpuSpriteVerticesCounter, D3D12_RESOURCE_STATE_COPY_DEST);
-    //barriers.transition(&gpuPerLaneOffset, D3D12_RESOURCE_STATE_COPY_DEST);
-    barriers.flush(commandList);
-    commandList->CopyBufferRegion(gpuDrawCommands[frameIndex].resource, 0, gpuUploadBuffer.resource, 0, drawCommandNum * sizeof(DrawCommand));
-    commandList->CopyResource(gpuSpriteVerticesCounter.resource, gpuCounterZero.resource);
-    //commandList->CopyResource(gpuPerLaneOffset.resource, gpuCounterZero.resource);
-    commandList->CopyResource(gpuIndirectCommandBuffer.resource, gpuClearIndirectCommandBuffer.resource);
-    barriers.transition(&gpuDrawCommands[frameIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    barriers.transition(&gpuIndirectCommandBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    barriers.transition(&gpuSpriteVerticesCounter, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    //barriers.transition(&gpuPerLaneOffset, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-
-    barriers.flush(commandList);
-
-    commandList->SetPipelineState(gpuSpriteGenPSO);
-    commandList->SetComputeRootSignature(gpuSpriteGenRootSignature);
-
-
-    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-    uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-    uavDesc.Buffer.FirstElement = 0;
-    uavDesc.Buffer.CounterOffsetInBytes = 0;
-    uavDesc.Buffer.NumElements = drawCommandNum;
-    uavDesc.Buffer.StructureByteStride = sizeof(DrawCommand);
-    ni::getDevice()->CreateUnorderedAccessView(gpuDrawCommands[frameIndex].resource, nullptr, &uavDesc, frame.descriptorTable.allocate().cpuHandle);
-
-    uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
-    uavDesc.Buffer.StructureByteStride = sizeof(SpriteQuad);
-    ni::getDevice()->CreateUnorderedAccessView(gpuSpriteVertices.resource, nullptr, &uavDesc, frame.descriptorTable.allocate().cpuHandle);
-
-    uavDesc.Buffer.NumElements = 1;
-    uavDesc.Buffer.StructureByteStride = sizeof(IndirectCommand);
-    ni::getDevice()->CreateUnorderedAccessView(gpuIndirectCommandBuffer.resource, nullptr, &uavDesc, frame.descriptorTable.allocate().cpuHandle);
-
-    uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
-    uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
-    ni::getDevice()->CreateUnorderedAccessView(gpuVisibleList.resource, nullptr, &uavDesc, frame.descriptorTable.allocate().cpuHandle);
-
-    uavDesc.Buffer.NumElements = MAX_DRAW_COMMANDS;
-    uavDesc.Buffer.StructureByteStride = sizeof(uint32_t);
-    ni::getDevice()->CreateUnorderedAccessView(gpuPerLaneOffset.resource, nullptr, &uavDesc, frame.descriptorTable.allocate().cpuHandle);
+    memcpy(ni::offsetPtr(gpuUploadBufferData, meshUploadOffset), spriteMeshes, imageNum * sizeof(SpriteMesh));
+    ni::unmapBuffer(gpuUploadBuffer[frameIndex], meshUploadOffset + imageNum * sizeof(SpriteMesh));
+
+    // Buffers decay to COMMON after every ExecuteCommandLists, whichever queue last touched them.
+    gpuDrawCommands[frameIndex].state = D3D12_RESOURCE_STATE_COMMON;
+    gpuSpriteMeshes[frameIndex].state = D3D12_RESOURCE_STATE_COMMON;
+    gpuSpriteVertices[bufferIndex].state = D3D12_RESOURCE_STATE_COMMON;
+    gpuIndirectCommandBuffer[bufferIndex].state = D3D12_RESOURCE_STATE_COMMON;
+    gpuSpriteVerticesCounter.state = D3D12_RESOURCE_STATE_COMMON;
+    gpuFrameCounters.state = D3D12_RESOURCE_STATE_COMMON;
+    gpuVisibleList.state = D3D12_RESOURCE_STATE_COMMON;
+    gpuPerLaneOffset.state = D3D12_RESOURCE_STATE_COMMON;
+
+    // Nothing draws to the backbuffer before the render pass, so its transition starts at the first flush of the direct list.
+    directBarriers.prepare(backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    // The per frame buffers go through the copy queue. They are promoted to COPY_DEST there, so no barriers
+    // are needed. Everything shared between frames stays off the copy queue, it would race the previous frame's reads.
+    uint32_t uploadScope = profiler->beginScope(copyCommandList, ni::GPU_PROFILER_QUEUE_COPY, "Upload");
+    copyCommandList->CopyBufferRegion(gpuDrawCommands[frameIndex].resource, 0, gpuUploadBuffer[frameIndex].resource, 0, drawCommandNum * sizeof(DrawCommand));
+    copyCommandList->CopyBufferRegion(gpuSpriteMeshes[frameIndex].resource, 0, gpuUploadBuffer[frameIndex].resource, meshUploadOffset, imageNum * sizeof(SpriteMesh));
+    profiler->endScope(copyCommandList, uploadScope);
+
+    if (gpuSpriteIndicesUpload.resource != nullptr) {
+        if (spriteIndicesUploadFrames == 0) {
+            directBarriers.require(&gpuSpriteIndices, D3D12_RESOURCE_STATE_COPY_DEST);
+            directBarriers.flush(commandList);
+            // The upload buffer is a small one sharing its resource, so copy from its offset.
+            commandList->CopyBufferRegion(gpuSpriteIndices.resource, 0, gpuSpriteIndicesUpload.resource, gpuSpriteIndicesUpload.offset, SPRITE_INDEX_COUNT * sizeof(uint16_t));
+            directBarriers.prepare(&gpuSpriteIndices, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+        } else if (spriteIndicesUploadFrames > NI_FRAME_COUNT) {
+            ni::destroyBuffer(gpuSpriteIndicesUpload);
+        }
+        spriteIndicesUploadFrames++;
+    }
+
+    // SpriteGen runs on the compute list, which is the direct list without NI_USE_ASYNC_COMPUTE.
+    // The indirect arguments and vertices are double buffered, the direct queue may still be drawing from the other pair.
+    uint32_t spriteGenScope = profiler->beginScope(computeCommandList, computeQueue, "SpriteGen");
+    computeBarriers.require(&gpuIndirectCommandBuffer[bufferIndex], D3D12_RESOURCE_STATE_COPY_DEST);
+    computeBarriers.require(&gpuSpriteVerticesCounter, D3D12_RESOURCE_STATE_COPY_DEST);
+    computeBarriers.require(&gpuFrameCounters, D3D12_RESOURCE_STATE_COPY_DEST);
+    //computeBarriers.require(&gpuPerLaneOffset, D3D12_RESOURCE_STATE_COPY_DEST);
+    computeBarriers.flush(computeCommandList);
+    // The sources are small upload buffers that share a resource, so copy from their offset.
+    computeCommandList->CopyBufferRegion(gpuSpriteVerticesCounter.resource, 0, gpuCounterZero.resource, gpuCounterZero.offset, sizeof(uint32_t));
+    computeCommandList->CopyBufferRegion(gpuFrameCounters.resource, 0, gpuCounterZero.resource, gpuCounterZero.offset, sizeof(uint32_t) * ni::FRAME_GPU_COUNTER_COUNT);
+    //computeCommandList->CopyBufferRegion(gpuPerLaneOffset.resource, 0, gpuCounterZero.resource, gpuCounterZero.offset, sizeof(uint32_t));
+    computeCommandList->CopyBufferRegion(gpuIndirectCommandBuffer[bufferIndex].resource, 0, gpuClearIndirectCommandBuffer.resource, gpuClearIndirectCommandBuffer.offset, sizeof(IndirectCommand));
+    computeBarriers.require(&gpuDrawCommands[frameIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuSpriteMeshes[frameIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuIndirectCommandBuffer[bufferIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuSpriteVerticesCounter, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuFrameCounters, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuSpriteVertices[bufferIndex], D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuVisibleList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.require(&gpuPerLaneOffset, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    computeBarriers.flush(computeCommandList);
+
+    computeCommandList->SetPipelineState(gpuSpriteGenPSO.get());
+    computeCommandList->SetComputeRootSignature(gpuSpriteGenRootSignature);
+
 
     struct { float resolution[2]; uint32_t drawCommandNum; uint32_t operationId; } 
     constantData = { { ni::getViewWidth(), ni::getViewHeight() }, drawCommandNum, OP_CULL_SPRITES };
-    commandList->SetComputeRoot32BitConstants(0, sizeof(constantData) / sizeof(uint32_t), &constantData, 0);
+    computeCommandList->SetComputeRoot32BitConstants(0, sizeof(constantData) / sizeof(uint32_t), &constantData, 0);
 
-    commandList->SetComputeRootDescriptorTable(1, frame.descriptorTable.gpuBaseHandle);
+    computeCommandList->SetComputeRootDescriptorTable(1, gpuSpriteGenDescriptors[frameIndex][bufferIndex].gpuBaseHandle);
     uint32_t disapatchSize = (drawCommandNum / THREAD_GROUP_SIZE) + ((drawCommandNum % THREAD_GROUP_SIZE > 0) ? 1 : 0);
-    commandList->Dispatch(disapatchSize, 1, 1);
+    computeCommandList->Dispatch(disapatchSize, 1, 1);
+    // The counters are read back on the queue that wrote them, the direct queue never touches them.
+    computeBarriers.require(&gpuFrameCounters, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    computeBarriers.flush(computeCommandList);
+    ni::getRendererStats()->resolveGpuCounters(computeCommandList, gpuFrameCounters);
+    profiler->endScope(computeCommandList, spriteGenScope);
     
     //constantData = { { gfx::getViewWidth(), gfx::getViewHeight() }, drawCommandNum, OP_GENERATE_SPRITES };
     //commandList->SetComputeRoot32BitConstants(0, sizeof(constantData) / sizeof(uint32_t), &constantData, 0);
@@ -271,45 +444,61 @@ void SpriteRenderer::flushCommands(ni::FrameData& frame) {
 
 
     // Render
-    ni::Resource tempRT = { ni::getCurrentBackbuffer(), D3D12_RESOURCE_STATE_PRESENT };
-    barriers.transition(&tempRT, D3D12_RESOURCE_STATE_RENDER_TARGET);
-    barriers.transition(&gpuSpriteVertices, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-    barriers.transition(&gpuIndirectCommandBuffer, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
-    barriers.flush(commandList);
+#if NI_USE_ASYNC_COMPUTE
+    // The compute list has been executed by the time the direct list runs, so its buffers decayed back to COMMON.
+    gpuSpriteVertices[bufferIndex].state = D3D12_RESOURCE_STATE_COMMON;
+    gpuIndirectCommandBuffer[bufferIndex].state = D3D12_RESOURCE_STATE_COMMON;
+#endif
+    // Everything on the direct list goes through the render graph, further passes only declare what they read and write.
+    NI_TRACE_BEGIN("RenderGraph");
+    renderGraph.reset();
+    renderTarget = renderGraph.importResource("backbuffer", backbuffer, true);
+    ni::RenderGraphHandle vertices = renderGraph.importResource("spriteVertices", &gpuSpriteVertices[bufferIndex], false);
+    ni::RenderGraphHandle indirectCommands = renderGraph.importResource("indirectCommands", &gpuIndirectCommandBuffer[bufferIndex], false);
+    ni::RenderGraphHandle indices = renderGraph.importResource("spriteIndices", &gpuSpriteIndices, false);
+    renderGraph.addPass("SpriteRender", [](ni::RenderPassContext& context, void* userData) {
+        ((SpriteRenderer*)userData)->renderSprites(context);
+    }, this);
+    renderGraph.write(renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    renderGraph.read(vertices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    renderGraph.read(indirectCommands, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+    renderGraph.read(indices, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+    renderGraph.compile();
+    renderBufferIndex = bufferIndex;
+    renderGraph.execute(commandList, directBarriers, profiler);
+    NI_TRACE_END();
+    // Bound again by the next frame's drawImage calls.
+    for (uint32_t index = 0; index < imageNum; ++index) {
+        ni::Texture* image = images[index];
+        image->state &= ~NI_IMAGE_STATE_BOUND;
+        image->textureId = ~0u;
+    }
+
+    directBarriers.require(backbuffer, D3D12_RESOURCE_STATE_PRESENT);
+    directBarriers.flush(commandList);
+}
 
+void SpriteRenderer::renderSprites(ni::RenderPassContext& context) {
+    ID3D12GraphicsCommandList* commandList = context.commandList;
     D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = ni::getRenderTargetViewCPUHandle();
     D3D12_RENDER_TARGET_VIEW_DESC rtvDesc{};
     rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
     rtvDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
     rtvDesc.Texture2D.MipSlice = 0;
     rtvDesc.Texture2D.PlaneSlice = 0;
-    ni::getDevice()->CreateRenderTargetView(ni::getCurrentBackbuffer(), &rtvDesc, rtvHandle);
+    ni::getDevice()->CreateRenderTargetView(context.getResource(renderTarget)->resource, &rtvDesc, rtvHandle);
     
     commandList->OMSetRenderTargets(1, &rtvHandle, true, nullptr);
     float clearColor[4] = { 0, 0, 0, 1 };
     commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
-    commandList->SetPipelineState(gpuSpriteRenderPSO);
+    commandList->SetPipelineState(gpuSpriteRenderPSO.get());
     commandList->SetGraphicsRootSignature(gpuSpriteRenderRootSignature);
     commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    float resolution[] = { 1.0f / ni::getViewWidth(), 1.0f / ni::getViewHeight() };
+    float resolution[2] = { 1.0f / ni::getViewWidth(), 1.0f / ni::getViewHeight() };
     commandList->SetGraphicsRoot32BitConstants(0, 2, resolution, 0);
-    commandList->SetGraphicsRootDescriptorTable(1, frame.descriptorTable.gpuBaseHandle);
-
-    // Set images in descriptor table (reuse previous pass descriptor table)
-    for (uint32_t index = 0; index < imageNum; ++index) {
-        ni::Texture* image = images[index];
-        image->state &= ~NI_IMAGE_STATE_BOUND;
-        image->textureId = ~0u;
-        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-        srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-        srvDesc.Texture2D.MostDetailedMip = 0;
-        srvDesc.Texture2D.MipLevels = 1;
-        srvDesc.Texture2D.PlaneSlice = 0;
-        srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-        ni::getDevice()->CreateShaderResourceView(image->texture.resource, &srvDesc, frame.descriptorTable.allocate().cpuHandle);
-    }
+    // Textures index the persistent region with their bindless index, their views were created with them.
+    commandList->SetGraphicsRootDescriptorTable(1, ni::getPersistentDescriptorBase());
+    commandList->SetGraphicsRootShaderResourceView(2, gpuSpriteVertices[renderBufferIndex].resource->GetGPUVirtualAddress());
 
     D3D12_VIEWPORT viewport = {};
     viewport.TopLeftX = 0.0f;
@@ -327,16 +516,12 @@ void SpriteRenderer::flushCommands(ni::FrameData& frame) {
     scissor.bottom = (uint32_t)ni::getViewHeight();
     commandList->RSSetScissorRects(1, &scissor);
 
-    D3D12_VERTEX_BUFFER_VIEW vertexBufferView{};
-    vertexBufferView.BufferLocation = gpuSpriteVertices.resource->GetGPUVirtualAddress();
-    vertexBufferView.SizeInBytes = MAX_DRAW_COMMANDS * (sizeof(SpriteVertex) * SPRITE_VERTEX_COUNT);
-    vertexBufferView.StrideInBytes = sizeof(SpriteVertex);
-    commandList->IASetVertexBuffers(0, 1, &vertexBufferView);
+    D3D12_INDEX_BUFFER_VIEW indexBufferView{};
+    indexBufferView.BufferLocation = gpuSpriteIndices.resource->GetGPUVirtualAddress();
+    indexBufferView.SizeInBytes = SPRITE_INDEX_COUNT * sizeof(uint16_t);
+    indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+    commandList->IASetIndexBuffer(&indexBufferView);
 
-    commandList->ExecuteIndirect(gpuDrawCommandSignature, 1, gpuIndirectCommandBuffer.resource, 0, nullptr, 0);
+    commandList->ExecuteIndirect(gpuDrawCommandSignature, 1, gpuIndirectCommandBuffer[renderBufferIndex].resource, 0, nullptr, 0);
     //commandList->DrawInstanced(drawCommandNum * 6, 1, 0, 0);
-
-    barriers.transition(&gpuSpriteVertices, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-    barriers.transition(&tempRT, D3D12_RESOURCE_STATE_PRESENT);
-    barriers.flush(commandList);
 }
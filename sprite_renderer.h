@@ -1,13 +1,16 @@
 #pragma once
 
 #include "ni.h"
+#include "pipeline_cache.h"
+#include "render_graph.h"
 #include "matrix.h"
+#include "sprite_mesh.h"
+#include "sprite_types.h"
 
 // We can have 1 texture per draw.
 #define MAX_DRAW_COMMANDS 1000000
-#define SPRITE_VERTEX_COUNT 6
 #define THREAD_GROUP_SIZE 1024
-#define TEXTURE_ID_OFFSET 5
+#define SPRITE_GEN_UAV_COUNT 7
 
 #define OP_CULL_SPRITES 0
 #define OP_GENERATE_SPRITES 1
@@ -20,28 +23,17 @@
 
 
 
-struct SpriteVertex {
-    float position[2];
-    float texCoord[2];
-    uint32_t color;
-    uint32_t textureId;
+struct SpriteRenderStats {
+    // Rough texture bandwidth of the last flush, before GPU culling. Assumes each draw touches
+    // every texel of the mip level the sampler selects for its average on screen size once.
+    uint64_t estimatedTextureBytes;
+    // Same draws if only the top level existed.
+    uint64_t estimatedTextureBytesWithoutMips;
 };
 
-struct SpriteQuad {
-    SpriteVertex v0;
-    SpriteVertex v1;
-    SpriteVertex v2;
-    SpriteVertex v3;
-    SpriteVertex v4;
-    SpriteVertex v5;
-};
-
-struct DrawCommand {
-    float image[4];
-    float transform[4];
-    uint32_t color;
-    uint32_t textureId;
-};
+namespace ni {
+    struct DrawCaptureWriter;
+}
 
 struct Transform {
     float x;
@@ -52,7 +44,7 @@ struct Transform {
 
 struct SpriteRenderer {
     struct IndirectCommand {
-        D3D12_DRAW_ARGUMENTS draw;
+        D3D12_DRAW_INDEXED_ARGUMENTS draw;
     };
 
     SpriteRenderer();
@@ -60,6 +52,7 @@ struct SpriteRenderer {
 
     void buildSpriteRender();
     void buildSpriteGen();
+    void buildSpriteGenDescriptors();
     inline void pushMatrix() { matrixStack.pushMatrix(); }
     inline void popMatrix() { matrixStack.popMatrix(); }
     inline void loadIdentity() { matrixStack.loadIdentity(); }
@@ -69,25 +62,61 @@ struct SpriteRenderer {
     void reset();
     void drawImage(float x, float y, float width, float height, uint32_t color, ni::Texture* image);
     void flushCommands(ni::FrameData& frame);
+    // Every flush is appended to the capture until it's set back to null.
+    void setCapture(ni::DrawCaptureWriter* writer) { capture = writer; }
+    // Replaces the queued draws with a captured frame. Mesh slots in the commands' texture ids index frameImages,
+    // their bindless bits are rewritten to match those textures.
+    void replayFrame(const DrawCommand* commands, uint32_t commandNum, ni::Texture* const* frameImages, const SpriteMesh* meshes, uint32_t frameImageNum);
+    const SpriteRenderStats& getStats() const { return stats; }
 
 private:
+    void computeTextureBandwidthEstimate();
+    void renderSprites(ni::RenderPassContext& context);
+
     ni::Resource gpuDrawCommands[NI_FRAME_COUNT];
-    ni::Resource gpuUploadBuffer;
-    ni::Resource gpuSpriteVertices;
+    ni::Resource gpuUploadBuffer[NI_FRAME_COUNT];
+    // Written by SpriteGen on the compute queue while the direct queue may still draw the previous frame.
+    ni::Resource gpuSpriteVertices[NI_ASYNC_COMPUTE_BUFFER_COUNT];
     ni::Resource gpuSpriteVerticesCounter;
+    ni::Resource gpuSpriteIndices;
+    ni::Resource gpuSpriteIndicesUpload;
+    ni::Resource gpuSpriteMeshes[NI_FRAME_COUNT];
     ni::Resource gpuVisibleList;
     ni::Resource gpuPerLaneOffset;
     ni::Resource gpuCounterZero;
-    ni::Resource gpuIndirectCommandBuffer;
+    // FRAME_GPU_COUNTER_COUNT counters SpriteGen accumulates, resolved into the renderer stats every flush.
+    ni::Resource gpuFrameCounters;
+    ni::Resource gpuIndirectCommandBuffer[NI_ASYNC_COMPUTE_BUFFER_COUNT];
     ni::Resource gpuClearIndirectCommandBuffer;
+    // u0-u6 of SpriteGen for every combination of per frame and double buffered resources, created once.
+    ni::DescriptorTable gpuSpriteGenDescriptors[NI_FRAME_COUNT][NI_ASYNC_COMPUTE_BUFFER_COUNT];
+    ni::ResourceStateTracker directBarriers;
+    ni::RenderGraph renderGraph;
+    ni::RenderGraphHandle renderTarget;
+    uint64_t renderBufferIndex;
+#if NI_USE_ASYNC_COMPUTE
+    ni::ResourceStateTracker asyncComputeBarriers;
+#endif
     ID3D12CommandSignature* gpuDrawCommandSignature;
+    // Read and compiled on the loader threads, the first flush waits for them.
+    ni::AsyncFile spriteGenShader;
+    ni::AsyncFile spriteRenderVertexShader;
+    ni::AsyncFile spriteRenderPixelShader;
     ID3D12RootSignature* gpuSpriteGenRootSignature;
-    ID3D12PipelineState* gpuSpriteGenPSO;
+    ni::AsyncPipeline gpuSpriteGenPSO;
     ID3D12RootSignature* gpuSpriteRenderRootSignature;
-    ID3D12PipelineState* gpuSpriteRenderPSO;
+    ni::AsyncPipeline gpuSpriteRenderPSO;
     TransformStack matrixStack;
     DrawCommand* drawCommands;
     uint32_t drawCommandNum;
+    // drawImage calls since reset that were skipped because their texture wasn't resident.
+    uint32_t skippedDrawNum;
     ni::Texture** images;
+    SpriteMesh* spriteMeshes;
+    float* imageCoverage;
+    uint32_t* imageDrawNums;
     uint32_t imageNum;
+    SpriteRenderStats stats;
+    uint32_t spriteIndicesUploadFrames;
+    ni::DrawCaptureWriter* capture;
 };
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include "sprite_mesh.h"
+
+// What SpriteRenderer and the CPU pipeline share: the draw commands SpriteGen reads and the quads it writes.
+// Plain data, so the software rasterizer and the golden images build without the renderer.
+
+#define SPRITE_VERTEX_COUNT SPRITE_MESH_VERTEX_COUNT
+#define SPRITE_INDEX_COUNT ((SPRITE_MESH_VERTEX_COUNT - 2) * 3)
+// DrawCommand::textureId holds the texture's bindless index in the low bits and its slot in this frame's
+// sprite mesh buffer above TEXTURE_ID_MESH_SHIFT. Bindless indices are below NI_MAX_DESCRIPTORS.
+#define TEXTURE_ID_MESH_SHIFT 12
+#define TEXTURE_ID_INDEX_MASK ((1u << TEXTURE_ID_MESH_SHIFT) - 1)
+
+struct SpriteVertex {
+    float position[2];
+    float texCoord[2];
+    uint32_t color;
+    uint32_t textureId;
+};
+
+struct SpriteQuad {
+    SpriteVertex vertices[SPRITE_VERTEX_COUNT];
+};
+
+struct DrawCommand {
+    float image[4];
+    float transform[4];
+    uint32_t color;
+    uint32_t textureId;
+};
@@ -0,0 +1,690 @@
+#include "texture_compression.h"
+#include "ni.h"
+#include "async_loader.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_BC_POWER_ITERATIONS 8
+#define NI_BC7_REFINE_ITERATIONS 2
+
+static const int32_t bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct TexelBlock {
+    float texels[16][4];
+};
+
+struct BitWriter {
+    void write(uint64_t value, uint32_t bitNum) {
+        for (uint32_t bit = 0; bit < bitNum; ++bit, ++offset) {
+            uint64_t set = (value >> bit) & 1;
+            if (offset < 64) lo |= set << offset;
+            else hi |= set << (offset - 64);
+        }
+    }
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint32_t offset = 0;
+};
+
+struct BitReader {
+    BitReader(const uint8_t* block) { memcpy(&lo, block, 8); memcpy(&hi, block + 8, 8); }
+    uint32_t read(uint32_t bitNum) {
+        uint32_t value = 0;
+        for (uint32_t bit = 0; bit < bitNum; ++bit, ++offset) {
+            uint64_t set = offset < 64 ? (lo >> offset) & 1 : (hi >> (offset - 64)) & 1;
+            value |= (uint32_t)set << bit;
+        }
+        return value;
+    }
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    uint32_t offset = 0;
+};
+
+static inline float clampUnorm8(float value) {
+    return value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+}
+
+static void loadBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, TexelBlock& block) {
+    for (uint32_t y = 0; y < NI_BC_BLOCK_DIM; ++y) {
+        for (uint32_t x = 0; x < NI_BC_BLOCK_DIM; ++x) {
+            uint32_t px = blockX * NI_BC_BLOCK_DIM + x;
+            uint32_t py = blockY * NI_BC_BLOCK_DIM + y;
+            float* texel = block.texels[y * NI_BC_BLOCK_DIM + x];
+            if (px < width && py < height) {
+                const uint8_t* src = &pixels[((size_t)py * width + px) * 4];
+                texel[0] = src[0];
+                texel[1] = src[1];
+                texel[2] = src[2];
+                texel[3] = src[3];
+            } else {
+                texel[0] = texel[1] = texel[2] = texel[3] = 0.0f;
+            }
+        }
+    }
+}
+
+// Fits a line through the included texels along their principal axis and returns its extent.
+static bool computeEndpoints(const TexelBlock& block, const bool* include, uint32_t channelNum, float outStart[4], float outEnd[4]) {
+    float mean[4] = {};
+    float minValue[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+    float maxValue[4] = {};
+    uint32_t count = 0;
+    for (uint32_t index = 0; index < 16; ++index) {
+        if (!include[index]) continue;
+        for (uint32_t c = 0; c < channelNum; ++c) {
+            float value = block.texels[index][c];
+            mean[c] += value;
+            minValue[c] = value < minValue[c] ? value : minValue[c];
+            maxValue[c] = value > maxValue[c] ? value : maxValue[c];
+        }
+        count++;
+    }
+    if (count == 0) return false;
+    for (uint32_t c = 0; c < channelNum; ++c) mean[c] /= (float)count;
+
+    float covariance[4][4] = {};
+    for (uint32_t index = 0; index < 16; ++index) {
+        if (!include[index]) continue;
+        float delta[4] = {};
+        for (uint32_t c = 0; c < channelNum; ++c) delta[c] = block.texels[index][c] - mean[c];
+        for (uint32_t r = 0; r < channelNum; ++r) {
+            for (uint32_t c = 0; c < channelNum; ++c) {
+                covariance[r][c] += delta[r] * delta[c];
+            }
+        }
+    }
+
+    float axis[4] = {};
+    for (uint32_t c = 0; c < channelNum; ++c) axis[c] = maxValue[c] - minValue[c];
+    for (uint32_t iteration = 0; iteration < NI_BC_POWER_ITERATIONS; ++iteration) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (uint32_t r = 0; r < channelNum; ++r) {
+            for (uint32_t c = 0; c < channelNum; ++c) next[r] += covariance[r][c] * axis[c];
+            length += next[r] * next[r];
+        }
+        if (length < 1e-8f) break;
+        length = 1.0f / sqrtf(length);
+        for (uint32_t c = 0; c < channelNum; ++c) axis[c] = next[c] * length;
+    }
+
+    float axisLength = 0.0f;
+    for (uint32_t c = 0; c < channelNum; ++c) axisLength += axis[c] * axis[c];
+    if (axisLength < 1e-8f) {
+        // Flat block.
+        for (uint32_t c = 0; c < 4; ++c) outStart[c] = outEnd[c] = c < channelNum ? mean[c] : 0.0f;
+        return true;
+    }
+    axisLength = 1.0f / sqrtf(axisLength);
+    for (uint32_t c = 0; c < channelNum; ++c) axis[c] *= axisLength;
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (uint32_t index = 0; index < 16; ++index) {
+        if (!include[index]) continue;
+        float t = 0.0f;
+        for (uint32_t c = 0; c < channelNum; ++c) t += (block.texels[index][c] - mean[c]) * axis[c];
+        minT = t < minT ? t : minT;
+        maxT = t > maxT ? t : maxT;
+    }
+    for (uint32_t c = 0; c < 4; ++c) {
+        outStart[c] = c < channelNum ? clampUnorm8(mean[c] + axis[c] * minT) : 0.0f;
+        outEnd[c] = c < channelNum ? clampUnorm8(mean[c] + axis[c] * maxT) : 0.0f;
+    }
+    return true;
+}
+
+static uint16_t packRGB565(const float color[3]) {
+    uint32_t r = (uint32_t)(color[0] * (31.0f / 255.0f) + 0.5f);
+    uint32_t g = (uint32_t)(color[1] * (63.0f / 255.0f) + 0.5f);
+    uint32_t b = (uint32_t)(color[2] * (31.0f / 255.0f) + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, int32_t outColor[3]) {
+    int32_t r = (packed >> 11) & 31;
+    int32_t g = (packed >> 5) & 63;
+    int32_t b = packed & 31;
+    outColor[0] = (r << 3) | (r >> 2);
+    outColor[1] = (g << 2) | (g >> 4);
+    outColor[2] = (b << 3) | (b >> 2);
+}
+
+static void buildColorPalette(uint16_t color0, uint16_t color1, bool fourColorMode, int32_t outPalette[4][4]) {
+    unpackRGB565(color0, outPalette[0]);
+    unpackRGB565(color1, outPalette[1]);
+    outPalette[0][3] = 255;
+    outPalette[1][3] = 255;
+    for (uint32_t c = 0; c < 3; ++c) {
+        if (fourColorMode) {
+            outPalette[2][c] = (2 * outPalette[0][c] + outPalette[1][c]) / 3;
+            outPalette[3][c] = (outPalette[0][c] + 2 * outPalette[1][c]) / 3;
+        } else {
+            outPalette[2][c] = (outPalette[0][c] + outPalette[1][c]) / 2;
+            outPalette[3][c] = 0;
+        }
+    }
+    outPalette[2][3] = 255;
+    outPalette[3][3] = fourColorMode ? 255 : 0;
+}
+
+// BC1 color block. With punchThrough texels below half alpha use the transparent index of
+// the 3 color mode, otherwise the block is always encoded in 4 color mode (as BC3 requires).
+static void encodeColorBlock(const TexelBlock& block, bool punchThrough, uint8_t* out) {
+    bool include[16] = {};
+    bool hasTransparent = false;
+    for (uint32_t index = 0; index < 16; ++index) {
+        float alpha = block.texels[index][3];
+        include[index] = punchThrough ? alpha >= 128.0f : alpha > 0.0f;
+        hasTransparent |= punchThrough && alpha < 128.0f;
+    }
+    float start[4], end[4];
+    uint16_t color0 = 0, color1 = 0;
+    if (computeEndpoints(block, include, 3, start, end)) {
+        color0 = packRGB565(end);
+        color1 = packRGB565(start);
+    }
+    bool fourColorMode = !hasTransparent;
+    if ((fourColorMode && color0 < color1) || (!fourColorMode && color0 > color1)) {
+        uint16_t temp = color0;
+        color0 = color1;
+        color1 = temp;
+    }
+
+    int32_t palette[4][4];
+    buildColorPalette(color0, color1, fourColorMode, palette);
+    uint32_t paletteNum = fourColorMode ? 4 : 3;
+    uint32_t indices = 0;
+    for (uint32_t index = 0; index < 16; ++index) {
+        uint32_t best = 3;
+        if (include[index] || fourColorMode) {
+            int32_t bestError = INT32_MAX;
+            best = 0;
+            for (uint32_t entry = 0; entry < paletteNum && color0 != color1; ++entry) {
+                int32_t error = 0;
+                for (uint32_t c = 0; c < 3; ++c) {
+                    int32_t delta = (int32_t)block.texels[index][c] - palette[entry][c];
+                    error += delta * delta;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = entry;
+                }
+            }
+        }
+        indices |= best << (index * 2);
+    }
+    memcpy(&out[0], &color0, 2);
+    memcpy(&out[2], &color1, 2);
+    memcpy(&out[4], &indices, 4);
+}
+
+static void buildAlphaPalette(int32_t alpha0, int32_t alpha1, int32_t outPalette[8]) {
+    outPalette[0] = alpha0;
+    outPalette[1] = alpha1;
+    if (alpha0 > alpha1) {
+        for (int32_t index = 1; index < 7; ++index) {
+            outPalette[index + 1] = ((7 - index) * alpha0 + index * alpha1) / 7;
+        }
+    } else {
+        for (int32_t index = 1; index < 5; ++index) {
+            outPalette[index + 1] = ((5 - index) * alpha0 + index * alpha1) / 5;
+        }
+        outPalette[6] = 0;
+        outPalette[7] = 255;
+    }
+}
+
+static void encodeAlphaBlock(const TexelBlock& block, uint8_t* out) {
+    int32_t alpha0 = 0, alpha1 = 255;
+    for (uint32_t index = 0; index < 16; ++index) {
+        int32_t alpha = (int32_t)block.texels[index][3];
+        alpha0 = alpha > alpha0 ? alpha : alpha0;
+        alpha1 = alpha < alpha1 ? alpha : alpha1;
+    }
+    int32_t palette[8];
+    buildAlphaPalette(alpha0, alpha1, palette);
+    uint64_t indices = 0;
+    for (uint32_t index = 0; index < 16 && alpha0 != alpha1; ++index) {
+        int32_t alpha = (int32_t)block.texels[index][3];
+        uint64_t best = 0;
+        int32_t bestError = INT32_MAX;
+        for (uint32_t entry = 0; entry < 8; ++entry) {
+            int32_t error = abs(alpha - palette[entry]);
+            if (error < bestError) {
+                bestError = error;
+                best = entry;
+            }
+        }
+        indices |= best << (index * 3);
+    }
+    out[0] = (uint8_t)alpha0;
+    out[1] = (uint8_t)alpha1;
+    memcpy(&out[2], &indices, 6);
+}
+
+static void quantizeBC7Endpoints(const float endpoints[2][4], uint32_t outQuantized[2][4], uint32_t outPBits[2]) {
+    for (uint32_t endpoint = 0; endpoint < 2; ++endpoint) {
+        float bestError = 1e30f;
+        for (uint32_t pbit = 0; pbit < 2; ++pbit) {
+            uint32_t candidate[4];
+            float error = 0.0f;
+            for (uint32_t c = 0; c < 4; ++c) {
+                int32_t value = (int32_t)((endpoints[endpoint][c] - (float)pbit) * 0.5f + 0.5f);
+                value = value < 0 ? 0 : (value > 127 ? 127 : value);
+                candidate[c] = (uint32_t)value;
+                float delta = (float)((value << 1) | pbit) - endpoints[endpoint][c];
+                error += delta * delta;
+            }
+            if (error < bestError) {
+                bestError = error;
+                memcpy(outQuantized[endpoint], candidate, sizeof(candidate));
+                outPBits[endpoint] = pbit;
+            }
+        }
+    }
+}
+
+// Picks the closest palette entry per texel. Color under fully transparent texels is never visible, so only alpha counts there.
+static int32_t selectBC7Indices(const TexelBlock& block, const bool visible[16], const uint32_t quantized[2][4], const uint32_t pbits[2], uint32_t outIndices[16]) {
+    int32_t palette[16][4];
+    for (uint32_t entry = 0; entry < 16; ++entry) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            int32_t e0 = (int32_t)((quantized[0][c] << 1) | pbits[0]);
+            int32_t e1 = (int32_t)((quantized[1][c] << 1) | pbits[1]);
+            palette[entry][c] = ((64 - bc7Weights4[entry]) * e0 + bc7Weights4[entry] * e1 + 32) >> 6;
+        }
+    }
+    int32_t totalError = 0;
+    for (uint32_t index = 0; index < 16; ++index) {
+        int32_t bestError = INT32_MAX;
+        uint32_t firstChannel = visible[index] ? 0 : 3;
+        for (uint32_t entry = 0; entry < 16; ++entry) {
+            int32_t error = 0;
+            for (uint32_t c = firstChannel; c < 4; ++c) {
+                int32_t delta = (int32_t)block.texels[index][c] - palette[entry][c];
+                error += delta * delta;
+            }
+            if (error < bestError) {
+                bestError = error;
+                outIndices[index] = entry;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// Least squares fit of the endpoints for a fixed set of indices.
+static bool refineBC7Endpoints(const TexelBlock& block, const bool visible[16], const uint32_t indices[16], float outEndpoints[2][4]) {
+    for (uint32_t c = 0; c < 4; ++c) {
+        float a = 0.0f, b = 0.0f, d = 0.0f, x0 = 0.0f, x1 = 0.0f;
+        for (uint32_t index = 0; index < 16; ++index) {
+            if (c < 3 && !visible[index]) continue;
+            float t = (float)bc7Weights4[indices[index]] / 64.0f;
+            float value = block.texels[index][c];
+            a += (1.0f - t) * (1.0f - t);
+            b += (1.0f - t) * t;
+            d += t * t;
+            x0 += (1.0f - t) * value;
+            x1 += t * value;
+        }
+        float determinant = a * d - b * b;
+        if (fabsf(determinant) < 1e-6f) return false;
+        outEndpoints[0][c] = clampUnorm8((d * x0 - b * x1) / determinant);
+        outEndpoints[1][c] = clampUnorm8((a * x1 - b * x0) / determinant);
+    }
+    return true;
+}
+
+// BC7 mode 6: one subset, RGBA endpoints with 7 bits plus a p-bit and 4 bit indices.
+static void encodeBC7Block(const TexelBlock& source, uint8_t* out) {
+    // Move the color of transparent texels onto the mean visible color so they don't bend the fit.
+    TexelBlock block = source;
+    bool include[16];
+    bool visible[16];
+    float meanColor[3] = {};
+    uint32_t visibleNum = 0;
+    for (uint32_t index = 0; index < 16; ++index) {
+        include[index] = true;
+        visible[index] = block.texels[index][3] > 0.0f;
+        if (!visible[index]) continue;
+        for (uint32_t c = 0; c < 3; ++c) meanColor[c] += block.texels[index][c];
+        visibleNum++;
+    }
+    for (uint32_t index = 0; index < 16 && visibleNum > 0; ++index) {
+        if (visible[index]) continue;
+        for (uint32_t c = 0; c < 3; ++c) block.texels[index][c] = meanColor[c] / (float)visibleNum;
+    }
+
+    float endpoints[2][4];
+    computeEndpoints(block, include, 4, endpoints[0], endpoints[1]);
+    uint32_t quantized[2][4];
+    uint32_t pbits[2];
+    uint32_t indices[16];
+    quantizeBC7Endpoints(endpoints, quantized, pbits);
+    int32_t error = selectBC7Indices(block, visible, quantized, pbits, indices);
+    for (uint32_t iteration = 0; iteration < NI_BC7_REFINE_ITERATIONS && error > 0; ++iteration) {
+        float refined[2][4];
+        if (!refineBC7Endpoints(block, visible, indices, refined)) break;
+        uint32_t refinedQuantized[2][4];
+        uint32_t refinedPBits[2];
+        uint32_t refinedIndices[16];
+        quantizeBC7Endpoints(refined, refinedQuantized, refinedPBits);
+        int32_t refinedError = selectBC7Indices(block, visible, refinedQuantized, refinedPBits, refinedIndices);
+        if (refinedError >= error) break;
+        error = refinedError;
+        memcpy(quantized, refinedQuantized, sizeof(quantized));
+        memcpy(pbits, refinedPBits, sizeof(pbits));
+        memcpy(indices, refinedIndices, sizeof(indices));
+    }
+
+    // The anchor index drops its top bit, so flip the endpoints when the first texel needs it.
+    if (indices[0] & 8) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            uint32_t temp = quantized[0][c];
+            quantized[0][c] = quantized[1][c];
+            quantized[1][c] = temp;
+        }
+        uint32_t temp = pbits[0];
+        pbits[0] = pbits[1];
+        pbits[1] = temp;
+        for (uint32_t index = 0; index < 16; ++index) indices[index] = 15 - indices[index];
+    }
+
+    BitWriter writer;
+    writer.write(1 << 6, 7);
+    for (uint32_t c = 0; c < 4; ++c) {
+        writer.write(quantized[0][c], 7);
+        writer.write(quantized[1][c], 7);
+    }
+    writer.write(pbits[0], 1);
+    writer.write(pbits[1], 1);
+    writer.write(indices[0], 3);
+    for (uint32_t index = 1; index < 16; ++index) writer.write(indices[index], 4);
+    memcpy(&out[0], &writer.lo, 8);
+    memcpy(&out[8], &writer.hi, 8);
+}
+
+static void decodeBlock(const uint8_t* in, DXGI_FORMAT format, uint8_t outTexels[16][4]) {
+    switch (format) {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC3_UNORM: {
+        const uint8_t* colorBlock = format == DXGI_FORMAT_BC3_UNORM ? in + 8 : in;
+        uint16_t color0, color1;
+        uint32_t indices;
+        memcpy(&color0, &colorBlock[0], 2);
+        memcpy(&color1, &colorBlock[2], 2);
+        memcpy(&indices, &colorBlock[4], 4);
+        int32_t palette[4][4];
+        buildColorPalette(color0, color1, format == DXGI_FORMAT_BC3_UNORM || color0 > color1, palette);
+        for (uint32_t index = 0; index < 16; ++index) {
+            const int32_t* color = palette[(indices >> (index * 2)) & 3];
+            for (uint32_t c = 0; c < 4; ++c) outTexels[index][c] = (uint8_t)color[c];
+        }
+        if (format == DXGI_FORMAT_BC3_UNORM) {
+            int32_t alphaPalette[8];
+            buildAlphaPalette(in[0], in[1], alphaPalette);
+            uint64_t alphaIndices = 0;
+            memcpy(&alphaIndices, &in[2], 6);
+            for (uint32_t index = 0; index < 16; ++index) {
+                outTexels[index][3] = (uint8_t)alphaPalette[(alphaIndices >> (index * 3)) & 7];
+            }
+        }
+        break;
+    }
+    case DXGI_FORMAT_BC7_UNORM: {
+        BitReader reader(in);
+        NI_ASSERT(reader.read(7) == (1 << 6), "Only BC7 mode 6 blocks can be decoded");
+        int32_t endpoints[2][4];
+        for (uint32_t c = 0; c < 4; ++c) {
+            endpoints[0][c] = (int32_t)reader.read(7) << 1;
+            endpoints[1][c] = (int32_t)reader.read(7) << 1;
+        }
+        uint32_t pbit0 = reader.read(1);
+        uint32_t pbit1 = reader.read(1);
+        for (uint32_t c = 0; c < 4; ++c) {
+            endpoints[0][c] |= pbit0;
+            endpoints[1][c] |= pbit1;
+        }
+        for (uint32_t index = 0; index < 16; ++index) {
+            int32_t weight = bc7Weights4[reader.read(index == 0 ? 3 : 4)];
+            for (uint32_t c = 0; c < 4; ++c) {
+                outTexels[index][c] = (uint8_t)(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+            }
+        }
+        break;
+    }
+    default:
+        NI_PANIC("Unsupported block compressed format %u", (uint32_t)format);
+        break;
+    }
+}
+
+static void compressBlockRows(const uint8_t* pixels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint8_t* outBlocks, uint32_t firstRow, uint32_t lastRow) {
+    uint32_t blocksX = (width + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+    size_t blockSize = ni::getBlockSize(format);
+    TexelBlock block;
+    for (uint32_t blockY = firstRow; blockY < lastRow; ++blockY) {
+        for (uint32_t blockX = 0; blockX < blocksX; ++blockX) {
+            uint8_t* out = &outBlocks[((size_t)blockY * blocksX + blockX) * blockSize];
+            loadBlock(pixels, width, height, blockX, blockY, block);
+            switch (format) {
+            case DXGI_FORMAT_BC1_UNORM:
+                encodeColorBlock(block, true, out);
+                break;
+            case DXGI_FORMAT_BC3_UNORM:
+                encodeAlphaBlock(block, out);
+                encodeColorBlock(block, false, out + 8);
+                break;
+            case DXGI_FORMAT_BC7_UNORM:
+                encodeBC7Block(block, out);
+                break;
+            default:
+                NI_PANIC("Unsupported block compressed format %u", (uint32_t)format);
+                break;
+            }
+        }
+    }
+}
+
+bool ni::isBlockCompressed(DXGI_FORMAT format) {
+    return getBlockSize(format) > 0;
+}
+
+size_t ni::getBlockSize(DXGI_FORMAT format) {
+    switch (format) {
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+        return 8;
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t ni::getTextureDataSize(uint32_t width, uint32_t height, DXGI_FORMAT format) {
+    size_t blockSize = getBlockSize(format);
+    if (blockSize > 0) {
+        size_t blocksX = (width + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+        size_t blocksY = (height + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+        return blocksX * blocksY * blockSize;
+    }
+    return (size_t)width * height * getDXGIFormatBytes(format);
+}
+
+struct CompressJob {
+    const uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    DXGI_FORMAT format;
+    uint8_t* outBlocks;
+    uint32_t firstRow;
+    uint32_t lastRow;
+};
+
+static void compressJob(void* userData) {
+    const CompressJob& job = *(const CompressJob*)userData;
+    compressBlockRows(job.pixels, job.width, job.height, job.format, job.outBlocks, job.firstRow, job.lastRow);
+}
+
+void ni::compressTexture(const void* pixels, uint32_t width, uint32_t height, DXGI_FORMAT format, void* outBlocks, uint32_t threadNum) {
+    uint32_t blocksY = (height + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+    if (threadNum == 0) {
+        threadNum = getLoaderThreadNum() + 1;
+    }
+    threadNum = threadNum > blocksY ? blocksY : threadNum;
+    if (threadNum <= 1) {
+        compressBlockRows((const uint8_t*)pixels, width, height, format, (uint8_t*)outBlocks, 0, blocksY);
+        return;
+    }
+    Array<CompressJob, uint32_t> jobs;
+    uint32_t rowsPerJob = (blocksY + threadNum - 1) / threadNum;
+    for (uint32_t firstRow = 0; firstRow < blocksY; firstRow += rowsPerJob) {
+        uint32_t lastRow = firstRow + rowsPerJob < blocksY ? firstRow + rowsPerJob : blocksY;
+        jobs.add({ (const uint8_t*)pixels, width, height, format, (uint8_t*)outBlocks, firstRow, lastRow });
+    }
+    JobCounter counter;
+    for (uint32_t index = 0; index < jobs.getNum(); ++index) {
+        submitJob(compressJob, &jobs.getData()[index], counter);
+    }
+    waitJobs(counter);
+    jobs.destroy();
+}
+
+void ni::decompressTexture(const void* blocks, uint32_t width, uint32_t height, DXGI_FORMAT format, void* outPixels) {
+    uint32_t blocksX = (width + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+    uint32_t blocksY = (height + NI_BC_BLOCK_DIM - 1) / NI_BC_BLOCK_DIM;
+    size_t blockSize = getBlockSize(format);
+    uint8_t* pixels = (uint8_t*)outPixels;
+    uint8_t texels[16][4];
+    for (uint32_t blockY = 0; blockY < blocksY; ++blockY) {
+        for (uint32_t blockX = 0; blockX < blocksX; ++blockX) {
+            decodeBlock(&((const uint8_t*)blocks)[((size_t)blockY * blocksX + blockX) * blockSize], format, texels);
+            for (uint32_t index = 0; index < 16; ++index) {
+                uint32_t px = blockX * NI_BC_BLOCK_DIM + index % NI_BC_BLOCK_DIM;
+                uint32_t py = blockY * NI_BC_BLOCK_DIM + index / NI_BC_BLOCK_DIM;
+                if (px < width && py < height) {
+                    memcpy(&pixels[((size_t)py * width + px) * 4], texels[index], 4);
+                }
+            }
+        }
+    }
+}
+
+void ni::benchmarkTextureCompression(const char* name, const void* pixels, uint32_t width, uint32_t height) {
+    const DXGI_FORMAT formats[] = { DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_BC7_UNORM };
+    const char* formatNames[] = { "BC1", "BC3", "BC7" };
+    const uint32_t iterationNum = 16;
+    size_t rawSize = (size_t)width * height * 4;
+    void* decoded = malloc(rawSize);
+    for (uint32_t formatIndex = 0; formatIndex < sizeof(formats) / sizeof(formats[0]); ++formatIndex) {
+        DXGI_FORMAT format = formats[formatIndex];
+        size_t compressedSize = getTextureDataSize(width, height, format);
+        void* blocks = malloc(compressedSize);
+
+        double singleStart = getSeconds();
+        compressTexture(pixels, width, height, format, blocks, 1);
+        double singleTime = getSeconds() - singleStart;
+        double multiStart = getSeconds();
+        for (uint32_t iteration = 0; iteration < iterationNum; ++iteration) {
+            compressTexture(pixels, width, height, format, blocks);
+        }
+        double multiTime = (getSeconds() - multiStart) / iterationNum;
+
+        decompressTexture(blocks, width, height, format, decoded);
+        double colorError = 0.0;
+        double alphaError = 0.0;
+        const uint8_t* src = (const uint8_t*)pixels;
+        const uint8_t* dst = (const uint8_t*)decoded;
+        for (size_t index = 0; index < (size_t)width * height; ++index) {
+            for (uint32_t c = 0; c < 3; ++c) {
+                double delta = (double)src[index * 4 + c] - (double)dst[index * 4 + c];
+                // Color under fully transparent texels is never visible.
+                colorError += src[index * 4 + 3] > 0 ? delta * delta : 0.0;
+            }
+            double delta = (double)src[index * 4 + 3] - (double)dst[index * 4 + 3];
+            alphaError += delta * delta;
+        }
+        double texelNum = (double)width * height;
+        double colorPSNR = colorError > 0.0 ? 10.0 * log10(255.0 * 255.0 / (colorError / (texelNum * 3.0))) : 99.0;
+        double alphaPSNR = alphaError > 0.0 ? 10.0 * log10(255.0 * 255.0 / (alphaError / texelNum)) : 99.0;
+        NI_LOG("%s %s: %.2f:1, 1 thread %.2f MPix/s, %u threads %.2f MPix/s, RGB PSNR %.2f dB, alpha PSNR %.2f dB",
+            name, formatNames[formatIndex], (double)rawSize / (double)compressedSize,
+            texelNum / singleTime / 1e6, getLoaderThreadNum() + 1, texelNum / multiTime / 1e6,
+            colorPSNR, alphaPSNR);
+        free(blocks);
+    }
+    free(decoded);
+}
+
+ni::CompressedMipChain ni::compressMipChain(const void* pixels, uint32_t width, uint32_t height, DXGI_FORMAT format, bool generateMips) {
+    NI_ASSERT(pixels != nullptr, "Can't build a mip chain without pixel data");
+    NI_ASSERT(isBlockCompressed(format) || getDXGIFormatBytes(format) == 4, "Source pixels are 8 bit RGBA");
+    CompressedMipChain mipChain = {};
+    if (!isBlockCompressed(format)) {
+        mipChain.width = width;
+        mipChain.height = height;
+        mipChain.mipLevels = generateMips ? getMipLevelCount(width, height) : 1;
+        mipChain.size = getMipChainSize(width, height, mipChain.mipLevels, format);
+        mipChain.data = malloc(mipChain.size);
+        NI_ASSERT(mipChain.data != nullptr, "Failed to allocate mip chain");
+        generateMipChainRGBA8(pixels, width, height, mipChain.mipLevels, mipChain.data);
+        return mipChain;
+    }
+
+    uint32_t paddedWidth = (uint32_t)alignSize(width, NI_BC_BLOCK_DIM);
+    uint32_t paddedHeight = (uint32_t)alignSize(height, NI_BC_BLOCK_DIM);
+    uint32_t mipLevels = generateMips ? getMipLevelCount(paddedWidth, paddedHeight) : 1;
+
+    // Pad to whole blocks with transparent texels so the padding never shows up on screen.
+    uint8_t* paddedPixels = (uint8_t*)calloc((size_t)paddedWidth * paddedHeight, 4);
+    NI_ASSERT(paddedPixels != nullptr, "Failed to allocate padded pixels");
+    for (uint32_t y = 0; y < height; ++y) {
+        memcpy(&paddedPixels[(size_t)y * paddedWidth * 4], &((const uint8_t*)pixels)[(size_t)y * width * 4], (size_t)width * 4);
+    }
+    uint8_t* rgbaMipChain = (uint8_t*)malloc(getMipChainSize(paddedWidth, paddedHeight, mipLevels, DXGI_FORMAT_R8G8B8A8_UNORM));
+    NI_ASSERT(rgbaMipChain != nullptr, "Failed to allocate mip chain");
+    generateMipChainRGBA8(paddedPixels, paddedWidth, paddedHeight, mipLevels, rgbaMipChain);
+    free(paddedPixels);
+
+    mipChain.width = paddedWidth;
+    mipChain.height = paddedHeight;
+    mipChain.mipLevels = mipLevels;
+    mipChain.size = getMipChainSize(paddedWidth, paddedHeight, mipLevels, format);
+    mipChain.data = malloc(mipChain.size);
+    NI_ASSERT(mipChain.data != nullptr, "Failed to allocate block compressed mip chain");
+    const uint8_t* srcMip = rgbaMipChain;
+    uint8_t* dstMip = (uint8_t*)mipChain.data;
+    uint32_t mipWidth = paddedWidth;
+    uint32_t mipHeight = paddedHeight;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        compressTexture(srcMip, mipWidth, mipHeight, format, dstMip);
+        srcMip += getTextureDataSize(mipWidth, mipHeight, DXGI_FORMAT_R8G8B8A8_UNORM);
+        dstMip += getTextureDataSize(mipWidth, mipHeight, format);
+        mipWidth = mipWidth > 1 ? mipWidth >> 1 : 1;
+        mipHeight = mipHeight > 1 ? mipHeight >> 1 : 1;
+    }
+    free(rgbaMipChain);
+    return mipChain;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <dxgi1_6.h>
+
+#define NI_BC_BLOCK_DIM 4
+
+namespace ni {
+
+	// Tightly packed mip chain, one level after the other. data is malloc'ed and owned by the caller.
+	struct CompressedMipChain {
+		void* data;
+		size_t size;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mipLevels;
+	};
+
+	bool isBlockCompressed(DXGI_FORMAT format);
+	size_t getBlockSize(DXGI_FORMAT format);
+	// Size of one 2D level in bytes. Block compressed formats round up to whole 4x4 blocks.
+	size_t getTextureDataSize(uint32_t width, uint32_t height, DXGI_FORMAT format);
+	// Padded 8 bit RGBA source pixels are encoded into BC1, BC3 or BC7 blocks. Texels outside of
+	// width x height read as transparent black. Row ranges run as jobs on the loader threads, threadNum 0 uses
+	// one job per loader thread plus the calling thread and 1 encodes on the calling thread only.
+	void compressTexture(const void* pixels, uint32_t width, uint32_t height, DXGI_FORMAT format, void* outBlocks, uint32_t threadNum = 0);
+	// Only decodes what compressTexture emits (BC7 mode 6). Used to measure quality.
+	void decompressTexture(const void* blocks, uint32_t width, uint32_t height, DXGI_FORMAT format, void* outPixels);
+	// Builds the mip chain for 8 bit RGBA pixels in format. Block compressed formats are padded to whole
+	// blocks with transparent texels first, so width and height of the result can be larger than the source.
+	CompressedMipChain compressMipChain(const void* pixels, uint32_t width, uint32_t height, DXGI_FORMAT format, bool generateMips);
+	void benchmarkTextureCompression(const char* name, const void* pixels, uint32_t width, uint32_t height);
+}
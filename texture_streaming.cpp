@@ -0,0 +1,331 @@
+#include "texture_streaming.h"
+#include "cpu_trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ni::StagingRing::init(void* memory, uint64_t ringCapacity) {
+    base = (uint8_t*)memory;
+    capacity = ringCapacity;
+    head = 0;
+    used = 0;
+    highWaterMark = 0;
+    markerFirst = 0;
+    markerNum = 0;
+}
+
+bool ni::StagingRing::allocate(uint64_t size, uint64_t alignment, StagingAllocation& outAllocation) {
+    NI_ASSERT(size <= capacity, "Staging allocation of %llu bytes is larger than the ring", (unsigned long long)size);
+    if (markerNum == NI_STREAMING_MAX_REQUESTS) return false;
+    uint64_t offset = alignSize(head, alignment);
+    if (offset + size > capacity) {
+        // Skip the tail end of the ring, it's given back together with this allocation.
+        offset = 0;
+    }
+    uint64_t bytes = (offset >= head ? offset - head : capacity - head + offset) + size;
+    if (used + bytes > capacity) return false;
+    uint32_t marker = (markerFirst + markerNum++) % NI_STREAMING_MAX_REQUESTS;
+    markers[marker] = { offset + size, bytes, UINT64_MAX };
+    head = offset + size;
+    used += bytes;
+    highWaterMark = used > highWaterMark ? used : highWaterMark;
+    outAllocation = { offset, size, marker };
+    return true;
+}
+
+void ni::StagingRing::submit(const StagingAllocation& allocation, uint64_t fenceValue) {
+    markers[allocation.marker].fenceValue = fenceValue;
+}
+
+void ni::StagingRing::reclaim(uint64_t completedFenceValue) {
+    // Allocations are submitted in order, so the first unfinished one blocks everything after it.
+    while (markerNum > 0 && markers[markerFirst].fenceValue <= completedFenceValue) {
+        used -= markers[markerFirst].bytes;
+        markerFirst = (markerFirst + 1) % NI_STREAMING_MAX_REQUESTS;
+        markerNum--;
+    }
+}
+
+bool ni::TextureStreamer::RequestQueue::push(const StreamRequest& request) {
+    if (num == NI_STREAMING_MAX_REQUESTS) return false;
+    requests[(first + num++) % NI_STREAMING_MAX_REQUESTS] = request;
+    return true;
+}
+
+bool ni::TextureStreamer::RequestQueue::pop(StreamRequest& outRequest) {
+    if (num == 0) return false;
+    outRequest = requests[first];
+    first = (first + 1) % NI_STREAMING_MAX_REQUESTS;
+    num--;
+    return true;
+}
+
+bool ni::TextureStreamer::RequestQueue::remove(const std::atomic<uint32_t>* residency, StreamRequest& outRequest) {
+    for (uint32_t index = 0; index < num; ++index) {
+        if (requests[(first + index) % NI_STREAMING_MAX_REQUESTS].residency != residency) continue;
+        outRequest = requests[(first + index) % NI_STREAMING_MAX_REQUESTS];
+        for (; index + 1 < num; ++index) {
+            requests[(first + index) % NI_STREAMING_MAX_REQUESTS] = requests[(first + index + 1) % NI_STREAMING_MAX_REQUESTS];
+        }
+        num--;
+        return true;
+    }
+    return false;
+}
+
+void ni::TextureStreamer::init(void* stagingMemory, uint64_t stagingCapacity, uint64_t budget) {
+    ring.init(stagingMemory, stagingCapacity);
+    pending.first = pending.num = 0;
+    staged.first = staged.num = 0;
+    uploading.first = uploading.num = 0;
+    frameBudget = budget;
+    uploadedBytes = 0;
+    maxFrameUploadBytes = 0;
+    residentNum = 0;
+    loadingResidency = nullptr;
+    loaderRunning = true;
+    loaderThread = std::thread(&TextureStreamer::loaderMain, this);
+}
+
+void ni::TextureStreamer::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loaderRunning = false;
+    }
+    loaderSignal.notify_all();
+    if (loaderThread.joinable()) {
+        loaderThread.join();
+    }
+}
+
+void ni::TextureStreamer::request(Texture* texture, std::atomic<uint32_t>& residency, const void* source, uint64_t size) {
+    residency = TEXTURE_RESIDENCY_QUEUED;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool queued = pending.push({ texture, &residency, source, size, {} });
+        NI_ASSERT(queued, "Exceeded %u pending stream requests", NI_STREAMING_MAX_REQUESTS);
+    }
+    loaderSignal.notify_one();
+}
+
+void ni::TextureStreamer::loaderMain() {
+    NI_TRACE_THREAD_NAME("Streaming loader");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        StreamRequest request = {};
+        bool allocated = false;
+        loaderSignal.wait(lock, [&] {
+            if (!loaderRunning) return true;
+            if (pending.num == 0) return false;
+            // Only take the request once it fits, reclaim wakes us up when staging memory frees up.
+            allocated = ring.allocate(pending.front().size, NI_STREAMING_PLACEMENT_ALIGNMENT, request.staging);
+            return allocated;
+        });
+        if (!loaderRunning) break;
+        StagingAllocation staging = request.staging;
+        pending.pop(request);
+        request.staging = staging;
+        *request.residency = TEXTURE_RESIDENCY_LOADING;
+        loadingResidency = request.residency;
+
+        lock.unlock();
+        memcpy(ring.getPointer(request.staging), request.source, (size_t)request.size);
+        lock.lock();
+
+        *request.residency = TEXTURE_RESIDENCY_STAGED;
+        bool queued = staged.push(request);
+        NI_ASSERT(queued, "Exceeded %u staged stream requests", NI_STREAMING_MAX_REQUESTS);
+        loadingResidency = nullptr;
+        loadedSignal.notify_all();
+    }
+}
+
+uint32_t ni::TextureStreamer::acquireStaged(StreamRequest* outRequests, uint32_t maxRequests) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t requestNum = 0;
+    uint64_t frameBytes = 0;
+    while (requestNum < maxRequests && staged.num > 0) {
+        const StreamRequest& request = staged.front();
+        if (requestNum > 0 && frameBytes + request.size > frameBudget) break;
+        frameBytes += request.size;
+        staged.pop(outRequests[requestNum++]);
+    }
+    maxFrameUploadBytes = frameBytes > maxFrameUploadBytes ? frameBytes : maxFrameUploadBytes;
+    uploadedBytes += frameBytes;
+    return requestNum;
+}
+
+void ni::TextureStreamer::submit(const StreamRequest* requests, uint32_t requestNum, uint64_t fenceValue) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t index = 0; index < requestNum; ++index) {
+        StreamRequest request = requests[index];
+        ring.submit(request.staging, fenceValue);
+        // The fence value rides along in the marker, uploading keeps the same order.
+        *request.residency = TEXTURE_RESIDENCY_UPLOADING;
+        bool queued = uploading.push(request);
+        NI_ASSERT(queued, "Exceeded %u uploading stream requests", NI_STREAMING_MAX_REQUESTS);
+    }
+}
+
+bool ni::TextureStreamer::allocateStaging(uint64_t size, StagingAllocation& outAllocation) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ring.allocate(size, NI_STREAMING_PLACEMENT_ALIGNMENT, outAllocation);
+}
+
+void ni::TextureStreamer::submitStaging(const StagingAllocation& allocation, uint64_t fenceValue) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ring.submit(allocation, fenceValue);
+}
+
+void ni::TextureStreamer::reclaim(uint64_t completedFenceValue) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (uploading.num > 0 && ring.markers[uploading.front().staging.marker].fenceValue <= completedFenceValue) {
+            StreamRequest request;
+            uploading.pop(request);
+            *request.residency = TEXTURE_RESIDENCY_RESIDENT;
+            residentNum++;
+        }
+        ring.reclaim(completedFenceValue);
+    }
+    loaderSignal.notify_one();
+}
+
+void ni::TextureStreamer::cancel(const std::atomic<uint32_t>& residency, uint64_t fenceValue) {
+    std::unique_lock<std::mutex> lock(mutex);
+    loadedSignal.wait(lock, [&] { return loadingResidency != &residency; });
+    StreamRequest request;
+    // Pending requests have no staging yet. Uploading ones were submitted, their markers retire with the copy.
+    pending.remove(&residency, request);
+    if (staged.remove(&residency, request)) {
+        ring.submit(request.staging, fenceValue);
+    }
+    uploading.remove(&residency, request);
+}
+
+ni::StreamingStats ni::TextureStreamer::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    StreamingStats stats = {};
+    stats.stagingCapacity = ring.capacity;
+    stats.stagingUsed = ring.used;
+    stats.stagingHighWaterMark = ring.highWaterMark;
+    stats.uploadedBytes = uploadedBytes;
+    stats.maxFrameUploadBytes = maxFrameUploadBytes;
+    stats.pendingNum = pending.num;
+    stats.stagedNum = staged.num;
+    stats.uploadingNum = uploading.num;
+    stats.residentNum = residentNum;
+    return stats;
+}
+
+// Copies recorded in frame N are complete once frame N + latency starts, like NI_FRAME_COUNT frames in flight.
+#define NI_STREAMING_BENCH_GPU_LATENCY 2
+#define NI_STREAMING_BENCH_MAX_FRAMES 100000
+// Every texture of this stride is destroyed on the frame below, whatever state its request is in.
+#define NI_STREAMING_BENCH_CANCEL_STRIDE 16
+#define NI_STREAMING_BENCH_CANCEL_FRAME 3
+// D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, what a committed upload buffer per texture would be rounded up to.
+#define NI_STREAMING_BENCH_BUFFER_ALIGNMENT (64ull << 10)
+
+uint32_t ni::benchmarkTextureStreaming(uint32_t textureNum) {
+    NI_ASSERT(textureNum <= NI_STREAMING_MAX_REQUESTS, "Too many textures for the streaming benchmark");
+    // No textures behind the requests, only their residencies.
+    std::atomic<uint32_t>* residencies = new std::atomic<uint32_t>[textureNum];
+    uint64_t* sizes = (uint64_t*)malloc(textureNum * sizeof(uint64_t));
+    uint64_t totalSize = 0;
+    // What one committed upload buffer per texture kept alive until destroyTexture would cost.
+    uint64_t committedSize = 0;
+    for (uint32_t index = 0; index < textureNum; ++index) {
+        // 64 KB up to 4 MB, roughly the range of a 128x128 RGBA8 sprite up to a 1024x1024 one.
+        sizes[index] = (64ull << 10) << (randomUint() % 7);
+        totalSize += sizes[index];
+        committedSize += alignSize((size_t)sizes[index], NI_STREAMING_BENCH_BUFFER_ALIGNMENT);
+    }
+    uint8_t* source = (uint8_t*)malloc((size_t)totalSize);
+    uint8_t* destination = (uint8_t*)malloc((size_t)totalSize);
+    for (uint64_t index = 0; index < totalSize; ++index) {
+        source[index] = (uint8_t)((index * 2654435761ull) >> 13);
+    }
+    void* stagingMemory = malloc(NI_STREAMING_STAGING_SIZE);
+
+    // Baseline, everything goes through the render thread in a single frame.
+    double syncStart = getSeconds();
+    memcpy(destination, source, (size_t)totalSize);
+    double syncTime = (getSeconds() - syncStart) * 1000.0;
+
+    TextureStreamer* streamer = new TextureStreamer();
+    streamer->init(stagingMemory, NI_STREAMING_STAGING_SIZE, NI_STREAMING_FRAME_BUDGET);
+    double streamStart = getSeconds();
+    uint64_t offset = 0;
+    for (uint32_t index = 0; index < textureNum; ++index) {
+        streamer->request(nullptr, residencies[index], source + offset, sizes[index]);
+        offset += sizes[index];
+    }
+
+    StreamRequest* requests = (StreamRequest*)malloc(NI_STREAMING_MAX_REQUESTS * sizeof(StreamRequest));
+    bool* cancelled = (bool*)calloc(textureNum, sizeof(bool));
+    uint32_t cancelledNum = 0;
+    double worstFrame = 0.0;
+    uint32_t frameNum = 0;
+    while (streamer->getStats().residentNum + cancelledNum < textureNum && frameNum < NI_STREAMING_BENCH_MAX_FRAMES) {
+        double frameStart = getSeconds();
+        uint64_t frameValue = ++frameNum;
+        if (frameValue == NI_STREAMING_BENCH_CANCEL_FRAME) {
+            for (uint32_t index = 0; index < textureNum; index += NI_STREAMING_BENCH_CANCEL_STRIDE) {
+                if (residencies[index] == TEXTURE_RESIDENCY_RESIDENT) continue;
+                streamer->cancel(residencies[index], frameValue);
+                cancelled[index] = true;
+                cancelledNum++;
+            }
+        }
+        streamer->reclaim(frameValue > NI_STREAMING_BENCH_GPU_LATENCY ? frameValue - NI_STREAMING_BENCH_GPU_LATENCY : 0);
+        uint32_t requestNum = streamer->acquireStaged(requests, NI_STREAMING_MAX_REQUESTS);
+        streamer->submit(requests, requestNum, frameValue);
+        double frameTime = (getSeconds() - frameStart) * 1000.0;
+        // Simulated GPU copy, not part of the render thread cost. The fence latency models when it's visible.
+        for (uint32_t index = 0; index < requestNum; ++index) {
+            uint64_t textureOffset = (const uint8_t*)requests[index].source - source;
+            memcpy(destination + textureOffset, streamer->getStagingPointer(requests[index].staging), (size_t)requests[index].size);
+        }
+        worstFrame = frameTime > worstFrame ? frameTime : worstFrame;
+        if (requestNum == 0) {
+            // Nothing staged yet, give the loader thread a moment instead of spinning.
+            std::this_thread::yield();
+        }
+    }
+    double streamTime = (getSeconds() - streamStart) * 1000.0;
+    // Once every copy retired the ring has to be empty, a cancelled request whose staging was never submitted
+    // would hold it forever.
+    streamer->reclaim(UINT64_MAX - 1);
+    StreamingStats stats = streamer->getStats();
+    streamer->destroy();
+
+    // Textures that never became resident, leaked staging and every texture whose data differs count as errors.
+    uint32_t errorNum = textureNum - stats.residentNum - cancelledNum + (stats.stagingUsed == 0 ? 0 : 1);
+    offset = 0;
+    for (uint32_t index = 0; index < textureNum; ++index) {
+        if (!cancelled[index] && memcmp(source + offset, destination + offset, (size_t)sizes[index]) != 0) {
+            errorNum++;
+        }
+        offset += sizes[index];
+    }
+    NI_LOG("Streaming %u textures (%.1f MB): synchronous upload %.2f ms in one frame", textureNum, (double)totalSize / (1024.0 * 1024.0), syncTime);
+    NI_LOG("Streaming %u textures: %u cancelled while streaming, %.1f MB of staging left after the last copy",
+        textureNum, cancelledNum, (double)stats.stagingUsed / (1024.0 * 1024.0));
+    NI_LOG("Streaming %u textures: %u frames, %.2f ms total, worst render thread frame %.3f ms, max %.1f MB per frame (budget %.1f MB), staging high water %.1f of %.1f MB, %u error(s)",
+        stats.residentNum, frameNum, streamTime, worstFrame,
+        (double)stats.maxFrameUploadBytes / (1024.0 * 1024.0), (double)NI_STREAMING_FRAME_BUDGET / (1024.0 * 1024.0),
+        (double)stats.stagingHighWaterMark / (1024.0 * 1024.0), (double)NI_STREAMING_STAGING_SIZE / (1024.0 * 1024.0),
+        errorNum);
+    NI_LOG("Streaming %u textures: upload heap %.1f MB pooled vs %.1f MB with an upload buffer per texture",
+        stats.residentNum, (double)NI_STREAMING_STAGING_SIZE / (1024.0 * 1024.0), (double)committedSize / (1024.0 * 1024.0));
+
+    delete streamer;
+    free(cancelled);
+    free(requests);
+    free(stagingMemory);
+    free(destination);
+    free(source);
+    free(sizes);
+    delete[] residencies;
+    return errorNum;
+}
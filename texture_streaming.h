@@ -0,0 +1,140 @@
+#pragma once
+
+#include "ni_core.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define NI_STREAMING_STAGING_SIZE (32ull << 20)
+#define NI_STREAMING_FRAME_BUDGET (8ull << 20)
+#define NI_STREAMING_MAX_REQUESTS 1024
+// D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, every texture's footprints start on it.
+#define NI_STREAMING_PLACEMENT_ALIGNMENT 512
+
+namespace ni {
+
+	// Only handed back in StreamRequest, the streamer never looks inside.
+	struct Texture;
+
+	// Range of the staging ring every upload goes through, see StagingRing.
+	struct StagingAllocation {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t marker;
+	};
+
+	// Residency of a texture. Streamed textures walk the states in order, everything else is created resident.
+	enum TextureResidency : uint32_t {
+		TEXTURE_RESIDENCY_QUEUED,     // Waiting for the loader thread.
+		TEXTURE_RESIDENCY_LOADING,    // Loader thread is copying the data into staging memory.
+		TEXTURE_RESIDENCY_STAGED,     // In staging memory, waiting for a frame with upload budget left.
+		TEXTURE_RESIDENCY_UPLOADING,  // Copy recorded, waiting for the GPU to finish it.
+		TEXTURE_RESIDENCY_RESIDENT
+	};
+
+	// Linear ring over persistently mapped upload memory. Allocations are released in the order they
+	// were made, once the fence value they were submitted with has completed. Not thread safe.
+	struct StagingRing {
+		void init(void* memory, uint64_t ringCapacity);
+		// Returns false when the ring is full. Allocations never wrap around the end of the ring.
+		bool allocate(uint64_t size, uint64_t alignment, StagingAllocation& outAllocation);
+		void submit(const StagingAllocation& allocation, uint64_t fenceValue);
+		void reclaim(uint64_t completedFenceValue);
+		void* getPointer(const StagingAllocation& allocation) const { return base + allocation.offset; }
+
+		struct Marker {
+			uint64_t end;
+			uint64_t bytes;
+			uint64_t fenceValue;
+		};
+
+		uint8_t* base;
+		uint64_t capacity;
+		uint64_t head;
+		uint64_t used;
+		uint64_t highWaterMark;
+		Marker markers[NI_STREAMING_MAX_REQUESTS];
+		uint32_t markerFirst;
+		uint32_t markerNum;
+	};
+
+	struct StreamRequest {
+		Texture* texture;
+		// Where the streamer writes the TextureResidency, also what cancel looks requests up by.
+		std::atomic<uint32_t>* residency;
+		const void* source;
+		uint64_t size;
+		StagingAllocation staging;
+	};
+
+	struct StreamingStats {
+		uint64_t stagingCapacity;
+		uint64_t stagingUsed;
+		uint64_t stagingHighWaterMark;
+		uint64_t uploadedBytes;
+		uint64_t maxFrameUploadBytes;
+		uint32_t pendingNum;
+		uint32_t stagedNum;
+		uint32_t uploadingNum;
+		uint32_t residentNum;
+	};
+
+	// Background loader feeding a staging ring. The loader thread copies the source data (usually a mapped
+	// asset pack, so this is where the page faults land) into staging memory. The render thread then picks up
+	// staged textures within a per-frame byte budget, records the copies and reclaims them once the GPU is done.
+	struct TextureStreamer {
+		void init(void* stagingMemory, uint64_t stagingCapacity, uint64_t frameBudget);
+		void destroy();
+		// source must be laid out like the upload footprints and stay valid until the texture is resident.
+		// residency walks the TextureResidency states, it has to stay valid until then or until cancel.
+		void request(Texture* texture, std::atomic<uint32_t>& residency, const void* source, uint64_t size);
+		// Oldest staged requests that fit in the frame budget. At least one is returned so large textures can't stall.
+		uint32_t acquireStaged(StreamRequest* outRequests, uint32_t maxRequests);
+		void submit(const StreamRequest* requests, uint32_t requestNum, uint64_t fenceValue);
+		void reclaim(uint64_t completedFenceValue);
+		// Forgets every request with this residency, waiting for the loader thread if it's copying one right now,
+		// so nothing touches the texture afterwards. Staging memory that was never submitted is submitted with
+		// fenceValue, the ring gives it back in order once that completed.
+		void cancel(const std::atomic<uint32_t>& residency, uint64_t fenceValue);
+		// Direct staging ring access for uploads that don't go through the loader thread. Returns false when the ring is full.
+		bool allocateStaging(uint64_t size, StagingAllocation& outAllocation);
+		void submitStaging(const StagingAllocation& allocation, uint64_t fenceValue);
+		void* getStagingPointer(const StagingAllocation& allocation) const { return ring.getPointer(allocation); }
+		StreamingStats getStats();
+
+	private:
+		void loaderMain();
+
+		struct RequestQueue {
+			bool push(const StreamRequest& request);
+			bool pop(StreamRequest& outRequest);
+			// Keeps the order of the requests behind it.
+			bool remove(const std::atomic<uint32_t>* residency, StreamRequest& outRequest);
+			const StreamRequest& front() const { return requests[first]; }
+			StreamRequest requests[NI_STREAMING_MAX_REQUESTS];
+			uint32_t first;
+			uint32_t num;
+		};
+
+		StagingRing ring;
+		RequestQueue pending;
+		RequestQueue staged;
+		RequestQueue uploading;
+		std::thread loaderThread;
+		std::mutex mutex;
+		std::condition_variable loaderSignal;
+		// Request the loader thread is copying without holding the lock, loadedSignal fires once it's done.
+		const std::atomic<uint32_t>* loadingResidency;
+		std::condition_variable loadedSignal;
+		uint64_t frameBudget;
+		uint64_t uploadedBytes;
+		uint64_t maxFrameUploadBytes;
+		uint32_t residentNum;
+		bool loaderRunning;
+	};
+
+	// Headless synthetic load: streams textureNum random sized textures through a simulated GPU
+	// and compares the worst frame against uploading everything in a single frame. Returns the error count.
+	uint32_t benchmarkTextureStreaming(uint32_t textureNum);
+}
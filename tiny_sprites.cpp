@@ -0,0 +1,237 @@
+#include "tiny_sprites.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NI_TINY_SPRITE_VALIDATE_WIDTH 320
+#define NI_TINY_SPRITE_VALIDATE_HEIGHT 200
+#define NI_TINY_SPRITE_VALIDATE_SPRITES 40000
+
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static float nextRandomFloat(uint32_t& state) {
+    return (float)(nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Texture index and mesh slot are the same, validateTinySprites sets both up side by side.
+static DrawCommand makeCommand(float x, float y, float size, float rotation, uint32_t color, uint32_t texture) {
+    return { { -size * 0.5f, -size * 0.5f, size, size }, { x, y, 1.0f, rotation }, color, texture | (texture << TEXTURE_ID_MESH_SHIFT) };
+}
+
+// Runs of tiny sprites from a single one up, with larger translucent ones between them, so the draw keeps
+// switching paths and the larger sprites cover tiny ones from before and below them.
+static uint32_t buildMixedScene(DrawCommand* commands, uint32_t textureNum, uint32_t& state) {
+    uint32_t commandNum = 0;
+    while (commandNum < NI_TINY_SPRITE_VALIDATE_SPRITES - 2) {
+        uint32_t runLength = 1 + nextRandom(state) % 64;
+        for (uint32_t index = 0; index < runLength && commandNum < NI_TINY_SPRITE_VALIDATE_SPRITES - 2; ++index) {
+            float x = nextRandomFloat(state) * (NI_TINY_SPRITE_VALIDATE_WIDTH + 16.0f) - 8.0f;
+            float y = nextRandomFloat(state) * (NI_TINY_SPRITE_VALIDATE_HEIGHT + 16.0f) - 8.0f;
+            float size = 1.0f + nextRandomFloat(state) * (NI_TINY_SPRITE_MAX_SIZE - 1.0f);
+            float rotation = nextRandomFloat(state) * 6.2831853f;
+            uint32_t alpha = 0x40 + nextRandom(state) % 0xc0;
+            uint32_t color = nextRandom(state) % 4 == 0 ? NI_COLOR_UINT(0xffffffff) : NI_COLOR_RGBA_UINT(nextRandom(state) & 0xff, 0xa0, 0x60, alpha);
+            uint32_t texture = nextRandom(state) % textureNum;
+            commands[commandNum++] = makeCommand(x, y, size, rotation, color, texture);
+        }
+        uint32_t largeNum = 1 + nextRandom(state) % 2;
+        for (uint32_t index = 0; index < largeNum; ++index) {
+            float x = nextRandomFloat(state) * NI_TINY_SPRITE_VALIDATE_WIDTH;
+            float y = nextRandomFloat(state) * NI_TINY_SPRITE_VALIDATE_HEIGHT;
+            float size = 12.0f + nextRandomFloat(state) * 48.0f;
+            float rotation = nextRandomFloat(state) * 6.2831853f;
+            uint32_t color = NI_COLOR_RGBA_UINT(0x40, nextRandom(state) & 0xff, 0xff, 0x80);
+            uint32_t texture = nextRandom(state) % textureNum;
+            commands[commandNum++] = makeCommand(x, y, size, rotation, color, texture);
+        }
+    }
+    return commandNum;
+}
+
+static uint32_t countDifferences(const uint32_t* pixels, const uint32_t* reference, uint32_t tolerance, uint32_t& outMaxDifference) {
+    uint32_t differenceNum = 0;
+    outMaxDifference = 0;
+    for (uint32_t index = 0; index < NI_TINY_SPRITE_VALIDATE_WIDTH * NI_TINY_SPRITE_VALIDATE_HEIGHT; ++index) {
+        uint32_t pixelDifference = 0;
+        for (uint32_t channel = 0; channel < 4; ++channel) {
+            int32_t difference = (int32_t)((pixels[index] >> (channel * 8)) & 0xff) - (int32_t)((reference[index] >> (channel * 8)) & 0xff);
+            pixelDifference = std::max(pixelDifference, (uint32_t)(difference < 0 ? -difference : difference));
+        }
+        outMaxDifference = std::max(outMaxDifference, pixelDifference);
+        differenceNum += pixelDifference > tolerance ? 1 : 0;
+    }
+    return differenceNum;
+}
+
+uint32_t ni::validateTinySprites() {
+    const uint32_t black = NI_COLOR_RGBA_UINT(0, 0, 0, 0xff);
+    const uint32_t pixelNum = NI_TINY_SPRITE_VALIDATE_WIDTH * NI_TINY_SPRITE_VALIDATE_HEIGHT;
+    uint32_t checkNum = 0;
+    uint32_t errorNum = 0;
+    bool ownThreads = getLoaderThreadNum() == 0;
+    if (ownThreads) {
+        initLoaderThreads(0);
+    }
+    SoftwareRasterizer rasterizer;
+    rasterizer.init(NI_TINY_SPRITE_VALIDATE_WIDTH, NI_TINY_SPRITE_VALIDATE_HEIGHT);
+    DrawCommand* commands = (DrawCommand*)malloc(NI_TINY_SPRITE_VALIDATE_SPRITES * sizeof(DrawCommand));
+    SpriteQuad* quads = (SpriteQuad*)malloc(NI_TINY_SPRITE_VALIDATE_SPRITES * sizeof(SpriteQuad));
+    uint32_t* reference = (uint32_t*)malloc(pixelNum * sizeof(uint32_t));
+
+    // Solid textures sample the same color anywhere, so only coverage and order can make a difference and the
+    // images have to match exactly. One of them has a trimmed octagon mesh.
+    const uint32_t solidColors[3] = { NI_COLOR_RGBA_UINT(0xff, 0xff, 0xff, 0xff), NI_COLOR_RGBA_UINT(0xff, 0x40, 0x20, 0x90), NI_COLOR_RGBA_UINT(0x20, 0xff, 0x80, 0xff) };
+    uint32_t* solidTexels[3];
+    for (uint32_t index = 0; index < 3; ++index) {
+        solidTexels[index] = (uint32_t*)malloc(getMipChainSizeRGBA8(4, 4, 3));
+        std::fill(solidTexels[index], solidTexels[index] + 16 + 4 + 1, solidColors[index]);
+    }
+    // Checker with a full mip chain for the texture coordinates and level of detail.
+    const uint32_t checkerSize = 32;
+    const uint32_t checkerMips = 6;
+    uint32_t* checker = (uint32_t*)malloc(checkerSize * checkerSize * sizeof(uint32_t));
+    for (uint32_t y = 0; y < checkerSize; ++y) {
+        for (uint32_t x = 0; x < checkerSize; ++x) {
+            checker[y * checkerSize + x] = ((x / 4 + y / 4) & 1) != 0 ? NI_COLOR_RGBA_UINT(0xff, 0xe0, 0x40, 0xff) : NI_COLOR_RGBA_UINT(0x20, 0x40, 0xc0, 0xc0);
+        }
+    }
+    uint8_t* checkerChain = (uint8_t*)malloc(getMipChainSizeRGBA8(checkerSize, checkerSize, checkerMips));
+    generateMipChainRGBA8(checker, checkerSize, checkerSize, checkerMips, checkerChain);
+
+    SpriteMesh meshes[4];
+    meshes[0] = getFullSpriteMesh();
+    meshes[1] = getFullSpriteMesh();
+    SpriteBounds octagon = { 0.1f, 0.0f, 0.9f, 1.0f, 0.35f, 1.65f, -0.65f, 0.65f, 1 };
+    meshes[2] = buildSpriteMesh(octagon, 1, 1);
+    meshes[3] = buildSpriteMesh(octagon, 1, 1);
+
+    for (uint32_t texturePass = 0; texturePass < 2; ++texturePass) {
+        bool textured = texturePass == 1;
+        for (uint32_t index = 0; index < 3; ++index) {
+            rasterizer.setTexture(index, { (const uint8_t*)solidTexels[index], 4, 4, 3 });
+        }
+        if (textured) {
+            rasterizer.setTexture(0, { checkerChain, checkerSize, checkerSize, checkerMips });
+            rasterizer.setTexture(3, { checkerChain, checkerSize, checkerSize, checkerMips });
+        }
+        uint32_t textureNum = textured ? 4 : 3;
+        // Last bits of the texture coordinates can move a bilinear or mip weight across a rounding step.
+        uint32_t tolerance = textured ? 2 : 0;
+        const char* label = textured ? "textured" : "solid";
+
+        uint32_t state = textured ? 0x6b43a9b5u : 0x2545f491u;
+        uint32_t commandNum = buildMixedScene(commands, textureNum, state);
+        generateSpritesCpu(commands, commandNum, meshes, (float)NI_TINY_SPRITE_VALIDATE_WIDTH, (float)NI_TINY_SPRITE_VALIDATE_HEIGHT, quads);
+        rasterizer.clear(black);
+        rasterizer.drawSprites(quads, commandNum);
+        memcpy(reference, rasterizer.getPixels(), pixelNum * sizeof(uint32_t));
+
+        // Every quad down the path of its own size, in one draw.
+        const SoftwareRasterStats& stats = rasterizer.getStats();
+        uint64_t splattedBefore = stats.quadsSplatted;
+        uint64_t trianglesBefore = stats.trianglesRasterized;
+        uint32_t maxDifference = 0;
+        rasterizer.clear(black);
+        drawSpritesCpu(rasterizer, quads, commandNum);
+        uint64_t splattedNum = stats.quadsSplatted - splattedBefore;
+        uint64_t triangleNum = stats.trianglesRasterized - trianglesBefore;
+        uint32_t differenceNum = countDifferences(rasterizer.getPixels(), reference, tolerance, maxDifference);
+        checkNum++;
+        if (differenceNum > (textured ? pixelNum / 1000 : 0)) {
+            NI_LOG("Tiny sprites: %s scene drawn mixed differs from triangles in %u pixels, up to %u", label, differenceNum, maxDifference);
+            errorNum++;
+        }
+        checkNum++;
+        if (splattedNum == 0 || triangleNum == 0) {
+            NI_LOG("Tiny sprites: %s scene took only one path, %llu quads splatted and %llu triangles", label, splattedNum, triangleNum);
+            errorNum++;
+        }
+        NI_LOG("Tiny sprites: %s scene, %u sprites, %llu quads splatted and %llu triangles", label, commandNum, splattedNum, triangleNum);
+    }
+
+    // Every sprite splatted, with the mesh vertices in both windings. Covers pixel center edges
+    // and a sprite exactly the size of a pixel.
+    for (uint32_t texture = 0; texture < 3; ++texture) {
+        rasterizer.setTexture(texture, { (const uint8_t*)solidTexels[texture], 4, 4, 3 });
+    }
+    uint32_t commandNum = 0;
+    for (uint32_t y = 0; y < 12; ++y) {
+        for (uint32_t x = 0; x < 20; ++x) {
+            float size = 1.0f + (float)((x + y) % 8);
+            float offset = (x % 2) * 0.5f;
+            commands[commandNum] = makeCommand(8.0f + x * 16.0f + offset, 8.0f + y * 16.0f + offset, size, (y % 3) * 0.4f, solidColors[(x + y) % 3], (x + y) % 3);
+            if (y % 2 == 1) {
+                commands[commandNum].transform[2] = -1.0f;
+            }
+            commandNum++;
+        }
+    }
+    generateSpritesCpu(commands, commandNum, meshes, (float)NI_TINY_SPRITE_VALIDATE_WIDTH, (float)NI_TINY_SPRITE_VALIDATE_HEIGHT, quads);
+    rasterizer.clear(black);
+    rasterizer.drawSprites(quads, commandNum);
+    memcpy(reference, rasterizer.getPixels(), pixelNum * sizeof(uint32_t));
+    rasterizer.clear(black);
+    rasterizer.splatSprites(quads, commandNum);
+    uint32_t maxDifference = 0;
+    uint32_t differenceNum = countDifferences(rasterizer.getPixels(), reference, 0, maxDifference);
+    checkNum++;
+    if (differenceNum > 0) {
+        NI_LOG("Tiny sprites: sprite grid splatted differs from triangles in %u pixels, up to %u", differenceNum, maxDifference);
+        errorNum++;
+    }
+
+    // Both paths get the same order from the bins whatever the thread count.
+    if (ownThreads) {
+        destroyLoaderThreads();
+        rasterizer.clear(black);
+        rasterizer.splatSprites(quads, commandNum);
+        differenceNum = countDifferences(rasterizer.getPixels(), reference, 0, maxDifference);
+        checkNum++;
+        if (differenceNum > 0) {
+            NI_LOG("Tiny sprites: sprite grid splatted without loader threads differs in %u pixels", differenceNum);
+            errorNum++;
+        }
+    }
+
+    // A single tiny sprite between two larger ones, each inside a tile of its own: only it is splatted.
+    const DrawCommand sandwich[3] = {
+        makeCommand(96.0f, 96.0f, 20.0f, 0.3f, solidColors[0], 0),
+        makeCommand(32.0f, 32.0f, 4.0f, 0.0f, solidColors[1], 1),
+        makeCommand(160.0f, 96.0f, 20.0f, 0.0f, solidColors[2], 2),
+    };
+    generateSpritesCpu(sandwich, 3, meshes, (float)NI_TINY_SPRITE_VALIDATE_WIDTH, (float)NI_TINY_SPRITE_VALIDATE_HEIGHT, quads);
+    rasterizer.clear(black);
+    rasterizer.drawSprites(quads, 3);
+    memcpy(reference, rasterizer.getPixels(), pixelNum * sizeof(uint32_t));
+    uint64_t splattedBefore = rasterizer.getStats().quadsSplatted;
+    rasterizer.clear(black);
+    drawSpritesCpu(rasterizer, quads, 3);
+    uint64_t splattedNum = rasterizer.getStats().quadsSplatted - splattedBefore;
+    differenceNum = countDifferences(rasterizer.getPixels(), reference, 0, maxDifference);
+    checkNum++;
+    if (splattedNum != 1 || differenceNum > 0) {
+        NI_LOG("Tiny sprites: %llu of a tiny sprite between larger ones splatted, %u pixels differ", splattedNum, differenceNum);
+        errorNum++;
+    }
+
+    const SoftwareRasterStats& stats = rasterizer.getStats();
+    NI_LOG("Tiny sprites: %llu quads splatted, %llu triangles, %llu pixels shaded, raster %.2f ms", stats.quadsSplatted, stats.trianglesRasterized,
+        stats.pixelsShaded, stats.rasterMs);
+    NI_LOG("Tiny sprites: %u checks, %u error(s)", checkNum, errorNum);
+    free(checkerChain);
+    free(checker);
+    for (uint32_t index = 0; index < 3; ++index) {
+        free(solidTexels[index]);
+    }
+    free(reference);
+    free(quads);
+    free(commands);
+    rasterizer.destroy();
+    return errorNum;
+}
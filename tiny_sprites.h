@@ -0,0 +1,19 @@
+#pragma once
+
+#include "software_rasterizer.h"
+
+// A quad is tiny when its bounds are no larger than this many pixels on either side on screen. Below that most
+// pixels of its fan triangles sit on shared edges, covering the quad as a whole visits each of them once.
+#define NI_TINY_SPRITE_MAX_SIZE 8.0f
+
+namespace ni {
+
+	// The quads generateSpritesCpu wrote for one draw, tiny ones splatted and the others rasterized. Each quad
+	// picks its path on its own, so a tiny sprite between larger ones is splatted too and the order holds.
+	inline void drawSpritesCpu(SoftwareRasterizer& rasterizer, const SpriteQuad* quads, uint32_t quadNum) {
+		rasterizer.drawSprites(quads, quadNum, NI_TINY_SPRITE_MAX_SIZE);
+	}
+	// Draws mixed scenes through both paths and compares them with drawing everything as triangles, then checks
+	// that every quad went down the path of its size. Doesn't need a device.
+	uint32_t validateTinySprites();
+}